@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * CRC32 and CRC32C using the ARMv8 CRC32 instructions
+ *
+ * These are optional in ARMv8.0, so their presence is checked at runtime.
+ */
+
+#include <compiler.h>
+#include <efi_loader.h>
+#include <asm/system.h>
+#include <u-boot/crc.h>
+
+static bool __efi_runtime cpu_has_crc32(void)
+{
+	u64 reg;
+
+	asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (reg));
+
+	return reg & ID_AA64ISAR0_EL1_CRC32;
+}
+
+bool __efi_runtime crc32_arch_supported(void)
+{
+	return cpu_has_crc32();
+}
+
+uint __efi_runtime crc32_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	uint32_t crc = *crcp;
+	uint left = len;
+
+	for (; left && ((ulong)buf & 7); left--)
+		crc = __builtin_aarch64_crc32b(crc, *buf++);
+
+	for (; left >= 8; left -= 8, buf += 8)
+		crc = __builtin_aarch64_crc32x(crc, *(const u64 *)buf);
+	for (; left; left--)
+		crc = __builtin_aarch64_crc32b(crc, *buf++);
+	*crcp = crc;
+
+	return len;
+}
+
+bool crc32c_arch_supported(void)
+{
+	return cpu_has_crc32();
+}
+
+uint crc32c_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	uint32_t crc = *crcp;
+	uint left = len;
+
+	for (; left && ((ulong)buf & 7); left--)
+		crc = __builtin_aarch64_crc32cb(crc, *buf++);
+	for (; left >= 8; left -= 8, buf += 8)
+		crc = __builtin_aarch64_crc32cx(crc, *(const u64 *)buf);
+	for (; left; left--)
+		crc = __builtin_aarch64_crc32cb(crc, *buf++);
+	*crcp = crc;
+
+	return len;
+}
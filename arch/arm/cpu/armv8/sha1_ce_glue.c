@@ -5,16 +5,31 @@
  * Copyright (C) 2022 Linaro Ltd <loic.poulain@linaro.org>
  */
 
+#include <asm/system.h>
 #include <u-boot/sha1.h>
 
 extern void sha1_armv8_ce_process(uint32_t state[5], uint8_t const *src,
 				  uint32_t blocks);
 
+static bool cpu_has_sha1(void)
+{
+	u64 reg;
+
+	asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (reg));
+
+	return reg & ID_AA64ISAR0_EL1_SHA1;
+}
+
 void sha1_process(sha1_context *ctx, const unsigned char *data,
 		  unsigned int blocks)
 {
 	if (!blocks)
 		return;
 
+	if (!cpu_has_sha1()) {
+		sha1_process_generic(ctx, data, blocks);
+		return;
+	}
+
 	sha1_armv8_ce_process(ctx->state, data, blocks);
 }
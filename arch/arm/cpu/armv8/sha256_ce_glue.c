@@ -5,16 +5,31 @@
  * Copyright (C) 2022 Linaro Ltd <loic.poulain@linaro.org>
  */
 
+#include <asm/system.h>
 #include <u-boot/sha256.h>
 
 extern void sha256_armv8_ce_process(uint32_t state[8], uint8_t const *src,
 				    uint32_t blocks);
 
+static bool cpu_has_sha256(void)
+{
+	u64 reg;
+
+	asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (reg));
+
+	return reg & ID_AA64ISAR0_EL1_SHA2;
+}
+
 void sha256_process(sha256_context *ctx, const unsigned char *data,
 		    unsigned int blocks)
 {
 	if (!blocks)
 		return;
 
+	if (!cpu_has_sha256()) {
+		sha256_process_generic(ctx, data, blocks);
+		return;
+	}
+
 	sha256_armv8_ce_process(ctx->state, data, blocks);
 }
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha512_ce_glue.c - SHA-384/SHA-512 secure hash using ARMv8.2 Crypto
+ * Extensions
+ *
+ * The SHA-512 instructions are optional, so this checks for them at runtime
+ * and uses the C implementation on cores which lack them.
+ */
+
+#include <asm/system.h>
+#include <u-boot/sha512.h>
+
+extern void sha512_armv8_ce_process(uint64_t state[8], uint8_t const *src,
+				    uint32_t blocks);
+
+static bool cpu_has_sha512(void)
+{
+	u64 reg;
+
+	asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (reg));
+
+	return (reg & ID_AA64ISAR0_EL1_SHA2) >= ID_AA64ISAR0_EL1_SHA512;
+}
+
+void sha512_process(uint64_t *state, const uint8_t *data, unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	if (!cpu_has_sha512()) {
+		sha512_process_generic(state, data, blocks);
+		return;
+	}
+
+	sha512_armv8_ce_process(state, data, blocks);
+}
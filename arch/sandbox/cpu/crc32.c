@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * CRC32 and CRC32C using the host CPU's instructions
+ *
+ * On x86_64 hosts, CRC32 is calculated by folding the data with carry-less
+ * multiplication (PCLMULQDQ), following Intel's white paper "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction". CRC32C
+ * uses the SSE4.2 crc32 instruction. Other hosts use the generic code.
+ */
+
+#include <compiler.h>
+#include <u-boot/crc.h>
+
+#ifdef __x86_64__
+#include <cpuid.h>
+
+typedef long long v2di __attribute__((vector_size(16)));
+typedef long long v2di_u __attribute__((vector_size(16), aligned(1)));
+
+/* Folding constants for the bit-reflected polynomial 0xedb88320 */
+#define CRC32_K1	0x154442bd4ULL	/* x^(4*128+32) mod P(x), reflected */
+#define CRC32_K2	0x1c6e41596ULL	/* x^(4*128-32) mod P(x), reflected */
+#define CRC32_K3	0x1751997d0ULL	/* x^(128+32) mod P(x), reflected */
+#define CRC32_K4	0x0ccaa009eULL	/* x^(128-32) mod P(x), reflected */
+#define CRC32_K5	0x163cd6124ULL	/* x^64 mod P(x), reflected */
+#define CRC32_POLY	0x1db710641ULL	/* P(x), reflected */
+#define CRC32_MU	0x1f7011641ULL	/* x^64 / P(x), reflected */
+
+#define CRC32_FOLD_MIN	64
+
+static bool cpu_has_ecx(uint bit)
+{
+	uint eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return ecx & bit;
+}
+
+bool crc32_arch_supported(void)
+{
+	return cpu_has_ecx(bit_PCLMUL);
+}
+
+__attribute__((target("pclmul")))
+static v2di clmul(v2di a, v2di b, const int imm)
+{
+	return __builtin_ia32_pclmulqdq128(a, b, imm);
+}
+
+/* Fold the 128-bit value @x into @data, moving it 128 * n bits along */
+__attribute__((target("pclmul")))
+static v2di fold(v2di x, v2di k, v2di data)
+{
+	return clmul(x, k, 0x00) ^ clmul(x, k, 0x11) ^ data;
+}
+
+static v2di load(const uint8_t *buf)
+{
+	return *(const v2di_u *)buf;
+}
+
+__attribute__((target("pclmul")))
+uint crc32_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	const v2di k12 = { CRC32_K1, CRC32_K2 };
+	const v2di k34 = { CRC32_K3, CRC32_K4 };
+	const v2di k5 = { CRC32_K5, 0 };
+	const v2di poly_mu = { CRC32_POLY, CRC32_MU };
+	const long long mask32 = 0xffffffff;
+	v2di x1, x2, x3, x4, t;
+	uint left;
+
+	if (len < CRC32_FOLD_MIN)
+		return 0;
+
+	/* fold 64 bytes at a time into four 128-bit accumulators */
+	x1 = load(buf) ^ (v2di){ *crcp, 0 };
+	x2 = load(buf + 16);
+	x3 = load(buf + 32);
+	x4 = load(buf + 48);
+	buf += 64;
+	for (left = len - 64; left >= 64; left -= 64, buf += 64) {
+		x1 = fold(x1, k12, load(buf));
+		x2 = fold(x2, k12, load(buf + 16));
+		x3 = fold(x3, k12, load(buf + 32));
+		x4 = fold(x4, k12, load(buf + 48));
+	}
+
+	/* reduce to one accumulator and fold in any remaining whole blocks */
+	x1 = fold(x1, k34, x2);
+	x1 = fold(x1, k34, x3);
+	x1 = fold(x1, k34, x4);
+	for (; left >= 16; left -= 16, buf += 16)
+		x1 = fold(x1, k34, load(buf));
+
+	/* 128 bits to 64 */
+	x1 = clmul(x1, k34, 0x10) ^ (v2di){ x1[1], 0 };
+
+	/* 64 bits to 32, leaving the result in bits 32-95 */
+	t = clmul((v2di){ x1[0] & mask32, 0 }, k5, 0x00);
+	x1 = (v2di){ (long long)((unsigned long long)x1[0] >> 32) |
+			(x1[1] << 32),
+		     (long long)((unsigned long long)x1[1] >> 32) } ^ t;
+
+	/* Barrett reduction to the final 32-bit CRC */
+	t = clmul((v2di){ x1[0] & mask32, 0 }, poly_mu, 0x10);
+	t = clmul((v2di){ t[0] & mask32, 0 }, poly_mu, 0x00);
+	x1 ^= t;
+	*crcp = (unsigned long long)x1[0] >> 32;
+
+	return len - left;
+}
+
+bool crc32c_arch_supported(void)
+{
+	return cpu_has_ecx(bit_SSE4_2);
+}
+
+__attribute__((target("sse4.2")))
+uint crc32c_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	unsigned long long crc = *crcp;
+	uint left = len;
+
+	for (; left && ((ulong)buf & 7); left--)
+		crc = __builtin_ia32_crc32qi(crc, *buf++);
+	for (; left >= 8; left -= 8, buf += 8)
+		crc = __builtin_ia32_crc32di(crc, *(const u64 *)buf);
+	for (; left; left--)
+		crc = __builtin_ia32_crc32qi(crc, *buf++);
+	*crcp = crc;
+
+	return len;
+}
+
+#else /* !__x86_64__ */
+
+bool crc32_arch_supported(void)
+{
+	return false;
+}
+
+uint crc32_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	return 0;
+}
+
+bool crc32c_arch_supported(void)
+{
+	return false;
+}
+
+uint crc32c_arch(uint32_t *crcp, const uint8_t *buf, uint len)
+{
+	return 0;
+}
+
+#endif
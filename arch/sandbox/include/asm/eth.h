@@ -61,6 +61,20 @@ int sandbox_eth_recv_arp_req(struct udevice *dev);
  */
 int sandbox_eth_recv_ping_req(struct udevice *dev);
 
+/*
+ * sandbox_eth_arp_handler()
+ *
+ * Answer an ARP request sent by U-Boot, for tx handlers which act as a
+ * fake host
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received packet buffer
+ * @len: length of received packet
+ * Return: 0 if answered, -EPROTONOSUPPORT if this is not an ARP request
+ */
+int sandbox_eth_arp_handler(struct udevice *dev, void *packet,
+			    unsigned int len);
+
 /**
  * A packet handler
  *
@@ -81,7 +95,17 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * iss - tcp initial send sequence
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
+ * recv_packet_time - times when the packets were queued, from get_timer()
  * recv_packets - number of packets returned
+ * recv_delay - milliseconds to hold back each packet before it is received
+ * rx_dest - where to place the payload of the next packet received
+ * rx_placed - where the payload of the packet being received was placed
+ * rx_posted - true if rx_dest is waiting for a packet
+ * no_rx_dest - true to act as a device which cannot place payloads
+ * rx_batch - true to hand over received packets in batches
+ * rx_calls - number of calls to recv() or recv_batch() which returned packets
+ * free_calls - number of calls to free_pkt() or free_batch()
+ * tx_calls - number of calls to send() or send_batch()
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
  */
@@ -93,7 +117,17 @@ struct eth_sandbox_priv {
 	u32 iss;
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
+	ulong recv_packet_time[PKTBUFSRX];
 	int recv_packets;
+	ulong recv_delay;
+	struct eth_rx_dest rx_dest;
+	struct eth_rx_dest rx_placed;
+	bool rx_posted;
+	bool no_rx_dest;
+	bool rx_batch;
+	int rx_calls;
+	int free_calls;
+	int tx_calls;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
 };
@@ -112,4 +146,43 @@ void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler);
  */
 void sandbox_eth_set_priv(int index, void *priv);
 
+/*
+ * Set the delay before a packet queued by the tx handler is received
+ *
+ * This simulates the round-trip time of a real network, so that protocols
+ * which keep several requests in flight can be exercised
+ *
+ * delay_ms - delay in milliseconds, 0 to receive packets immediately
+ */
+void sandbox_eth_set_recv_delay(int index, ulong delay_ms);
+
+/*
+ * Stop the device placing payloads where the network stack posts them
+ *
+ * disable - true to leave received packets whole in the receive buffer
+ */
+void sandbox_eth_disable_rx_dest(int index, bool disable);
+
+/*
+ * Hand over all the packets which are waiting at once, through recv_batch()
+ *
+ * Packets stay in the receive queue until the whole batch is processed, so
+ * there is less room for the tx handler to queue replies meanwhile.
+ *
+ * enable - true to receive in batches, false to use recv()
+ */
+void sandbox_eth_set_rx_batch(int index, bool enable);
+
+/*
+ * Set the work which the device does for the network stack
+ *
+ * With ETH_OFFLOAD_TX_CSUM, checksums are filled in before packets reach the
+ * tx handler. With ETH_OFFLOAD_RX_CSUM, the checksums of all received packets
+ * are reported as correct, whatever they hold. ETH_OFFLOAD_RX_DROPS is always
+ * kept, since the driver counts its drops.
+ *
+ * offload - mask of ETH_OFFLOAD_... flags
+ */
+void sandbox_eth_set_offload(int index, uint offload);
+
 #endif /* __ETH_H */
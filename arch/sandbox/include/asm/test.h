@@ -361,4 +361,73 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+/**
+ * sandbox_ufs_get_queue_stats() - Get the queueing seen by the UFS emulator
+ *
+ * @dev: UFS device
+ * @doorbellsp: Returns the number of writes to the doorbell register
+ * @reqsp: Returns the number of transfer requests passed to the controller
+ * @max_depthp: Returns the largest number of requests outstanding at once
+ */
+void sandbox_ufs_get_queue_stats(struct udevice *dev, uint *doorbellsp,
+				 uint *reqsp, uint *max_depthp);
+
+/**
+ * sandbox_ufs_get_write_stats() - Get the write state seen by the UFS emulator
+ *
+ * @dev: UFS device
+ * @gearp: Returns the TX gear set for the link
+ * @wb_bytesp: Returns the number of bytes written through the WriteBooster
+ *	buffer
+ */
+void sandbox_ufs_get_write_stats(struct udevice *dev, uint *gearp,
+				 u64 *wb_bytesp);
+
+/**
+ * sandbox_ufs_get_sg_stats() - Get the largest transfers seen by the emulator
+ *
+ * @dev: UFS device
+ * @max_prdtp: Returns the largest number of PRDT entries in a read or write
+ * @max_xferp: Returns the largest number of bytes in a read or write
+ */
+void sandbox_ufs_get_sg_stats(struct udevice *dev, uint *max_prdtp,
+			      ulong *max_xferp);
+
+/**
+ * sandbox_nvme_get_queue_stats() - Get the queueing seen by the NVMe emulator
+ *
+ * @dev: NVMe controller
+ * @sq_doorbellsp: Returns the number of writes to the I/O submission doorbell
+ * @cq_doorbellsp: Returns the number of writes to the I/O completion doorbell
+ * @cmdsp: Returns the number of I/O commands carried out
+ * @max_batchp: Returns the largest number of I/O commands passed with one
+ *	submission doorbell write
+ */
+void sandbox_nvme_get_queue_stats(struct udevice *dev, uint *sq_doorbellsp,
+				  uint *cq_doorbellsp, uint *cmdsp,
+				  uint *max_batchp);
+
+/**
+ * sandbox_nvme_set_hang() - Make the NVMe emulator hang
+ *
+ * While it hangs, the I/O commands passed to the emulator are not answered.
+ * They are carried out late, when the next ones are passed, unless the
+ * submission queue is deleted first.
+ *
+ * @dev: NVMe controller
+ * @hang: true to hang, false to work normally again
+ */
+void sandbox_nvme_set_hang(struct udevice *dev, bool hang);
+
+/**
+ * sandbox_mmc_get_cqe_stats() - Get the queueing seen by the eMMC emulator
+ *
+ * @dev: MMC device
+ * @doorbellsp: Returns the number of writes to the command queue doorbell
+ * @tasksp: Returns the number of tasks queued
+ * @max_depthp: Returns the largest number of tasks queued at once
+ */
+void sandbox_mmc_get_cqe_stats(struct udevice *dev, uint *doorbellsp,
+			       uint *tasksp, uint *max_depthp);
+
 #endif
@@ -15,6 +15,7 @@
 #include <dm/device-internal.h>
 #include <env_internal.h>
 #include <fs.h>
+#include <image.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <dm/uclass-internal.h>
@@ -413,6 +414,36 @@ int bootmeth_alloc_other(struct bootflow *bflow, const char *fname,
 	return 0;
 }
 
+/**
+ * struct bootmeth_fit_stream - a FIT file being streamed from a bootflow
+ *
+ * @bflow: Bootflow holding the file
+ * @desc: Block device of the bootflow, or NULL
+ * @fname: Filename
+ */
+struct bootmeth_fit_stream {
+	struct bootflow *bflow;
+	struct blk_desc *desc;
+	const char *fname;
+};
+
+static int bootmeth_fit_stream_read(void *priv, ulong offset, ulong size,
+				    void *buf)
+{
+	struct bootmeth_fit_stream *bs = priv;
+	loff_t len_read;
+	int ret;
+
+	ret = bootmeth_setup_fs(bs->bflow, bs->desc);
+	if (ret)
+		return ret;
+	ret = fs_read(bs->fname, map_to_sysmem(buf), offset, size, &len_read);
+	if (ret)
+		return ret;
+
+	return len_read == size ? 0 : -EIO;
+}
+
 int bootmeth_common_read_file(struct udevice *dev, struct bootflow *bflow,
 			      const char *file_path, ulong addr,
 			      enum bootflow_img_t type, ulong *sizep)
@@ -435,6 +466,28 @@ int bootmeth_common_read_file(struct udevice *dev, struct bootflow *bflow,
 	if (size > *sizep)
 		return log_msg_ret("spc", -ENOSPC);
 
+	/*
+	 * A FIT kernel is streamed, so its images land at their load
+	 * addresses already hashed. Anything else, including a FIT which
+	 * cannot be streamed, is read as a whole and left to bootm to check.
+	 */
+	if (IS_ENABLED(CONFIG_FIT_STREAM) &&
+	    type == (enum bootflow_img_t)IH_TYPE_KERNEL) {
+		struct bootmeth_fit_stream bs = {
+			.bflow = bflow,
+			.desc = desc,
+			.fname = file_path,
+		};
+
+		ret = fit_stream_load(addr, NULL, bootmeth_fit_stream_read, &bs,
+				      NULL);
+		if (!ret) {
+			*sizep = size;
+			goto done;
+		}
+		log_debug("not streamed: err=%d\n", ret);
+	}
+
 	ret = bootmeth_setup_fs(bflow, desc);
 	if (ret)
 		return log_msg_ret("fs", ret);
@@ -444,6 +497,8 @@ int bootmeth_common_read_file(struct udevice *dev, struct bootflow *bflow,
 		return ret;
 	*sizep = len_read;
 
+done:
+
 	if (!bootflow_img_add(bflow, bflow->fname, type, addr, size))
 		return log_msg_ret("bci", -ENOMEM);
 
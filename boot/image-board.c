@@ -757,6 +757,8 @@ int boot_get_loadable(struct bootm_headers *images)
 	int fit_img_result;
 	const char *uname;
 	u8 img_type;
+	struct image_info *os = &images->os;
+	ulong os_end = os->load + os->image_len;
 
 	/* Check to see if the images struct has a FIT configuration */
 	if (!genimg_has_config(images)) {
@@ -795,6 +797,17 @@ int boot_get_loadable(struct bootm_headers *images)
 				return fit_img_result;
 			}
 
+			/*
+			 * The OS is loaded after the loadables, so catch one
+			 * which it would overwrite before anything is lost
+			 */
+			if (os->image_len && img_data < os_end &&
+			    img_data + img_len > os->load) {
+				printf("ERROR: %s overlaps OS image (OS=%lx..%lx)\n",
+				       uname, os->load, os_end);
+				return -EXDEV;
+			}
+
 			fit_img_result = fit_image_get_node(buf, uname);
 			if (fit_img_result < 0) {
 				/* Something went wrong! */
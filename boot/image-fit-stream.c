@@ -0,0 +1,469 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Streaming loader for FIT images with external data
+ *
+ * The FIT structure is read first, so that the configuration signature can be
+ * checked before any image data is trusted. The external data of each image
+ * is then read in chunks, straight to the load address for uncompressed
+ * images of the selected configuration. fit_image_load() picks up the placed
+ * images without copying them. The image hashes are not checked here, since
+ * fit_image_load() hashes each image anyway: the data may have been changed
+ * since it was read, so a hash taken while streaming proves nothing by then.
+ */
+
+#define LOG_CATEGORY LOGC_BOOT
+
+#include <blk.h>
+#include <env.h>
+#include <fs.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <sort.h>
+#include <asm/cache.h>
+#include <asm/global_data.h>
+#include <linux/libfdt.h>
+#include <u-boot/crc.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct fit_stream_image - an image with external data
+ *
+ * @noffset: Image node offset
+ * @offset: Offset of the data within the FIT file
+ * @size: Size of the data
+ * @dest: Address the data is read to
+ * @in_conf: true if the image is used by the selected configuration
+ * @placed: true if @dest is the load address rather than the FIT layout
+ */
+struct fit_stream_image {
+	int noffset;
+	ulong offset;
+	ulong size;
+	ulong dest;
+	bool in_conf;
+	bool placed;
+};
+
+/**
+ * struct fit_stream - the last FIT streamed by fit_stream_load()
+ *
+ * @addr: Address of the FIT structure
+ * @totalsize: Size of the FIT structure, 0 if none
+ * @crc: CRC32 of the FIT structure, to spot a FIT which has been replaced
+ * @count: Number of entries in @img
+ * @img: Images with external data
+ */
+static struct fit_stream {
+	ulong addr;
+	ulong totalsize;
+	u32 crc;
+	int count;
+	struct fit_stream_image *img;
+} stream;
+
+static bool fit_stream_in_conf(const void *fit, int conf_noffset,
+			       const char *name)
+{
+	int prop;
+
+	fdt_for_each_property_offset(prop, fit, conf_noffset) {
+		const char *pname;
+		const char *val;
+		int len;
+
+		val = fdt_getprop_by_offset(fit, prop, &pname, &len);
+		if (!val || !strcmp(pname, FIT_DESC_PROP) ||
+		    !strcmp(pname, "compatible"))
+			continue;
+		if (fdt_stringlist_contains(val, len, name))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Work out where the data of an image goes. Uncompressed images of the
+ * configuration are placed at their load address, as fit_image_load() would
+ * copy them there anyway. A zero load address of a devicetree means none.
+ */
+static void fit_stream_place(const void *fit, int conf_noffset, ulong addr,
+			     struct fit_stream_image *img)
+{
+	ulong load;
+	u8 comp;
+
+	img->dest = addr + img->offset;
+	img->in_conf = fit_stream_in_conf(fit, conf_noffset,
+					  fit_get_name(fit, img->noffset, NULL));
+	if (!img->in_conf)
+		return;
+	if (fit_image_get_load(fit, img->noffset, &load))
+		return;
+	if (!fit_image_get_comp(fit, img->noffset, &comp) &&
+	    comp != IH_COMP_NONE)
+		return;
+	if (fit_image_check_type(fit, img->noffset, IH_TYPE_KERNEL_NOLOAD) ||
+	    (fit_image_check_type(fit, img->noffset, IH_TYPE_FLATDT) && !load))
+		return;
+
+	img->dest = load;
+	img->placed = true;
+}
+
+static bool fit_stream_overlap(ulong start1, ulong size1, ulong start2,
+			       ulong size2)
+{
+	return start1 < start2 + size2 && start2 < start1 + size1;
+}
+
+static int fit_stream_check_overlap(const void *fit, ulong addr,
+				    struct fit_stream_image *img, int count)
+{
+	ulong fit_size = ALIGN(fdt_totalsize(fit), 4);
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		if (!img[i].placed)
+			continue;
+		if (fit_stream_overlap(img[i].dest, img[i].size, addr,
+				       fit_size)) {
+			printf("Error: image '%s' overlaps the FIT\n",
+			       fit_get_name(fit, img[i].noffset, NULL));
+			return -EXDEV;
+		}
+		for (j = 0; j < count; j++) {
+			if (j == i || !img[j].size)
+				continue;
+			if (fit_stream_overlap(img[i].dest, img[i].size,
+					       img[j].dest, img[j].size)) {
+				printf("Error: images '%s' and '%s' overlap\n",
+				       fit_get_name(fit, img[i].noffset, NULL),
+				       fit_get_name(fit, img[j].noffset, NULL));
+				return -EXDEV;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int fit_stream_cmp(const void *v1, const void *v2)
+{
+	const struct fit_stream_image *img1 = v1, *img2 = v2;
+
+	return img1->offset < img2->offset ? -1 : img1->offset > img2->offset;
+}
+
+/* List the images with external data, in the order they are in the file */
+static int fit_stream_scan(const void *fit, struct fit_stream_image **imgp)
+{
+	ulong base = ALIGN(fdt_totalsize(fit), 4);
+	struct fit_stream_image *img;
+	int images, noffset;
+	int count = 0;
+
+	images = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	if (images < 0)
+		return -ENOENT;
+	fdt_for_each_subnode(noffset, fit, images)
+		count++;
+
+	img = calloc(count ? count : 1, sizeof(*img));
+	if (!img)
+		return -ENOMEM;
+
+	count = 0;
+	fdt_for_each_subnode(noffset, fit, images) {
+		int offset, size;
+
+		if (!fit_image_get_data_position(fit, noffset, &offset))
+			img[count].offset = offset;
+		else if (!fit_image_get_data_offset(fit, noffset, &offset))
+			img[count].offset = base + offset;
+		else
+			continue;	/* the data came with the structure */
+		if (fit_image_get_data_size(fit, noffset, &size)) {
+			free(img);
+			return -ENOEXEC;
+		}
+		img[count].noffset = noffset;
+		img[count].size = size;
+		count++;
+	}
+	qsort(img, count, sizeof(*img), fit_stream_cmp);
+	*imgp = img;
+
+	return count;
+}
+
+static int fit_stream_read_image(fit_stream_read_t read, void *priv,
+				 struct fit_stream_image *img)
+{
+	void *buf;
+	ulong pos, len;
+	int ret = 0;
+
+	buf = map_sysmem(img->dest, img->size);
+	for (pos = 0; pos < img->size; pos += len) {
+		len = min_t(ulong, img->size - pos, CONFIG_FIT_STREAM_CHUNK);
+		ret = read(priv, img->offset + pos, len, buf + pos);
+		if (ret)
+			break;
+	}
+	unmap_sysmem(buf);
+
+	return ret;
+}
+
+void fit_stream_reset(void)
+{
+	free(stream.img);
+	memset(&stream, '\0', sizeof(stream));
+}
+
+int fit_stream_load(ulong addr, const char *conf_name, fit_stream_read_t read,
+		    void *priv, ulong *sizep)
+{
+	struct fit_stream_image *img;
+	struct fdt_header hdr;
+	ulong totalsize, end;
+	int conf_noffset;
+	void *fit;
+	int count, i;
+	int ret;
+
+	fit_stream_reset();
+
+	ret = read(priv, 0, sizeof(hdr), &hdr);
+	if (ret)
+		return log_msg_ret("hdr", ret);
+	if (fdt_check_header(&hdr))
+		return log_msg_ret("fdt", -ENOEXEC);
+	totalsize = fdt_totalsize(&hdr);
+	if (CONFIG_IS_ENABLED(FIT_SIGNATURE) &&
+	    totalsize > CONFIG_IF_ENABLED_INT(FIT_SIGNATURE,
+					      FIT_SIGNATURE_MAX_SIZE))
+		return log_msg_ret("size", -E2BIG);
+
+	fit = map_sysmem(addr, totalsize);
+	ret = read(priv, 0, totalsize, fit);
+	if (ret) {
+		ret = log_msg_ret("fit", ret);
+		goto err_unmap;
+	}
+	ret = fit_check_format(fit, IMAGE_SIZE_INVAL);
+	if (ret) {
+		printf("Bad FIT image format! (err=%d)\n", ret);
+		goto err_unmap;
+	}
+
+	ret = -ENXIO;
+	if (IS_ENABLED(CONFIG_FIT_BEST_MATCH) && !conf_name)
+		ret = fit_conf_find_compat(fit, gd_fdt_blob());
+	if (ret < 0 && ret != -EINVAL)
+		ret = fit_conf_get_node(fit, conf_name);
+	if (ret < 0) {
+		puts("Could not find configuration node\n");
+		ret = -ENOENT;
+		goto err_unmap;
+	}
+	conf_noffset = ret;
+
+	/* the image hashes are left to bootm, which checks them anyway */
+	if (FIT_IMAGE_ENABLE_VERIFY && env_get_yesno("verify") != 0) {
+		printf("   Verifying '%s' configuration ... ",
+		       fdt_get_name(fit, conf_noffset, NULL));
+		if (fit_config_verify(fit, conf_noffset)) {
+			puts("Bad Data Hash\n");
+			ret = -EACCES;
+			goto err_unmap;
+		}
+		puts("OK\n");
+	}
+
+	count = fit_stream_scan(fit, &img);
+	if (count < 0) {
+		ret = log_msg_ret("scan", count);
+		goto err_unmap;
+	}
+	for (i = 0; i < count; i++)
+		fit_stream_place(fit, conf_noffset, addr, &img[i]);
+	ret = fit_stream_check_overlap(fit, addr, img, count);
+	if (ret)
+		goto err;
+
+	end = totalsize;
+	for (i = 0; i < count; i++) {
+		ret = fit_stream_read_image(read, priv, &img[i]);
+		if (ret)
+			goto err;
+		log_debug("'%s' at %lx size %lx to %lx\n",
+			  fit_get_name(fit, img[i].noffset, NULL),
+			  img[i].offset, img[i].size, img[i].dest);
+		end = max(end, img[i].offset + img[i].size);
+	}
+
+	stream.addr = addr;
+	stream.totalsize = totalsize;
+	stream.crc = crc32(0, fit, totalsize);
+	stream.count = count;
+	stream.img = img;
+	if (sizep)
+		*sizep = end;
+	unmap_sysmem(fit);
+
+	return 0;
+
+err:
+	free(img);
+err_unmap:
+	unmap_sysmem(fit);
+
+	return ret;
+}
+
+/* Check that @fit is still the FIT which was streamed last */
+static bool fit_stream_valid(const void *fit)
+{
+	return stream.totalsize && map_to_sysmem(fit) == stream.addr &&
+		fdt_totalsize(fit) == stream.totalsize &&
+		crc32(0, fit, stream.totalsize) == stream.crc;
+}
+
+int fit_stream_get_data(const void *fit, int noffset, const void **data,
+			size_t *size)
+{
+	int i;
+
+	if (!fit_stream_valid(fit))
+		return -ENOENT;
+	for (i = 0; i < stream.count; i++) {
+		struct fit_stream_image *img = &stream.img[i];
+
+		if (img->noffset == noffset && img->placed) {
+			*data = map_sysmem(img->dest, img->size);
+			*size = img->size;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * struct fit_stream_file - a FIT in a file on a filesystem
+ *
+ * @ifname: Interface name
+ * @dev_part: Device and partition
+ * @fname: Filename
+ */
+struct fit_stream_file {
+	const char *ifname;
+	const char *dev_part;
+	const char *fname;
+};
+
+static int fit_stream_read_file(void *priv, ulong offset, ulong size,
+				void *buf)
+{
+	struct fit_stream_file *file = priv;
+	loff_t actread;
+	int ret;
+
+	if (fs_set_blk_dev(file->ifname, file->dev_part, FS_TYPE_ANY))
+		return -ENODEV;
+	ret = fs_read(file->fname, map_to_sysmem(buf), offset, size, &actread);
+	if (ret)
+		return ret;
+
+	return actread == size ? 0 : -EIO;
+}
+
+int fit_stream_load_fs(const char *ifname, const char *dev_part,
+		       const char *fname, ulong addr, const char *conf_name)
+{
+	struct fit_stream_file file = {
+		.ifname = ifname,
+		.dev_part = dev_part,
+		.fname = fname,
+	};
+
+	return fit_stream_load(addr, conf_name, fit_stream_read_file, &file,
+			       NULL);
+}
+
+/**
+ * struct fit_stream_blk - a FIT on a block device
+ *
+ * @desc: Block device
+ * @start: First block of the FIT
+ * @bounce: Buffer for blocks which are only partly wanted, one block long
+ * @bounce_blk: Block held in @bounce, or -1 if none
+ */
+struct fit_stream_blk {
+	struct blk_desc *desc;
+	lbaint_t start;
+	void *bounce;
+	lbaint_t bounce_blk;
+};
+
+static int fit_stream_read_blk(void *priv, ulong offset, ulong size,
+			       void *buf)
+{
+	struct fit_stream_blk *sb = priv;
+	ulong blksz = sb->desc->blksz;
+	lbaint_t blk = sb->start + offset / blksz;
+	ulong skip = offset % blksz;
+
+	while (size) {
+		ulong len;
+
+		if (skip || size < blksz) {
+			if (blk != sb->bounce_blk) {
+				sb->bounce_blk = (lbaint_t)-1;
+				if (blk_dread(sb->desc, blk, 1, sb->bounce) != 1)
+					return -EIO;
+				sb->bounce_blk = blk;
+			}
+			len = min(blksz - skip, size);
+			memcpy(buf, sb->bounce + skip, len);
+			if (skip + len == blksz)
+				blk++;
+			skip = 0;
+		} else {
+			lbaint_t count = size / blksz;
+
+			if (blk_dread(sb->desc, blk, count, buf) != count)
+				return -EIO;
+			len = count * blksz;
+			blk += count;
+		}
+		buf += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+int fit_stream_load_blk(struct blk_desc *desc, ulong start, ulong addr,
+			const char *conf_name)
+{
+	struct fit_stream_blk sb = {
+		.desc = desc,
+		.start = start,
+		.bounce_blk = (lbaint_t)-1,
+	};
+	int ret;
+
+	sb.bounce = memalign(ARCH_DMA_MINALIGN, desc->blksz);
+	if (!sb.bounce)
+		return -ENOMEM;
+	ret = fit_stream_load(addr, conf_name, fit_stream_read_blk, &sb, NULL);
+	free(sb.bounce);
+
+	return ret;
+}
@@ -1054,6 +1054,10 @@ int fit_image_get_data(const void *fit, int noffset, const void **data,
 	int len;
 	int ret;
 
+	/* images placed by fit_stream_load() are not in the FIT layout */
+	if (!fit_stream_get_data(fit, noffset, data, size))
+		return 0;
+
 	if (!fit_image_get_data_position(fit, noffset, &offset)) {
 		external_data = true;
 	} else if (!fit_image_get_data_offset(fit, noffset, &offset)) {
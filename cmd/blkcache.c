@@ -4,46 +4,93 @@
  * Author: Eric Nelson<eric@nelint.com>
  *
  */
+#include <blk.h>
 #include <command.h>
 #include <config.h>
 #include <malloc.h>
 #include <part.h>
 #include <vsprintf.h>
 
+#define BLKC_MAX_DEVS	16
+
+/* hit ratio in tenths of a percent, counting partial hits as hits */
+static uint blkc_ratio(uint hits, uint partials, uint misses)
+{
+	uint total = hits + partials + misses;
+
+	return total ? (uint)((hits + partials) * 1000ULL / total) : 0;
+}
+
 static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
+	struct block_cache_dev_stats devs[BLKC_MAX_DEVS];
 	struct block_cache_stats stats;
+	uint ratio;
+	int count, i;
+
 	blkcache_stats(&stats);
+	count = blkcache_dev_stats(devs, ARRAY_SIZE(devs));
 
+	ratio = blkc_ratio(stats.hits, stats.partials, stats.misses);
 	printf("hits: %u\n"
+	       "partial hits: %u\n"
 	       "misses: %u\n"
+	       "hit ratio: %u.%u%%\n"
 	       "entries: %u\n"
+	       "bytes: %lu\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache entries: %u\n"
+	       "max cache bytes: %lu\n",
+	       stats.hits, stats.partials, stats.misses, ratio / 10,
+	       ratio % 10, stats.entries, stats.bytes,
+	       stats.max_blocks_per_entry, stats.max_entries, stats.max_bytes);
+
+	if (!count)
+		return 0;
+
+	printf("\n%-8s %5s %8s %8s %8s %7s %8s %10s\n", "type", "dev",
+	       "hits", "partial", "misses", "ratio", "entries", "bytes");
+	for (i = 0; i < min(count, BLKC_MAX_DEVS); i++) {
+		struct block_cache_dev_stats *dev = &devs[i];
+
+		ratio = blkc_ratio(dev->hits, dev->partials, dev->misses);
+		printf("%-8s %5d %8u %8u %8u %5u.%u%% %8u %10lu\n",
+		       blk_get_uclass_name(dev->iftype), dev->devnum,
+		       dev->hits, dev->partials, dev->misses, ratio / 10,
+		       ratio % 10, dev->entries, dev->bytes);
+	}
+
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
+	struct block_cache_stats stats;
 	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	unsigned long max_bytes;
+
+	if (argc != 3 && argc != 4)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
 	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	if (argc == 4) {
+		max_bytes = simple_strtoul(argv[3], 0, 0);
+	} else {
+		blkcache_stats(&stats);
+		max_bytes = stats.max_bytes;
+	}
+	blkcache_configure(blocks_per_entry, max_entries, max_bytes);
+	printf("changed to max of %u entries of %u blocks each, %lu bytes in total\n",
+	       max_entries, blocks_per_entry, max_bytes);
 	return 0;
 }
 
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
-	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(configure, 4, 0, blkc_configure, "", ""),
 };
 
 static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
@@ -67,9 +114,9 @@ static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
 }
 
 U_BOOT_CMD(
-	blkcache, 4, 0, do_blkcache,
+	blkcache, 5, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <entries> [<bytes>] "
+	"- set max blocks per entry, max cache entries and max cached bytes\n"
 );
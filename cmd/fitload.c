@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Stream a FIT with external data from storage
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <image.h>
+#include <part.h>
+#include <time.h>
+#include <vsprintf.h>
+#include <linux/string.h>
+
+static int do_fitload(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	const char *conf = NULL;
+	bool raw = false;
+	ulong addr, time;
+	int nargs;
+	int ret;
+
+	if (argc > 1 && !strcmp(argv[1], "-r")) {
+		raw = true;
+		argc--;
+		argv++;
+	}
+	/* interface, device, address and, unless raw, the filename */
+	nargs = raw ? 4 : 5;
+	if (argc < nargs || argc > nargs + 1)
+		return CMD_RET_USAGE;
+	addr = hextoul(argv[3], NULL);
+	if (argc > nargs) {
+		conf = argv[nargs];
+		if (*conf == '#')
+			conf++;
+	}
+
+	time = get_timer(0);
+	if (raw) {
+		struct disk_partition info;
+		struct blk_desc *desc;
+
+		if (blk_get_device_part_str(argv[1], argv[2], &desc, &info,
+					    1) < 0)
+			return CMD_RET_FAILURE;
+		ret = fit_stream_load_blk(desc, info.start, addr, conf);
+	} else {
+		ret = fit_stream_load_fs(argv[1], argv[2], argv[4], addr, conf);
+	}
+	time = get_timer(time);
+	if (ret) {
+		printf("Failed to stream FIT (err=%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+	printf("FIT streamed in %lu ms\n", time);
+	image_load_addr = addr;
+
+	return 0;
+}
+
+U_BOOT_CMD(fitload, 7, 0, do_fitload,
+	   "stream a FIT with external data from storage",
+	   "<interface> <dev[:part]> <addr> <filename> [<config>]\n"
+	   "    - stream FIT file 'filename' to 'addr'\n"
+	   "fitload -r <interface> <dev[:part]> <addr> [<config>]\n"
+	   "    - stream a FIT from the start of a raw partition\n"
+	   "Images of 'config' (default: the default configuration) are read\n"
+	   "to their load addresses and hashed while they are read"
+);
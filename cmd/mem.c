@@ -26,6 +26,7 @@
 #include <mapmem.h>
 #include <rand.h>
 #include <time.h>
+#include <u-boot/crc.h>
 #include <watchdog.h>
 #include <asm/global_data.h>
 #include <asm/io.h>
@@ -33,6 +34,7 @@
 #include <linux/compiler.h>
 #include <linux/ctype.h>
 #include <linux/delay.h>
+#include <linux/sizes.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -1243,6 +1245,89 @@ mod_mem(struct cmd_tbl *cmdtp, int incrflag, int flag, int argc,
 
 #ifdef CONFIG_CMD_CRC32
 
+#ifdef CONFIG_CRC32_BENCH
+/* Minimum time to spend on each implementation, in microseconds */
+#define CRC32_BENCH_US	200000
+
+static void crc32_bench_show(const char *name, uint32_t crc, ulong len,
+			     uint runs, ulong us)
+{
+	u64 rate = (u64)len * runs * 1000000 / max(us, 1UL);
+
+	printf("%-18s %08x  %6llu MiB/s\n", name, crc, rate / SZ_1M);
+}
+
+static int crc32_bench(ulong addr, ulong len)
+{
+	const uint8_t *buf;
+	uint32_t expect = 0;
+	bool first = true;
+	int ret = 0;
+	int impl;
+
+	buf = map_sysmem(addr, len);
+	for (impl = 0; impl < CRC32_IMPL_COUNT; impl++) {
+		uint32_t crc;
+		ulong start, us;
+		uint runs;
+
+		start = timer_get_us();
+		runs = 0;
+		do {
+			crc = ~0;
+			if (crc32_no_comp_impl(impl, &crc, buf, len))
+				break;
+			runs++;
+			us = timer_get_us() - start;
+		} while (us < CRC32_BENCH_US);
+		if (!runs)
+			continue;
+		crc = ~crc;
+		crc32_bench_show(crc32_impl_name(impl), crc, len, runs, us);
+		if (!first && crc != expect)
+			ret = CMD_RET_FAILURE;
+		expect = crc;
+		first = false;
+	}
+
+#if IS_ENABLED(CONFIG_CRC32C)
+	{
+		uint32_t table[256];
+		uint32_t crc, table_crc;
+		ulong start, us;
+		uint runs;
+
+		crc32c_init(table, 0x82f63b78);
+		start = timer_get_us();
+		runs = 0;
+		do {
+			table_crc = crc32c_table_cal(~0, (const char *)buf, len,
+						     table);
+			runs++;
+			us = timer_get_us() - start;
+		} while (us < CRC32_BENCH_US);
+		crc32_bench_show("crc32c table", ~table_crc, len, runs, us);
+
+		start = timer_get_us();
+		runs = 0;
+		do {
+			crc = crc32c_cal(~0, (const char *)buf, len, table);
+			runs++;
+			us = timer_get_us() - start;
+		} while (us < CRC32_BENCH_US);
+		crc32_bench_show("crc32c", ~crc, len, runs, us);
+		if (crc != table_crc)
+			ret = CMD_RET_FAILURE;
+	}
+#endif
+	unmap_sysmem(buf);
+	if (ret)
+		printf("Mismatch between implementations\n");
+
+	return ret;
+}
+#endif
+
 static int do_mem_crc(struct cmd_tbl *cmdtp, int flag, int argc,
 		      char *const argv[])
 {
@@ -1255,6 +1340,14 @@ static int do_mem_crc(struct cmd_tbl *cmdtp, int flag, int argc,
 
 	av = argv + 1;
 	ac = argc - 1;
+#ifdef CONFIG_CRC32_BENCH
+	if (!strcmp(*av, "-b")) {
+		if (ac != 3)
+			return CMD_RET_USAGE;
+
+		return crc32_bench(hextoul(av[1], NULL), hextoul(av[2], NULL));
+	}
+#endif
 #ifdef CONFIG_CRC32_VERIFY
 	if (strcmp(*av, "-v") == 0) {
 		flags |= HASH_FLAG_VERIFY | HASH_FLAG_ENV;
@@ -1360,12 +1453,20 @@ U_BOOT_CMD(
 
 #ifdef CONFIG_CMD_CRC32
 
+#ifdef CONFIG_CRC32_BENCH
+#define CRC32_BENCH_HELP \
+	"\n-b address count\n    - measure speed of each CRC32 implementation"
+#else
+#define CRC32_BENCH_HELP
+#endif
+
 #ifndef CONFIG_CRC32_VERIFY
 
 U_BOOT_CMD(
 	crc32,	4,	1,	do_mem_crc,
 	"checksum calculation",
 	"address count [addr]\n    - compute CRC32 checksum [save at addr]"
+	CRC32_BENCH_HELP
 );
 
 #else	/* CONFIG_CRC32_VERIFY */
@@ -1375,6 +1476,7 @@ U_BOOT_CMD(
 	"checksum calculation",
 	"address count [addr]\n    - compute CRC32 checksum [save at addr]\n"
 	"-v address count crc\n    - verify crc of memory area"
+	CRC32_BENCH_HELP
 );
 
 #endif	/* CONFIG_CRC32_VERIFY */
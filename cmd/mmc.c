@@ -17,9 +17,24 @@
 #include <image-sparse.h>
 #include <vsprintf.h>
 #include <linux/ctype.h>
+#include <linux/math64.h>
 
 static int curr_device = -1;
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static void print_cqe_stats(const char *name,
+			    const struct mmc_cqe_stats *stats)
+{
+	u64 time_us = max_t(u64, stats->time_us, 1);
+	u64 rate = div64_u64(stats->bytes * 100, time_us);
+
+	printf("%s: %llu tasks, %llu bytes, %llu IOPS, %llu.%02llu MB/s, depth %u\n",
+	       name, stats->tasks, stats->bytes,
+	       div64_u64(stats->tasks * 1000000, time_us), rate / 100,
+	       rate % 100, stats->max_depth);
+}
+#endif
+
 static void print_mmcinfo(struct mmc *mmc)
 {
 	int i;
@@ -66,6 +81,14 @@ static void print_mmcinfo(struct mmc *mmc)
 	print_size(((u64)mmc->erase_grp_size) << 9, "\n");
 #endif
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	if (mmc->cqe_depth) {
+		printf("Command Queue: %u tasks\n", mmc->cqe_depth);
+		print_cqe_stats("Queued Reads", &mmc->cqe_read);
+		print_cqe_stats("Queued Writes", &mmc->cqe_write);
+	}
+#endif
+
 	if (!IS_SD(mmc) && mmc->version >= MMC_VERSION_4_41) {
 		bool has_enh = (mmc->part_support & ENHNCD_SUPPORT) != 0;
 		bool usr_enh = has_enh && (mmc->part_attr & EXT_CSD_ENH_USR);
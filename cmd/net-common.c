@@ -10,6 +10,8 @@
 #include <net.h>
 #include <linux/compat.h>
 #include <linux/ethtool.h>
+#include <linux/math64.h>
+#include <net/stats.h>
 
 static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
@@ -26,6 +28,51 @@ static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const ar
 	return CMD_RET_SUCCESS;
 }
 
+static void net_show_proto_stats(void)
+{
+	const struct net_stats *stats = net_stats_get();
+	const struct net_proto_stats *s;
+	int i, j;
+
+	printf("%-5s %6s %8s %11s %7s %7s %6s %6s  %s\n", "Proto", "Xfers",
+	       "Packets", "Bytes", "KiB/s", "Resent", "Dups", "OOO",
+	       "RTT min/avg/max (us)");
+	for (i = 0; i < NET_STATS_COUNT; i++) {
+		s = &stats->proto[i];
+		printf("%-5s %6lu %8lu %11llu %7lu %7lu %6lu %6lu  ",
+		       net_stats_name(i), s->transfers, s->rx_packets,
+		       s->rx_bytes,
+		       (ulong)div_u64(s->rx_bytes * 1000,
+				      max(s->time_ms, 1UL) * 1024),
+		       s->retransmits, s->dups, s->ooo);
+		if (s->rtt_count)
+			printf("%lu/%lu/%lu\n", s->rtt_min,
+			       (ulong)div_u64(s->rtt_sum, s->rtt_count),
+			       s->rtt_max);
+		else
+			printf("-\n");
+	}
+	if (!stats->rx_drops_unknown)
+		printf("Driver RX drops: %lu\n", stats->rx_drops);
+	else if (stats->rx_drops)
+		printf("Driver RX drops: at least %lu\n", stats->rx_drops);
+	else
+		printf("Driver RX drops: n/a\n");
+
+	printf("KiB/s over the last transfer:\n");
+	for (i = 0; i < NET_STATS_COUNT; i++) {
+		s = &stats->proto[i];
+		if (!s->rate_count)
+			continue;
+		printf("%-5s", net_stats_name(i));
+		j = s->rate_count > NET_STATS_RATE_SLOTS ?
+			s->rate_count - NET_STATS_RATE_SLOTS : 0;
+		for (; j < s->rate_count; j++)
+			printf(" %u", s->rate[j % NET_STATS_RATE_SLOTS]);
+		printf("\n");
+	}
+}
+
 static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	int nstats, err, i, off;
@@ -33,8 +80,16 @@ static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc, char *const a
 	u64 *values;
 	u8 *strings;
 
-	if (argc < 2)
-		return CMD_RET_USAGE;
+	if (argc < 2) {
+		if (!IS_ENABLED(CONFIG_NET_STATS))
+			return CMD_RET_USAGE;
+		net_show_proto_stats();
+		return CMD_RET_SUCCESS;
+	}
+	if (IS_ENABLED(CONFIG_NET_STATS) && !strcmp(argv[1], "reset")) {
+		net_stats_reset();
+		return CMD_RET_SUCCESS;
+	}
 
 	err = uclass_get_device_by_name(UCLASS_ETH, argv[1], &dev);
 	if (err) {
@@ -103,4 +158,8 @@ static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 
 U_BOOT_CMD(net, 3, 1, do_net, "NET sub-system",
 	   "list - list available devices\n"
+#if IS_ENABLED(CONFIG_NET_STATS)
+	   "stats - show statistics for each protocol\n"
+	   "stats reset - reset the protocol statistics\n"
+#endif
 	   "stats <device> - dump statistics for specified device\n");
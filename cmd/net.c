@@ -9,6 +9,8 @@
 /*
  * Boot support
  */
+#include <blk.h>
+#include <blk_stream.h>
 #include <bootstage.h>
 #include <command.h>
 #include <dm.h>
@@ -18,6 +20,7 @@
 #include <log.h>
 #include <net.h>
 #include <net6.h>
+#include <net/neigh.h>
 #include <net/udp.h>
 #include <net/sntp.h>
 #include <net/ncsi.h>
@@ -455,6 +458,79 @@ static int netboot_common(enum proto_t proto, struct cmd_tbl *cmdtp, int argc,
 	return rcode;
 }
 
+#if defined(CONFIG_CMD_NETWRITE)
+static int do_netwrite(struct cmd_tbl *cmdtp, int flag, int argc,
+		       char *const argv[])
+{
+	struct disk_partition info;
+	struct blk_desc *desc;
+	struct blk_stream bs;
+	enum proto_t proto;
+	lbaint_t offset;
+	int size, ret;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+
+	if (IS_ENABLED(CONFIG_CMD_TFTPBOOT) && !strcmp(argv[1], "tftp")) {
+		proto = TFTPGET;
+	} else if (IS_ENABLED(CONFIG_CMD_WGET) && !strcmp(argv[1], "wget")) {
+		proto = WGET;
+		wget_info = &default_wget_info;
+	} else {
+		return CMD_RET_USAGE;
+	}
+
+	if (blk_get_device_part_str(argv[2], argv[3], &desc, &info, 1) < 0)
+		return CMD_RET_FAILURE;
+	offset = hextoul(argv[4], NULL);
+	if (offset >= info.size) {
+		printf("Block " LBAF " is past the end\n", offset);
+		return CMD_RET_FAILURE;
+	}
+
+	net_boot_file_name_explicit = false;
+	*net_boot_file_name = '\0';
+	if (IS_ENABLED(CONFIG_IPV6))
+		use_ip6 = false;
+	/* the block number stands in for the command name */
+	if (parse_args(proto, argc - 4, argv + 4))
+		return CMD_RET_USAGE;
+
+	ret = blk_stream_start(&bs, desc, info.start + offset,
+			       info.size - offset);
+	if (ret) {
+		blk_stream_finish(&bs);
+		return CMD_RET_FAILURE;
+	}
+	net_blk_stream = &bs;
+	size = net_loop(proto);
+	net_blk_stream = NULL;
+	ret = blk_stream_finish(&bs);
+	if (size < 0)
+		return CMD_RET_FAILURE;
+	if (ret) {
+		printf("Writing to %s %s failed (err=%d)\n", argv[2], argv[3],
+		       ret);
+		return CMD_RET_FAILURE;
+	}
+	printf(LBAFU " blocks written to %s %s at block " LBAFU "\n",
+	       bs.written, argv[2], argv[3], info.start + offset);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	netwrite,	6,	0,	do_netwrite,
+	"download an image straight to a block device",
+	"tftp|wget <interface> <dev[:part]> <blk#> [[hostIPaddr:]image name]\n"
+	"    - download the image, decompressing it if it is gzip or zstd\n"
+	"      data, and write it from block 'blk#' (hex) of the device or\n"
+	"      partition as it arrives. Android sparse images are written\n"
+	"      out as such."
+);
+#endif
+
 #if defined(CONFIG_CMD_PING)
 int do_ping(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
@@ -508,6 +584,55 @@ U_BOOT_CMD(
 );
 #endif /* CONFIG_CMD_PING6 */
 
+#if defined(CONFIG_CMD_NEIGH)
+static int do_neigh(struct cmd_tbl *cmdtp, int flag, int argc,
+		    char *const argv[])
+{
+	const struct neigh_entry *entry;
+	const struct neigh_stats *stats;
+	ulong now = get_timer(0);
+	char addr[40];
+	int i;
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		neigh_flush(NULL);
+		return CMD_RET_SUCCESS;
+	} else if (argc != 1) {
+		return CMD_RET_USAGE;
+	}
+
+	printf("%-39s %-17s %5s  %s\n", "Address", "Ethernet address", "Age",
+	       "Device");
+	for (i = 0; (entry = neigh_get_entry(i)); i++) {
+		if (!entry->dev)
+			continue;
+		if (entry->ip6)
+			snprintf(addr, sizeof(addr), "%pI6c", &entry->addr);
+		else
+			snprintf(addr, sizeof(addr), "%pI4", &entry->addr);
+		printf("%-39s %pM %5lu  %s%s\n", addr, entry->ethaddr,
+		       (now - entry->updated) / 1000, entry->dev->name,
+		       entry->stale ? " (stale)" : "");
+	}
+
+	stats = neigh_get_stats();
+	printf("%lu hits, %lu misses, %lu probes, %lu expired, %lu evicted\n",
+	       stats->hits, stats->misses, stats->probes, stats->expired,
+	       stats->evicted);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	neigh,	2,	1,	do_neigh,
+	"show or flush the neighbour cache",
+	"\n"
+	"    - show the cached Ethernet addresses and statistics\n"
+	"neigh flush\n"
+	"    - drop all entries and reset the statistics"
+);
+#endif /* CONFIG_CMD_NEIGH */
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
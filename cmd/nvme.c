@@ -8,9 +8,31 @@
 #include <command.h>
 #include <dm.h>
 #include <nvme.h>
+#include <part.h>
 
 static int nvme_curr_dev;
 
+/* List the devices as blk_list_devices() does, with their statistics */
+static void nvme_list_devices(void)
+{
+	struct blk_desc *desc;
+	int ret;
+	int i;
+
+	for (i = 0;; ++i) {
+		ret = blk_get_desc(UCLASS_NVME, i, &desc);
+		if (ret == -ENODEV)
+			break;
+		else if (ret)
+			continue;
+		if (desc->type == DEV_TYPE_UNKNOWN)
+			continue;
+		printf("Device %d: ", i);
+		dev_print(desc);
+		nvme_print_stats(desc->bdev);
+	}
+}
+
 static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		   char *const argv[])
 {
@@ -24,6 +46,11 @@ static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 
 			return ret;
 		}
+		if (strncmp(argv[1], "inf", 3) == 0) {
+			nvme_list_devices();
+
+			return CMD_RET_SUCCESS;
+		}
 		if (strncmp(argv[1], "deta", 4) == 0) {
 			struct udevice *udev;
 
@@ -46,7 +73,7 @@ U_BOOT_CMD(
 	"NVM Express sub-system",
 	"scan - scan NVMe devices\n"
 	"nvme detail - show details of current NVMe device\n"
-	"nvme info - show all available NVMe devices\n"
+	"nvme info - show all available NVMe devices and their statistics\n"
 	"nvme device [dev] - show or set current NVMe device\n"
 	"nvme part [dev] - print partition table of one or all NVMe devices\n"
 	"nvme read addr blk# cnt - read `cnt' blocks starting at block\n"
@@ -10,6 +10,7 @@
 #include <command.h>
 #include <fs.h>
 #include <squashfs.h>
+#include <linux/string.h>
 
 static int do_sqfs_ls(struct cmd_tbl *cmdtp, int flag, int argc, char * const argv[])
 {
@@ -40,3 +41,36 @@ U_BOOT_CMD(sqfsload, 7, 0, do_sqfs_load,
 	   "      ARCH_DMA_MINALIGN then a misaligned buffer warning will\n"
 	   "      be printed and performance will suffer for the load."
 );
+
+static int do_sqfs_stats(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char * const argv[])
+{
+	struct sqfs_stats stats;
+
+	if (argc > 2)
+		return CMD_RET_USAGE;
+
+	if (argc == 2) {
+		if (strcmp(argv[1], "flush"))
+			return CMD_RET_USAGE;
+		sqfs_cache_free();
+		return CMD_RET_SUCCESS;
+	}
+
+	sqfs_get_stats(&stats);
+	printf("metadata: %lu hits, %lu misses, %lu blocks decompressed\n",
+	       stats.meta_hits, stats.meta_misses, stats.metablks);
+	printf("fragments: %lu hits, %lu misses\n", stats.frag_hits,
+	       stats.frag_misses);
+	printf("cached: %lu bytes\n", stats.cached_bytes);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(sqfsstats, 2, 0, do_sqfs_stats,
+	   "show SquashFS cache statistics",
+	   "\n"
+	   "    - show metadata and fragment cache hits and misses\n"
+	   "sqfsstats flush\n"
+	   "    - drop all cached SquashFS data"
+);
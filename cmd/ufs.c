@@ -6,12 +6,43 @@
  *
  */
 #include <command.h>
+#include <dm.h>
 #include <ufs.h>
 #include <vsprintf.h>
 #include <linux/string.h>
 
+static void ufs_show_status(struct udevice *dev)
+{
+	const struct ufs_bulk_stats *last;
+	struct ufs_status status;
+
+	if (ufs_get_status(dev, &status))
+		return;
+
+	printf("Device:       %s\n", dev->name);
+	printf("Link:         %s-G%u (max %u), %u lane%s\n",
+	       status.hs ? "HS" : "PWM", status.gear, status.max_gear,
+	       status.lanes, status.lanes == 1 ? "" : "s");
+	if (!status.wb_sup)
+		printf("WriteBooster: not supported\n");
+	else if (status.wb_avail < 0)
+		printf("WriteBooster: %s\n", status.wb_enabled ? "on" : "off");
+	else
+		printf("WriteBooster: %s, %d%% available\n",
+		       status.wb_enabled ? "on" : "off", status.wb_avail);
+
+	last = &status.bulk_last;
+	if (status.bulk_active)
+		printf("Bulk write:   in progress\n");
+	else if (last->time_us)
+		printf("Bulk write:   %llu bytes in %lu ms, %lu.%02lu MB/s\n",
+		       last->bytes, last->time_us / 1000, last->rate / 1000,
+		       last->rate % 1000 / 10);
+}
+
 static int do_ufs(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
+	struct udevice *ufs;
 	int dev, ret;
 
 	if (argc >= 2) {
@@ -27,12 +58,58 @@ static int do_ufs(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 
 			return CMD_RET_SUCCESS;
 		}
+
+		if (argc < 3)
+			return CMD_RET_USAGE;
+		dev = dectoul(argv[2], NULL);
+		if (uclass_get_device(UCLASS_UFS, dev, &ufs)) {
+			printf("UFS device %d not found\n", dev);
+			return CMD_RET_FAILURE;
+		}
+
+		if (!strcmp(argv[1], "info") && argc == 3) {
+			ufs_show_status(ufs);
+
+			return CMD_RET_SUCCESS;
+		}
+
+		if (argc != 4)
+			return CMD_RET_USAGE;
+
+		if (!strcmp(argv[1], "wb")) {
+			if (!strcmp(argv[3], "on"))
+				ret = ufs_wb_enable(ufs, true);
+			else if (!strcmp(argv[3], "off"))
+				ret = ufs_wb_enable(ufs, false);
+			else if (!strcmp(argv[3], "flush"))
+				ret = ufs_wb_flush(ufs);
+			else
+				return CMD_RET_USAGE;
+		} else if (!strcmp(argv[1], "bulk")) {
+			if (!strcmp(argv[3], "begin"))
+				ret = ufs_bulk_begin(ufs);
+			else if (!strcmp(argv[3], "end"))
+				ret = ufs_bulk_end(ufs, NULL);
+			else
+				return CMD_RET_USAGE;
+		} else {
+			return CMD_RET_USAGE;
+		}
+		if (ret) {
+			printf("Failed (err=%d)\n", ret);
+			return CMD_RET_FAILURE;
+		}
+
+		return CMD_RET_SUCCESS;
 	}
 
 	return CMD_RET_USAGE;
 }
 
-U_BOOT_CMD(ufs, 3, 1, do_ufs,
+U_BOOT_CMD(ufs, 4, 1, do_ufs,
 	   "UFS sub-system",
 	   "init [dev] - init UFS subsystem\n"
+	   "ufs info <dev> - show link, WriteBooster and bulk write state\n"
+	   "ufs wb <dev> on|off|flush - control the WriteBooster buffer\n"
+	   "ufs bulk <dev> begin|end - run the following writes at full speed\n"
 );
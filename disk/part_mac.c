@@ -150,6 +150,10 @@ static void part_print_mac(struct blk_desc *desc)
  */
 static int part_mac_read_ddb(struct blk_desc *desc, mac_driver_desc_t *ddb_p)
 {
+	/* the blocks are read into buffers of 512 bytes */
+	if (desc->blksz != 512)
+		return -1;
+
 	if (blk_dread(desc, 0, 1, (ulong *)ddb_p) != 1) {
 		debug("** Can't read Driver Descriptor Block **\n");
 		return (-1);
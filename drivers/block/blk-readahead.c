@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Read-ahead for sequential reads from block devices
+ *
+ * When a device sees a run of sequential reads which are smaller than the
+ * read-ahead window, the next window is fetched into a staging buffer by a
+ * uthread. Drivers whose completion loops yield (via udelay() or schedule())
+ * let that read proceed while the caller processes the previous data. Without
+ * CONFIG_UTHREAD the window is read synchronously, which still turns many
+ * small reads into a few large ones.
+ *
+ * Block devices on the same host controller, such as UFS LUNs or NVMe
+ * namespaces, share its command slots and queues, so only one of them may
+ * read ahead at a time and nothing else may use the host meanwhile.
+ */
+
+#define LOG_CATEGORY UCLASS_BLK
+
+#include <blk.h>
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <uthread.h>
+#include <asm/cache.h>
+
+#define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
+
+/**
+ * struct blk_readahead - read-ahead state of a block device
+ *
+ * @dev: Block device
+ * @buf: Staging buffer, @window blocks long
+ * @window: Size of the staging buffer in blocks, 0 to disable read-ahead
+ * @next: Block following the last read, used to detect sequential access
+ * @seq: Number of consecutive sequential reads seen
+ * @start: First block held in @buf
+ * @count: Number of blocks held in @buf, or being read into it if @busy
+ * @busy: true while the read-ahead thread is running
+ * @valid: true if @buf holds @count blocks starting at @start
+ * @stats: Statistics
+ */
+struct blk_readahead {
+	struct udevice *dev;
+	void *buf;
+	lbaint_t window;
+	lbaint_t next;
+	uint seq;
+	lbaint_t start;
+	lbaint_t count;
+	bool busy;
+	bool valid;
+	struct blk_readahead_stats stats;
+};
+
+static struct blk_readahead *ra_get(struct udevice *dev, bool create)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = desc->ra;
+
+	if (ra || !create || !desc->readahead)
+		return ra;
+
+	ra = calloc(1, sizeof(*ra));
+	if (!ra)
+		return NULL;
+	ra->dev = dev;
+	ra->window = CONFIG_BLK_READAHEAD_WINDOW;
+	ra->next = (lbaint_t)-1;
+	desc->ra = ra;
+
+	return ra;
+}
+
+/* Check whether any block device on the same host is reading ahead */
+static bool ra_host_busy(struct udevice *dev)
+{
+	struct udevice *sibling;
+
+	device_foreach_child(sibling, dev_get_parent(dev)) {
+		struct blk_desc *desc;
+
+		if (device_get_uclass_id(sibling) != UCLASS_BLK)
+			continue;
+		desc = dev_get_uclass_plat(sibling);
+		if (desc->ra && desc->ra->busy)
+			return true;
+	}
+
+	return false;
+}
+
+static void ra_thread(void *arg)
+{
+	struct blk_readahead *ra = arg;
+	const struct blk_ops *ops = blk_get_ops(ra->dev);
+	ulong blks_read;
+
+	blks_read = ops->read(ra->dev, ra->start, ra->count, ra->buf);
+	ra->valid = blks_read == ra->count;
+	if (ra->valid)
+		ra->stats.blocks += ra->count;
+	else
+		log_debug("read-ahead of " LBAFU " blocks at " LBAF " failed\n",
+			  ra->count, ra->start);
+	ra->busy = false;
+}
+
+void blk_readahead_wait(struct udevice *dev)
+{
+	while (ra_host_busy(dev))
+		uthread_schedule();
+}
+
+lbaint_t blk_readahead_read(struct udevice *dev, lbaint_t start,
+			    lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = ra_get(dev, false);
+	bool ready = true;
+	lbaint_t count;
+
+	if (!ra || !blkcnt)
+		return 0;
+	if (start < ra->start || start >= ra->start + ra->count) {
+		ra->stats.misses += blkcnt;
+		return 0;
+	}
+
+	if (ra->busy) {
+		ra->stats.waits++;
+		ready = false;
+		blk_readahead_wait(dev);
+	}
+	if (!ra->valid) {
+		ra->stats.misses += blkcnt;
+		return 0;
+	}
+
+	count = min(ra->start + ra->count - start, blkcnt);
+	ra->stats.misses += blkcnt - count;
+	memcpy(buf, ra->buf + (start - ra->start) * desc->blksz,
+	       count * desc->blksz);
+	ra->stats.used += count;
+	if (ready)
+		ra->stats.ready += count;
+
+	return count;
+}
+
+void blk_readahead_done(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = ra_get(dev, true);
+
+	if (!ra || !ra->window)
+		return;
+
+	ra->seq = start == ra->next ? ra->seq + 1 : 0;
+	ra->next = start + blkcnt;
+
+	/* large reads gain nothing from a smaller staging buffer */
+	if (!ra->seq || blkcnt >= ra->window || ra_host_busy(dev))
+		return;
+
+	/* there is still data ahead of the caller */
+	if (ra->valid && ra->next >= ra->start &&
+	    ra->next < ra->start + ra->count)
+		return;
+
+	if (ra->next >= desc->lba)
+		return;
+
+	if (!ra->buf) {
+		ra->buf = memalign(ARCH_DMA_MINALIGN, ra->window * desc->blksz);
+		if (!ra->buf)
+			return;
+	}
+
+	ra->start = ra->next;
+	ra->count = min(ra->window, desc->lba - ra->next);
+	ra->valid = false;
+	ra->busy = true;
+	ra->stats.prefetches++;
+	if (uthread_create(NULL, ra_thread, ra, 0, 0)) {
+		ra->busy = false;
+		ra->count = 0;
+	}
+}
+
+void blk_readahead_invalidate(struct udevice *dev)
+{
+	struct blk_readahead *ra = ra_get(dev, false);
+
+	if (!ra)
+		return;
+	blk_readahead_wait(dev);
+	if (ra->valid)
+		ra->stats.discarded++;
+	ra->valid = false;
+	ra->count = 0;
+	ra->seq = 0;
+}
+
+void blk_readahead_free(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = ra_get(dev, false);
+
+	if (!ra)
+		return;
+	blk_readahead_wait(dev);
+	/* a finished thread keeps its stack until the scheduler next runs */
+	uthread_schedule();
+	free(ra->buf);
+	free(ra);
+	desc->ra = NULL;
+}
+
+int blk_readahead_configure(struct udevice *dev, lbaint_t window)
+{
+	struct blk_readahead *ra = ra_get(dev, true);
+
+	if (!ra)
+		return -ENOSYS;
+	blk_readahead_invalidate(dev);
+	free(ra->buf);
+	ra->buf = NULL;
+	ra->window = window;
+	memset(&ra->stats, '\0', sizeof(ra->stats));
+
+	return 0;
+}
+
+int blk_readahead_get_stats(struct udevice *dev,
+			    struct blk_readahead_stats *stats)
+{
+	struct blk_readahead *ra = ra_get(dev, false);
+
+	if (!ra)
+		return -ENOENT;
+	*stats = ra->stats;
+
+	return 0;
+}
@@ -322,12 +322,23 @@ int blk_show_device(enum uclass_id uclass_id, int devnum)
 int blk_select_hwpart(struct udevice *dev, int hwpart)
 {
 	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_desc *desc;
 
 	if (!ops)
 		return -ENOSYS;
 	if (!ops->select_hwpart)
 		return 0;
 
+	/*
+	 * A read-ahead started before the switch must not finish after it, nor
+	 * its data be taken as coming from the new partition. Drivers select
+	 * the current partition again when reading, so only do this when it
+	 * changes, as this may be called from the read-ahead itself.
+	 */
+	desc = dev_get_uclass_plat(dev);
+	if (hwpart != desc->hwpart)
+		blk_readahead_invalidate(dev);
+
 	return ops->select_hwpart(dev, hwpart);
 }
 
@@ -433,14 +444,28 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
+	lbaint_t first = start, total = blkcnt;
+	ulong blks_read, cached;
 
 	if (!ops->read)
 		return -ENOSYS;
 
-	if (blkcache_read(desc->uclass_id, desc->devnum,
-			  start, blkcnt, desc->blksz, buf))
+	cached = blkcache_read(desc->uclass_id, desc->devnum,
+			       start, blkcnt, desc->blksz, buf);
+	if (cached < blkcnt)
+		cached += blk_readahead_read(dev, start + cached,
+					     blkcnt - cached,
+					     buf + cached * desc->blksz);
+	if (cached == blkcnt) {
+		blk_readahead_done(dev, first, total);
 		return blkcnt;
+	}
+	start += cached;
+	blkcnt -= cached;
+	buf += cached * desc->blksz;
+
+	/* the device cannot be used while it is reading ahead */
+	blk_readahead_wait(dev);
 
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
@@ -460,11 +485,15 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 		blks_read = ops->read(dev, start, blkcnt, buf);
 	}
 
-	if (blks_read == blkcnt)
+	if (blks_read == blkcnt) {
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
+		blk_readahead_done(dev, first, total);
+	} else if (IS_ERR_VALUE(blks_read)) {
+		return blks_read;
+	}
 
-	return blks_read;
+	return cached + blks_read;
 }
 
 long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
@@ -478,6 +507,7 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_readahead_invalidate(dev);
 
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
@@ -510,6 +540,7 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_readahead_invalidate(dev);
 
 	return ops->erase(dev, start, blkcnt);
 }
@@ -841,9 +872,20 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+
+	blkcache_remove(desc->uclass_id, desc->devnum);
+	blk_readahead_free(dev);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
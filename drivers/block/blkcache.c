@@ -11,101 +11,274 @@
 #include <asm/global_data.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
 
-struct block_cache_node {
-	struct list_head lh;
+/*
+ * Entries are hashed on (iftype, devnum, start >> chunk_shift), where a chunk
+ * is at least max_blocks_per_entry blocks. An entry can therefore only cover
+ * a block in its own chunk or the following one, so a lookup needs to probe
+ * two buckets at most, however many entries are cached.
+ */
+#define BLKCACHE_MIN_HASH_BITS	4
+#define BLKCACHE_MAX_HASH_BITS	12
+
+/**
+ * struct block_cache_dev - per-device state of the block cache
+ *
+ * @sibling: Node in block_cache_devs
+ * @lru: Cache entries for this device, most recently used first
+ * @iftype: uclass_id of the device
+ * @devnum: Device number
+ * @entries: Number of entries cached for this device
+ * @bytes: Number of bytes cached for this device
+ * @hits: Reads fully satisfied from the cache
+ * @partials: Reads for which only the leading blocks were cached
+ * @misses: Reads not found in the cache
+ */
+struct block_cache_dev {
+	struct list_head sibling;
+	struct list_head lru;
 	int iftype;
 	int devnum;
+	unsigned entries;
+	unsigned long bytes;
+	unsigned hits;
+	unsigned partials;
+	unsigned misses;
+};
+
+struct block_cache_node {
+	struct hlist_node hash;
+	struct list_head lru;
+	struct block_cache_dev *bdev;
 	lbaint_t start;
 	lbaint_t blkcnt;
 	unsigned long blksz;
 	char *cache;
 };
 
-static LIST_HEAD(block_cache);
+static LIST_HEAD(block_cache_devs);
+static struct hlist_head *block_cache_hash;
+static unsigned block_cache_hash_bits;
+static unsigned block_cache_chunk_shift;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = 32,
+	.max_entries = 128,
+	.max_bytes = SZ_2M,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static int cache_setup(void)
 {
-	struct block_cache_node *node;
-
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
-			return node;
-		}
+	unsigned bits;
+
+	if (block_cache_hash)
+		return 0;
+
+	bits = ilog2(__roundup_pow_of_two(_stats.max_entries));
+	bits = clamp_t(unsigned, bits, BLKCACHE_MIN_HASH_BITS,
+		       BLKCACHE_MAX_HASH_BITS);
+	block_cache_hash = calloc(1 << bits, sizeof(*block_cache_hash));
+	if (!block_cache_hash)
+		return -ENOMEM;
+	block_cache_hash_bits = bits;
+	block_cache_chunk_shift =
+		ilog2(__roundup_pow_of_two(_stats.max_blocks_per_entry));
+
 	return 0;
 }
 
+static struct hlist_head *cache_bucket(int iftype, int devnum, lbaint_t chunk)
+{
+	u64 key = (u64)chunk;
+	u32 hash;
+
+	hash = (u32)key ^ (u32)(key >> 32) ^ ((u32)iftype << 24) ^
+		((u32)devnum << 16);
+	hash *= 0x9e3779b1;
+
+	return &block_cache_hash[hash >> (32 - block_cache_hash_bits)];
+}
+
+static struct block_cache_dev *cache_get_dev(int iftype, int devnum,
+					     bool create)
+{
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache_devs, sibling)
+		if (bdev->iftype == iftype && bdev->devnum == devnum)
+			return bdev;
+	if (!create)
+		return NULL;
+
+	bdev = calloc(1, sizeof(*bdev));
+	if (!bdev)
+		return NULL;
+	bdev->iftype = iftype;
+	bdev->devnum = devnum;
+	INIT_LIST_HEAD(&bdev->lru);
+	list_add_tail(&bdev->sibling, &block_cache_devs);
+
+	return bdev;
+}
+
+/* find the entry covering @start which extends furthest beyond it */
+static struct block_cache_node *cache_find(struct block_cache_dev *bdev,
+					   lbaint_t start, unsigned long blksz)
+{
+	struct block_cache_node *node, *best = NULL;
+	lbaint_t chunk = start >> block_cache_chunk_shift;
+	int i;
+
+	if (!block_cache_hash)
+		return NULL;
+
+	for (i = 0; i < 2 && i <= chunk; i++) {
+		hlist_for_each_entry(node, cache_bucket(bdev->iftype,
+							bdev->devnum,
+							chunk - i), hash) {
+			if (node->bdev != bdev || node->blksz != blksz ||
+			    node->start > start ||
+			    node->start + node->blkcnt <= start)
+				continue;
+			if (!best || node->start + node->blkcnt >
+				     best->start + best->blkcnt)
+				best = node;
+		}
+	}
+
+	return best;
+}
+
+static void cache_unlink(struct block_cache_node *node)
+{
+	struct block_cache_dev *bdev = node->bdev;
+
+	hlist_del(&node->hash);
+	list_del(&node->lru);
+	bdev->entries--;
+	bdev->bytes -= node->blkcnt * node->blksz;
+	_stats.entries--;
+	_stats.bytes -= node->blkcnt * node->blksz;
+}
+
+static void cache_free_node(struct block_cache_node *node)
+{
+	free(node->cache);
+	free(node);
+}
+
+/*
+ * Pick the least-recently-used entry of the device holding the most data, so
+ * that streaming through one device does not flush another device's metadata.
+ */
+static struct block_cache_node *cache_victim(struct block_cache_dev *pref)
+{
+	struct block_cache_dev *bdev, *largest = NULL;
+
+	list_for_each_entry(bdev, &block_cache_devs, sibling) {
+		if (!bdev->entries)
+			continue;
+		if (!largest || bdev->bytes > largest->bytes ||
+		    (bdev == pref && bdev->bytes == largest->bytes))
+			largest = bdev;
+	}
+	if (!largest)
+		return NULL;
+
+	return list_last_entry(&largest->lru, struct block_cache_node, lru);
+}
+
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
+	/* a device is only tracked once something of it is cached */
+	struct block_cache_dev *bdev = cache_get_dev(iftype, devnum, false);
+	struct block_cache_node *node = NULL;
+	lbaint_t count;
+
+	if (bdev)
+		node = cache_find(bdev, start, blksz);
+	if (!node) {
+		debug("miss: start " LBAF ", count " LBAFU "\n",
+		      start, blkcnt);
+		++_stats.misses;
+		if (bdev)
+			++bdev->misses;
+		return 0;
+	}
+
+	count = min(node->start + node->blkcnt - start, blkcnt);
+	memcpy(buffer, node->cache + (start - node->start) * blksz,
+	       blksz * count);
+	if (bdev->lru.next != &node->lru) {
+		/* maintain MRU ordering */
+		list_del(&node->lru);
+		list_add(&node->lru, &bdev->lru);
+	}
+
+	if (count == blkcnt) {
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
 		++_stats.hits;
-		return 1;
+		++bdev->hits;
+	} else {
+		debug("partial: start " LBAF ", count " LBAFU "/" LBAFU "\n",
+		      start, count, blkcnt);
+		++_stats.partials;
+		++bdev->partials;
 	}
 
-	debug("miss: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-	++_stats.misses;
-	return 0;
+	return count;
 }
 
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
+	struct block_cache_node *node = NULL, *victim;
+	struct block_cache_dev *bdev;
 	lbaint_t bytes;
-	struct block_cache_node *node;
 
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (!blkcnt || blkcnt > _stats.max_blocks_per_entry)
 		return;
 
 	if (_stats.max_entries == 0)
 		return;
 
 	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
+	if (bytes > _stats.max_bytes)
+		return;
+
+	if (cache_setup())
+		return;
+
+	bdev = cache_get_dev(iftype, devnum, true);
+	if (!bdev)
+		return;
+
+	while (_stats.entries >= _stats.max_entries ||
+	       _stats.bytes + bytes > _stats.max_bytes) {
+		victim = cache_victim(bdev);
+		if (!victim)
+			break;
 		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
+		      victim->start, victim->blkcnt);
+		cache_unlink(victim);
+		/* recycle a buffer of the right size */
+		if (!node && victim->blkcnt * victim->blksz == bytes)
+			node = victim;
+		else
+			cache_free_node(victim);
+	}
+
+	if (!node) {
 		node = malloc(sizeof(*node));
 		if (!node)
 			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
 		node->cache = malloc(bytes);
 		if (!node->cache) {
 			free(node);
@@ -116,44 +289,74 @@ void blkcache_fill(int iftype, int devnum,
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
+	node->bdev = bdev;
 	node->start = start;
 	node->blkcnt = blkcnt;
 	node->blksz = blksz;
 	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
+	hlist_add_head(&node->hash,
+		       cache_bucket(iftype, devnum,
+				    start >> block_cache_chunk_shift));
+	list_add(&node->lru, &bdev->lru);
+	bdev->entries++;
+	bdev->bytes += bytes;
 	_stats.entries++;
+	_stats.bytes += bytes;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
-
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+	struct block_cache_node *node, *n;
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache_devs, sibling) {
+		if (iftype != -1 &&
+		    (bdev->iftype != iftype || bdev->devnum != devnum))
+			continue;
+		list_for_each_entry_safe(node, n, &bdev->lru, lru) {
+			cache_unlink(node);
+			cache_free_node(node);
 		}
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_remove(int iftype, int devnum)
+{
+	struct block_cache_dev *bdev;
+
+	bdev = cache_get_dev(iftype, devnum, false);
+	if (!bdev)
+		return;
+	blkcache_invalidate(iftype, devnum);
+	list_del(&bdev->sibling);
+	free(bdev);
+
+	/* the hash table is set up again when something is next cached */
+	if (list_empty(&block_cache_devs)) {
+		free(block_cache_hash);
+		block_cache_hash = NULL;
+	}
+}
+
+void blkcache_configure(unsigned blocks, unsigned entries,
+			unsigned long bytes)
 {
 	/* invalidate cache if there is a change */
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
+	    (entries != _stats.max_entries) ||
+	    (bytes != _stats.max_bytes)) {
 		blkcache_invalidate(-1, 0);
+		/* the hash geometry depends on the limits */
+		free(block_cache_hash);
+		block_cache_hash = NULL;
+	}
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
+	_stats.max_bytes = bytes;
 
 	_stats.hits = 0;
+	_stats.partials = 0;
 	_stats.misses = 0;
 }
 
@@ -161,10 +364,43 @@ void blkcache_stats(struct block_cache_stats *stats)
 {
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
+	_stats.partials = 0;
 	_stats.misses = 0;
 }
 
+int blkcache_dev_stats(struct block_cache_dev_stats *stats, int max)
+{
+	struct block_cache_dev *bdev;
+	int count = 0;
+
+	list_for_each_entry(bdev, &block_cache_devs, sibling) {
+		if (count < max) {
+			stats[count].iftype = bdev->iftype;
+			stats[count].devnum = bdev->devnum;
+			stats[count].hits = bdev->hits;
+			stats[count].partials = bdev->partials;
+			stats[count].misses = bdev->misses;
+			stats[count].entries = bdev->entries;
+			stats[count].bytes = bdev->bytes;
+		}
+		bdev->hits = 0;
+		bdev->partials = 0;
+		bdev->misses = 0;
+		count++;
+	}
+
+	return count;
+}
+
 void blkcache_free(void)
 {
+	struct block_cache_dev *bdev, *n;
+
 	blkcache_invalidate(-1, 0);
+	list_for_each_entry_safe(bdev, n, &block_cache_devs, sibling) {
+		list_del(&bdev->sibling);
+		free(bdev);
+	}
+	free(block_cache_hash);
+	block_cache_hash = NULL;
 }
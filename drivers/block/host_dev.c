@@ -118,6 +118,7 @@ static int host_sb_bind(struct udevice *dev)
 	snprintf(desc->vendor, BLK_VEN_SIZE, "U-Boot");
 	snprintf(desc->product, BLK_PRD_SIZE, "hostfile");
 	snprintf(desc->revision, BLK_REV_SIZE, "1.0");
+	desc->readahead = 1;
 
 	if (CONFIG_IS_ENABLED(BOOTSTD)) {
 		ret = bootdev_bind(dev, "host_bootdev", "bootdev", &bdev);
@@ -17,6 +17,7 @@
 #include <scsi.h>
 #include <part.h>
 #include <command.h>
+#include <ufs.h>
 #include <linux/printk.h>
 
 static unsigned char *dfu_file_buf;
@@ -74,6 +75,24 @@ static int scsi_block_op(enum dfu_op op, struct dfu_entity *dfu, u64 offset, voi
 	return 0;
 }
 
+/* Let a UFS device run at full speed from the first write until the flush */
+static void scsi_bulk(struct dfu_entity *dfu, bool begin)
+{
+	struct udevice *scsi, *ufs;
+
+	if (find_scsi_device(dfu->data.scsi.lun, &scsi) < 0)
+		return;
+
+	ufs = ufs_blk_host(scsi_get_blk_desc(scsi));
+	if (!ufs)
+		return;
+
+	if (begin)
+		ufs_bulk_begin(ufs);
+	else
+		ufs_bulk_end(ufs, NULL);
+}
+
 static int scsi_file_op(enum dfu_op op, struct dfu_entity *dfu, u64 offset, void *buf, u64 *len)
 {
 	char dev_part_str[8];
@@ -179,6 +198,7 @@ int dfu_write_medium_scsi(struct dfu_entity *dfu, u64 offset, void *buf, long *l
 
 	switch (dfu->layout) {
 	case DFU_RAW_ADDR:
+		scsi_bulk(dfu, true);
 		ret = scsi_block_op(DFU_OP_WRITE, dfu, offset, buf, len);
 		break;
 	case DFU_FS_FAT:
@@ -213,6 +233,8 @@ int dfu_flush_medium_scsi(struct dfu_entity *dfu)
 		dfu_reinit_needed = true;
 		break;
 	case DFU_RAW_ADDR:
+		scsi_bulk(dfu, false);
+		break;
 	case DFU_SKIP:
 		break;
 	default:
@@ -11,6 +11,7 @@
 #include <image-sparse.h>
 #include <part.h>
 #include <malloc.h>
+#include <ufs.h>
 
 /**
  * FASTBOOT_MAX_BLOCKS_ERASE - maximum blocks to erase per derase call
@@ -309,10 +310,16 @@ void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 {
 	struct blk_desc *dev_desc;
 	struct disk_partition part_info;
+	struct udevice *ufs;
 
 	if (fastboot_block_get_part_info(part_name, &dev_desc, &part_info, response) < 0)
 		return;
 
+	/* let UFS run at full speed while the image is written */
+	ufs = ufs_blk_host(dev_desc);
+	if (ufs)
+		ufs_bulk_begin(ufs);
+
 	if (is_sparse_image(download_buffer)) {
 		fastboot_block_write_sparse_image(dev_desc, &part_info, part_name,
 						  download_buffer, response);
@@ -320,4 +327,7 @@ void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 		fastboot_block_write_raw_image(dev_desc, &part_info, part_name,
 					       download_buffer, download_bytes, response);
 	}
+
+	if (ufs)
+		ufs_bulk_end(ufs, NULL);
 }
@@ -52,6 +52,19 @@ static int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 
 int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 {
+	/*
+	 * Only queued tasks are accepted in command queueing mode, so leave it
+	 * first. There is no need to tell a card which is about to be reset.
+	 */
+	if (mmc_cqe_on(mmc)) {
+		int ret;
+
+		ret = mmc_cqe_disable(mmc,
+				      cmd->cmdidx != MMC_CMD_GO_IDLE_STATE);
+		if (ret)
+			return ret;
+	}
+
 	return dm_mmc_send_cmd(mmc->dev, cmd, data);
 }
 
@@ -287,6 +300,9 @@ int mmc_of_parse(struct udevice *dev, struct mmc_config *cfg)
 			cfg->host_caps |= MMC_CAP_NEEDS_POLL;
 	}
 
+	if (dev_read_bool(dev, "supports-cqe"))
+		cfg->host_caps |= MMC_CAP_CQE;
+
 	if (dev_read_bool(dev, "no-1-8-v")) {
 		cfg->host_caps &= ~(UHS_CAPS | MMC_MODE_HS200 |
 				    MMC_MODE_HS400 | MMC_MODE_HS400_ES);
@@ -453,6 +469,7 @@ int mmc_bind(struct udevice *dev, struct mmc *mmc, const struct mmc_config *cfg)
 	mmc->dsr = 0xffffffff;
 	/* Setup the universal parts of the block interface just once */
 	bdesc->removable = 1;
+	bdesc->readahead = 1;
 
 	/* setup initial part type */
 	bdesc->part_type = cfg->part_type;
@@ -519,6 +536,9 @@ static int mmc_remove(struct udevice *dev)
 	struct mmc_uclass_priv *upriv = dev_get_uclass_priv(dev);
 	struct mmc *mmc = upriv->mmc;
 
+	if (mmc_cqe_on(mmc))
+		mmc_cqe_disable(mmc, true);
+
 	return mmc_deinit(mmc);
 }
 
@@ -542,6 +542,9 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		return 0;
 	}
 
+	if (mmc_cqe_usable(mmc, block_dev->hwpart))
+		return mmc_cqe_rw(mmc, start, blkcnt, dst, false);
+
 	if (mmc_set_blocklen(mmc, mmc->read_bl_len)) {
 		pr_debug("%s: Failed to set blocklen\n", __func__);
 		return 0;
@@ -2688,6 +2691,7 @@ static int mmc_startup(struct mmc *mmc)
 	err = mmc_startup_v4(mmc);
 	if (err)
 		return err;
+	mmc_cqe_init(mmc);
 
 	err = mmc_set_capacity(mmc, mmc_get_blk_desc(mmc)->hwpart);
 	if (err)
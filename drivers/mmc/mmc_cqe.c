@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * eMMC command queueing
+ *
+ * Block transfers are split into data tasks which are queued on the card
+ * through the command queue engine (CQE) of the host. The card works through
+ * the queue by itself, so the next task starts as soon as one is done rather
+ * than when the host gets round to sending the next command.
+ */
+
+#define LOG_CATEGORY UCLASS_MMC
+
+#include <blk.h>
+#include <dm.h>
+#include <log.h>
+#include <mmc.h>
+#include <time.h>
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include "mmc_private.h"
+
+/* Largest queue allowed by the spec, one bit per tag in the doorbell */
+#define MMC_CQE_MAX_DEPTH	32
+/* The task descriptor has a 16-bit block count */
+#define MMC_CQE_MAX_BLOCKS	0xffff
+/* Time allowed for the next queued task to complete */
+#define MMC_CQE_TIMEOUT_US	(5 * 1000 * 1000)
+
+void mmc_cqe_init(struct mmc *mmc)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+	const u8 *ext_csd = mmc->ext_csd;
+
+	mmc->cqe_depth = 0;
+	if (!(mmc->host_caps & MMC_CAP_CQE) || !ops->cqe_enable ||
+	    !ops->cqe_submit || !ops->cqe_wait)
+		return;
+	if (IS_SD(mmc) || mmc->version < MMC_VERSION_5_1 || !ext_csd ||
+	    !(ext_csd[EXT_CSD_CMDQ_SUPPORT] & EXT_CSD_CMDQ_SUPPORTED))
+		return;
+
+	mmc->cqe_depth = (ext_csd[EXT_CSD_CMDQ_DEPTH] &
+			  EXT_CSD_CMDQ_DEPTH_MASK) + 1;
+	log_debug("%s: command queue depth %u\n", mmc->cfg->name,
+		  mmc->cqe_depth);
+}
+
+static int mmc_cqe_enable(struct mmc *mmc)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+	int ret;
+
+	ret = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN,
+			 EXT_CSD_CMDQ_MODE_ENABLED);
+	if (ret)
+		return ret;
+
+	ret = ops->cqe_enable(mmc->dev, true);
+	if (ret) {
+		mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 0);
+		return ret;
+	}
+	mmc->cqe_on = true;
+
+	return 0;
+}
+
+int mmc_cqe_disable(struct mmc *mmc, bool card)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+	int ret;
+
+	/* the switch below is a legacy command, so clear this first */
+	mmc->cqe_on = false;
+	ret = ops->cqe_enable(mmc->dev, false);
+	if (ret || !card)
+		return ret;
+
+	return mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 0);
+}
+
+ulong mmc_cqe_rw(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt, void *buf,
+		 bool write)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+	struct mmc_cqe_stats *stats = write ? &mmc->cqe_write : &mmc->cqe_read;
+	struct mmc_cqe_task tasks[MMC_CQE_MAX_DEPTH];
+	u32 all = GENMASK(mmc->cqe_depth - 1, 0);
+	u32 pending = 0, done, errors, tags;
+	uint blksz = mmc->read_bl_len;
+	lbaint_t b_max, todo = blkcnt;
+	bool failed = false;
+	ulong begin;
+	int ret = 0;
+
+	if (!mmc->cqe_on) {
+		ret = mmc_cqe_enable(mmc);
+		if (ret) {
+			log_err("MMC: cannot enable command queue (err=%d)\n",
+				ret);
+			return 0;
+		}
+	}
+
+	b_max = min_t(lbaint_t, mmc_get_b_max(mmc, buf, blkcnt),
+		      MMC_CQE_MAX_BLOCKS);
+	begin = timer_get_us();
+	do {
+		/* fill every free slot, then ring the doorbell once */
+		for (tags = 0; todo && !failed && (pending | tags) != all;) {
+			uint tag = ffs(~(pending | tags)) - 1;
+			struct mmc_cqe_task *task = &tasks[tag];
+
+			task->dest = buf;
+			task->flags = write ? MMC_DATA_WRITE : MMC_DATA_READ;
+			task->blkaddr = mmc->high_capacity ? start :
+				start * blksz;
+			task->blocks = min(todo, b_max);
+			tags |= BIT(tag);
+			todo -= task->blocks;
+			start += task->blocks;
+			buf += task->blocks * blksz;
+		}
+		if (tags) {
+			ret = ops->cqe_submit(mmc->dev, tasks, tags);
+			if (ret)
+				break;
+			pending |= tags;
+			stats->max_depth = max_t(uint, stats->max_depth,
+						 hweight32(pending));
+		}
+
+		ret = ops->cqe_wait(mmc->dev, &done, &errors,
+				    MMC_CQE_TIMEOUT_US);
+		if (ret)
+			break;
+		done &= pending;
+		pending &= ~done;
+		while (done) {
+			uint tag = ffs(done) - 1;
+			struct mmc_cqe_task *task = &tasks[tag];
+
+			done &= ~BIT(tag);
+			if (errors & BIT(tag)) {
+				printf("MMC: queued %s of %u blocks at %#x failed\n",
+				       write ? "write" : "read", task->blocks,
+				       task->blkaddr);
+				failed = true;
+				continue;
+			}
+			stats->tasks++;
+			stats->bytes += (u64)task->blocks * blksz;
+		}
+	} while ((todo && !failed) || pending);
+	stats->time_us += timer_get_us() - begin;
+
+	if (ret || failed) {
+		if (ret)
+			log_err("MMC: command queue failed (err=%d)\n", ret);
+		/* discard anything still queued and go back to legacy mode */
+		mmc_cqe_disable(mmc, true);
+		return 0;
+	}
+
+	return blkcnt;
+}
@@ -88,6 +88,74 @@ static inline void mmc_trace_state(struct mmc *mmc, struct mmc_cmd *cmd)
 }
 #endif
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+/**
+ * mmc_cqe_init() - Decide whether to use the command queue of a card
+ *
+ * @mmc:	MMC device, whose EXT_CSD has been read
+ */
+void mmc_cqe_init(struct mmc *mmc);
+
+/**
+ * mmc_cqe_disable() - Leave command queueing mode
+ *
+ * @mmc:	MMC device
+ * @card:	Switch the card out of queueing mode too; false if it is about
+ *		to be reset
+ * Return: 0 if OK, -ve on error
+ */
+int mmc_cqe_disable(struct mmc *mmc, bool card);
+
+/**
+ * mmc_cqe_rw() - Transfer blocks through the command queue
+ *
+ * @mmc:	MMC device
+ * @start:	First block to transfer
+ * @blkcnt:	Number of blocks to transfer
+ * @buf:	Buffer to read into or write from
+ * @write:	true to write, false to read
+ * Return: number of blocks transferred, 0 on error
+ */
+ulong mmc_cqe_rw(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt, void *buf,
+		 bool write);
+
+static inline bool mmc_cqe_on(struct mmc *mmc)
+{
+	return mmc->cqe_on;
+}
+
+/* The command queue cannot be used with the RPMB partition */
+static inline bool mmc_cqe_usable(struct mmc *mmc, int hwpart)
+{
+	return mmc->cqe_depth && hwpart != MMC_PART_RPMB;
+}
+#else
+static inline void mmc_cqe_init(struct mmc *mmc)
+{
+}
+
+static inline int mmc_cqe_disable(struct mmc *mmc, bool card)
+{
+	return 0;
+}
+
+static inline ulong mmc_cqe_rw(struct mmc *mmc, lbaint_t start,
+			       lbaint_t blkcnt, void *buf, bool write)
+{
+	return 0;
+}
+
+static inline bool mmc_cqe_on(struct mmc *mmc)
+{
+	return false;
+}
+
+static inline bool mmc_cqe_usable(struct mmc *mmc, int hwpart)
+{
+	return false;
+}
+#endif
+
 /**
  * mmc_get_next_devnum() - Get the next available MMC device number
  *
@@ -237,6 +237,9 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	if (err < 0)
 		return 0;
 
+	if (mmc_cqe_usable(mmc, block_dev->hwpart))
+		return mmc_cqe_rw(mmc, start, blkcnt, (void *)src, true);
+
 	if (mmc_set_blocklen(mmc, mmc->write_bl_len))
 		return 0;
 
@@ -12,6 +12,8 @@
 #include <mmc.h>
 #include <os.h>
 #include <asm/test.h>
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
 
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
@@ -26,16 +28,49 @@ struct sandbox_mmc_plat {
 /* Granularity of priv->csize - this is 1MB */
 #define SIZE_MULTIPLE		((1 << (MMC_CMULT + 2)) * MMC_BL_LEN)
 
+/* Largest transfer of the emulated eMMC host, in blocks (32KiB) */
+#define EMMC_B_MAX		64
+/* Number of tasks the emulated eMMC can queue */
+#define EMMC_CQE_DEPTH		16
+
+enum sandbox_mmc_type {
+	SANDBOX_SD,
+	SANDBOX_EMMC,	/* eMMC 5.1 device with a command queue */
+};
+
 struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	bool emmc;
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
+	/* command queue engine */
+	bool cqe_enabled;
+	struct mmc_cqe_task cqe_tasks[EMMC_CQE_DEPTH];
+	u32 cqe_queued;
+	uint cqe_doorbells;
+	uint cqe_count;
+	uint cqe_max_depth;
 };
 
+/* Switch command of eMMC, which only supports writing a byte */
+static int sandbox_emmc_switch(struct sandbox_mmc_priv *priv,
+			       struct mmc_cmd *cmd)
+{
+	uint index = (cmd->cmdarg >> 16) & 0xff;
+
+	if ((cmd->cmdarg >> 24) != MMC_SWITCH_MODE_WRITE_BYTE)
+		return -EINVAL;
+	priv->ext_csd[index] = (cmd->cmdarg >> 8) & 0xff;
+
+	return 0;
+}
+
 /**
- * sandbox_mmc_send_cmd() - Emulate SD commands
+ * sandbox_mmc_send_cmd() - Emulate SD and eMMC commands
  *
- * This emulate an SD card version 2. Single-block reads result in zero data.
+ * This emulate an SD card version 2, or an eMMC 5.1 device for the
+ * "sandbox,emmc" compatible. Single-block reads result in zero data.
  * Multiple-block reads return a test string.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
@@ -44,19 +79,41 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 	static ulong erase_start, erase_end;
 
+	/* in command queueing mode the eMMC only takes a switch or status */
+	if (priv->ext_csd[EXT_CSD_CMDQ_MODE_EN] &&
+	    cmd->cmdidx != MMC_CMD_GO_IDLE_STATE &&
+	    cmd->cmdidx != MMC_CMD_SWITCH &&
+	    cmd->cmdidx != MMC_CMD_SEND_STATUS)
+		return -EIO;
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		memset(cmd->response, '\0', sizeof(cmd->response));
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		priv->ext_csd[EXT_CSD_CMDQ_MODE_EN] = 0;
+		break;
+	case MMC_CMD_SEND_OP_COND:
+		if (!priv->emmc)
+			return -ETIMEDOUT;
+		cmd->response[0] = OCR_BUSY | OCR_HCS | MMC_VDD_32_33 |
+				   MMC_VDD_33_34;
 		break;
 	case SD_CMD_SEND_IF_COND:
+		if (priv->emmc) {
+			/* this is SEND_EXT_CSD on eMMC */
+			if (!data)
+				return -ETIMEDOUT;
+			memcpy(data->dest, priv->ext_csd, sizeof(priv->ext_csd));
+			break;
+		}
 		cmd->response[0] = 0xaa;
 		break;
 	case MMC_CMD_SEND_STATUS:
-		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA | MMC_STATE_TRANS;
 		break;
 	case MMC_CMD_SELECT_CARD:
 		break;
@@ -66,8 +123,15 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				   ((priv->csize >> 16) & 0x3f);
 		cmd->response[2] = (priv->csize & 0xffff) << 16;
 		cmd->response[3] = 0;
+		if (priv->emmc) {
+			/* SPEC_VERS 4 and WRITE_BL_LEN */
+			cmd->response[0] = 4 << 26;
+			cmd->response[3] = MMC_BL_LEN_SHIFT << 22;
+		}
 		break;
 	case SD_CMD_SWITCH_FUNC: {
+		if (priv->emmc)
+			return sandbox_emmc_switch(priv, cmd);
 		if (!data)
 			break;
 		u32 *resp = (u32 *)data->dest;
@@ -90,9 +154,11 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case MMC_CMD_STOP_TRANSMISSION:
 		break;
 	case SD_CMD_ERASE_WR_BLK_START:
+	case MMC_CMD_ERASE_GROUP_START:
 		erase_start = cmd->cmdarg;
 		break;
 	case SD_CMD_ERASE_WR_BLK_END:
+	case MMC_CMD_ERASE_GROUP_END:
 		erase_end = cmd->cmdarg;
 		break;
 #if CONFIG_IS_ENABLED(MMC_WRITE)
@@ -110,6 +176,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[2] = 0;
 		break;
 	case MMC_CMD_APP_CMD:
+		if (priv->emmc)
+			return -ETIMEDOUT;
 		break;
 	case MMC_CMD_SET_BLOCKLEN:
 		debug("block len %d\n", cmd->cmdarg);
@@ -138,12 +206,112 @@ static int sandbox_mmc_get_cd(struct udevice *dev)
 	return 1;
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static int sandbox_mmc_cqe_enable(struct udevice *dev, bool enable)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (!priv->emmc)
+		return -ENOSYS;
+	priv->cqe_enabled = enable;
+	if (!enable)
+		priv->cqe_queued = 0;
+
+	return 0;
+}
+
+static int sandbox_mmc_cqe_submit(struct udevice *dev,
+				  const struct mmc_cqe_task *tasks, u32 tags)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	uint tag;
+
+	if (!priv->cqe_enabled || !priv->ext_csd[EXT_CSD_CMDQ_MODE_EN])
+		return -EIO;
+	if ((tags & priv->cqe_queued) || tags >= BIT(EMMC_CQE_DEPTH))
+		return -EINVAL;
+
+	for (tag = 0; tag < EMMC_CQE_DEPTH; tag++) {
+		if (tags & BIT(tag))
+			priv->cqe_tasks[tag] = tasks[tag];
+	}
+	priv->cqe_queued |= tags;
+	priv->cqe_doorbells++;
+	priv->cqe_count += hweight32(tags);
+	priv->cqe_max_depth = max_t(uint, priv->cqe_max_depth,
+				    hweight32(priv->cqe_queued));
+
+	return 0;
+}
+
+/* The emulated engine runs every queued task before reporting completion */
+static int sandbox_mmc_cqe_wait(struct udevice *dev, u32 *donep,
+				u32 *errorsp, int timeout_us)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u32 errors = 0;
+	uint tag;
+
+	if (!priv->cqe_queued)
+		return -ETIMEDOUT;
+
+	for (tag = 0; tag < EMMC_CQE_DEPTH; tag++) {
+		const struct mmc_cqe_task *task = &priv->cqe_tasks[tag];
+		ulong offset = (ulong)task->blkaddr * MMC_MAX_BLOCK_LEN;
+		ulong len = task->blocks * MMC_MAX_BLOCK_LEN;
+
+		if (!(priv->cqe_queued & BIT(tag)))
+			continue;
+		if (offset + len > priv->size)
+			errors |= BIT(tag);
+		else if (task->flags & MMC_DATA_WRITE)
+			memcpy(&priv->buf[offset], task->src, len);
+		else
+			memcpy(task->dest, &priv->buf[offset], len);
+	}
+	*donep = priv->cqe_queued;
+	*errorsp = errors;
+	priv->cqe_queued = 0;
+
+	return 0;
+}
+#endif
+
+void sandbox_mmc_get_cqe_stats(struct udevice *dev, uint *doorbellsp,
+			       uint *tasksp, uint *max_depthp)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	*doorbellsp = priv->cqe_doorbells;
+	*tasksp = priv->cqe_count;
+	*max_depthp = priv->cqe_max_depth;
+}
+
 static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	.cqe_enable = sandbox_mmc_cqe_enable,
+	.cqe_submit = sandbox_mmc_cqe_submit,
+	.cqe_wait = sandbox_mmc_cqe_wait,
+#endif
 };
 
+/* Set up the EXT_CSD of an eMMC 5.1 device with a command queue */
+static void sandbox_emmc_init(struct sandbox_mmc_priv *priv)
+{
+	u32 sectors = priv->size / MMC_MAX_BLOCK_LEN;
+	u8 *ext_csd = priv->ext_csd;
+
+	ext_csd[EXT_CSD_REV] = 8;
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+				     EXT_CSD_CARD_TYPE_52;
+	put_unaligned_le32(sectors, &ext_csd[EXT_CSD_SEC_CNT]);
+	ext_csd[EXT_CSD_CMDQ_SUPPORT] = EXT_CSD_CMDQ_SUPPORTED;
+	ext_csd[EXT_CSD_CMDQ_DEPTH] = EMMC_CQE_DEPTH - 1;
+}
+
 static int sandbox_mmc_of_to_plat(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_plat(dev);
@@ -169,6 +337,7 @@ static int sandbox_mmc_probe(struct udevice *dev)
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 	int ret;
 
+	priv->emmc = dev_get_driver_data(dev) == SANDBOX_EMMC;
 	if (plat->fname) {
 		ret = os_map_file(plat->fname, OS_O_RDWR | OS_O_CREAT,
 				  (void **)&priv->buf, &priv->size);
@@ -189,6 +358,8 @@ static int sandbox_mmc_probe(struct udevice *dev)
 			return -ENOMEM;
 		}
 	}
+	if (priv->emmc)
+		sandbox_emmc_init(priv);
 
 	return mmc_init(&plat->mmc);
 }
@@ -217,6 +388,8 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
 	cfg->b_max = U32_MAX;
+	if (dev_get_driver_data(dev) == SANDBOX_EMMC)
+		cfg->b_max = EMMC_B_MAX;
 
 	return mmc_bind(dev, &plat->mmc, cfg);
 }
@@ -229,7 +402,8 @@ static int sandbox_mmc_unbind(struct udevice *dev)
 }
 
 static const struct udevice_id sandbox_mmc_ids[] = {
-	{ .compatible = "sandbox,mmc" },
+	{ .compatible = "sandbox,mmc", .data = SANDBOX_SD },
+	{ .compatible = "sandbox,emmc", .data = SANDBOX_EMMC },
 	{ }
 };
 
@@ -1164,6 +1164,44 @@ static int mtk_eth_send(struct udevice *dev, void *packet, int length)
 	return 0;
 }
 
+static u32 mtk_eth_rxd_len(struct mtk_eth_priv *priv,
+			   struct mtk_rx_dma_v2 *rxd)
+{
+	if (MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V2) ||
+	    MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V3))
+		return PDMA_V2_RXD2_PLEN0_GET(rxd->rxd2);
+
+	return PDMA_V1_RXD2_PLEN0_GET(rxd->rxd2);
+}
+
+/* Make a descriptor ready to receive another packet */
+static void mtk_eth_rxd_reset(struct mtk_eth_priv *priv,
+			      struct mtk_rx_dma_v2 *rxd)
+{
+	if (MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V2) ||
+	    MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V3))
+		rxd->rxd2 = PDMA_V2_RXD2_PLEN0_SET(PKTSIZE_ALIGN);
+	else
+		rxd->rxd2 = PDMA_V1_RXD2_PLEN0_SET(PKTSIZE_ALIGN);
+}
+
+/*
+ * Invalidate the buffers of @count descriptors from @idx. The buffers are
+ * laid out in ring order, so this takes one range, or two if the ring wraps.
+ */
+static void mtk_eth_rx_invalidate(struct mtk_eth_priv *priv, u32 idx,
+				  int count)
+{
+	ulong base = (ulong)priv->pkt_pool + TX_TOTAL_BUF_SIZE;
+	int part = min_t(int, count, NUM_RX_DESC - idx);
+
+	invalidate_dcache_range(base + idx * PKTSIZE_ALIGN,
+				base + (idx + part) * PKTSIZE_ALIGN);
+	if (count > part)
+		invalidate_dcache_range(base,
+					base + (count - part) * PKTSIZE_ALIGN);
+}
+
 static int mtk_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct mtk_eth_priv *priv = dev_get_priv(dev);
@@ -1179,11 +1217,7 @@ static int mtk_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		return -EAGAIN;
 	}
 
-	if (MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V2) ||
-	    MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V3))
-		length = PDMA_V2_RXD2_PLEN0_GET(rxd->rxd2);
-	else
-		length = PDMA_V1_RXD2_PLEN0_GET(rxd->rxd2);
+	length = mtk_eth_rxd_len(priv, rxd);
 
 	pkt_base = (void *)phys_to_virt(rxd->rxd1);
 	invalidate_dcache_range((ulong)pkt_base, (ulong)pkt_base +
@@ -1206,11 +1240,7 @@ static int mtk_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	invalidate_dcache_range((ulong)rxd->rxd1,
 				(ulong)rxd->rxd1 + PKTSIZE_ALIGN);
 
-	if (MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V2) ||
-	    MTK_HAS_CAPS(priv->soc->caps, MTK_NETSYS_V3))
-		rxd->rxd2 = PDMA_V2_RXD2_PLEN0_SET(PKTSIZE_ALIGN);
-	else
-		rxd->rxd2 = PDMA_V1_RXD2_PLEN0_SET(PKTSIZE_ALIGN);
+	mtk_eth_rxd_reset(priv, rxd);
 
 	mtk_pdma_write(priv, RX_CRX_IDX_REG(0), idx);
 	priv->rx_dma_owner_idx0 = (priv->rx_dma_owner_idx0 + 1) % NUM_RX_DESC;
@@ -1218,6 +1248,55 @@ static int mtk_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	return 0;
 }
 
+static int mtk_eth_recv_batch(struct udevice *dev, int flags,
+			      struct eth_rx_pkt *pkts, int max)
+{
+	struct mtk_eth_priv *priv = dev_get_priv(dev);
+	u32 idx = priv->rx_dma_owner_idx0;
+	struct mtk_rx_dma_v2 *rxd;
+	int count;
+
+	for (count = 0; count < max && count < NUM_RX_DESC; count++) {
+		rxd = priv->rx_ring_noc + idx * priv->soc->rxd_size;
+		if (!(rxd->rxd2 & PDMA_RXD2_DDONE))
+			break;
+
+		pkts[count].packet = (void *)phys_to_virt(rxd->rxd1);
+		pkts[count].len = mtk_eth_rxd_len(priv, rxd);
+		pkts[count].placed = NULL;
+		idx = (idx + 1) % NUM_RX_DESC;
+	}
+	if (!count)
+		return -EAGAIN;
+
+	mtk_eth_rx_invalidate(priv, priv->rx_dma_owner_idx0, count);
+
+	return count;
+}
+
+static int mtk_eth_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts,
+			      int count)
+{
+	struct mtk_eth_priv *priv = dev_get_priv(dev);
+	u32 idx = priv->rx_dma_owner_idx0;
+	int i;
+
+	mtk_eth_rx_invalidate(priv, idx, count);
+
+	for (i = 0; i < count; i++) {
+		mtk_eth_rxd_reset(priv, priv->rx_ring_noc +
+				  idx * priv->soc->rxd_size);
+		idx = (idx + 1) % NUM_RX_DESC;
+	}
+
+	/* Hand all of them back to the DMA with a single register write */
+	mtk_pdma_write(priv, RX_CRX_IDX_REG(0),
+		       (idx + NUM_RX_DESC - 1) % NUM_RX_DESC);
+	priv->rx_dma_owner_idx0 = idx;
+
+	return 0;
+}
+
 static int mtk_eth_probe(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev_get_plat(dev);
@@ -1557,6 +1636,8 @@ static const struct eth_ops mtk_eth_ops = {
 	.recv = mtk_eth_recv,
 	.free_pkt = mtk_eth_free_pkt,
 	.write_hwaddr = mtk_eth_write_hwaddr,
+	.recv_batch = mtk_eth_recv_batch,
+	.free_batch = mtk_eth_free_batch,
 };
 
 U_BOOT_DRIVER(mtk_eth) = {
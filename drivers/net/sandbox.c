@@ -13,6 +13,7 @@
 #include <asm/global_data.h>
 #include <asm/test.h>
 #include <asm/types.h>
+#include <net/stats.h>
 
 /*
  * Structure definitions for network protocols. Since this file is used for
@@ -146,8 +147,10 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		net_stats_rx_drop(1);
 		return 0;
+	}
 
 	/* store this as the assumed IP of the fake host */
 	arpd = (struct arpdata *)(arp + 1);
@@ -210,8 +213,10 @@ int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		net_stats_rx_drop(1);
 		return 0;
+	}
 
 	/* reply to the ping */
 	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
@@ -331,6 +336,31 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	return 0;
 }
 
+/*
+ * sandbox_eth_arp_handler()
+ *
+ * Answer an ARP request sent by U-Boot, as a tx handler for a fake host
+ *
+ * returns 0 if answered, -EPROTONOSUPPORT if this is not an ARP request
+ */
+int sandbox_eth_arp_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
+	int ret;
+
+	if (ntohs(arp->ar_op) != ARPOP_REQUEST)
+		return -EPROTONOSUPPORT;
+
+	priv->fake_host_ipaddr = net_read_ip(&arp->ar_spa);
+	ret = sandbox_eth_recv_arp_req(dev);
+	if (ret)
+		return ret;
+
+	return sandbox_eth_arp_req_to_reply(dev, packet, len);
+}
+
 /*
  * sb_default_handler()
  *
@@ -397,6 +427,65 @@ void sandbox_eth_set_priv(int index, void *priv)
 	dev_priv->priv = priv;
 }
 
+/*
+ * Set the delay before a packet queued by the tx handler is received
+ *
+ * delay_ms - delay in milliseconds, 0 to receive packets immediately
+ */
+void sandbox_eth_set_recv_delay(int index, ulong delay_ms)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->recv_delay = delay_ms;
+}
+
+void sandbox_eth_disable_rx_dest(int index, bool disable)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->no_rx_dest = disable;
+}
+
+void sandbox_eth_set_rx_batch(int index, bool enable)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->rx_batch = enable;
+}
+
+void sandbox_eth_set_offload(int index, uint offload)
+{
+	struct udevice *dev;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	eth_set_offload(dev, offload | ETH_OFFLOAD_RX_DROPS);
+}
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -404,24 +493,95 @@ static int sb_eth_start(struct udevice *dev)
 	debug("eth_sandbox: Start\n");
 
 	priv->recv_packets = 0;
+	priv->rx_posted = false;
 	for (int i = 0; i < PKTBUFSRX; i++) {
 		priv->recv_packet_buffer[i] = net_rx_packets[i];
 		priv->recv_packet_length[i] = 0;
+		priv->recv_packet_time[i] = 0;
 	}
 
 	return 0;
 }
 
-static int sb_eth_send(struct udevice *dev, void *packet, int length)
+/* Pass a packet to the tx handler, timing any replies from now */
+static int sb_eth_xmit(struct udevice *dev, void *packet, int length)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int first = priv->recv_packets;
+	int ret;
+	int i;
 
 	debug("eth_sandbox: Send packet %d\n", length);
 
+	ret = priv->tx_handler(dev, packet, length);
+	for (i = first; i < priv->recv_packets; i++)
+		priv->recv_packet_time[i] = get_timer(0);
+
+	return ret;
+}
+
+static int sb_eth_send(struct udevice *dev, void *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
 	if (priv->disabled)
 		return 0;
+	priv->tx_calls++;
+
+	return sb_eth_xmit(dev, packet, length);
+}
+
+static int sb_eth_send_batch(struct udevice *dev, struct eth_tx_pkt *pkts,
+			     int count)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i;
 
-	return priv->tx_handler(dev, packet, length);
+	if (priv->disabled)
+		return count;
+	priv->tx_calls++;
+
+	/* Packets which the tx handler does not understand are still sent */
+	for (i = 0; i < count; i++) {
+		struct eth_tx_pkt *pkt = &pkts[i];
+
+		/* Fill in the checksum as the device would, on the wire */
+		if (pkt->csum_start)
+			net_csum_fill(pkt->packet, pkt->len, pkt->csum_start,
+				      pkt->csum_offset);
+		sb_eth_xmit(dev, pkt->packet, pkt->len);
+	}
+
+	return count;
+}
+
+/*
+ * Move the payload of a packet to the posted destination, as a device would
+ * with DMA, leaving a hole in the receive buffer
+ */
+static void sb_eth_place(struct eth_sandbox_priv *priv, uchar *packet, int len)
+{
+	struct eth_rx_dest *dest = &priv->rx_placed;
+	uint offset;
+	int i;
+
+	*dest = priv->rx_dest;
+	priv->rx_posted = false;
+	offset = dest->hdr_len;
+	for (i = 0; i < dest->count && offset < len; i++) {
+		uint part = min_t(uint, dest->sg[i].len, len - offset);
+
+		memcpy(dest->sg[i].addr, packet + offset, part);
+		memset(packet + offset, 0xa5, part);
+		offset += part;
+	}
+}
+
+/* Check if packet @i in the queue is still being held back */
+static bool sb_eth_held(struct eth_sandbox_priv *priv, int i)
+{
+	return priv->recv_delay &&
+		get_timer(priv->recv_packet_time[i]) < priv->recv_delay;
 }
 
 static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
@@ -433,33 +593,115 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		skip_timeout = false;
 	}
 
+	/* Hold the packet back without freeing it */
+	if (priv->recv_packets && sb_eth_held(priv, 0))
+		return -EAGAIN;
+
 	if (priv->recv_packets) {
 		int lcl_recv_packet_length = priv->recv_packet_length[0];
 
 		debug("eth_sandbox: received packet[%d], %d waiting\n",
 		      lcl_recv_packet_length, priv->recv_packets - 1);
 		*packetp = priv->recv_packet_buffer[0];
+		if (priv->rx_posted &&
+		    lcl_recv_packet_length > priv->rx_dest.hdr_len) {
+			sb_eth_place(priv, *packetp, lcl_recv_packet_length);
+			eth_rx_placed(&priv->rx_placed);
+		}
+		if (eth_get_offload(dev) & ETH_OFFLOAD_RX_CSUM)
+			eth_rx_csum_valid();
+		priv->rx_calls++;
 		return lcl_recv_packet_length;
 	}
 	return 0;
 }
 
-static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
+static int sb_eth_recv_batch(struct udevice *dev, int flags,
+			     struct eth_rx_pkt *pkts, int max)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
-	int i;
+	struct eth_rx_pkt *pkt;
+	int count;
 
-	if (!priv->recv_packets)
-		return 0;
+	if (!priv->rx_batch)
+		return -ENOSYS;
+
+	if (skip_timeout) {
+		timer_test_add_offset(11000UL);
+		skip_timeout = false;
+	}
+
+	for (count = 0; count < max && count < priv->recv_packets; count++) {
+		if (sb_eth_held(priv, count))
+			break;
+		pkt = &pkts[count];
+		pkt->packet = priv->recv_packet_buffer[count];
+		pkt->len = priv->recv_packet_length[count];
+		pkt->placed = NULL;
+		pkt->csum_valid = eth_get_offload(dev) & ETH_OFFLOAD_RX_CSUM;
+		if (priv->rx_posted && pkt->len > priv->rx_dest.hdr_len) {
+			sb_eth_place(priv, pkt->packet, pkt->len);
+			pkt->placed = &priv->rx_placed;
+		}
+	}
+	if (!count)
+		return priv->recv_packets ? -EAGAIN : 0;
+
+	debug("eth_sandbox: received %d packets, %d waiting\n", count,
+	      priv->recv_packets - count);
+	priv->rx_calls++;
+
+	return count;
+}
+
+/* Drop @count packets from the head of the queue */
+static void sb_eth_drop(struct eth_sandbox_priv *priv, int count)
+{
+	int i;
 
-	--priv->recv_packets;
+	count = min(count, priv->recv_packets);
+	priv->recv_packets -= count;
 	for (i = 0; i < priv->recv_packets; i++) {
-		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
+		priv->recv_packet_length[i] =
+			priv->recv_packet_length[i + count];
+		priv->recv_packet_time[i] = priv->recv_packet_time[i + count];
 		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
+		       priv->recv_packet_buffer[i + count],
+		       priv->recv_packet_length[i + count]);
 	}
-	priv->recv_packet_length[priv->recv_packets] = 0;
+	for (i = priv->recv_packets; i < priv->recv_packets + count; i++)
+		priv->recv_packet_length[i] = 0;
+	priv->free_calls++;
+}
+
+static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	if (priv->recv_packets)
+		sb_eth_drop(priv, 1);
+
+	return 0;
+}
+
+static int sb_eth_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts,
+			     int count)
+{
+	sb_eth_drop(dev_get_priv(dev), count);
+
+	return 0;
+}
+
+static int sb_eth_post_rx(struct udevice *dev, const struct eth_rx_dest *dest)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	if (priv->no_rx_dest)
+		return -ENOSYS;
+
+	priv->rx_posted = dest;
+	if (dest)
+		priv->rx_dest = *dest;
 
 	return 0;
 }
@@ -487,6 +729,10 @@ static const struct eth_ops sb_eth_ops = {
 	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
+	.post_rx		= sb_eth_post_rx,
+	.recv_batch		= sb_eth_recv_batch,
+	.free_batch		= sb_eth_free_batch,
+	.send_batch		= sb_eth_send_batch,
 };
 
 static int sb_eth_remove(struct udevice *dev)
@@ -494,6 +740,13 @@ static int sb_eth_remove(struct udevice *dev)
 	return 0;
 }
 
+static int sb_eth_probe(struct udevice *dev)
+{
+	eth_set_offload(dev, ETH_OFFLOAD_RX_DROPS);
+
+	return 0;
+}
+
 static int sb_eth_of_to_plat(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev_get_plat(dev);
@@ -516,6 +769,7 @@ U_BOOT_DRIVER(eth_sandbox) = {
 	.id	= UCLASS_ETH,
 	.of_match = sb_eth_ids,
 	.of_to_plat = sb_eth_of_to_plat,
+	.probe	= sb_eth_probe,
 	.remove	= sb_eth_remove,
 	.ops	= &sb_eth_ops,
 	.priv_auto	= sizeof(struct eth_sandbox_priv),
@@ -15,17 +15,21 @@
 #include <time.h>
 #include <dm/device-internal.h>
 #include <linux/compat.h>
+#include <u-boot/schedule.h>
 #include "nvme.h"
 
 #define NVME_Q_DEPTH		2
+#define NVME_IO_Q_DEPTH		64
 #define NVME_AQ_DEPTH		2
-#define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
-#define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
-#define NVME_CQ_ALLOCATION	ALIGN(NVME_CQ_SIZE(NVME_Q_DEPTH), \
-				      ARCH_DMA_MINALIGN)
+#define NVME_SQ_SIZE(depth)	((depth) * sizeof(struct nvme_command))
+#define NVME_CQ_SIZE(depth)	((depth) * sizeof(struct nvme_completion))
+#define NVME_CQ_ALLOCATION(depth)	ALIGN(NVME_CQ_SIZE(depth), \
+					      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
 #define MAX_PRP_POOL		512
+/* Smallest share of a transfer worth a command of its own */
+#define NVME_QUEUE_MIN_BYTES	(128 << 10)
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -124,7 +128,7 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 	 * as the cache line should never become dirty.
 	 */
 	ulong start = (ulong)&nvmeq->cqes[0];
-	ulong stop = start + NVME_CQ_ALLOCATION;
+	ulong stop = start + NVME_CQ_ALLOCATION(nvmeq->q_depth);
 
 	invalidate_dcache_range(start, stop);
 
@@ -154,7 +158,7 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
+	nvme_writel(nvmeq->dev, tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
 }
 
@@ -181,6 +185,7 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 		if (timeout_us > 0 && (timer_get_us() - start_time)
 		    >= timeout_us)
 			return -ETIMEDOUT;
+		schedule();
 	}
 
 	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
@@ -196,7 +201,8 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 			head = 0;
 			phase = !phase;
 		}
-		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+		nvme_writel(nvmeq->dev, head,
+			    nvmeq->q_db + nvmeq->dev->db_stride);
 		nvmeq->cq_head = head;
 		nvmeq->cq_phase = phase;
 
@@ -210,7 +216,7 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 		head = 0;
 		phase = !phase;
 	}
-	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+	nvme_writel(nvmeq->dev, head, nvmeq->q_db + nvmeq->dev->db_stride);
 	nvmeq->cq_head = head;
 	nvmeq->cq_phase = phase;
 
@@ -233,7 +239,7 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		return NULL;
 	memset(nvmeq, 0, sizeof(*nvmeq));
 
-	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION);
+	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION(depth));
 	if (!nvmeq->cqes)
 		goto free_nvmeq;
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(depth));
@@ -243,6 +249,18 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		goto free_queue;
 	memset((void *)nvmeq->sq_cmds, 0, NVME_SQ_SIZE(depth));
 
+	/*
+	 * I/O commands on a standard controller are queued together, so each
+	 * command slot needs a PRP list of its own
+	 */
+	ops = (struct nvme_ops *)dev->udev->driver->ops;
+	if (qid && !(ops && ops->submit_cmd)) {
+		nvmeq->prp_lists = memalign(dev->page_size,
+					    depth * dev->page_size);
+		if (!nvmeq->prp_lists)
+			goto free_sq;
+	}
+
 	nvmeq->dev = dev;
 
 	nvmeq->cq_head = 0;
@@ -253,12 +271,13 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 	dev->queue_count++;
 	dev->queues[qid] = nvmeq;
 
-	ops = (struct nvme_ops *)dev->udev->driver->ops;
 	if (ops && ops->setup_queue)
 		ops->setup_queue(nvmeq);
 
 	return nvmeq;
 
+ free_sq:
+	free(nvmeq->sq_cmds);
  free_queue:
 	free((void *)nvmeq->cqes);
  free_nvmeq:
@@ -292,7 +311,7 @@ static int nvme_enable_ctrl(struct nvme_dev *dev)
 {
 	dev->ctrl_config &= ~NVME_CC_SHN_MASK;
 	dev->ctrl_config |= NVME_CC_ENABLE;
-	writel(dev->ctrl_config, &dev->bar->cc);
+	nvme_writel(dev, dev->ctrl_config, &dev->bar->cc);
 
 	return nvme_wait_csts(dev, NVME_CSTS_RDY, NVME_CSTS_RDY);
 }
@@ -301,7 +320,7 @@ static int nvme_disable_ctrl(struct nvme_dev *dev)
 {
 	dev->ctrl_config &= ~NVME_CC_SHN_MASK;
 	dev->ctrl_config &= ~NVME_CC_ENABLE;
-	writel(dev->ctrl_config, &dev->bar->cc);
+	nvme_writel(dev, dev->ctrl_config, &dev->bar->cc);
 
 	return nvme_wait_csts(dev, NVME_CSTS_RDY, 0);
 }
@@ -310,13 +329,14 @@ static int nvme_shutdown_ctrl(struct nvme_dev *dev)
 {
 	dev->ctrl_config &= ~NVME_CC_SHN_MASK;
 	dev->ctrl_config |= NVME_CC_SHN_NORMAL;
-	writel(dev->ctrl_config, &dev->bar->cc);
+	nvme_writel(dev, dev->ctrl_config, &dev->bar->cc);
 
 	return nvme_wait_csts(dev, NVME_CSTS_SHST_MASK, NVME_CSTS_SHST_CMPLT);
 }
 
 static void nvme_free_queue(struct nvme_queue *nvmeq)
 {
+	free(nvmeq->prp_lists);
 	free((void *)nvmeq->cqes);
 	free(nvmeq->sq_cmds);
 	free(nvmeq);
@@ -344,7 +364,8 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(nvmeq->q_depth));
 	flush_dcache_range((ulong)nvmeq->cqes,
-			   (ulong)nvmeq->cqes + NVME_CQ_ALLOCATION);
+			   (ulong)nvmeq->cqes +
+			   NVME_CQ_ALLOCATION(nvmeq->q_depth));
 	dev->online_queues++;
 }
 
@@ -392,7 +413,7 @@ static int nvme_configure_admin_queue(struct nvme_dev *dev)
 	dev->ctrl_config |= NVME_CC_ARB_RR | NVME_CC_SHN_NONE;
 	dev->ctrl_config |= NVME_CC_IOSQES | NVME_CC_IOCQES;
 
-	writel(aqa, &dev->bar->aqa);
+	nvme_writel(dev, aqa, &dev->bar->aqa);
 	nvme_writeq((ulong)nvmeq->sq_cmds, &dev->bar->asq);
 	nvme_writeq((ulong)nvmeq->cqes, &dev->bar->acq);
 
@@ -733,6 +754,7 @@ static int nvme_blk_probe(struct udevice *udev)
 	desc->log2blksz = ns->lba_shift;
 	desc->blksz = 1 << ns->lba_shift;
 	desc->bdev = udev;
+	desc->readahead = 1;
 	memcpy(desc->vendor, ndev->vendor, sizeof(ndev->vendor));
 	memcpy(desc->product, ndev->serial, sizeof(ndev->serial));
 	memcpy(desc->revision, ndev->firmware_rev, sizeof(ndev->firmware_rev));
@@ -741,11 +763,225 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+/* Fill the PRP list of command @slot, which holds at most one page of entries */
+static u64 nvme_setup_slot_prps(struct nvme_queue *nvmeq, int slot,
+				u32 total_len, u64 dma_addr)
+{
+	u32 page_size = nvmeq->dev->page_size;
+	int offset = dma_addr & (page_size - 1);
+	int length = total_len - (page_size - offset);
+	u64 *list;
+	int i, nprps;
+
+	if (length <= 0)
+		return 0;
+
+	dma_addr += page_size - offset;
+	if (length <= page_size)
+		return dma_addr;
+
+	list = nvmeq->prp_lists + slot * (page_size >> 3);
+	nprps = DIV_ROUND_UP(length, page_size);
+	for (i = 0; i < nprps; i++, dma_addr += page_size)
+		list[i] = cpu_to_le64(dma_addr);
+	flush_dcache_range((ulong)list, (ulong)list + page_size);
+
+	return (ulong)list;
+}
+
+/**
+ * nvme_reset_io_queue() - start the I/O queue again, empty
+ *
+ * Deleting the submission queue aborts the commands left in it, so that none
+ * of them can complete later into slots which have been given out again.
+ * Both queues are then created again, which brings the head, tail and phase
+ * of the driver and the controller back to the start.
+ *
+ * @dev:	NVMe controller
+ * Return: 0 if OK, -ve on error, or an NVMe status
+ */
+static int nvme_reset_io_queue(struct nvme_dev *dev)
+{
+	int ret;
+
+	ret = nvme_delete_sq(dev, NVME_IO_Q);
+	if (!ret)
+		ret = nvme_delete_cq(dev, NVME_IO_Q);
+	if (ret)
+		return ret;
+	dev->online_queues--;
+
+	return nvme_create_queue(dev->queues[NVME_IO_Q], NVME_IO_Q);
+}
+
+/**
+ * nvme_blk_rw_queued() - transfer blocks with many commands in flight
+ *
+ * The transfer is split into commands which fill the free slots of the I/O
+ * queue. The submission doorbell is written once for each batch of commands
+ * and the completion doorbell once for each set of completions reaped, so the
+ * controller can work on all of them at once.
+ *
+ * @udev:	Namespace block device
+ * @blknr:	First block to transfer
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Buffer holding or receiving the data
+ * @read:	true to read, false to write
+ * Return: number of blocks transferred before the first one which failed
+ */
+static ulong nvme_blk_rw_queued(struct udevice *udev, lbaint_t blknr,
+				lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_rw_stats *stats = read ? &ns->read_stats :
+					     &ns->write_stats;
+	lbaint_t slot_lba[NVME_IO_Q_DEPTH];
+	u32 slot_lbas[NVME_IO_Q_DEPTH];
+	lbaint_t next = blknr, failed = blknr + blkcnt;
+	lbaint_t max_lbas, per_cmd;
+	uint slots, inflight = 0;
+	struct nvme_command c;
+	u64 free_slots, prp2;
+	ulong start;
+	int slot;
+
+	if (!blkcnt)
+		return 0;
+
+	/* One entry stays empty, since a full queue would look empty */
+	slots = nvmeq->q_depth - 1;
+	free_slots = GENMASK_ULL(slots - 1, 0);
+
+	/*
+	 * A command is limited by the MDTS, by its 16-bit block count and by
+	 * what one PRP list page can describe. Within that, spread the
+	 * transfer over the queue without making the commands tiny.
+	 */
+	max_lbas = min_t(lbaint_t, 0x10000,
+			 1 << (dev->max_transfer_shift - ns->lba_shift));
+	max_lbas = min_t(lbaint_t, max_lbas,
+			 (dev->page_size >> 3) * dev->page_size >>
+			 ns->lba_shift);
+	per_cmd = max_t(lbaint_t, DIV_ROUND_UP(blkcnt, slots),
+			NVME_QUEUE_MIN_BYTES >> ns->lba_shift);
+	per_cmd = min(per_cmd, max_lbas);
+
+	start = timer_get_us();
+	flush_dcache_range((ulong)buffer,
+			   (ulong)buffer + (blkcnt << ns->lba_shift));
+
+	memset(&c, 0, sizeof(c));
+	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
+	c.rw.nsid = cpu_to_le32(ns->ns_id);
+
+	while (next < failed || inflight) {
+		u16 tail = nvmeq->sq_tail;
+		u16 head = nvmeq->cq_head;
+		u8 phase = nvmeq->cq_phase;
+		uint queued = 0, reaped = 0;
+		ulong wait = timer_get_us();
+
+		while (free_slots && next < failed) {
+			u32 lbas = min(failed - next, per_cmd);
+			ulong addr = (ulong)buffer +
+				     ((next - blknr) << ns->lba_shift);
+
+			slot = __ffs64(free_slots);
+			c.rw.command_id = cpu_to_le16(slot);
+			c.rw.slba = cpu_to_le64(next);
+			c.rw.length = cpu_to_le16(lbas - 1);
+			c.rw.prp1 = cpu_to_le64(addr);
+			prp2 = nvme_setup_slot_prps(nvmeq, slot,
+						    lbas << ns->lba_shift, addr);
+			c.rw.prp2 = cpu_to_le64(prp2);
+			memcpy(&nvmeq->sq_cmds[tail], &c, sizeof(c));
+			flush_dcache_range((ulong)&nvmeq->sq_cmds[tail],
+					   (ulong)&nvmeq->sq_cmds[tail] +
+					   sizeof(c));
+			if (++tail == nvmeq->q_depth)
+				tail = 0;
+
+			slot_lba[slot] = next;
+			slot_lbas[slot] = lbas;
+			free_slots &= ~BIT_ULL(slot);
+			next += lbas;
+			inflight++;
+			queued++;
+		}
+		if (queued) {
+			nvme_writel(dev, tail, nvmeq->q_db);
+			nvmeq->sq_tail = tail;
+			stats->max_depth = max(stats->max_depth, inflight);
+		}
+
+		/* Wait for one completion, then take all which are ready */
+		while (inflight) {
+			u16 status = nvme_read_completion_status(nvmeq, head);
+
+			if ((status & 0x01) != phase) {
+				if (reaped)
+					break;
+				if (timer_get_us() - wait >=
+				    IO_TIMEOUT * 100000)
+					break;
+				schedule();
+				continue;
+			}
+
+			slot = readw(&nvmeq->cqes[head].command_id);
+			status >>= 1;
+			if (status) {
+				printf("ERROR: status = %x, block " LBAFU "\n",
+				       status, slot_lba[slot]);
+				failed = min(failed, slot_lba[slot]);
+			} else {
+				stats->cmds++;
+				stats->bytes += (u64)slot_lbas[slot] <<
+						ns->lba_shift;
+			}
+			free_slots |= BIT_ULL(slot);
+			inflight--;
+			reaped++;
+			if (++head == nvmeq->q_depth) {
+				head = 0;
+				phase = !phase;
+			}
+		}
+		if (!reaped) {
+			/* Give up on the blocks of the commands still queued */
+			printf("Error: %s: I/O timed out\n", udev->name);
+			for (slot = 0; slot < slots; slot++) {
+				if (!(free_slots & BIT_ULL(slot)))
+					failed = min(failed, slot_lba[slot]);
+			}
+			if (nvme_reset_io_queue(dev))
+				printf("Error: %s: cannot reset I/O queue\n",
+				       udev->name);
+			break;
+		}
+		nvme_writel(dev, head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	if (read)
+		invalidate_dcache_range((ulong)buffer,
+					(ulong)buffer +
+					(blkcnt << ns->lba_shift));
+	stats->time_us += timer_get_us() - start;
+
+	return failed - blknr;
+}
+
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			 lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	struct nvme_rw_stats *stats = read ? &ns->read_stats :
+					     &ns->write_stats;
 	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
 	int status;
@@ -753,11 +989,16 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 	u64 total_len = blkcnt << desc->log2blksz;
 	u64 temp_len = total_len;
 	uintptr_t temp_buffer = (uintptr_t)buffer;
+	ulong start;
 
 	u64 slba = blknr;
 	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
 	u64 total_lbas = blkcnt;
 
+	if (dev->queues[NVME_IO_Q]->prp_lists)
+		return nvme_blk_rw_queued(udev, blknr, blkcnt, buffer, read);
+
+	start = timer_get_us();
 	flush_dcache_range((unsigned long)buffer,
 			   (unsigned long)buffer + total_len);
 
@@ -791,6 +1032,8 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 				&c, NULL, IO_TIMEOUT);
 		if (status)
 			break;
+		stats->cmds++;
+		stats->max_depth = 1;
 		temp_len -= (u32)lbas << ns->lba_shift;
 		temp_buffer += lbas << ns->lba_shift;
 	}
@@ -798,6 +1041,8 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
+	stats->bytes += total_len - temp_len;
+	stats->time_us += timer_get_us() - start;
 
 	return (total_len - temp_len) >> desc->log2blksz;
 }
@@ -830,6 +1075,7 @@ U_BOOT_DRIVER(nvme_blk) = {
 int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
+	struct nvme_ops *ops = (struct nvme_ops *)udev->driver->ops;
 	struct nvme_id_ns *id;
 	int ret;
 
@@ -850,7 +1096,10 @@ int nvme_init(struct udevice *udev)
 	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
 
 	ndev->cap = nvme_readq(&ndev->bar->cap);
-	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
+	/* Controllers with their own submission run one command at a time */
+	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1,
+			      ops && ops->submit_cmd ? NVME_Q_DEPTH :
+			      NVME_IO_Q_DEPTH);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
 	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
 
@@ -647,9 +647,25 @@ struct nvme_queue {
 	u16 qid;
 	u8 cq_phase;
 	u8 cqe_seen;
+	u64 *prp_lists;		/* a PRP list page for each command slot */
 	unsigned long cmdid_data[];
 };
 
+/**
+ * struct nvme_rw_stats - totals for the reads or writes on a namespace
+ *
+ * @cmds:	Number of commands completed
+ * @bytes:	Number of bytes transferred
+ * @time_us:	Time spent with commands outstanding, in microseconds
+ * @max_depth:	Largest number of commands outstanding at once
+ */
+struct nvme_rw_stats {
+	u64 cmds;
+	u64 bytes;
+	u64 time_us;
+	uint max_depth;
+};
+
 /*
  * An NVM Express namespace is equivalent to a SCSI LUN.
  * Each namespace is operated as an independent "device".
@@ -662,6 +678,8 @@ struct nvme_ns {
 	int devnum;
 	int lba_shift;
 	u8 flbas;
+	struct nvme_rw_stats read_stats;
+	struct nvme_rw_stats write_stats;
 };
 
 struct nvme_ops {
@@ -691,6 +709,15 @@ struct nvme_ops {
 	void (*complete_cmd)(struct nvme_queue *nvmeq, struct nvme_command *cmd);
 };
 
+#if IS_ENABLED(CONFIG_NVME_SANDBOX)
+/* The sandbox emulator acts on writes to the controller registers */
+void sandbox_nvme_writel(struct nvme_dev *dev, u32 val, u32 __iomem *reg);
+
+#define nvme_writel(dev, val, reg)	sandbox_nvme_writel(dev, val, reg)
+#else
+#define nvme_writel(dev, val, reg)	writel(val, reg)
+#endif
+
 /**
  * nvme_init() - Initialize NVM Express device
  * @udev:	The NVM Express device
@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Emulation of an NVM Express controller for sandbox
+ *
+ * The controller registers and doorbells are kept in memory, which the NVMe
+ * driver reads directly. Its writes come here through nvme_writel(), so that
+ * enabling the controller and ringing a doorbell take effect. The controller
+ * has an admin queue, one I/O queue and one namespace held in memory.
+ *
+ * All the commands passed with a submission doorbell write are carried out
+ * and completed at once, so the number of commands in each batch shows how
+ * deeply the driver queues them. The controller can also be made to hang,
+ * leaving I/O commands to be carried out late, when the next ones arrive.
+ */
+
+#define LOG_CATEGORY UCLASS_NVME
+
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <time.h>
+#include <asm/test.h>
+#include "nvme.h"
+
+enum {
+	SANDBOX_NVME_PAGE_SIZE	= 4096,
+	/* Registers, followed by the doorbells */
+	SANDBOX_NVME_REG_SIZE	= 2 * 4096,
+	SANDBOX_NVME_Q_DEPTH	= 16,
+	/* Largest transfer, as a power of two of pages (128KiB) */
+	SANDBOX_NVME_MDTS	= 5,
+	SANDBOX_NVME_LBA_SHIFT	= 9,
+	SANDBOX_NVME_BLOCKS	= 8192,
+	SANDBOX_NVME_QUEUES	= 2,
+	/* Time which passes on each hang, beyond the driver's I/O timeout */
+	SANDBOX_NVME_HANG_MS	= 5000,
+};
+
+/**
+ * struct sandbox_nvme_queue - a submission queue and its completion queue
+ *
+ * @sq: Submission queue entries, or NULL if the queue does not exist
+ * @cq: Completion queue entries, or NULL if the queue does not exist
+ * @sq_depth: Number of submission queue entries
+ * @cq_depth: Number of completion queue entries
+ * @sq_head: Next submission queue entry to carry out
+ * @cq_tail: Next completion queue entry to fill
+ * @phase: Phase tag of the completion queue entries being filled
+ */
+struct sandbox_nvme_queue {
+	struct nvme_command *sq;
+	struct nvme_completion *cq;
+	uint sq_depth;
+	uint cq_depth;
+	uint sq_head;
+	uint cq_tail;
+	u8 phase;
+};
+
+/**
+ * struct sandbox_nvme_priv - state of the emulated controller
+ *
+ * @ndev: NVMe driver state, which must come first
+ * @regs: Controller registers and doorbells
+ * @queues: Admin queue and I/O queue
+ * @id: Buffer for the identify data
+ * @data: Contents of the namespace
+ * @sq_doorbells: Number of writes to the I/O submission queue doorbell
+ * @cq_doorbells: Number of writes to the I/O completion queue doorbell
+ * @cmds: Number of I/O commands carried out
+ * @max_batch: Largest number of I/O commands passed with one doorbell write
+ * @hang: true to leave the I/O commands passed unanswered
+ */
+struct sandbox_nvme_priv {
+	struct nvme_dev ndev;
+	void *regs;
+	struct sandbox_nvme_queue queues[SANDBOX_NVME_QUEUES];
+	union {
+		struct nvme_id_ctrl ctrl;
+		struct nvme_id_ns ns;
+	} id;
+	u8 *data;
+	uint sq_doorbells;
+	uint cq_doorbells;
+	uint cmds;
+	uint max_batch;
+	bool hang;
+};
+
+static void *sandbox_nvme_ptr(u64 addr)
+{
+	return (void *)(uintptr_t)addr;
+}
+
+static void sandbox_nvme_copy(u64 addr, void *buf, ulong size, bool to_host)
+{
+	if (to_host)
+		memcpy(sandbox_nvme_ptr(addr), buf, size);
+	else
+		memcpy(buf, sandbox_nvme_ptr(addr), size);
+}
+
+/* Copy between @buf and the memory described by the PRPs of a command */
+static void sandbox_nvme_xfer(struct nvme_common_command *cmd, void *buf,
+			      ulong len, bool to_host)
+{
+	const ulong page_size = SANDBOX_NVME_PAGE_SIZE;
+	u64 addr = le64_to_cpu(cmd->prp1);
+	ulong size;
+	u64 *list;
+	uint i;
+
+	/* PRP1 covers the rest of its page */
+	size = min(len, page_size - (ulong)(addr & (page_size - 1)));
+	sandbox_nvme_copy(addr, buf, size, to_host);
+	buf += size;
+	len -= size;
+	if (!len)
+		return;
+
+	/* PRP2 is the next page, or a list of pages if more are needed */
+	addr = le64_to_cpu(cmd->prp2);
+	if (len <= page_size) {
+		sandbox_nvme_copy(addr, buf, len, to_host);
+		return;
+	}
+
+	list = sandbox_nvme_ptr(addr);
+	for (i = 0; len; i++) {
+		/* The last entry of a full list page points to the next one */
+		if (i == page_size / sizeof(u64) - 1 && len > page_size) {
+			list = sandbox_nvme_ptr(le64_to_cpu(list[i]));
+			i = 0;
+		}
+		size = min(len, page_size);
+		sandbox_nvme_copy(le64_to_cpu(list[i]), buf, size, to_host);
+		buf += size;
+		len -= size;
+	}
+}
+
+static void sandbox_nvme_complete(struct sandbox_nvme_queue *q, int qid,
+				  u16 command_id, u16 status, u32 result)
+{
+	struct nvme_completion *cqe = &q->cq[q->cq_tail];
+
+	cqe->result = cpu_to_le32(result);
+	cqe->sq_head = cpu_to_le16(q->sq_head);
+	cqe->sq_id = cpu_to_le16(qid);
+	cqe->command_id = command_id;
+	cqe->status = cpu_to_le16(status << 1 | q->phase);
+	if (++q->cq_tail == q->cq_depth) {
+		q->cq_tail = 0;
+		q->phase = !q->phase;
+	}
+}
+
+static u16 sandbox_nvme_identify(struct sandbox_nvme_priv *priv,
+				 struct nvme_command *cmd)
+{
+	struct nvme_id_ctrl *ctrl = &priv->id.ctrl;
+	struct nvme_id_ns *ns = &priv->id.ns;
+
+	memset(&priv->id, '\0', sizeof(priv->id));
+	switch (le32_to_cpu(cmd->identify.cns)) {
+	case 1:
+		memcpy(ctrl->sn, "SANDBOX0001", 11);
+		memcpy(ctrl->mn, "Sandbox NVMe", 12);
+		memcpy(ctrl->fr, "1.0", 3);
+		ctrl->mdts = SANDBOX_NVME_MDTS;
+		ctrl->nn = cpu_to_le32(1);
+		break;
+	case 0:
+		/* Other namespaces are inactive, so are left empty */
+		if (le32_to_cpu(cmd->identify.nsid) != 1)
+			break;
+		ns->nsze = cpu_to_le64(SANDBOX_NVME_BLOCKS);
+		ns->ncap = ns->nsze;
+		ns->nuse = ns->nsze;
+		ns->lbaf[0].ds = SANDBOX_NVME_LBA_SHIFT;
+		break;
+	default:
+		return NVME_SC_INVALID_FIELD;
+	}
+	sandbox_nvme_xfer(&cmd->common, &priv->id, sizeof(priv->id), true);
+
+	return NVME_SC_SUCCESS;
+}
+
+static u16 sandbox_nvme_admin(struct sandbox_nvme_priv *priv,
+			      struct nvme_command *cmd, u32 *result)
+{
+	struct sandbox_nvme_queue *q;
+	uint qid;
+
+	switch (cmd->common.opcode) {
+	case nvme_admin_identify:
+		return sandbox_nvme_identify(priv, cmd);
+	case nvme_admin_set_features:
+		if (le32_to_cpu(cmd->features.fid) != NVME_FEAT_NUM_QUEUES)
+			return NVME_SC_INVALID_FIELD;
+		/* One submission and one completion queue, as 0-based counts */
+		*result = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_cq:
+		qid = le16_to_cpu(cmd->create_cq.cqid);
+		if (!qid || qid >= SANDBOX_NVME_QUEUES)
+			return NVME_SC_QID_INVALID;
+		q = &priv->queues[qid];
+		q->cq = sandbox_nvme_ptr(le64_to_cpu(cmd->create_cq.prp1));
+		q->cq_depth = le16_to_cpu(cmd->create_cq.qsize) + 1;
+		q->cq_tail = 0;
+		q->phase = 1;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_sq:
+		qid = le16_to_cpu(cmd->create_sq.sqid);
+		if (!qid || qid >= SANDBOX_NVME_QUEUES ||
+		    le16_to_cpu(cmd->create_sq.cqid) != qid)
+			return NVME_SC_QID_INVALID;
+		q = &priv->queues[qid];
+		q->sq = sandbox_nvme_ptr(le64_to_cpu(cmd->create_sq.prp1));
+		q->sq_depth = le16_to_cpu(cmd->create_sq.qsize) + 1;
+		q->sq_head = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_delete_sq:
+	case nvme_admin_delete_cq:
+		qid = le16_to_cpu(cmd->delete_queue.qid);
+		if (!qid || qid >= SANDBOX_NVME_QUEUES)
+			return NVME_SC_QID_INVALID;
+		/* commands left in a deleted submission queue are dropped */
+		q = &priv->queues[qid];
+		if (cmd->common.opcode == nvme_admin_delete_sq)
+			q->sq = NULL;
+		else
+			q->cq = NULL;
+		return NVME_SC_SUCCESS;
+	default:
+		return NVME_SC_INVALID_OPCODE;
+	}
+}
+
+static u16 sandbox_nvme_io(struct sandbox_nvme_priv *priv,
+			   struct nvme_command *cmd)
+{
+	u64 slba = le64_to_cpu(cmd->rw.slba);
+	uint blocks = le16_to_cpu(cmd->rw.length) + 1;
+	ulong len = (ulong)blocks << SANDBOX_NVME_LBA_SHIFT;
+
+	if (le32_to_cpu(cmd->rw.nsid) != 1)
+		return NVME_SC_INVALID_NS;
+
+	switch (cmd->rw.opcode) {
+	case nvme_cmd_flush:
+		return NVME_SC_SUCCESS;
+	case nvme_cmd_read:
+	case nvme_cmd_write:
+		if (slba + blocks > SANDBOX_NVME_BLOCKS)
+			return NVME_SC_LBA_RANGE;
+		if (len > SANDBOX_NVME_PAGE_SIZE << SANDBOX_NVME_MDTS)
+			return NVME_SC_INVALID_FIELD;
+		sandbox_nvme_xfer(&cmd->common,
+				  priv->data + (slba << SANDBOX_NVME_LBA_SHIFT), len,
+				  cmd->rw.opcode == nvme_cmd_read);
+		return NVME_SC_SUCCESS;
+	default:
+		return NVME_SC_INVALID_OPCODE;
+	}
+}
+
+/* Carry out the commands of queue @qid up to the new tail, @tail */
+static void sandbox_nvme_run(struct sandbox_nvme_priv *priv, uint qid,
+			     uint tail)
+{
+	struct sandbox_nvme_queue *q = &priv->queues[qid];
+	uint count = 0;
+
+	if (!q->sq || !q->cq || tail >= q->sq_depth)
+		return;
+	if (qid && priv->hang) {
+		/* let the driver's timeout run out at once */
+		timer_test_add_offset(SANDBOX_NVME_HANG_MS);
+		return;
+	}
+
+	while (q->sq_head != tail) {
+		struct nvme_command *cmd = &q->sq[q->sq_head];
+		u32 result = 0;
+		u16 status;
+
+		if (++q->sq_head == q->sq_depth)
+			q->sq_head = 0;
+		if (qid)
+			status = sandbox_nvme_io(priv, cmd);
+		else
+			status = sandbox_nvme_admin(priv, cmd, &result);
+		sandbox_nvme_complete(q, qid, cmd->common.command_id, status,
+				      result);
+		count++;
+	}
+
+	if (qid) {
+		priv->sq_doorbells++;
+		priv->cmds += count;
+		priv->max_batch = max(priv->max_batch, count);
+	}
+}
+
+static void sandbox_nvme_set_cc(struct sandbox_nvme_priv *priv, u32 cc)
+{
+	struct nvme_bar *bar = priv->regs;
+	struct sandbox_nvme_queue *q = &priv->queues[NVME_ADMIN_Q];
+	u32 csts = bar->csts & ~NVME_CSTS_SHST_MASK;
+
+	if (cc & NVME_CC_SHN_MASK)
+		csts |= NVME_CSTS_SHST_CMPLT;
+
+	if (!(cc & NVME_CC_ENABLE)) {
+		memset(priv->queues, '\0', sizeof(priv->queues));
+		csts &= ~NVME_CSTS_RDY;
+	} else if (!(csts & NVME_CSTS_RDY)) {
+		q->sq = sandbox_nvme_ptr(bar->asq);
+		q->cq = sandbox_nvme_ptr(bar->acq);
+		q->sq_depth = (bar->aqa & 0xfff) + 1;
+		q->cq_depth = (bar->aqa >> 16 & 0xfff) + 1;
+		q->phase = 1;
+		csts |= NVME_CSTS_RDY;
+	}
+	bar->cc = cc;
+	bar->csts = csts;
+}
+
+void sandbox_nvme_writel(struct nvme_dev *dev, u32 val, u32 __iomem *reg)
+{
+	struct sandbox_nvme_priv *priv;
+	struct nvme_bar *bar;
+	ulong db;
+
+	if (dev->udev->driver != DM_DRIVER_GET(sandbox_nvme)) {
+		writel(val, reg);
+		return;
+	}
+
+	priv = dev_get_priv(dev->udev);
+	bar = priv->regs;
+	if (reg == &bar->cc) {
+		sandbox_nvme_set_cc(priv, val);
+		return;
+	}
+
+	*reg = val;
+	if ((void *)reg < (void *)dev->dbs)
+		return;
+
+	/* Doorbells alternate between submission tail and completion head */
+	db = reg - dev->dbs;
+	if (db / 2 >= SANDBOX_NVME_QUEUES)
+		return;
+	if (!(db & 1))
+		sandbox_nvme_run(priv, db / 2, val);
+	else if (db / 2)
+		priv->cq_doorbells++;
+}
+
+void sandbox_nvme_get_queue_stats(struct udevice *dev, uint *sq_doorbellsp,
+				  uint *cq_doorbellsp, uint *cmdsp,
+				  uint *max_batchp)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	*sq_doorbellsp = priv->sq_doorbells;
+	*cq_doorbellsp = priv->cq_doorbells;
+	*cmdsp = priv->cmds;
+	*max_batchp = priv->max_batch;
+}
+
+void sandbox_nvme_set_hang(struct udevice *dev, bool hang)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	priv->hang = hang;
+}
+
+static int sandbox_nvme_probe(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+	struct nvme_bar *bar;
+
+	priv->regs = memalign(SANDBOX_NVME_PAGE_SIZE, SANDBOX_NVME_REG_SIZE);
+	priv->data = calloc(SANDBOX_NVME_BLOCKS, 1 << SANDBOX_NVME_LBA_SHIFT);
+	if (!priv->regs || !priv->data)
+		return log_ret(-ENOMEM);
+	memset(priv->regs, '\0', SANDBOX_NVME_REG_SIZE);
+
+	/* Contiguous queues, a 500ms timeout and 4KiB pages */
+	bar = priv->regs;
+	bar->cap = (SANDBOX_NVME_Q_DEPTH - 1) | 1 << 16 | 1 << 24 |
+		   1ULL << 37;
+	bar->vs = NVME_VS(1, 4);
+
+	strcpy(priv->ndev.vendor, "sandbox");
+	priv->ndev.bar = priv->regs;
+
+	return nvme_init(dev);
+}
+
+static int sandbox_nvme_remove(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	nvme_shutdown(dev);
+	free(priv->regs);
+	free(priv->data);
+
+	return 0;
+}
+
+static const struct udevice_id sandbox_nvme_ids[] = {
+	{ .compatible = "sandbox,nvme" },
+	{ }
+};
+
+U_BOOT_DRIVER(sandbox_nvme) = {
+	.name		= "sandbox_nvme",
+	.id		= UCLASS_NVME,
+	.of_match	= sandbox_nvme_ids,
+	.probe		= sandbox_nvme_probe,
+	.remove		= sandbox_nvme_remove,
+	.priv_auto	= sizeof(struct sandbox_nvme_priv),
+};
@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <memalign.h>
 #include <nvme.h>
+#include <linux/math64.h>
 #include "nvme.h"
 
 static void print_optional_admin_cmd(u16 oacs, int devnum)
@@ -143,3 +144,22 @@ free_ctrl:
 	free(ctrl);
 	return ret;
 }
+
+static void print_rw_stats(const char *name, const struct nvme_rw_stats *stats)
+{
+	u64 time_us = max_t(u64, stats->time_us, 1);
+	u64 rate = div64_u64(stats->bytes * 100, time_us);
+
+	printf("            %s: %llu cmds, %llu bytes, %llu IOPS, %llu.%02llu MB/s, depth %u\n",
+	       name, stats->cmds, stats->bytes,
+	       div64_u64(stats->cmds * 1000000, time_us), rate / 100,
+	       rate % 100, stats->max_depth);
+}
+
+void nvme_print_stats(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	print_rw_stats("Reads", &ns->read_stats);
+	print_rw_stats("Writes", &ns->write_stats);
+}
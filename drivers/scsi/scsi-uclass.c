@@ -25,6 +25,24 @@ int scsi_exec(struct udevice *dev, struct scsi_cmd *pccb)
 	return ops->exec(dev, pccb);
 }
 
+int scsi_exec_queue(struct udevice *dev, struct scsi_cmd *cmds, int count)
+{
+	struct scsi_ops *ops = scsi_get_ops(dev);
+	int i;
+
+	if (ops->exec_queue)
+		return ops->exec_queue(dev, cmds, count);
+	if (!ops->exec)
+		return -ENOSYS;
+
+	for (i = 0; i < count; i++) {
+		if (ops->exec(dev, &cmds[i]))
+			break;
+	}
+
+	return i;
+}
+
 int scsi_get_blk_by_uuid(const char *uuid,
 			 struct blk_desc **blk_desc_ptr,
 			 struct disk_partition *part_info_ptr)
@@ -13,6 +13,7 @@
 #include <env.h>
 #include <libata.h>
 #include <log.h>
+#include <malloc.h>
 #include <memalign.h>
 #include <part.h>
 #include <pci.h>
@@ -32,25 +33,33 @@ DEFINE_CACHE_ALIGN_BUFFER(u8, tempbuff, 512);	/* temporary data buffer */
 #define SCSI_UNMAP_PARAM_LEN 22
 #define SCSI_UNMAP_PARAM_DATA_LEN 16
 
+/* Smallest command a queued read is split into */
+#define SCSI_QUEUE_MIN_BYTES	(256 << 10)
+
+/* Hosts take scatter-gather segments made of whole 32-bit words */
+#define SCSI_SG_MIN_ALIGN	4
+
 static void scsi_print_error(struct scsi_cmd *pccb)
 {
 	/* Dummy function that could print an error for debugging */
 }
 
-#ifdef CONFIG_SYS_64BIT_LBA
-void scsi_setup_read16(struct scsi_cmd *pccb, lbaint_t start,
-		       lbaint_t blocks)
+/* Set up a 16-byte read or write, for a start block or count too large for 10 */
+static void scsi_setup_ext16(struct scsi_cmd *pccb, u8 opcode, lbaint_t start,
+			     lbaint_t blocks)
 {
-	pccb->cmd[0] = SCSI_READ16;
+	u64 lba = start;
+
+	pccb->cmd[0] = opcode;
 	pccb->cmd[1] = 0;
-	pccb->cmd[2] = (unsigned char)(start >> 56) & 0xff;
-	pccb->cmd[3] = (unsigned char)(start >> 48) & 0xff;
-	pccb->cmd[4] = (unsigned char)(start >> 40) & 0xff;
-	pccb->cmd[5] = (unsigned char)(start >> 32) & 0xff;
-	pccb->cmd[6] = (unsigned char)(start >> 24) & 0xff;
-	pccb->cmd[7] = (unsigned char)(start >> 16) & 0xff;
-	pccb->cmd[8] = (unsigned char)(start >> 8) & 0xff;
-	pccb->cmd[9] = (unsigned char)start & 0xff;
+	pccb->cmd[2] = (unsigned char)(lba >> 56) & 0xff;
+	pccb->cmd[3] = (unsigned char)(lba >> 48) & 0xff;
+	pccb->cmd[4] = (unsigned char)(lba >> 40) & 0xff;
+	pccb->cmd[5] = (unsigned char)(lba >> 32) & 0xff;
+	pccb->cmd[6] = (unsigned char)(lba >> 24) & 0xff;
+	pccb->cmd[7] = (unsigned char)(lba >> 16) & 0xff;
+	pccb->cmd[8] = (unsigned char)(lba >> 8) & 0xff;
+	pccb->cmd[9] = (unsigned char)lba & 0xff;
 	pccb->cmd[10] = 0;
 	pccb->cmd[11] = (unsigned char)(blocks >> 24) & 0xff;
 	pccb->cmd[12] = (unsigned char)(blocks >> 16) & 0xff;
@@ -59,13 +68,12 @@ void scsi_setup_read16(struct scsi_cmd *pccb, lbaint_t start,
 	pccb->cmd[15] = 0;
 	pccb->cmdlen = 16;
 	pccb->msgout[0] = SCSI_IDENTIFY; /* NOT USED */
-	debug("scsi_setup_read16: cmd: %02X %02X startblk %02X%02X%02X%02X%02X%02X%02X%02X blccnt %02X%02X%02X%02X\n",
-	      pccb->cmd[0], pccb->cmd[1],
+	debug("%s: cmd: %02X %02X startblk %02X%02X%02X%02X%02X%02X%02X%02X blccnt %02X%02X%02X%02X\n",
+	      __func__, pccb->cmd[0], pccb->cmd[1],
 	      pccb->cmd[2], pccb->cmd[3], pccb->cmd[4], pccb->cmd[5],
 	      pccb->cmd[6], pccb->cmd[7], pccb->cmd[8], pccb->cmd[9],
 	      pccb->cmd[11], pccb->cmd[12], pccb->cmd[13], pccb->cmd[14]);
 }
-#endif
 
 static void scsi_setup_inquiry(struct scsi_cmd *pccb)
 {
@@ -187,6 +195,258 @@ static void scsi_setup_erase_ext(struct scsi_cmd *pccb, lbaint_t start,
 	      pccb->cmd[7], pccb->cmd[8]);
 }
 
+/**
+ * scsi_read_queued() - Read using several commands at once
+ *
+ * The read is split into as many commands as the host can queue, but none
+ * smaller than SCSI_QUEUE_MIN_BYTES, and these are passed to the host
+ * together.
+ *
+ * @dev: Block device
+ * @blknr: First block to read
+ * @blkcnt: Number of blocks to read
+ * @buffer: Buffer for the data
+ * @max_blks: Largest number of blocks for one command
+ * Return: number of blocks read, or -ENOMEM if there is no memory for the
+ * commands
+ */
+static long scsi_read_queued(struct udevice *dev, lbaint_t blknr,
+			     lbaint_t blkcnt, void *buffer, lbaint_t max_blks)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct udevice *bdev = dev->parent;
+	struct scsi_plat *uc_plat = dev_get_uclass_plat(bdev);
+	lbaint_t start = blknr, left = blkcnt, per_cmd, blocks;
+	struct scsi_cmd *cmds, *pccb;
+	int count, done;
+	u8 *buf = buffer;
+
+	per_cmd = DIV_ROUND_UP(blkcnt, uc_plat->queue_depth);
+	per_cmd = max_t(lbaint_t, per_cmd,
+			SCSI_QUEUE_MIN_BYTES / block_dev->blksz);
+	per_cmd = min3(per_cmd, max_blks, (lbaint_t)SCSI_MAX_BLK);
+
+	cmds = memalign(ARCH_DMA_MINALIGN,
+			uc_plat->queue_depth * sizeof(*cmds));
+	if (!cmds)
+		return -ENOMEM;
+	memset(cmds, '\0', uc_plat->queue_depth * sizeof(*cmds));
+
+	while (left) {
+		for (count = 0; count < uc_plat->queue_depth && left; count++) {
+			blocks = min(left, per_cmd);
+			pccb = &cmds[count];
+			pccb->target = block_dev->target;
+			pccb->lun = block_dev->lun;
+			pccb->pdata = buf;
+			pccb->datalen = block_dev->blksz * blocks;
+			pccb->dma_dir = DMA_FROM_DEVICE;
+#ifdef CONFIG_SYS_64BIT_LBA
+			if (start > SCSI_LBA48_READ)
+				scsi_setup_ext16(pccb, SCSI_READ16, start,
+						 blocks);
+			else
+#endif
+				scsi_setup_read_ext(pccb, start, blocks);
+			start += blocks;
+			left -= blocks;
+			buf += pccb->datalen;
+		}
+
+		done = scsi_exec_queue(bdev, cmds, count);
+		if (done != count) {
+			/* the blocks before the first failed command were read */
+			pccb = &cmds[max(done, 0)];
+			scsi_print_error(pccb);
+			blocks = (pccb->pdata - (u8 *)buffer) / block_dev->blksz;
+			free(cmds);
+			return blocks;
+		}
+	}
+	free(cmds);
+
+	return blkcnt;
+}
+
+/* Set up a read or write, using a 16-byte command if 10 bytes are too few */
+static void scsi_setup_rw(struct scsi_cmd *pccb, lbaint_t start,
+			  lbaint_t blocks, bool write)
+{
+	if (start > SCSI_LBA48_READ || blocks > SCSI_MAX_BLK)
+		scsi_setup_ext16(pccb, write ? SCSI_WRITE16 : SCSI_READ16,
+				 start, blocks);
+	else if (write)
+		scsi_setup_write_ext(pccb, start, blocks);
+	else
+		scsi_setup_read_ext(pccb, start, blocks);
+}
+
+/**
+ * scsi_setup_sg() - Describe the data for a command as a list of segments
+ *
+ * The parts of @buf before its first and after its last ARCH_DMA_MINALIGN
+ * boundary share cache lines with memory outside the buffer, so they are
+ * passed through @bounce. The rest of @buf is used in place, in segments of
+ * at most @max_seg bytes.
+ *
+ * @pccb: Command to set up
+ * @sg: Segments for the command
+ * @bounce: Bounce buffer of 2 * ARCH_DMA_MINALIGN bytes
+ * @buf: Data for the command
+ * @len: Number of bytes in @buf
+ * @max_seg: Largest segment, 0 for no limit
+ */
+static void scsi_setup_sg(struct scsi_cmd *pccb, struct scsi_sg *sg,
+			  u8 *bounce, u8 *buf, ulong len, ulong max_seg)
+{
+	ulong head, tail, mid, size;
+	uint count = 0;
+	u8 *ptr;
+
+	head = min_t(ulong, PTR_ALIGN(buf, ARCH_DMA_MINALIGN) - buf, len);
+	tail = head < len ? (uintptr_t)(buf + len) % ARCH_DMA_MINALIGN : 0;
+	mid = len - head - tail;
+
+	if (head) {
+		sg[count].addr = bounce;
+		sg[count++].len = head;
+	}
+	for (ptr = buf + head; mid; mid -= size, ptr += size) {
+		size = max_seg ? min(mid, max_seg) : mid;
+		sg[count].addr = ptr;
+		sg[count++].len = size;
+	}
+	if (tail) {
+		sg[count].addr = bounce + ARCH_DMA_MINALIGN;
+		sg[count++].len = tail;
+	}
+
+	pccb->pdata = buf;
+	pccb->datalen = len;
+	pccb->sg = sg;
+	pccb->sg_count = count;
+}
+
+/* Copy the bounced start and end of a command's data to or from its buffer */
+static void scsi_sg_bounce(struct scsi_cmd *pccb, bool to_bounce)
+{
+	struct scsi_sg *first = &pccb->sg[0];
+	struct scsi_sg *last = &pccb->sg[pccb->sg_count - 1];
+	u8 *end = pccb->pdata + pccb->datalen - last->len;
+
+	if (first->addr != pccb->pdata) {
+		if (to_bounce)
+			memcpy(first->addr, pccb->pdata, first->len);
+		else
+			memcpy(pccb->pdata, first->addr, first->len);
+	}
+	if (last != first && last->addr != end) {
+		if (to_bounce)
+			memcpy(last->addr, end, last->len);
+		else
+			memcpy(end, last->addr, last->len);
+	}
+}
+
+/**
+ * scsi_rw_sg() - Read or write using scatter-gather commands
+ *
+ * The transfer is split into as many commands as the host can queue, but
+ * none smaller than SCSI_QUEUE_MIN_BYTES, and these are passed to the host
+ * together. Each command's data is passed as a list of segments, so only its
+ * unaligned start and end are copied.
+ *
+ * @dev: Block device
+ * @blknr: First block to transfer
+ * @blkcnt: Number of blocks to transfer
+ * @buffer: Buffer for the data
+ * @max_blks: Largest number of blocks for one command
+ * @write: true to write, false to read
+ * Return: number of blocks transferred, or -ENOMEM if there is no memory for
+ * the commands
+ */
+static long scsi_rw_sg(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		       void *buffer, lbaint_t max_blks, bool write)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct udevice *bdev = dev->parent;
+	struct scsi_plat *uc_plat = dev_get_uclass_plat(bdev);
+	ulong max_seg = uc_plat->max_seg_bytes;
+	lbaint_t start = blknr, left = blkcnt, per_cmd, blocks;
+	struct scsi_cmd *cmds = NULL, *pccb;
+	uint depth, segs, count;
+	struct scsi_sg *sg = NULL;
+	u8 *bounce = NULL;
+	u8 *buf = buffer;
+	long ret = -ENOMEM;
+	int done, i;
+
+	/* leave room for the bounced start and end of each command */
+	if (max_seg)
+		max_blks = min_t(lbaint_t, max_blks,
+				 (uc_plat->max_segments - 2) * max_seg /
+				 block_dev->blksz);
+	depth = max(uc_plat->queue_depth, 1U);
+	per_cmd = DIV_ROUND_UP(blkcnt, depth);
+	per_cmd = max_t(lbaint_t, per_cmd,
+			SCSI_QUEUE_MIN_BYTES / block_dev->blksz);
+	per_cmd = min(per_cmd, max_blks);
+	depth = min_t(lbaint_t, depth, DIV_ROUND_UP(blkcnt, per_cmd));
+	segs = 2 + (max_seg ? DIV_ROUND_UP(per_cmd * block_dev->blksz,
+					   max_seg) : 1);
+
+	cmds = memalign(ARCH_DMA_MINALIGN, depth * sizeof(*cmds));
+	sg = malloc(depth * segs * sizeof(*sg));
+	bounce = memalign(ARCH_DMA_MINALIGN, depth * 2 * ARCH_DMA_MINALIGN);
+	if (!cmds || !sg || !bounce)
+		goto out;
+	memset(cmds, '\0', depth * sizeof(*cmds));
+
+	while (left) {
+		for (count = 0; count < depth && left; count++) {
+			blocks = min(left, per_cmd);
+			pccb = &cmds[count];
+			pccb->target = block_dev->target;
+			pccb->lun = block_dev->lun;
+			pccb->dma_dir = write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+			scsi_setup_rw(pccb, start, blocks, write);
+			scsi_setup_sg(pccb, &sg[count * segs],
+				      &bounce[count * 2 * ARCH_DMA_MINALIGN], buf,
+				      block_dev->blksz * blocks, max_seg);
+			if (write)
+				scsi_sg_bounce(pccb, true);
+			start += blocks;
+			left -= blocks;
+			buf += pccb->datalen;
+		}
+
+		done = scsi_exec_queue(bdev, cmds, count);
+		for (i = 0; !write && i < done; i++)
+			scsi_sg_bounce(&cmds[i], false);
+		if (done != count) {
+			/* the blocks before the first failed command were done */
+			pccb = &cmds[max(done, 0)];
+			scsi_print_error(pccb);
+			ret = (pccb->pdata - (u8 *)buffer) / block_dev->blksz;
+			goto out;
+		}
+	}
+	ret = blkcnt;
+out:
+	free(bounce);
+	free(sg);
+	free(cmds);
+
+	return ret;
+}
+
+/* Check whether a transfer can use scsi_rw_sg() */
+static bool scsi_use_sg(struct scsi_plat *uc_plat, const void *buffer)
+{
+	return uc_plat->max_segments >= 3 &&
+		IS_ALIGNED((uintptr_t)buffer, SCSI_SG_MIN_ALIGN);
+}
+
 static ulong scsi_read(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
 		       void *buffer)
 {
@@ -208,6 +468,23 @@ static ulong scsi_read(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
 	else
 		max_blks = SCSI_MAX_BLK;
 
+	if (scsi_use_sg(uc_plat, buffer)) {
+		long ret;
+
+		ret = scsi_rw_sg(dev, blknr, blkcnt, buffer, max_blks, false);
+		if (ret != -ENOMEM)
+			return ret;
+	}
+
+	if (uc_plat->queue_depth > 1 &&
+	    blkcnt * block_dev->blksz >= 2 * SCSI_QUEUE_MIN_BYTES) {
+		long ret;
+
+		ret = scsi_read_queued(dev, blknr, blkcnt, buffer, max_blks);
+		if (ret != -ENOMEM)
+			return ret;
+	}
+
 	debug("\nscsi_read: dev %d startblk " LBAF
 	      ", blccnt " LBAF " buffer %lx\n",
 	      block_dev->devnum, start, blks, (unsigned long)buffer);
@@ -218,7 +495,7 @@ static ulong scsi_read(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
 		if (start > SCSI_LBA48_READ) {
 			blocks = min_t(lbaint_t, blks, max_blks);
 			pccb->datalen = block_dev->blksz * blocks;
-			scsi_setup_read16(pccb, start, blocks);
+			scsi_setup_ext16(pccb, SCSI_READ16, start, blocks);
 			start += blocks;
 			blks -= blocks;
 		} else
@@ -275,6 +552,17 @@ static ulong scsi_write(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
 	else
 		max_blks = SCSI_MAX_BLK;
 
+	if (scsi_use_sg(uc_plat, buffer)) {
+		long ret;
+
+		ret = scsi_rw_sg(dev, blknr, blkcnt, (void *)buffer, max_blks,
+				 true);
+		if (ret != -ENOMEM) {
+			blkcnt = ret;
+			goto sync;
+		}
+	}
+
 	debug("\n%s: dev %d startblk " LBAF ", blccnt " LBAF " buffer %lx\n",
 	      __func__, block_dev->devnum, start, blks, (unsigned long)buffer);
 	do {
@@ -302,6 +590,7 @@ static ulong scsi_write(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
 		buf_addr += pccb->datalen;
 	} while (blks != 0);
 
+sync:
 	/* Flush the SCSI cache so we don't lose data on board reset. */
 	scsi_setup_sync_cache(pccb, 0, 0);
 	if (scsi_exec(bdev, pccb))
@@ -580,6 +869,7 @@ removable:
  */
 static int do_scsi_scan_one(struct udevice *dev, int id, int lun, bool verbose)
 {
+	struct scsi_plat *uc_plat = dev_get_uclass_plat(dev);
 	int ret;
 	struct udevice *bdev;
 	struct blk_desc bd;
@@ -617,6 +907,7 @@ static int do_scsi_scan_one(struct udevice *dev, int id, int lun, bool verbose)
 	bdesc->removable = bd.removable;
 	bdesc->type = bd.type;
 	bdesc->bb = bd.bb;
+	bdesc->readahead = uc_plat->readahead;
 	memcpy(&bdesc->vendor, &bd.vendor, sizeof(bd.vendor));
 	memcpy(&bdesc->product, &bd.product, sizeof(bd.product));
 	memcpy(&bdesc->revision, &bd.revision,	sizeof(bd.revision));
@@ -15,6 +15,7 @@
 #include <log.h>
 #include <scsi.h>
 #include <scsi_emul.h>
+#include <asm/unaligned.h>
 
 int sb_scsi_emul_command(struct scsi_emul_info *info,
 			 const struct scsi_cmd *req, int len)
@@ -61,6 +62,12 @@ int sb_scsi_emul_command(struct scsi_emul_info *info,
 		ret = SCSI_EMUL_DO_READ;
 		break;
 	}
+	case SCSI_READ16:
+		info->seek_block = get_unaligned_be64(&req->cmd[2]);
+		info->read_len = get_unaligned_be32(&req->cmd[10]);
+		info->buff_used = info->read_len * info->block_size;
+		ret = SCSI_EMUL_DO_READ;
+		break;
 	case SCSI_WRITE10: {
 		const struct scsi_write10_req *write_req = (void *)req;
 
@@ -70,6 +77,12 @@ int sb_scsi_emul_command(struct scsi_emul_info *info,
 		ret = SCSI_EMUL_DO_WRITE;
 		break;
 	}
+	case SCSI_WRITE16:
+		info->seek_block = get_unaligned_be64(&req->cmd[2]);
+		info->write_len = get_unaligned_be32(&req->cmd[10]);
+		info->buff_used = info->write_len * info->block_size;
+		ret = SCSI_EMUL_DO_WRITE;
+		break;
 	default:
 		debug("Command not supported: %x\n", req->cmd[0]);
 		ret = -EPROTONOSUPPORT;
@@ -0,0 +1,476 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Emulation of a UFS host controller and device for sandbox
+ *
+ * The controller registers are kept in memory and accesses to them come here
+ * through ufshcd_readl() and ufshcd_writel(). Requests are taken from the
+ * UTP Transfer Request List set up by the driver, as a real controller would,
+ * with their UPIUs and PRDTs in the Command Descriptors. The device has one
+ * logical unit held in memory and a shared WriteBooster buffer.
+ *
+ * The requests passed with a doorbell write complete one at a time, each
+ * time the doorbell register is read, so that the driver sees several of
+ * them outstanding.
+ */
+
+#define LOG_CATEGORY UCLASS_UFS
+
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <scsi.h>
+#include <scsi_emul.h>
+#include <ufs.h>
+#include <asm/test.h>
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
+#include "ufs.h"
+
+enum {
+	SANDBOX_UFS_NUTRS	= 8,
+	SANDBOX_UFS_BLOCK_LEN	= 4096,
+	SANDBOX_UFS_BLOCKS	= 1024,
+	SANDBOX_UFS_BUF_SIZE	= 512,
+	SANDBOX_UFS_LANES	= 2,
+	SANDBOX_UFS_HS_GEAR	= 4,
+	SANDBOX_UFS_REG_SIZE	= 0x100,
+	SANDBOX_UFS_WB_SIZE	= 2 << 20,
+};
+
+/* SCSI status returned for a command which fails */
+#define SANDBOX_UFS_CHECK_CONDITION	0x02
+
+#define SANDBOX_UFS_NUM_FLAGS	(QUERY_FLAG_IDN_WB_BUFF_FLUSH_DURING_HIBERN8 + 1)
+#define SANDBOX_UFS_NUM_ATTRS	(QUERY_ATTR_IDN_CURR_WB_BUFF_SIZE + 1)
+
+/* Length of the device descriptor, which includes the WriteBooster fields */
+#define SANDBOX_UFS_DEV_DESC_LEN	0x59
+
+/**
+ * struct sandbox_ufs_priv - state of the emulated controller and device
+ *
+ * @regs: Controller registers
+ * @flags: Device flags, indexed by enum flag_idn
+ * @attrs: Device attributes, indexed by enum attr_idn
+ * @gear: TX gear set for the link
+ * @eminfo: SCSI emulator state
+ * @data: Contents of the logical unit
+ * @doorbells: Number of writes to the doorbell register
+ * @reqs: Number of transfer requests passed to the controller
+ * @max_depth: Largest number of transfer requests outstanding at once
+ * @wb_bytes: Number of bytes written through the WriteBooster buffer
+ * @wb_used: Number of bytes in the WriteBooster buffer waiting to be flushed
+ * @max_prdt: Largest number of PRDT entries in a read or write
+ * @max_xfer: Largest number of bytes in a read or write
+ */
+struct sandbox_ufs_priv {
+	u32 regs[SANDBOX_UFS_REG_SIZE / sizeof(u32)];
+	bool flags[SANDBOX_UFS_NUM_FLAGS];
+	u32 attrs[SANDBOX_UFS_NUM_ATTRS];
+	uint gear;
+	struct scsi_emul_info eminfo;
+	u8 *data;
+	uint doorbells;
+	uint reqs;
+	uint max_depth;
+	u64 wb_bytes;
+	ulong wb_used;
+	uint max_prdt;
+	ulong max_xfer;
+};
+
+static const u8 sandbox_ufs_desc_len[QUERY_DESC_IDN_MAX] = {
+	[QUERY_DESC_IDN_DEVICE]		= SANDBOX_UFS_DEV_DESC_LEN,
+	[QUERY_DESC_IDN_CONFIGURATION]	= QUERY_DESC_CONFIGURATION_DEF_SIZE,
+	[QUERY_DESC_IDN_UNIT]		= QUERY_DESC_UNIT_DEF_SIZE,
+	[QUERY_DESC_IDN_INTERCONNECT]	= QUERY_DESC_INTERCONNECT_DEF_SIZE,
+	[QUERY_DESC_IDN_GEOMETRY]	= QUERY_DESC_GEOMETRY_DEF_SIZE,
+	[QUERY_DESC_IDN_POWER]		= QUERY_DESC_POWER_DEF_SIZE,
+	[QUERY_DESC_IDN_HEALTH]		= QUERY_DESC_HEALTH_DEF_SIZE,
+};
+
+#define REG(priv, reg)	((priv)->regs[(reg) / sizeof(u32)])
+
+static void *sandbox_ufs_ptr(u32 lo, u32 hi)
+{
+	return (void *)(uintptr_t)((u64)hi << 32 | lo);
+}
+
+static void sandbox_ufs_uic_cmd(struct sandbox_ufs_priv *priv, u32 cmd)
+{
+	u32 attr = UIC_GET_ATTR_ID(REG(priv, REG_UIC_COMMAND_ARG_1));
+	u32 result = UIC_CMD_RESULT_SUCCESS;
+	u32 val = 0;
+
+	switch (cmd & COMMAND_OPCODE_MASK) {
+	case UIC_CMD_DME_LINK_STARTUP:
+		break;
+	case UIC_CMD_DME_GET:
+	case UIC_CMD_DME_PEER_GET:
+		switch (attr) {
+		case PA_CONNECTEDRXDATALANES:
+		case PA_CONNECTEDTXDATALANES:
+			val = SANDBOX_UFS_LANES;
+			break;
+		case PA_MAXRXHSGEAR:
+			val = SANDBOX_UFS_HS_GEAR;
+			break;
+		}
+		break;
+	case UIC_CMD_DME_SET:
+	case UIC_CMD_DME_PEER_SET:
+		if (attr == PA_PWRMODE)
+			REG(priv, REG_INTERRUPT_STATUS) |= UIC_POWER_MODE;
+		else if (attr == PA_TXGEAR)
+			priv->gear = REG(priv, REG_UIC_COMMAND_ARG_3);
+		break;
+	default:
+		result = UIC_CMD_RESULT_FAILURE;
+	}
+	REG(priv, REG_UIC_COMMAND_ARG_2) = result;
+	REG(priv, REG_UIC_COMMAND_ARG_3) = val;
+	REG(priv, REG_INTERRUPT_STATUS) |= UIC_COMMAND_COMPL;
+}
+
+/* Fill in descriptor @idn, returning its length, or 0 if there is none */
+static uint sandbox_ufs_desc(u8 idn, u8 *desc)
+{
+	static const char model[] = "SANDBOX UFS";
+	u16 *str;
+	uint len;
+	int i;
+
+	if (idn == QUERY_DESC_IDN_STRING) {
+		len = QUERY_DESC_HDR_SIZE + 2 * strlen(model);
+		str = (u16 *)(desc + QUERY_DESC_HDR_SIZE);
+		for (i = 0; model[i]; i++)
+			str[i] = model[i];
+	} else if (idn < QUERY_DESC_IDN_MAX && sandbox_ufs_desc_len[idn]) {
+		len = sandbox_ufs_desc_len[idn];
+		memset(desc, '\0', len);
+	} else {
+		return 0;
+	}
+
+	if (idn == QUERY_DESC_IDN_DEVICE) {
+		desc[DEVICE_DESC_PARAM_NUM_LU] = 1;
+		desc[DEVICE_DESC_PARAM_SPEC_VER] = 0x03;
+		desc[DEVICE_DESC_PARAM_SPEC_VER + 1] = 0x10;
+		/* the model name is string descriptor 1 */
+		desc[DEVICE_DESC_PARAM_PRDCT_NAME] = 1;
+		put_unaligned_be32(UFS_DEV_WRITE_BOOSTER_SUP,
+				   &desc[DEVICE_DESC_PARAM_EXT_UFS_FEATURE_SUP]);
+		desc[DEVICE_DESC_PARAM_WB_TYPE] = WB_BUF_MODE_SHARED;
+		put_unaligned_be32(SANDBOX_UFS_WB_SIZE / SANDBOX_UFS_BLOCK_LEN,
+				   &desc[DEVICE_DESC_PARAM_WB_SHARED_ALLOC_UNITS]);
+	}
+	desc[QUERY_DESC_LENGTH_OFFSET] = len;
+	desc[QUERY_DESC_DESC_TYPE_OFFSET] = idn;
+
+	return len;
+}
+
+static void sandbox_ufs_query(struct sandbox_ufs_priv *priv, int tag,
+			      struct utp_upiu_req *req,
+			      struct utp_upiu_rsp *rsp)
+{
+	const struct utp_upiu_query *qr = &req->qr;
+	u8 *desc = (u8 *)rsp + GENERAL_UPIU_REQUEST_SIZE;
+	u8 func = be32_to_cpu(req->header.dword_1) >> 16;
+	u8 result = QUERY_RESULT_SUCCESS;
+	uint len = 0;
+
+	rsp->qr = *qr;
+	switch (qr->opcode) {
+	case UPIU_QUERY_OPCODE_READ_FLAG:
+	case UPIU_QUERY_OPCODE_SET_FLAG:
+	case UPIU_QUERY_OPCODE_CLEAR_FLAG:
+	case UPIU_QUERY_OPCODE_TOGGLE_FLAG:
+		if (qr->idn >= SANDBOX_UFS_NUM_FLAGS) {
+			result = QUERY_RESULT_INVALID_IDN;
+			break;
+		}
+		if (qr->opcode == UPIU_QUERY_OPCODE_SET_FLAG)
+			priv->flags[qr->idn] = true;
+		else if (qr->opcode == UPIU_QUERY_OPCODE_CLEAR_FLAG)
+			priv->flags[qr->idn] = false;
+		else if (qr->opcode == UPIU_QUERY_OPCODE_TOGGLE_FLAG)
+			priv->flags[qr->idn] = !priv->flags[qr->idn];
+
+		/* the device finishes initialising and flushing at once */
+		priv->flags[QUERY_FLAG_IDN_FDEVICEINIT] = false;
+		if (priv->flags[QUERY_FLAG_IDN_WB_BUFF_FLUSH_EN])
+			priv->wb_used = 0;
+		rsp->qr.value = cpu_to_be32(priv->flags[qr->idn]);
+		break;
+	case UPIU_QUERY_OPCODE_READ_ATTR:
+	case UPIU_QUERY_OPCODE_WRITE_ATTR:
+		if (qr->idn >= SANDBOX_UFS_NUM_ATTRS) {
+			result = QUERY_RESULT_INVALID_IDN;
+			break;
+		}
+		if (qr->opcode == UPIU_QUERY_OPCODE_WRITE_ATTR)
+			priv->attrs[qr->idn] = be32_to_cpu(qr->value);
+
+		priv->attrs[QUERY_ATTR_IDN_WB_FLUSH_STATUS] =
+			priv->flags[QUERY_FLAG_IDN_WB_BUFF_FLUSH_EN] ?
+			WB_FLUSH_STATUS_COMPLETED : WB_FLUSH_STATUS_IDLE;
+		/* in units of 10% */
+		priv->attrs[QUERY_ATTR_IDN_AVAIL_WB_BUFF_SIZE] =
+			10 - priv->wb_used * 10 / SANDBOX_UFS_WB_SIZE;
+		rsp->qr.value = cpu_to_be32(priv->attrs[qr->idn]);
+		break;
+	case UPIU_QUERY_OPCODE_READ_DESC:
+		len = sandbox_ufs_desc(qr->idn, desc);
+		if (!len) {
+			result = QUERY_RESULT_INVALID_IDN;
+			break;
+		}
+		len = min_t(uint, len, be16_to_cpu(qr->length));
+		rsp->qr.length = cpu_to_be16(len);
+		break;
+	default:
+		result = QUERY_RESULT_INVALID_OPCODE;
+	}
+
+	rsp->header.dword_0 = UPIU_HEADER_DWORD(UPIU_TRANSACTION_QUERY_RSP, 0, 0,
+						tag);
+	rsp->header.dword_1 = UPIU_HEADER_DWORD(0, func, result, 0);
+	rsp->header.dword_2 = UPIU_HEADER_DWORD(0, 0, len >> 8, len & 0xff);
+}
+
+/* Copy data between the device and the buffers in a PRDT */
+static void sandbox_ufs_dma(struct ufshcd_sg_entry *prdt, int entries,
+			    u8 *data, ulong len, bool to_host)
+{
+	ulong size;
+	void *buf;
+	int i;
+
+	for (i = 0; i < entries && len; i++) {
+		buf = sandbox_ufs_ptr(le32_to_cpu(prdt[i].base_addr),
+				      le32_to_cpu(prdt[i].upper_addr));
+		size = (le32_to_cpu(prdt[i].size) & GENMASK(17, 0)) + 1;
+		size = min(size, len);
+		if (to_host)
+			memcpy(buf, data, size);
+		else
+			memcpy(data, buf, size);
+		data += size;
+		len -= size;
+	}
+}
+
+static void sandbox_ufs_scsi(struct sandbox_ufs_priv *priv, int tag,
+			     struct utp_upiu_req *req,
+			     struct utp_upiu_rsp *rsp,
+			     struct ufshcd_sg_entry *prdt, int entries)
+{
+	struct scsi_emul_info *info = &priv->eminfo;
+	u8 lun = be32_to_cpu(req->header.dword_0) >> 8;
+	u8 status = SANDBOX_UFS_CHECK_CONDITION;
+	struct scsi_cmd cmd = {};
+	u8 *data;
+	int ret;
+
+	memcpy(cmd.cmd, req->sc.cdb, UFS_CDB_SIZE);
+	cmd.cmdlen = UFS_CDB_SIZE;
+	ret = lun ? -ENODEV : sb_scsi_emul_command(info, &cmd, cmd.cmdlen);
+	data = priv->data + (ulong)info->seek_block * info->block_size;
+	if (ret == SCSI_EMUL_DO_READ || ret == SCSI_EMUL_DO_WRITE) {
+		priv->max_prdt = max_t(uint, priv->max_prdt, entries);
+		priv->max_xfer = max_t(ulong, priv->max_xfer, info->buff_used);
+		if (info->seek_block + info->buff_used / info->block_size <=
+		    SANDBOX_UFS_BLOCKS) {
+			sandbox_ufs_dma(prdt, entries, data, info->buff_used,
+					ret == SCSI_EMUL_DO_READ);
+			status = 0;
+		}
+		if (!status && ret == SCSI_EMUL_DO_WRITE &&
+		    priv->flags[QUERY_FLAG_IDN_WB_EN]) {
+			priv->wb_bytes += info->buff_used;
+			priv->wb_used = min_t(ulong, priv->wb_used +
+					      info->buff_used,
+					      SANDBOX_UFS_WB_SIZE);
+		}
+	} else if (!ret) {
+		sandbox_ufs_dma(prdt, entries, info->buff, info->buff_used,
+				true);
+		status = 0;
+	}
+
+	rsp->header.dword_0 = UPIU_HEADER_DWORD(UPIU_TRANSACTION_RESPONSE, 0,
+						lun, tag);
+	rsp->header.dword_1 = UPIU_HEADER_DWORD(UPIU_COMMAND_SET_TYPE_SCSI, 0,
+						0, status);
+}
+
+/* Carry out the request in slot @tag */
+static void sandbox_ufs_complete(struct sandbox_ufs_priv *priv, int tag)
+{
+	struct utp_transfer_req_desc *utrd;
+	struct ufshcd_sg_entry *prdt;
+	struct utp_upiu_req *req;
+	struct utp_upiu_rsp *rsp;
+	int ocs = OCS_SUCCESS;
+	u8 *ucd;
+
+	utrd = sandbox_ufs_ptr(REG(priv, REG_UTP_TRANSFER_REQ_LIST_BASE_L),
+			       REG(priv, REG_UTP_TRANSFER_REQ_LIST_BASE_H));
+	utrd += tag;
+	ucd = sandbox_ufs_ptr(le32_to_cpu(utrd->command_desc_base_addr_lo),
+			      le32_to_cpu(utrd->command_desc_base_addr_hi));
+	req = (struct utp_upiu_req *)ucd;
+	rsp = (struct utp_upiu_rsp *)(ucd +
+			le16_to_cpu(utrd->response_upiu_offset) * 4);
+	prdt = (struct ufshcd_sg_entry *)(ucd +
+			le16_to_cpu(utrd->prd_table_offset) * 4);
+
+	switch (be32_to_cpu(req->header.dword_0) >> 24) {
+	case UPIU_TRANSACTION_NOP_OUT:
+		rsp->header.dword_0 =
+			UPIU_HEADER_DWORD(UPIU_TRANSACTION_NOP_IN, 0, 0, tag);
+		break;
+	case UPIU_TRANSACTION_QUERY_REQ:
+		sandbox_ufs_query(priv, tag, req, rsp);
+		break;
+	case UPIU_TRANSACTION_COMMAND:
+		sandbox_ufs_scsi(priv, tag, req, rsp, prdt,
+				 le16_to_cpu(utrd->prd_table_length));
+		break;
+	default:
+		ocs = OCS_INVALID_CMD_TABLE_ATTR;
+	}
+	utrd->header.dword_2 = cpu_to_le32(ocs);
+
+	REG(priv, REG_UTP_TRANSFER_REQ_DOOR_BELL) &= ~BIT(tag);
+	REG(priv, REG_INTERRUPT_STATUS) |= UTP_TRANSFER_REQ_COMPL;
+}
+
+u32 sandbox_ufs_readl(struct ufs_hba *hba, u32 reg)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(hba->dev);
+	u32 doorbell;
+
+	switch (reg) {
+	case REG_CONTROLLER_CAPABILITIES:
+		return (SANDBOX_UFS_NUTRS - 1) | MASK_64_ADDRESSING_SUPPORT;
+	case REG_UFS_VERSION:
+		return UFSHCI_VERSION_31;
+	case REG_CONTROLLER_STATUS:
+		return DEVICE_PRESENT | UFSHCD_STATUS_READY | PWR_LOCAL << 8;
+	case REG_UTP_TRANSFER_REQ_DOOR_BELL:
+		doorbell = REG(priv, reg);
+		if (doorbell)
+			sandbox_ufs_complete(priv, __ffs(doorbell));
+		break;
+	}
+	if (reg >= SANDBOX_UFS_REG_SIZE)
+		return 0;
+
+	return REG(priv, reg);
+}
+
+void sandbox_ufs_writel(struct ufs_hba *hba, u32 val, u32 reg)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(hba->dev);
+	u32 *doorbell = &REG(priv, REG_UTP_TRANSFER_REQ_DOOR_BELL);
+
+	switch (reg) {
+	case REG_INTERRUPT_STATUS:
+		REG(priv, reg) &= ~val;
+		return;
+	case REG_UIC_COMMAND:
+		sandbox_ufs_uic_cmd(priv, val);
+		return;
+	case REG_UTP_TRANSFER_REQ_DOOR_BELL:
+		*doorbell |= val;
+		priv->doorbells++;
+		priv->reqs += hweight32(val);
+		priv->max_depth = max_t(uint, priv->max_depth,
+					hweight32(*doorbell));
+		return;
+	case REG_UTP_TRANSFER_REQ_LIST_CLEAR:
+		*doorbell &= val;
+		return;
+	}
+	if (reg < SANDBOX_UFS_REG_SIZE)
+		REG(priv, reg) = val;
+}
+
+void sandbox_ufs_get_queue_stats(struct udevice *dev, uint *doorbellsp,
+				 uint *reqsp, uint *max_depthp)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(dev);
+
+	*doorbellsp = priv->doorbells;
+	*reqsp = priv->reqs;
+	*max_depthp = priv->max_depth;
+}
+
+void sandbox_ufs_get_write_stats(struct udevice *dev, uint *gearp,
+				 u64 *wb_bytesp)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(dev);
+
+	*gearp = priv->gear;
+	*wb_bytesp = priv->wb_bytes;
+}
+
+void sandbox_ufs_get_sg_stats(struct udevice *dev, uint *max_prdtp,
+			      ulong *max_xferp)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(dev);
+
+	*max_prdtp = priv->max_prdt;
+	*max_xferp = priv->max_xfer;
+}
+
+static int sandbox_ufs_bind(struct udevice *dev)
+{
+	struct udevice *scsi_dev;
+
+	return ufs_scsi_bind(dev, &scsi_dev);
+}
+
+static int sandbox_ufs_probe(struct udevice *dev)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(dev);
+	struct scsi_emul_info *info = &priv->eminfo;
+
+	info->vendor = "SANDBOX";
+	info->product = "FAKE UFS";
+	info->block_size = SANDBOX_UFS_BLOCK_LEN;
+	info->file_size = SANDBOX_UFS_BLOCKS * SANDBOX_UFS_BLOCK_LEN;
+	info->buff = malloc(SANDBOX_UFS_BUF_SIZE);
+	priv->data = calloc(SANDBOX_UFS_BLOCKS, SANDBOX_UFS_BLOCK_LEN);
+	if (!info->buff || !priv->data)
+		return log_ret(-ENOMEM);
+
+	return ufshcd_probe(dev, NULL);
+}
+
+static int sandbox_ufs_remove(struct udevice *dev)
+{
+	struct sandbox_ufs_priv *priv = dev_get_priv(dev);
+
+	free(priv->eminfo.buff);
+	free(priv->data);
+
+	return 0;
+}
+
+static const struct udevice_id sandbox_ufs_ids[] = {
+	{ .compatible = "sandbox,ufs" },
+	{ }
+};
+
+U_BOOT_DRIVER(sandbox_ufs) = {
+	.name		= "sandbox_ufs",
+	.id		= UCLASS_UFS,
+	.of_match	= sandbox_ufs_ids,
+	.bind		= sandbox_ufs_bind,
+	.probe		= sandbox_ufs_probe,
+	.remove		= sandbox_ufs_remove,
+	.priv_auto	= sizeof(struct sandbox_ufs_priv),
+};
@@ -8,8 +8,10 @@
  * Copyright (C) 2019 Texas Instruments Incorporated - https://www.ti.com
  */
 
+#include <blk.h>
 #include <bouncebuf.h>
 #include <charset.h>
+#include <div64.h>
 #include <dm.h>
 #include <log.h>
 #include <dm/device_compat.h>
@@ -19,12 +21,15 @@
 #include <malloc.h>
 #include <hexdump.h>
 #include <scsi.h>
+#include <time.h>
 #include <ufs.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
 #include <asm/dma-mapping.h>
 #include <linux/bitops.h>
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
+#include <u-boot/schedule.h>
 
 #include "ufs.h"
 
@@ -49,7 +54,10 @@
 /* Timeout after 30 msecs if NOP OUT hangs without response */
 #define NOP_OUT_TIMEOUT    30 /* msecs */
 
-/* Only use one Task Tag for all requests */
+/* Time allowed for the WriteBooster buffer to flush */
+#define UFS_WB_FLUSH_TIMEOUT	10000 /* 10 seconds */
+
+/* Task Tag used for device management requests */
 #define TASK_TAG	0
 
 /* Expose the flag value from utp_upiu_query.value */
@@ -57,6 +65,9 @@
 
 #define MAX_PRDT_ENTRY	262144
 
+/* Transfer request slots with a single doorbell register */
+#define UFSHCD_MAX_SLOTS	32
+
 /* maximum bytes per request */
 #define UFS_MAX_BYTES	(128 * 256 * 1024)
 
@@ -604,27 +615,33 @@ static void ufshcd_host_memory_configure(struct ufs_hba *hba)
 	dma_addr_t cmd_desc_dma_addr;
 	u16 response_offset;
 	u16 prdt_offset;
+	int i;
 
-	utrdlp = hba->utrdl;
-	cmd_desc_dma_addr = (dma_addr_t)hba->ucdl;
+	response_offset = offsetof(struct utp_transfer_cmd_desc, response_upiu);
+	prdt_offset = offsetof(struct utp_transfer_cmd_desc, prd_table);
 
-	utrdlp->command_desc_base_addr_lo =
+	/* Each slot has its own Command Descriptor */
+	for (i = 0; i < hba->nutrs; i++) {
+		utrdlp = &hba->utrdl[i];
+		cmd_desc_dma_addr = (dma_addr_t)&hba->ucdl[i];
+
+		utrdlp->command_desc_base_addr_lo =
 				cpu_to_le32(lower_32_bits(cmd_desc_dma_addr));
-	utrdlp->command_desc_base_addr_hi =
+		utrdlp->command_desc_base_addr_hi =
 				cpu_to_le32(upper_32_bits(cmd_desc_dma_addr));
 
-	response_offset = offsetof(struct utp_transfer_cmd_desc, response_upiu);
-	prdt_offset = offsetof(struct utp_transfer_cmd_desc, prd_table);
-
-	utrdlp->response_upiu_offset = cpu_to_le16(response_offset >> 2);
-	utrdlp->prd_table_offset = cpu_to_le16(prdt_offset >> 2);
-	utrdlp->response_upiu_length = cpu_to_le16(ALIGNED_UPIU_SIZE >> 2);
+		utrdlp->response_upiu_offset =
+				cpu_to_le16(response_offset >> 2);
+		utrdlp->prd_table_offset = cpu_to_le16(prdt_offset >> 2);
+		utrdlp->response_upiu_length =
+				cpu_to_le16(ALIGNED_UPIU_SIZE >> 2);
+	}
 
-	hba->ucd_req_ptr = (struct utp_upiu_req *)hba->ucdl;
+	hba->ucd_req_ptr = (struct utp_upiu_req *)&hba->ucdl[TASK_TAG];
 	hba->ucd_rsp_ptr =
-		(struct utp_upiu_rsp *)&hba->ucdl->response_upiu;
+		(struct utp_upiu_rsp *)&hba->ucdl[TASK_TAG].response_upiu;
 	hba->ucd_prdt_ptr =
-		(struct ufshcd_sg_entry *)&hba->ucdl->prd_table;
+		(struct ufshcd_sg_entry *)&hba->ucdl[TASK_TAG].prd_table;
 }
 
 /**
@@ -632,23 +649,23 @@ static void ufshcd_host_memory_configure(struct ufs_hba *hba)
  */
 static int ufshcd_memory_alloc(struct ufs_hba *hba)
 {
-	/* Allocate one Transfer Request Descriptor
+	/* Allocate a Transfer Request Descriptor for each slot
 	 * Should be aligned to 1k boundary.
 	 */
 	hba->utrdl = memalign(1024,
-			      ALIGN(sizeof(struct utp_transfer_req_desc),
-				    ARCH_DMA_MINALIGN));
+			      ALIGN(sizeof(struct utp_transfer_req_desc) *
+				    hba->nutrs, ARCH_DMA_MINALIGN));
 	if (!hba->utrdl) {
 		dev_err(hba->dev, "Transfer Descriptor memory allocation failed\n");
 		return -ENOMEM;
 	}
 
-	/* Allocate one Command Descriptor
+	/* Allocate a Command Descriptor for each slot
 	 * Should be aligned to 1k boundary.
 	 */
 	hba->ucdl = memalign(1024,
-			     ALIGN(sizeof(struct utp_transfer_cmd_desc),
-				   ARCH_DMA_MINALIGN));
+			     ALIGN(sizeof(struct utp_transfer_cmd_desc) *
+				   hba->nutrs, ARCH_DMA_MINALIGN));
 	if (!hba->ucdl) {
 		dev_err(hba->dev, "Command descriptor memory allocation failed\n");
 		return -ENOMEM;
@@ -727,11 +744,11 @@ static void ufshcd_cache_invalidate(void *addr, unsigned long size)
  * ufshcd_prepare_req_desc_hdr() - Fills the requests header
  * descriptor according to request
  */
-static void ufshcd_prepare_req_desc_hdr(struct ufs_hba *hba,
+static void ufshcd_prepare_req_desc_hdr(struct ufs_hba *hba, int tag,
 					u32 *upiu_flags,
 					enum dma_data_direction cmd_dir)
 {
-	struct utp_transfer_req_desc *req_desc = hba->utrdl;
+	struct utp_transfer_req_desc *req_desc = &hba->utrdl[tag];
 	u32 data_direction;
 	u32 dword_0;
 
@@ -838,7 +855,7 @@ static int ufshcd_comp_devman_upiu(struct ufs_hba *hba,
 
 	hba->dev_cmd.type = cmd_type;
 
-	ufshcd_prepare_req_desc_hdr(hba, &upiu_flags, DMA_NONE);
+	ufshcd_prepare_req_desc_hdr(hba, TASK_TAG, &upiu_flags, DMA_NONE);
 	switch (cmd_type) {
 	case DEV_CMD_TYPE_QUERY:
 		ufshcd_prepare_utp_query_req_upiu(hba, upiu_flags);
@@ -853,16 +870,94 @@ static int ufshcd_comp_devman_upiu(struct ufs_hba *hba,
 	return ret;
 }
 
-static int ufshcd_send_command(struct ufs_hba *hba, unsigned int task_tag)
+/**
+ * ufshcd_wait_free_tag() - Wait for a free request slot
+ *
+ * Other requests may be sent while one is polled for, e.g. by a read-ahead
+ * thread, so this must not pick a slot which is still in use.
+ *
+ * @hba: per adapter instance
+ * Return: the free slot
+ */
+static int ufshcd_wait_free_tag(struct ufs_hba *hba)
 {
-	unsigned long start;
-	u32 intr_status;
-	u32 enabled_intr_status;
+	u32 free;
 
-	ufshcd_writel(hba, 1 << task_tag, REG_UTP_TRANSFER_REQ_DOOR_BELL);
+	while (!(free = GENMASK(hba->nutrs - 1, 0) & ~hba->outstanding_reqs))
+		schedule();
+
+	return __ffs(free);
+}
+
+/**
+ * ufshcd_wait_idle() - Wait until no requests are outstanding
+ *
+ * Device management requests all use the same slot and the same query in
+ * @hba->dev_cmd, so they must wait until any earlier one is finished, as
+ * well as any SCSI command which may be using that slot.
+ *
+ * @hba: per adapter instance
+ */
+static void ufshcd_wait_idle(struct ufs_hba *hba)
+{
+	while (hba->outstanding_reqs)
+		schedule();
+}
+
+/**
+ * ufshcd_ring_doorbell() - Pass requests to the controller
+ *
+ * All the requests are passed with a single write to the doorbell register.
+ *
+ * @hba: per adapter instance
+ * @tags: Slots holding the requests
+ */
+static void ufshcd_ring_doorbell(struct ufs_hba *hba, u32 tags)
+{
+	hba->outstanding_reqs |= tags;
+	ufshcd_writel(hba, tags, REG_UTP_TRANSFER_REQ_DOOR_BELL);
 
 	/* Make sure doorbell reg is updated before reading interrupt status */
 	wmb();
+}
+
+/**
+ * ufshcd_clear_reqs() - Remove requests from the controller
+ *
+ * This is used when requests do not complete, so that their slots can be
+ * used again.
+ *
+ * @hba: per adapter instance
+ * @tags: Slots holding the requests
+ */
+static void ufshcd_clear_reqs(struct ufs_hba *hba, u32 tags)
+{
+	if (hba->quirks & UFSHCI_QUIRK_BROKEN_REQ_LIST_CLR)
+		ufshcd_writel(hba, tags, REG_UTP_TRANSFER_REQ_LIST_CLEAR);
+	else
+		ufshcd_writel(hba, ~tags, REG_UTP_TRANSFER_REQ_LIST_CLEAR);
+	hba->outstanding_reqs &= ~tags;
+}
+
+/**
+ * ufshcd_poll_completions() - Wait for requests to complete
+ *
+ * This returns as soon as any of the requests completes. The controller
+ * clears the doorbell bit of each request it completes. If there is an error,
+ * or no request completes in time, all the requests are cleared.
+ *
+ * @hba: per adapter instance
+ * @tags: Slots holding the requests to wait for
+ * @donep: Returns the slots of the requests which completed
+ * Return: 0 if OK, -ETIMEDOUT if no request completed in time, -EIO if the
+ * controller reported an error
+ */
+static int ufshcd_poll_completions(struct ufs_hba *hba, u32 tags, u32 *donep)
+{
+	unsigned long start;
+	u32 intr_status;
+	u32 enabled_intr_status;
+	u32 done;
 
 	start = get_timer(0);
 	do {
@@ -870,22 +965,40 @@ static int ufshcd_send_command(struct ufs_hba *hba, unsigned int task_tag)
 		enabled_intr_status = intr_status & hba->intr_mask;
 		ufshcd_writel(hba, intr_status, REG_INTERRUPT_STATUS);
 
+		if (enabled_intr_status & UFSHCD_ERROR_MASK) {
+			dev_err(hba->dev, "Error in status:%08x\n",
+				enabled_intr_status);
+			ufshcd_clear_reqs(hba, tags);
+
+			return -EIO;
+		}
+
+		done = tags & ~ufshcd_readl(hba, REG_UTP_TRANSFER_REQ_DOOR_BELL);
+		if (done) {
+			hba->outstanding_reqs &= ~done;
+			*donep = done;
+
+			return 0;
+		}
+
 		if (get_timer(start) > QUERY_REQ_TIMEOUT) {
 			dev_err(hba->dev,
 				"Timedout waiting for UTP response\n");
+			ufshcd_clear_reqs(hba, tags);
 
 			return -ETIMEDOUT;
 		}
+		schedule();
+	} while (true);
+}
 
-		if (enabled_intr_status & UFSHCD_ERROR_MASK) {
-			dev_err(hba->dev, "Error in status:%08x\n",
-				enabled_intr_status);
+static int ufshcd_send_command(struct ufs_hba *hba, unsigned int task_tag)
+{
+	u32 done;
 
-			return -1;
-		}
-	} while (!(enabled_intr_status & UTP_TRANSFER_REQ_COMPL));
+	ufshcd_ring_doorbell(hba, BIT(task_tag));
 
-	return 0;
+	return ufshcd_poll_completions(hba, BIT(task_tag), &done);
 }
 
 /**
@@ -902,9 +1015,9 @@ static inline int ufshcd_get_req_rsp(struct utp_upiu_rsp *ucd_rsp_ptr)
  * ufshcd_get_tr_ocs - Get the UTRD Overall Command Status
  *
  */
-static inline int ufshcd_get_tr_ocs(struct ufs_hba *hba)
+static inline int ufshcd_get_tr_ocs(struct ufs_hba *hba, int tag)
 {
-	struct utp_transfer_req_desc *req_desc = hba->utrdl;
+	struct utp_transfer_req_desc *req_desc = &hba->utrdl[tag];
 
 	ufshcd_cache_invalidate(req_desc, sizeof(*req_desc));
 
@@ -971,6 +1084,7 @@ static int ufshcd_exec_dev_cmd(struct ufs_hba *hba, enum dev_cmd_type cmd_type,
 	int err;
 	int resp;
 
+	ufshcd_wait_idle(hba);
 	err = ufshcd_comp_devman_upiu(hba, cmd_type);
 	if (err)
 		return err;
@@ -979,7 +1093,7 @@ static int ufshcd_exec_dev_cmd(struct ufs_hba *hba, enum dev_cmd_type cmd_type,
 	if (err)
 		return err;
 
-	err = ufshcd_get_tr_ocs(hba);
+	err = ufshcd_get_tr_ocs(hba, TASK_TAG);
 	if (err) {
 		dev_err(hba->dev, "Error in OCS:%d\n", err);
 		return -EINVAL;
@@ -1018,6 +1132,7 @@ static inline void ufshcd_init_query(struct ufs_hba *hba,
 				     enum query_opcode opcode,
 				     u8 idn, u8 index, u8 selector)
 {
+	ufshcd_wait_idle(hba);
 	*request = &hba->dev_cmd.query.request;
 	*response = &hba->dev_cmd.query.response;
 	memset(*request, 0, sizeof(struct ufs_query_req));
@@ -1107,6 +1222,78 @@ static int ufshcd_query_flag_retry(struct ufs_hba *hba,
 	return ret;
 }
 
+/**
+ * ufshcd_query_attr() - API function for sending attribute requests
+ */
+static int ufshcd_query_attr(struct ufs_hba *hba, enum query_opcode opcode,
+			     enum attr_idn idn, u8 index, u8 selector,
+			     u32 *attr_val)
+{
+	struct ufs_query_req *request = NULL;
+	struct ufs_query_res *response = NULL;
+	int err;
+
+	if (!attr_val) {
+		dev_err(hba->dev, "%s: attribute value required for opcode 0x%x\n",
+			__func__, opcode);
+		return -EINVAL;
+	}
+
+	ufshcd_init_query(hba, &request, &response, opcode, idn, index,
+			  selector);
+
+	switch (opcode) {
+	case UPIU_QUERY_OPCODE_WRITE_ATTR:
+		request->query_func = UPIU_QUERY_FUNC_STANDARD_WRITE_REQUEST;
+		request->upiu_req.value = cpu_to_be32(*attr_val);
+		break;
+	case UPIU_QUERY_OPCODE_READ_ATTR:
+		request->query_func = UPIU_QUERY_FUNC_STANDARD_READ_REQUEST;
+		break;
+	default:
+		dev_err(hba->dev, "%s: Expected query attr opcode but got = 0x%.2x\n",
+			__func__, opcode);
+		return -EINVAL;
+	}
+
+	err = ufshcd_exec_dev_cmd(hba, DEV_CMD_TYPE_QUERY, QUERY_REQ_TIMEOUT);
+	if (err) {
+		dev_err(hba->dev, "%s: opcode 0x%.2x for idn %d failed, index %d, err = %d\n",
+			__func__, opcode, idn, index, err);
+		return err;
+	}
+
+	*attr_val = be32_to_cpu(response->upiu_res.value);
+
+	return 0;
+}
+
+static int ufshcd_query_attr_retry(struct ufs_hba *hba,
+				   enum query_opcode opcode,
+				   enum attr_idn idn, u8 index, u8 selector,
+				   u32 *attr_val)
+{
+	int ret;
+	int retries;
+
+	for (retries = 0; retries < QUERY_REQ_RETRIES; retries++) {
+		ret = ufshcd_query_attr(hba, opcode, idn, index, selector,
+					attr_val);
+		if (ret)
+			dev_dbg(hba->dev,
+				"%s: failed with error %d, retries %d\n",
+				__func__, ret, retries);
+		else
+			break;
+	}
+
+	if (ret)
+		dev_err(hba->dev,
+			"%s: query attribute, opcode %d, idn %d, failed with error %d after %d retries\n",
+			__func__, opcode, idn, ret, retries);
+	return ret;
+}
+
 static int __ufshcd_query_descriptor(struct ufs_hba *hba,
 				     enum query_opcode opcode,
 				     enum desc_idn idn, u8 index, u8 selector,
@@ -1433,16 +1620,19 @@ static int ufshcd_uic_change_pwr_mode(struct ufs_hba *hba, u8 mode)
 }
 
 static
-void ufshcd_prepare_utp_scsi_cmd_upiu(struct ufs_hba *hba,
+void ufshcd_prepare_utp_scsi_cmd_upiu(struct ufs_hba *hba, int tag,
 				      struct scsi_cmd *pccb, u32 upiu_flags)
 {
-	struct utp_upiu_req *ucd_req_ptr = hba->ucd_req_ptr;
+	struct utp_upiu_req *ucd_req_ptr =
+		(struct utp_upiu_req *)hba->ucdl[tag].command_upiu;
+	struct utp_upiu_rsp *ucd_rsp_ptr =
+		(struct utp_upiu_rsp *)hba->ucdl[tag].response_upiu;
 	unsigned int cdb_len;
 
 	/* command descriptor fields */
 	ucd_req_ptr->header.dword_0 =
 			UPIU_HEADER_DWORD(UPIU_TRANSACTION_COMMAND, upiu_flags,
-					  pccb->lun, TASK_TAG);
+					  pccb->lun, tag);
 	ucd_req_ptr->header.dword_1 =
 			UPIU_HEADER_DWORD(UPIU_COMMAND_SET_TYPE_SCSI, 0, 0, 0);
 
@@ -1455,9 +1645,31 @@ void ufshcd_prepare_utp_scsi_cmd_upiu(struct ufs_hba *hba,
 	memset(ucd_req_ptr->sc.cdb, 0, UFS_CDB_SIZE);
 	memcpy(ucd_req_ptr->sc.cdb, pccb->cmd, cdb_len);
 
-	memset(hba->ucd_rsp_ptr, 0, sizeof(struct utp_upiu_rsp));
+	memset(ucd_rsp_ptr, 0, sizeof(struct utp_upiu_rsp));
 	ufshcd_cache_flush(ucd_req_ptr, sizeof(*ucd_req_ptr));
-	ufshcd_cache_flush(hba->ucd_rsp_ptr, sizeof(*hba->ucd_rsp_ptr));
+	ufshcd_cache_flush(ucd_rsp_ptr, sizeof(*ucd_rsp_ptr));
+}
+
+/* Flush or invalidate the data for a SCSI command, in each of its segments */
+static void ufshcd_cache_data(struct scsi_cmd *pccb, bool flush)
+{
+	int i;
+
+	if (!pccb->sg_count) {
+		if (flush)
+			ufshcd_cache_flush(pccb->pdata, pccb->datalen);
+		else
+			ufshcd_cache_invalidate(pccb->pdata, pccb->datalen);
+		return;
+	}
+
+	for (i = 0; i < pccb->sg_count; i++) {
+		if (flush)
+			ufshcd_cache_flush(pccb->sg[i].addr, pccb->sg[i].len);
+		else
+			ufshcd_cache_invalidate(pccb->sg[i].addr,
+						pccb->sg[i].len);
+	}
 }
 
 static inline void prepare_prdt_desc(struct ufshcd_sg_entry *entry,
@@ -1468,10 +1680,11 @@ static inline void prepare_prdt_desc(struct ufshcd_sg_entry *entry,
 	entry->upper_addr = cpu_to_le32(upper_32_bits((unsigned long)buf));
 }
 
-static void prepare_prdt_table(struct ufs_hba *hba, struct scsi_cmd *pccb)
+static void prepare_prdt_table(struct ufs_hba *hba, int tag,
+			       struct scsi_cmd *pccb)
 {
-	struct utp_transfer_req_desc *req_desc = hba->utrdl;
-	struct ufshcd_sg_entry *prd_table = hba->ucd_prdt_ptr;
+	struct utp_transfer_req_desc *req_desc = &hba->utrdl[tag];
+	struct ufshcd_sg_entry *prd_table = hba->ucdl[tag].prd_table;
 	ulong datalen = pccb->datalen;
 	int table_length;
 	u8 *buf;
@@ -1483,6 +1696,14 @@ static void prepare_prdt_table(struct ufs_hba *hba, struct scsi_cmd *pccb)
 		return;
 	}
 
+	if (pccb->sg_count) {
+		table_length = pccb->sg_count;
+		for (i = 0; i < table_length; i++)
+			prepare_prdt_desc(&prd_table[i], pccb->sg[i].addr,
+					  pccb->sg[i].len - 1);
+		goto done;
+	}
+
 	table_length = DIV_ROUND_UP(pccb->datalen, MAX_PRDT_ENTRY);
 	buf = pccb->pdata;
 	i = table_length;
@@ -1495,35 +1716,47 @@ static void prepare_prdt_table(struct ufs_hba *hba, struct scsi_cmd *pccb)
 
 	prepare_prdt_desc(&prd_table[table_length - i - 1], buf, datalen - 1);
 
+done:
 	req_desc->prd_table_length = table_length;
 	ufshcd_cache_flush(prd_table, sizeof(*prd_table) * table_length);
 	ufshcd_cache_flush(req_desc, sizeof(*req_desc));
 }
 
-static int ufs_scsi_exec(struct udevice *scsi_dev, struct scsi_cmd *pccb)
+/**
+ * ufshcd_prepare_scsi_cmd() - Set up a slot to send a SCSI command
+ */
+static void ufshcd_prepare_scsi_cmd(struct ufs_hba *hba, int tag,
+				    struct scsi_cmd *pccb)
 {
-	struct ufs_hba *hba = dev_get_uclass_priv(scsi_dev->parent);
 	u32 upiu_flags;
-	int ocs, result = 0;
-	u8 scsi_status;
 
-	ufshcd_prepare_req_desc_hdr(hba, &upiu_flags, pccb->dma_dir);
-	ufshcd_prepare_utp_scsi_cmd_upiu(hba, pccb, upiu_flags);
-	prepare_prdt_table(hba, pccb);
+	ufshcd_prepare_req_desc_hdr(hba, tag, &upiu_flags, pccb->dma_dir);
+	ufshcd_prepare_utp_scsi_cmd_upiu(hba, tag, pccb, upiu_flags);
+	prepare_prdt_table(hba, tag, pccb);
 
-	ufshcd_cache_flush(pccb->pdata, pccb->datalen);
+	ufshcd_cache_data(pccb, true);
+}
 
-	ufshcd_send_command(hba, TASK_TAG);
+/**
+ * ufshcd_scsi_cmd_result() - Check the response to a completed SCSI command
+ */
+static int ufshcd_scsi_cmd_result(struct ufs_hba *hba, int tag,
+				  struct scsi_cmd *pccb)
+{
+	struct utp_upiu_rsp *ucd_rsp_ptr =
+		(struct utp_upiu_rsp *)hba->ucdl[tag].response_upiu;
+	int ocs, result = 0;
+	u8 scsi_status;
 
-	ufshcd_cache_invalidate(pccb->pdata, pccb->datalen);
+	ufshcd_cache_data(pccb, false);
 
-	ocs = ufshcd_get_tr_ocs(hba);
+	ocs = ufshcd_get_tr_ocs(hba, tag);
 	switch (ocs) {
 	case OCS_SUCCESS:
-		result = ufshcd_get_req_rsp(hba->ucd_rsp_ptr);
+		result = ufshcd_get_req_rsp(ucd_rsp_ptr);
 		switch (result) {
 		case UPIU_TRANSACTION_RESPONSE:
-			result = ufshcd_get_rsp_upiu_result(hba->ucd_rsp_ptr);
+			result = ufshcd_get_rsp_upiu_result(ucd_rsp_ptr);
 
 			scsi_status = result & MASK_SCSI_STATUS;
 			if (scsi_status)
@@ -1547,9 +1780,77 @@ static int ufs_scsi_exec(struct udevice *scsi_dev, struct scsi_cmd *pccb)
 		return -EINVAL;
 	}
 
+	if (hba->bulk_active && pccb->dma_dir == DMA_TO_DEVICE)
+		hba->bulk_bytes += pccb->datalen;
+
 	return 0;
 }
 
+static int ufs_scsi_exec(struct udevice *scsi_dev, struct scsi_cmd *pccb)
+{
+	struct ufs_hba *hba = dev_get_uclass_priv(scsi_dev->parent);
+	int tag = ufshcd_wait_free_tag(hba);
+	int err;
+
+	ufshcd_prepare_scsi_cmd(hba, tag, pccb);
+
+	err = ufshcd_send_command(hba, tag);
+	if (err)
+		return err;
+
+	return ufshcd_scsi_cmd_result(hba, tag, pccb);
+}
+
+/*
+ * Commands go into all the free slots, with one doorbell write for each
+ * batch, and each slot is filled again as soon as its command completes, so
+ * the device always has as many commands as it can hold.
+ */
+static int ufs_scsi_exec_queue(struct udevice *scsi_dev, struct scsi_cmd *cmds,
+			       int count)
+{
+	struct ufs_hba *hba = dev_get_uclass_priv(scsi_dev->parent);
+	int cmd_of_tag[UFSHCD_MAX_SLOTS];
+	u32 pending = 0, tags, free, done;
+	int next = 0, failed = count;
+	int tag, err;
+
+	while (pending || (next < failed && next < count)) {
+		free = GENMASK(hba->nutrs - 1, 0) & ~hba->outstanding_reqs;
+		tags = 0;
+		while (free && next < failed && next < count) {
+			tag = __ffs(free);
+			free &= ~BIT(tag);
+			ufshcd_prepare_scsi_cmd(hba, tag, &cmds[next]);
+			cmd_of_tag[tag] = next++;
+			tags |= BIT(tag);
+		}
+		if (tags) {
+			ufshcd_ring_doorbell(hba, tags);
+			pending |= tags;
+		}
+
+		err = ufshcd_poll_completions(hba, pending, &done);
+		if (err) {
+			/* the requests were cleared, so none of them finished */
+			done = pending;
+			failed = min(failed, next);
+		}
+		pending &= ~done;
+
+		for (tag = 0; done; tag++) {
+			if (!(done & BIT(tag)))
+				continue;
+			done &= ~BIT(tag);
+			if (err || ufshcd_scsi_cmd_result(hba, tag,
+							  &cmds[cmd_of_tag[tag]]))
+				failed = min(failed, cmd_of_tag[tag]);
+		}
+	}
+
+	return failed;
+}
+
 static inline int ufshcd_read_desc(struct ufs_hba *hba, enum desc_idn desc_id,
 				   int desc_index, u8 *buf, u32 size)
 {
@@ -1622,6 +1923,37 @@ out:
 	return err;
 }
 
+/**
+ * ufshcd_wb_probe() - check whether the device has a usable WriteBooster
+ * buffer
+ *
+ * Only a buffer shared by all logical units is used, since writes may go to
+ * any of them.
+ */
+static void ufshcd_wb_probe(struct ufs_hba *hba, const u8 *desc_buf)
+{
+	u16 spec_ver;
+	u32 features;
+
+	hba->wb_sup = false;
+	if (hba->desc_size.dev_desc < DEVICE_DESC_PARAM_WB_SHARED_ALLOC_UNITS + 4)
+		return;
+
+	spec_ver = get_unaligned_be16(&desc_buf[DEVICE_DESC_PARAM_SPEC_VER]);
+	features = get_unaligned_be32(&desc_buf[DEVICE_DESC_PARAM_EXT_UFS_FEATURE_SUP]);
+	if (spec_ver < 0x220 || !(features & UFS_DEV_WRITE_BOOSTER_SUP))
+		return;
+
+	if (desc_buf[DEVICE_DESC_PARAM_WB_TYPE] != WB_BUF_MODE_SHARED ||
+	    !get_unaligned_be32(&desc_buf[DEVICE_DESC_PARAM_WB_SHARED_ALLOC_UNITS])) {
+		dev_dbg(hba->dev, "%s: no shared WriteBooster buffer\n",
+			__func__);
+		return;
+	}
+
+	hba->wb_sup = true;
+}
+
 static int ufs_get_device_desc(struct ufs_hba *hba,
 			       struct ufs_dev_desc *dev_desc)
 {
@@ -1654,6 +1986,8 @@ static int ufs_get_device_desc(struct ufs_hba *hba,
 
 	model_index = desc_buf[DEVICE_DESC_PARAM_PRDCT_NAME];
 
+	ufshcd_wb_probe(hba, desc_buf);
+
 	/* Zero-pad entire buffer for string termination. */
 	memset(desc_buf, 0, buff_len);
 
@@ -1805,6 +2139,96 @@ static int ufshcd_change_power_mode(struct ufs_hba *hba,
 	return ret;
 }
 
+/**
+ * ufshcd_idle_pwr_mode() - work out the power mode to use outside bulk
+ * transfers
+ *
+ * This is the highest mode the link supports, with the HS gear limited to
+ * CONFIG_UFS_IDLE_HS_GEAR if that is set.
+ */
+static void ufshcd_idle_pwr_mode(struct ufs_hba *hba)
+{
+	struct ufs_pa_layer_attr *pwr_info = &hba->idle_pwr_info;
+
+	*pwr_info = hba->max_pwr_info.info;
+	if (!CONFIG_UFS_IDLE_HS_GEAR)
+		return;
+
+	if (pwr_info->pwr_rx != SLOW_MODE)
+		pwr_info->gear_rx = min_t(u32, pwr_info->gear_rx,
+					  CONFIG_UFS_IDLE_HS_GEAR);
+	if (pwr_info->pwr_tx != SLOW_MODE)
+		pwr_info->gear_tx = min_t(u32, pwr_info->gear_tx,
+					  CONFIG_UFS_IDLE_HS_GEAR);
+}
+
+/**
+ * ufshcd_wb_ctrl() - send writes through the WriteBooster buffer, or not
+ */
+static int ufshcd_wb_ctrl(struct ufs_hba *hba, bool enable)
+{
+	enum query_opcode opcode;
+	int ret;
+
+	if (!hba->wb_sup)
+		return -EOPNOTSUPP;
+	if (hba->wb_enabled == enable)
+		return 0;
+
+	opcode = enable ? UPIU_QUERY_OPCODE_SET_FLAG :
+		 UPIU_QUERY_OPCODE_CLEAR_FLAG;
+	ret = ufshcd_query_flag_retry(hba, opcode, QUERY_FLAG_IDN_WB_EN, NULL);
+	if (ret)
+		return ret;
+	hba->wb_enabled = enable;
+
+	return 0;
+}
+
+/**
+ * ufshcd_wb_flush() - flush the WriteBooster buffer to normal storage
+ *
+ * If @wait is false the device is left to flush the buffer while it is idle.
+ * Otherwise this waits for the flush to finish and then stops the device
+ * flushing again.
+ */
+static int ufshcd_wb_flush(struct ufs_hba *hba, bool wait)
+{
+	ulong start;
+	u32 status;
+	int ret;
+
+	if (!hba->wb_sup)
+		return -EOPNOTSUPP;
+
+	ret = ufshcd_query_flag_retry(hba, UPIU_QUERY_OPCODE_SET_FLAG,
+				      QUERY_FLAG_IDN_WB_BUFF_FLUSH_EN, NULL);
+	if (ret || !wait)
+		return ret;
+
+	start = get_timer(0);
+	do {
+		ret = ufshcd_query_attr_retry(hba, UPIU_QUERY_OPCODE_READ_ATTR,
+					      QUERY_ATTR_IDN_WB_FLUSH_STATUS,
+					      0, 0, &status);
+		if (ret)
+			return ret;
+		if (status != WB_FLUSH_STATUS_IN_PROGRESS)
+			break;
+		if (get_timer(start) > UFS_WB_FLUSH_TIMEOUT)
+			return -ETIMEDOUT;
+		schedule();
+		mdelay(1);
+	} while (true);
+
+	ret = ufshcd_query_flag_retry(hba, UPIU_QUERY_OPCODE_CLEAR_FLAG,
+				      QUERY_FLAG_IDN_WB_BUFF_FLUSH_EN, NULL);
+	if (ret)
+		return ret;
+
+	return status == WB_FLUSH_STATUS_FAILED ? -EIO : 0;
+}
+
 /**
  * ufshcd_verify_dev_init() - Verify device initialization
  *
@@ -1910,7 +2334,8 @@ static int ufs_start(struct ufs_hba *hba)
 			"%s: Failed getting max supported power mode\n",
 			__func__);
 	} else {
-		ret = ufshcd_change_power_mode(hba, &hba->max_pwr_info.info);
+		ufshcd_idle_pwr_mode(hba);
+		ret = ufshcd_change_power_mode(hba, &hba->idle_pwr_info);
 		if (ret) {
 			dev_err(hba->dev, "%s: Failed setting power mode, err = %d\n",
 				__func__, ret);
@@ -1941,6 +2366,10 @@ int ufshcd_probe(struct udevice *ufs_dev, struct ufs_hba_ops *hba_ops)
 	scsi_plat->max_id = UFSHCD_MAX_ID;
 	scsi_plat->max_lun = UFS_MAX_LUNS;
 	scsi_plat->max_bytes_per_req = UFS_MAX_BYTES;
+	scsi_plat->max_segments = MAX_BUFF;
+	scsi_plat->max_seg_bytes = MAX_PRDT_ENTRY;
+	/* ufshcd_send_command() yields while polling, so reads can overlap */
+	scsi_plat->readahead = true;
 
 	hba->dev = ufs_dev;
 	hba->ops = hba_ops;
@@ -1963,6 +2392,10 @@ int ufshcd_probe(struct udevice *ufs_dev, struct ufs_hba_ops *hba_ops)
 	if (hba->quirks & UFSHCD_QUIRK_BROKEN_64BIT_ADDRESS)
 		hba->capabilities &= ~MASK_64_ADDRESSING_SUPPORT;
 
+	/* nutrs is 0 based */
+	hba->nutrs = (hba->capabilities & MASK_TRANSFER_REQUESTS_SLOTS_SDB) + 1;
+	scsi_plat->queue_depth = hba->nutrs;
+
 	/* Get UFS version supported by the controller */
 	hba->version = ufshcd_get_ufs_version(hba);
 	if (hba->version != UFSHCI_VERSION_10 &&
@@ -2045,6 +2478,7 @@ static int ufs_scsi_buffer_aligned(struct udevice *scsi_dev, struct bounce_buffe
 
 static struct scsi_ops ufs_ops = {
 	.exec		= ufs_scsi_exec,
+	.exec_queue	= ufs_scsi_exec_queue,
 #if IS_ENABLED(CONFIG_BOUNCE_BUFFER)
 	.buffer_aligned	= ufs_scsi_buffer_aligned,
 #endif	/* CONFIG_BOUNCE_BUFFER */
@@ -2071,6 +2505,121 @@ int ufs_probe(void)
 	return 0;
 }
 
+struct udevice *ufs_blk_host(struct blk_desc *desc)
+{
+	struct udevice *scsi_dev, *ufs_dev;
+
+	if (desc->uclass_id != UCLASS_SCSI)
+		return NULL;
+
+	scsi_dev = dev_get_parent(desc->bdev);
+	ufs_dev = dev_get_parent(scsi_dev);
+	if (!ufs_dev || device_get_uclass_id(ufs_dev) != UCLASS_UFS)
+		return NULL;
+
+	return ufs_dev;
+}
+
+int ufs_bulk_begin(struct udevice *dev)
+{
+	struct ufs_hba *hba = dev_get_uclass_priv(dev);
+	int ret;
+
+	if (hba->bulk_active)
+		return 0;
+
+	if (hba->max_pwr_info.is_valid) {
+		ret = ufshcd_change_power_mode(hba, &hba->max_pwr_info.info);
+		if (ret)
+			return ret;
+	}
+
+	if (hba->wb_sup) {
+		ret = ufshcd_wb_ctrl(hba, true);
+		if (ret)
+			dev_warn(dev, "Cannot enable WriteBooster, err = %d\n",
+				 ret);
+	}
+
+	hba->bulk_active = true;
+	hba->bulk_bytes = 0;
+	hba->bulk_start = timer_get_us();
+
+	return 0;
+}
+
+int ufs_bulk_end(struct udevice *dev, struct ufs_bulk_stats *stats)
+{
+	struct ufs_hba *hba = dev_get_uclass_priv(dev);
+	struct ufs_bulk_stats *last = &hba->bulk_last;
+	int ret = 0;
+
+	if (!hba->bulk_active)
+		return -EINVAL;
+	hba->bulk_active = false;
+
+	last->bytes = hba->bulk_bytes;
+	last->time_us = max(timer_get_us() - hba->bulk_start, 1UL);
+	last->rate = lldiv(last->bytes * 1000, last->time_us);
+	printf("UFS: wrote %llu bytes in %lu ms, %lu.%02lu MB/s\n",
+	       last->bytes, last->time_us / 1000, last->rate / 1000,
+	       last->rate % 1000 / 10);
+	if (stats)
+		*stats = *last;
+
+	/* leave the device to flush the buffer while it is idle */
+	if (hba->wb_enabled) {
+		ret = ufshcd_wb_ctrl(hba, false);
+		if (!ret)
+			ret = ufshcd_wb_flush(hba, false);
+	}
+
+	if (hba->max_pwr_info.is_valid) {
+		int err;
+
+		err = ufshcd_change_power_mode(hba, &hba->idle_pwr_info);
+		if (!ret)
+			ret = err;
+	}
+
+	return ret;
+}
+
+int ufs_wb_enable(struct udevice *dev, bool enable)
+{
+	return ufshcd_wb_ctrl(dev_get_uclass_priv(dev), enable);
+}
+
+int ufs_wb_flush(struct udevice *dev)
+{
+	return ufshcd_wb_flush(dev_get_uclass_priv(dev), true);
+}
+
+int ufs_get_status(struct udevice *dev, struct ufs_status *status)
+{
+	struct ufs_hba *hba = dev_get_uclass_priv(dev);
+	u32 avail;
+
+	memset(status, '\0', sizeof(*status));
+	status->gear = hba->pwr_info.gear_tx;
+	status->max_gear = hba->max_pwr_info.info.gear_tx;
+	status->lanes = hba->pwr_info.lane_tx;
+	status->hs = hba->pwr_info.pwr_tx == FAST_MODE ||
+		     hba->pwr_info.pwr_tx == FASTAUTO_MODE;
+	status->wb_sup = hba->wb_sup;
+	status->wb_enabled = hba->wb_enabled;
+	status->wb_avail = -1;
+	if (hba->wb_sup &&
+	    !ufshcd_query_attr_retry(hba, UPIU_QUERY_OPCODE_READ_ATTR,
+				     QUERY_ATTR_IDN_AVAIL_WB_BUFF_SIZE, 0, 0,
+				     &avail))
+		status->wb_avail = min(avail, 10U) * 10;
+	status->bulk_active = hba->bulk_active;
+	status->bulk_last = hba->bulk_last;
+
+	return 0;
+}
+
 U_BOOT_DRIVER(ufs_scsi) = {
 	.id = UCLASS_SCSI,
 	.name = "ufs_scsi",
@@ -2,6 +2,7 @@
 #ifndef __UFS_H
 #define __UFS_H
 
+#include <ufs.h>
 #include <linux/types.h>
 #include <asm/io.h>
 #include "ufshci.h"
@@ -206,6 +207,9 @@ enum flag_idn {
 	QUERY_FLAG_IDN_BUSY_RTC				= 0x09,
 	QUERY_FLAG_IDN_RESERVED3			= 0x0A,
 	QUERY_FLAG_IDN_PERMANENTLY_DISABLE_FW_UPDATE	= 0x0B,
+	QUERY_FLAG_IDN_WB_EN				= 0x0E,
+	QUERY_FLAG_IDN_WB_BUFF_FLUSH_EN			= 0x0F,
+	QUERY_FLAG_IDN_WB_BUFF_FLUSH_DURING_HIBERN8	= 0x10,
 };
 
 /* Attribute idn for Query requests */
@@ -233,6 +237,19 @@ enum attr_idn {
 	QUERY_ATTR_IDN_FFU_STATUS		= 0x14,
 	QUERY_ATTR_IDN_PSA_STATE		= 0x15,
 	QUERY_ATTR_IDN_PSA_DATA_SIZE		= 0x16,
+	QUERY_ATTR_IDN_WB_FLUSH_STATUS		= 0x1C,
+	QUERY_ATTR_IDN_AVAIL_WB_BUFF_SIZE	= 0x1D,
+	QUERY_ATTR_IDN_WB_BUFF_LIFE_TIME_EST	= 0x1E,
+	QUERY_ATTR_IDN_CURR_WB_BUFF_SIZE	= 0x1F,
+};
+
+/* Values of QUERY_ATTR_IDN_WB_FLUSH_STATUS */
+enum ufs_wb_flush_status {
+	WB_FLUSH_STATUS_IDLE		= 0x0,
+	WB_FLUSH_STATUS_IN_PROGRESS	= 0x1,
+	WB_FLUSH_STATUS_STOPPED		= 0x2,
+	WB_FLUSH_STATUS_COMPLETED	= 0x3,
+	WB_FLUSH_STATUS_FAILED		= 0x4,
 };
 
 /* Descriptor idn for Query requests */
@@ -382,6 +399,19 @@ enum device_desc_param {
 	DEVICE_DESC_PARAM_PSA_MAX_DATA		= 0x25,
 	DEVICE_DESC_PARAM_PSA_TMT		= 0x29,
 	DEVICE_DESC_PARAM_PRDCT_REV		= 0x2A,
+	DEVICE_DESC_PARAM_EXT_UFS_FEATURE_SUP	= 0x4F,
+	DEVICE_DESC_PARAM_WB_PRESRV_USRSPC_EN	= 0x53,
+	DEVICE_DESC_PARAM_WB_TYPE		= 0x54,
+	DEVICE_DESC_PARAM_WB_SHARED_ALLOC_UNITS	= 0x55,
+};
+
+/* Bits in DEVICE_DESC_PARAM_EXT_UFS_FEATURE_SUP */
+#define UFS_DEV_WRITE_BOOSTER_SUP	BIT(8)
+
+/* Values of DEVICE_DESC_PARAM_WB_TYPE */
+enum {
+	WB_BUF_MODE_LU_DEDICATED	= 0x0,
+	WB_BUF_MODE_SHARED		= 0x1,
 };
 
 struct ufs_hba;
@@ -686,6 +716,21 @@ struct ufs_hba {
 	u32			intr_mask;
 	enum ufshcd_quirks	quirks;
 
+	/* Number of UTP transfer request slots */
+	int			nutrs;
+	/* Slots whose request the controller has not completed */
+	u32			outstanding_reqs;
+
+	/* WriteBooster */
+	bool			wb_sup;
+	bool			wb_enabled;
+
+	/* Bulk transfer, see ufs_bulk_begin() */
+	bool			bulk_active;
+	ulong			bulk_start;
+	u64			bulk_bytes;
+	struct ufs_bulk_stats	bulk_last;
+
 	/* Virtual memory reference */
 	struct utp_transfer_cmd_desc *ucdl;
 	struct utp_transfer_req_desc *utrdl;
@@ -700,6 +745,8 @@ struct ufs_hba {
 	enum ufs_dev_pwr_mode curr_dev_pwr_mode;
 	struct ufs_pa_layer_attr pwr_info;
 	struct ufs_pwr_mode_info max_pwr_info;
+	/* Power mode used outside bulk transfers */
+	struct ufs_pa_layer_attr idle_pwr_info;
 
 	struct ufs_dev_cmd dev_cmd;
 };
@@ -760,10 +807,19 @@ enum {
 	INTERRUPT_MASK_ALL_VER_21	= 0x71FFF,
 };
 
+#if IS_ENABLED(CONFIG_UFS_SANDBOX)
+/* The sandbox emulator stands in for the controller registers */
+u32 sandbox_ufs_readl(struct ufs_hba *hba, u32 reg);
+void sandbox_ufs_writel(struct ufs_hba *hba, u32 val, u32 reg);
+
+#define ufshcd_writel(hba, val, reg)	sandbox_ufs_writel(hba, val, reg)
+#define ufshcd_readl(hba, reg)		sandbox_ufs_readl(hba, reg)
+#else
 #define ufshcd_writel(hba, val, reg)   \
 	writel((val), (hba)->mmio_base + (reg))
 #define ufshcd_readl(hba, reg) \
 	readl((hba)->mmio_base + (reg))
+#endif
 
 /**
  * ufshcd_rmwl - perform read/modify/write for a controller register
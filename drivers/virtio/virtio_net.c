@@ -32,36 +32,117 @@ struct virtio_net_priv {
 	char rx_buff[VIRTIO_NET_NUM_RX_BUFS][VIRTIO_NET_RX_BUF_SIZE];
 	bool rx_running;
 	int net_hdr_len;
+
+	/* Headers of the frames being sent, the legacy one being a prefix */
+	struct virtio_net_hdr_v1 tx_hdr[ETH_PACKETS_BATCH_SEND];
+
+	/*
+	 * While a destination is posted, only one buffer is kept in the ring,
+	 * so that the destination given to it is for the very next frame. The
+	 * other buffers wait in rx_held. rx_dest_queued counts the buffers in
+	 * the ring which point at a destination, and rx_busy marks the buffer
+	 * being processed by the stack.
+	 */
+	struct eth_rx_dest rx_dest;
+	struct eth_rx_dest rx_placed[VIRTIO_NET_NUM_RX_BUFS];
+	bool rx_has_dest[VIRTIO_NET_NUM_RX_BUFS];
+	bool rx_busy[VIRTIO_NET_NUM_RX_BUFS];
+	bool rx_post_mode;
+	bool rx_posted;
+	int rx_queued;
+	int rx_dest_queued;
+	int rx_held[VIRTIO_NET_NUM_RX_BUFS];
+	int rx_num_held;
 };
 
 /*
- * For simplicity, the driver only negotiates the VIRTIO_NET_F_MAC feature.
- * For the VIRTIO_NET_F_STATUS feature, we don't negotiate it, hence per spec
- * we should assume the link is always active.
+ * For simplicity, the driver only negotiates the VIRTIO_NET_F_MAC feature and
+ * the checksum offloads. For the VIRTIO_NET_F_STATUS feature, we don't
+ * negotiate it, hence per spec we should assume the link is always active.
  */
 static const u32 feature[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+	VIRTIO_NET_F_CSUM,
+	VIRTIO_NET_F_GUEST_CSUM,
 };
 
 static const u32 feature_legacy[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+	VIRTIO_NET_F_CSUM,
+	VIRTIO_NET_F_GUEST_CSUM,
 };
 
+/* Put receive buffer @i in the ring, placing the payload at rx_dest if posted */
+static int virtio_net_add_rx(struct virtio_net_priv *priv, int i)
+{
+	struct eth_rx_dest *dest = &priv->rx_placed[i];
+	struct virtio_sg sg[ETH_RX_SG_MAX + 2];
+	struct virtio_sg *sgs[ETH_RX_SG_MAX + 2];
+	uint offset;
+	int count = 0;
+	int ret;
+	int j;
+
+	priv->rx_has_dest[i] = priv->rx_posted;
+	if (!priv->rx_posted) {
+		sg[count].addr = priv->rx_buff[i];
+		sg[count++].length = VIRTIO_NET_RX_BUF_SIZE;
+	} else {
+		/*
+		 * Headers go at the start of the buffer, the payload to the
+		 * destination and anything after it back in the buffer, at the
+		 * same place as if the frame had been received whole
+		 */
+		*dest = priv->rx_dest;
+		priv->rx_posted = false;
+		offset = priv->net_hdr_len + dest->hdr_len;
+		sg[count].addr = priv->rx_buff[i];
+		sg[count++].length = offset;
+		for (j = 0; j < dest->count; j++) {
+			sg[count].addr = dest->sg[j].addr;
+			sg[count++].length = dest->sg[j].len;
+			offset += dest->sg[j].len;
+		}
+		if (offset < VIRTIO_NET_RX_BUF_SIZE) {
+			sg[count].addr = priv->rx_buff[i] + offset;
+			sg[count++].length = VIRTIO_NET_RX_BUF_SIZE - offset;
+		}
+	}
+	for (j = 0; j < count; j++)
+		sgs[j] = &sg[j];
+
+	ret = virtqueue_add(priv->rx_vq, sgs, 0, count);
+	if (ret)
+		return ret;
+	priv->rx_queued++;
+	if (priv->rx_has_dest[i])
+		priv->rx_dest_queued++;
+
+	return 0;
+}
+
+/* Keep one buffer in the ring while destinations are being posted */
+static void virtio_net_refill_rx(struct virtio_net_priv *priv)
+{
+	if (priv->rx_queued || !priv->rx_num_held)
+		return;
+
+	if (virtio_net_add_rx(priv, priv->rx_held[priv->rx_num_held - 1]))
+		return;
+	priv->rx_num_held--;
+	virtqueue_kick(priv->rx_vq);
+}
+
 static int virtio_net_start(struct udevice *dev)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
-	struct virtio_sg sg;
-	struct virtio_sg *sgs[] = { &sg };
 	int i;
 
 	if (!priv->rx_running) {
-		/* receive buffer length is always 1526 */
-		sg.length = VIRTIO_NET_RX_BUF_SIZE;
-
-		/* setup the receive buffer address */
+		/* the buffer the stack still holds goes back when freed */
 		for (i = 0; i < VIRTIO_NET_NUM_RX_BUFS; i++) {
-			sg.addr = priv->rx_buff[i];
-			virtqueue_add(priv->rx_vq, sgs, 0, 1);
+			if (!priv->rx_busy[i])
+				virtio_net_add_rx(priv, i);
 		}
 
 		virtqueue_kick(priv->rx_vq);
@@ -73,61 +154,203 @@ static int virtio_net_start(struct udevice *dev)
 	return 0;
 }
 
-static int virtio_net_send(struct udevice *dev, void *packet, int length)
+/* Put a frame in the tx ring, with header @i of tx_hdr */
+static int virtio_net_add_tx(struct udevice *dev, struct eth_tx_pkt *pkt,
+			     int i)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
-	struct virtio_net_hdr hdr;
-	struct virtio_net_hdr_v1 hdr_v1;
-	struct virtio_sg hdr_sg;
-	struct virtio_sg data_sg = { packet, length };
+	struct virtio_net_hdr_v1 *hdr = &priv->tx_hdr[i];
+	struct virtio_sg hdr_sg = { hdr, priv->net_hdr_len };
+	struct virtio_sg data_sg = { pkt->packet, pkt->len };
 	struct virtio_sg *sgs[] = { &hdr_sg, &data_sg };
-	int ret;
 
-	if (priv->net_hdr_len == sizeof(struct virtio_net_hdr))
-		hdr_sg.addr = &hdr;
-	else
-		hdr_sg.addr = &hdr_v1;
-	hdr_sg.length = priv->net_hdr_len;
+	memset(hdr, 0, priv->net_hdr_len);
+	if (pkt->csum_start) {
+		hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+		hdr->csum_start = cpu_to_virtio16(dev, pkt->csum_start);
+		hdr->csum_offset = cpu_to_virtio16(dev, pkt->csum_offset);
+	}
 
-	memset(hdr_sg.addr, 0, priv->net_hdr_len);
+	return virtqueue_add(priv->tx_vq, sgs, 2, 0);
+}
 
-	ret = virtqueue_add(priv->tx_vq, sgs, 2, 0);
-	if (ret)
-		return ret;
+/* Start sending the frames in the tx ring and wait for all @count of them */
+static void virtio_net_tx_wait(struct virtio_net_priv *priv, int count)
+{
+	if (!count)
+		return;
 
 	virtqueue_kick(priv->tx_vq);
-
-	while (1) {
+	while (count) {
 		if (virtqueue_get_buf(priv->tx_vq, NULL))
+			count--;
+	}
+}
+
+static int virtio_net_send_batch(struct udevice *dev, struct eth_tx_pkt *pkts,
+				 int count)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int queued = 0;
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (queued == ARRAY_SIZE(priv->tx_hdr)) {
+			virtio_net_tx_wait(priv, queued);
+			queued = 0;
+		}
+		ret = virtio_net_add_tx(dev, &pkts[i], queued);
+		if (ret == -ENOSPC && queued) {
+			/* The ring is full, so let it drain first */
+			virtio_net_tx_wait(priv, queued);
+			queued = 0;
+			ret = virtio_net_add_tx(dev, &pkts[i], queued);
+		}
+		if (ret)
 			break;
+		queued++;
 	}
+	virtio_net_tx_wait(priv, queued);
 
-	return 0;
+	return i ? i : ret;
+}
+
+static int virtio_net_send(struct udevice *dev, void *packet, int length)
+{
+	struct eth_tx_pkt pkt = { .packet = packet, .len = length };
+	int ret;
+
+	ret = virtio_net_send_batch(dev, &pkt, 1);
+
+	return ret < 0 ? ret : 0;
 }
 
 static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
+	struct virtio_net_hdr *hdr;
 	unsigned int len;
 	void *buf;
+	int i;
 
 	buf = virtqueue_get_buf(priv->rx_vq, &len);
 	if (!buf)
 		return -EAGAIN;
+	priv->rx_queued--;
+
+	i = (buf - (void *)priv->rx_buff) / VIRTIO_NET_RX_BUF_SIZE;
+	priv->rx_busy[i] = true;
+	if (priv->rx_has_dest[i])
+		priv->rx_dest_queued--;
+	hdr = buf;
+	len -= priv->net_hdr_len;
+	if (priv->rx_has_dest[i] && len > priv->rx_placed[i].hdr_len) {
+		eth_rx_placed(&priv->rx_placed[i]);
+	} else if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+		/*
+		 * The host left the checksum for us to fill in, as it does for
+		 * frames which never went on a wire. Do it, so the frame is
+		 * whole for a stack which checks it anyway.
+		 */
+		net_csum_fill(buf + priv->net_hdr_len, len,
+			      virtio16_to_cpu(dev, hdr->csum_start),
+			      virtio16_to_cpu(dev, hdr->csum_offset));
+	}
+	if (hdr->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+			  VIRTIO_NET_HDR_F_DATA_VALID))
+		eth_rx_csum_valid();
 
 	*packetp = buf + priv->net_hdr_len;
-	return len - priv->net_hdr_len;
+	return len;
 }
 
 static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
 	void *buf = packet - priv->net_hdr_len;
-	struct virtio_sg sg = { buf, VIRTIO_NET_RX_BUF_SIZE };
-	struct virtio_sg *sgs[] = { &sg };
+	int i = (buf - (void *)priv->rx_buff) / VIRTIO_NET_RX_BUF_SIZE;
+
+	priv->rx_busy[i] = false;
+	if (priv->rx_post_mode) {
+		priv->rx_held[priv->rx_num_held++] = i;
+		virtio_net_refill_rx(priv);
+		return 0;
+	}
 
 	/* Put the buffer back to the rx ring */
-	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+	virtio_net_add_rx(priv, i);
+	virtqueue_kick(priv->rx_vq);
+
+	return 0;
+}
+
+static int virtio_net_write_hwaddr(struct udevice *dev);
+
+/*
+ * Take back a receive buffer which points at a destination. The device cannot
+ * be asked to give up a buffer, so reset it and set the queues up again. The
+ * receive buffers are put back in the ring by virtio_net_start().
+ */
+static int virtio_net_reset_rx(struct udevice *dev)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	ret = virtio_reset(dev);
+	if (ret)
+		return ret;
+	virtio_add_status(dev, VIRTIO_CONFIG_S_ACKNOWLEDGE |
+			  VIRTIO_CONFIG_S_DRIVER);
+	ret = virtio_finalize_features(dev);
+	if (ret)
+		return ret;
+	virtio_del_vqs(dev);
+	ret = virtio_find_vqs(dev, 2, priv->vqs);
+	if (ret)
+		return ret;
+	virtio_add_status(dev, VIRTIO_CONFIG_S_DRIVER_OK);
+
+	/* a legacy device forgets its MAC address on reset */
+	virtio_net_write_hwaddr(dev);
+
+	priv->rx_running = false;
+	priv->rx_queued = 0;
+	priv->rx_dest_queued = 0;
+	priv->rx_num_held = 0;
+
+	return 0;
+}
+
+static int virtio_net_post_rx(struct udevice *dev,
+			      const struct eth_rx_dest *dest)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	if (dest && dest->count > ETH_RX_SG_MAX)
+		return -E2BIG;
+
+	priv->rx_posted = dest;
+	if (dest) {
+		priv->rx_dest = *dest;
+		priv->rx_post_mode = true;
+		virtio_net_refill_rx(priv);
+		return 0;
+	}
+
+	priv->rx_post_mode = false;
+	if (priv->rx_dest_queued) {
+		/* nothing may be written to the destination from now on */
+		ret = virtio_net_reset_rx(dev);
+		if (ret)
+			return ret;
+		return virtio_net_start(dev);
+	}
+
+	/* Put all the buffers back in the ring */
+	while (priv->rx_num_held)
+		virtio_net_add_rx(priv, priv->rx_held[--priv->rx_num_held]);
 	virtqueue_kick(priv->rx_vq);
 
 	return 0;
@@ -138,8 +361,10 @@ static void virtio_net_stop(struct udevice *dev)
 	/*
 	 * There is no way to stop the queue from running, unless we issue
 	 * a reset to the virtio device, and re-do the queue initialization
-	 * from the beginning.
+	 * from the beginning. Do that only if the ring still holds a buffer
+	 * pointing at memory which the caller may reuse.
 	 */
+	virtio_net_post_rx(dev, NULL);
 }
 
 static int virtio_net_write_hwaddr(struct udevice *dev)
@@ -213,6 +438,12 @@ static int virtio_net_probe(struct udevice *dev)
 	else
 		priv->net_hdr_len = sizeof(struct virtio_net_hdr_v1);
 
+	eth_set_offload(dev,
+			(virtio_has_feature(dev, VIRTIO_NET_F_CSUM) ?
+			 ETH_OFFLOAD_TX_CSUM : 0) |
+			(virtio_has_feature(dev, VIRTIO_NET_F_GUEST_CSUM) ?
+			 ETH_OFFLOAD_RX_CSUM : 0));
+
 	return 0;
 }
 
@@ -224,6 +455,8 @@ static const struct eth_ops virtio_net_ops = {
 	.stop = virtio_net_stop,
 	.write_hwaddr = virtio_net_write_hwaddr,
 	.read_rom_hwaddr = virtio_net_read_rom_hwaddr,
+	.post_rx = virtio_net_post_rx,
+	.send_batch = virtio_net_send_batch,
 };
 
 U_BOOT_DRIVER(virtio_net) = {
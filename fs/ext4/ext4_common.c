@@ -1995,6 +1995,230 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/*
+ * Runs looked up for the most recently read inode. Directory iteration and
+ * repeated reads of the same file resolve each run once; the map is keyed on
+ * the inode size and block count as well, so that it does not outlive a
+ * write to the inode.
+ */
+static struct {
+	struct ext2_data *data;
+	int ino;
+	__le32 size;
+	__le32 blockcnt;
+	uint count;
+	struct ext4_extent_run runs[EXT4_RUN_CACHE_SIZE];
+} ext4fs_run_map;
+
+static void ext4fs_run_map_reset(void)
+{
+	ext4fs_run_map.data = NULL;
+	ext4fs_run_map.count = 0;
+}
+
+static bool ext4fs_run_map_valid(struct ext2fs_node *node)
+{
+	return ext4fs_run_map.data == node->data &&
+	       ext4fs_run_map.ino == node->ino &&
+	       ext4fs_run_map.size == node->inode.size &&
+	       ext4fs_run_map.blockcnt == node->inode.blockcnt;
+}
+
+/* index of the first cached run starting after @fileblock */
+static uint ext4fs_run_map_upper(uint32_t fileblock)
+{
+	uint lo = 0, hi = ext4fs_run_map.count;
+
+	while (lo < hi) {
+		uint mid = (lo + hi) / 2;
+
+		if (ext4fs_run_map.runs[mid].lblk <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static bool ext4fs_run_map_find(struct ext2fs_node *node, uint32_t fileblock,
+				struct ext4_extent_run *run)
+{
+	struct ext4_extent_run *r;
+	uint i;
+
+	if (!ext4fs_run_map_valid(node))
+		return false;
+
+	i = ext4fs_run_map_upper(fileblock);
+	if (!i)
+		return false;
+	r = &ext4fs_run_map.runs[i - 1];
+	if (fileblock - r->lblk >= r->len)
+		return false;
+
+	run->lblk = fileblock;
+	run->len = r->len - (fileblock - r->lblk);
+	run->pblk = r->pblk ? r->pblk + (fileblock - r->lblk) : 0;
+
+	return true;
+}
+
+static void ext4fs_run_map_add(struct ext2fs_node *node,
+			       const struct ext4_extent_run *run)
+{
+	struct ext4_extent_run *r;
+	uint i;
+
+	if (!ext4fs_run_map_valid(node) ||
+	    ext4fs_run_map.count == EXT4_RUN_CACHE_SIZE) {
+		ext4fs_run_map.data = node->data;
+		ext4fs_run_map.ino = node->ino;
+		ext4fs_run_map.size = node->inode.size;
+		ext4fs_run_map.blockcnt = node->inode.blockcnt;
+		ext4fs_run_map.count = 0;
+	}
+
+	i = ext4fs_run_map_upper(run->lblk);
+	r = &ext4fs_run_map.runs[i];
+	memmove(r + 1, r, (ext4fs_run_map.count - i) * sizeof(*r));
+	*r = *run;
+	/* keep the runs disjoint */
+	if (i < ext4fs_run_map.count && r[1].lblk - r->lblk < r->len)
+		r->len = r[1].lblk - r->lblk;
+	ext4fs_run_map.count++;
+}
+
+static int ext4fs_extent_run(struct ext2_inode *inode, uint32_t fileblock,
+			     struct ext4_extent_run *run,
+			     struct ext_block_cache *cache)
+{
+	struct ext4_extent_header *root, *ext_block;
+	struct ext4_extent *extent;
+	int log2_blksz;
+	uint32_t end;
+	uint lo, hi, n;
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	root = (struct ext4_extent_header *)inode->b.blocks.dir_blocks;
+	ext_block = ext4fs_get_extent_block(ext4fs_root, cache, root,
+					    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	n = le16_to_cpu(ext_block->eh_entries);
+
+	/* find the first extent starting after fileblock */
+	lo = 0;
+	hi = n;
+	while (lo < hi) {
+		uint mid = (lo + hi) / 2;
+
+		if (le32_to_cpu(extent[mid].ee_block) <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	run->lblk = fileblock;
+	if (lo) {
+		uint32_t start = le32_to_cpu(extent[lo - 1].ee_block);
+
+		end = start + le16_to_cpu(extent[lo - 1].ee_len);
+		if (fileblock < end) {
+			run->pblk = ((u64)le16_to_cpu(extent[lo - 1].ee_start_hi)
+				     << 32) +
+				le32_to_cpu(extent[lo - 1].ee_start_lo) +
+				(fileblock - start);
+			run->len = end - fileblock;
+
+			/* merge extents which are contiguous on disk too */
+			for (; lo < n; lo++) {
+				u64 pblk;
+
+				pblk = ((u64)le16_to_cpu(extent[lo].ee_start_hi)
+					<< 32) + le32_to_cpu(extent[lo].ee_start_lo);
+				if (le32_to_cpu(extent[lo].ee_block) !=
+				    fileblock + run->len ||
+				    pblk != run->pblk + run->len)
+					break;
+				run->len += le16_to_cpu(extent[lo].ee_len);
+			}
+
+			return 0;
+		}
+	}
+
+	/* Sparse file */
+	run->pblk = 0;
+	if (lo < n)
+		run->len = le32_to_cpu(extent[lo].ee_block) - fileblock;
+	else if (ext_block == root)
+		run->len = U32_MAX - fileblock;
+	else
+		/* the hole may end in the next leaf */
+		run->len = 1;
+
+	return 0;
+}
+
+static int ext4fs_indirect_run(struct ext2_inode *inode, uint32_t fileblock,
+			       uint32_t maxblocks, struct ext4_extent_run *run)
+{
+	long int blknr;
+
+	blknr = read_allocated_block(inode, fileblock, NULL);
+	if (blknr < 0)
+		return -EIO;
+	run->lblk = fileblock;
+	run->pblk = blknr;
+	run->len = 1;
+
+	/* coalesce pointers to consecutive blocks, or consecutive holes */
+	while (run->len < maxblocks) {
+		blknr = read_allocated_block(inode, fileblock + run->len, NULL);
+		if (blknr < 0)
+			return -EIO;
+		if (run->pblk ? blknr != run->pblk + run->len : blknr)
+			break;
+		run->len++;
+	}
+
+	return 0;
+}
+
+int ext4fs_map_run(struct ext2fs_node *node, uint32_t fileblock,
+		   uint32_t maxblocks, struct ext4_extent_run *run,
+		   struct ext_block_cache *cache)
+{
+	int ret;
+
+	if (!maxblocks)
+		return -EINVAL;
+
+	if (!ext4fs_run_map_find(node, fileblock, run)) {
+		if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+			ret = ext4fs_extent_run(&node->inode, fileblock, run,
+						cache);
+		else
+			ret = ext4fs_indirect_run(&node->inode, fileblock,
+						  maxblocks, run);
+		if (ret)
+			return ret;
+		ext4fs_run_map_add(node, run);
+	}
+	if (run->len > maxblocks)
+		run->len = maxblocks;
+	debug("ext4fs_map_run %u: %u blocks at %llu\n", run->lblk, run->len,
+	      (unsigned long long)run->pblk);
+
+	return 0;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -2009,6 +2233,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_run_map_reset();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -42,6 +42,22 @@
 #define SUPERBLOCK_SIZE	1024
 #define F_FILE			1
 
+/* Number of runs remembered for the most recently read inode */
+#define EXT4_RUN_CACHE_SIZE	32
+
+/**
+ * struct ext4_extent_run - run of file blocks which are contiguous on disk
+ *
+ * @lblk: First file block
+ * @len: Number of blocks
+ * @pblk: Filesystem block holding @lblk, or 0 if the run is a hole
+ */
+struct ext4_extent_run {
+	uint32_t lblk;
+	uint32_t len;
+	u64 pblk;
+};
+
 static inline void *zalloc(size_t size)
 {
 	return kzalloc(size, 0);
@@ -51,6 +67,23 @@ int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
+
+/**
+ * ext4fs_map_run() - Map file blocks to a run of filesystem blocks
+ *
+ * Works for both extent-mapped and indirect-block (ext2/3) inodes. For the
+ * latter, pointers to consecutive blocks are coalesced into one run.
+ *
+ * @node: Inode to map
+ * @fileblock: First file block to map
+ * @maxblocks: Maximum length of the run, must be non-zero
+ * @run: Returns the run starting at @fileblock
+ * @cache: Cache for extent tree blocks
+ * Return: 0 if OK, -ve on error
+ */
+int ext4fs_map_run(struct ext2fs_node *node, uint32_t fileblock,
+		   uint32_t maxblocks, struct ext4_extent_run *run,
+		   struct ext_block_cache *cache);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_find_file1(const char *currpath, struct ext2fs_node *currroot,
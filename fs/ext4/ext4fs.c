@@ -64,29 +64,23 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 }
 
 /*
- * Taken from openmoko-kernel mailing list: By Andy green
- * Optimized read file API : collects and defers contiguous sector
- * reads into one potentially more efficient larger sequential read action
+ * Read the file one run of contiguous blocks at a time, so that each run
+ * becomes a single multi-block read straight into the caller's buffer
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	lbaint_t blockcnt;
+	lbaint_t blockcnt, i;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
-	lbaint_t delayed_start = 0;
-	lbaint_t delayed_extent = 0;
-	lbaint_t delayed_skipfirst = 0;
-	lbaint_t delayed_next = 0;
-	char *delayed_buf = NULL;
-	char *start_buf = buf;
-	short status;
+	/* keep each read within the int byte count of ext4fs_devread() */
+	uint32_t maxrun = (INT_MAX >> (log2_fs_blocksize + log2blksz)) - 1;
+	struct ext4_extent_run run;
 	struct ext_block_cache cache;
+	loff_t left;
 
 	ext_cache_init(&cache);
 
@@ -100,105 +94,37 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 	}
 
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	left = len;
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
-		lbaint_t blknr;
-		long blknr_and_status;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
+	for (i = lldiv(pos, blocksize); i < blockcnt; i += run.len) {
 		int skipfirst = 0;
-		blknr_and_status = read_allocated_block(&node->inode, i, &cache);
-		if (blknr_and_status < 0) {
+		loff_t n;
+
+		if (ext4fs_map_run(node, i, min_t(lbaint_t, blockcnt - i,
+						  maxrun), &run, &cache)) {
 			ext_cache_fini(&cache);
 			return -1;
 		}
 
-		/* Block number could becomes very large when CONFIG_SYS_64BIT_LBA is enabled
-		 * and wrap around at max long int
-		 */
-		blknr = (lbaint_t)blknr_and_status << log2_fs_blocksize;
-
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
-
 		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
-		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-					if (status == 0) {
-						ext_cache_fini(&cache);
-						return -1;
-					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_skipfirst = skipfirst;
-				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
+		if (i == lldiv(pos, blocksize))
+			skipfirst = pos - (blocksize * i);
+		n = min_t(loff_t, ((loff_t)run.len << (log2_fs_blocksize +
+						       log2blksz)) - skipfirst,
+			  left);
+
+		if (run.pblk) {
+			if (!ext4fs_devread((lbaint_t)run.pblk <<
+					    log2_fs_blocksize, skipfirst, n,
+					    buf)) {
+				ext_cache_fini(&cache);
+				return -1;
 			}
 		} else {
-			int n;
-			int n_left;
-			if (previous_block_number != -1) {
-				/* spill */
-				status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-				if (status == 0) {
-					ext_cache_fini(&cache);
-					return -1;
-				}
-				previous_block_number = -1;
-			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
 			memset(buf, 0, n);
 		}
-		buf += blocksize - skipfirst;
-	}
-	if (previous_block_number != -1) {
-		/* spill */
-		status = ext4fs_devread(delayed_start,
-					delayed_skipfirst, delayed_extent,
-					delayed_buf);
-		if (status == 0) {
-			ext_cache_fini(&cache);
-			return -1;
-		}
-		previous_block_number = -1;
+		buf += n;
+		left -= n;
 	}
 
 	*actread  = len;
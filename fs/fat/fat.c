@@ -12,6 +12,7 @@
 
 #include <blk.h>
 #include <config.h>
+#include <div64.h>
 #include <exports.h>
 #include <fat.h>
 #include <fs.h>
@@ -65,10 +66,50 @@ static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 	return ret;
 }
 
+/**
+ * struct fat_run - run of clusters which are contiguous on disk
+ *
+ * @fclust:	index of the first cluster of the run within the file
+ * @clust:	first cluster of the run
+ * @count:	number of clusters in the run
+ */
+struct fat_run {
+	__u32 fclust;
+	__u32 clust;
+	__u32 count;
+};
+
+/*
+ * Cluster map of the most recently read file. It is extended lazily as far as
+ * reads require, so that loading a file piecewise at increasing offsets walks
+ * the FAT only once, and finding the cluster at an offset is a binary search.
+ * It is dropped whenever the device is set, since the volume may have been
+ * written behind our back, e.g. with 'mmc write', ums or fastboot.
+ */
+static struct {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	__u32 vol_id;
+	__u32 start;		/* first cluster of the file */
+	__u32 size;		/* file size */
+	__u32 nclust;		/* number of clusters mapped */
+	__u32 last;		/* last cluster mapped */
+	int count;		/* number of runs */
+	int alloc;		/* number of runs allocated */
+	struct fat_run *runs;
+} fat_map;
+
+static void fat_map_invalidate(void)
+{
+	free(fat_map.runs);
+	memset(&fat_map, '\0', sizeof(fat_map));
+}
+
 int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fat_map_invalidate();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -309,6 +350,84 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* extend the cluster map of the file to cover at least 'nclust' clusters */
+static int fat_map_extend(fsdata *mydata, dir_entry *dentptr, __u32 nclust)
+{
+	__u32 clust;
+
+	if (fat_map.dev != cur_dev ||
+	    fat_map.part_start != cur_part_info.start ||
+	    fat_map.vol_id != mydata->vol_id ||
+	    fat_map.start != START(dentptr) ||
+	    fat_map.size != FAT2CPU32(dentptr->size)) {
+		fat_map_invalidate();
+		fat_map.dev = cur_dev;
+		fat_map.part_start = cur_part_info.start;
+		fat_map.vol_id = mydata->vol_id;
+		fat_map.start = START(dentptr);
+		fat_map.size = FAT2CPU32(dentptr->size);
+	}
+
+	while (fat_map.nclust < nclust) {
+		struct fat_run *run = NULL;
+
+		if (fat_map.count)
+			run = &fat_map.runs[fat_map.count - 1];
+		if (fat_map.nclust)
+			clust = get_fatent(mydata, fat_map.last);
+		else
+			clust = fat_map.start;
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			fat_map_invalidate();
+			return -1;
+		}
+
+		if (run && run->clust + run->count == clust) {
+			run->count++;
+		} else {
+			if (fat_map.count == fat_map.alloc) {
+				int alloc = fat_map.alloc ? fat_map.alloc * 2 : 8;
+
+				run = realloc(fat_map.runs, alloc * sizeof(*run));
+				if (!run) {
+					debug("Error: allocating cluster map\n");
+					fat_map_invalidate();
+					return -1;
+				}
+				fat_map.runs = run;
+				fat_map.alloc = alloc;
+			}
+			run = &fat_map.runs[fat_map.count++];
+			run->fclust = fat_map.nclust;
+			run->clust = clust;
+			run->count = 1;
+		}
+		fat_map.last = clust;
+		fat_map.nclust++;
+	}
+
+	return 0;
+}
+
+/* find the run holding cluster 'fclust' of the file, which must be mapped */
+static struct fat_run *fat_map_find(__u32 fclust)
+{
+	int lo = 0, hi = fat_map.count - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+
+		if (fat_map.runs[mid].fclust <= fclust)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return &fat_map.runs[lo];
+}
+
 /**
  * get_contents() - read from file
  *
@@ -329,9 +448,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	struct fat_run *run;
+	__u32 fclust, clust;
+	loff_t actsize, offset;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -346,101 +465,52 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
+	if (fat_map_extend(mydata, dentptr,
+			   lldiv(filesize + bytesperclust - 1, bytesperclust)))
+		return -1;
 
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
+	while (pos < filesize) {
+		fclust = lldiv(pos, bytesperclust);
+		run = fat_map_find(fclust);
+		clust = run->clust + fclust - run->fclust;
+		offset = pos - (loff_t)fclust * bytesperclust;
+
+		/* read up to the beginning of the next cluster */
+		if (offset) {
+			__u8 *tmp_buffer;
+
+			actsize = min(filesize - pos + offset,
+				      (loff_t)bytesperclust);
+			tmp_buffer = malloc_cache_aligned(actsize);
+			if (!tmp_buffer) {
+				debug("Error: allocating buffer\n");
+				return -1;
+			}
 
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
-			printf("Error reading cluster\n");
+			if (get_cluster(mydata, clust, tmp_buffer, actsize)) {
+				printf("Error reading cluster\n");
+				free(tmp_buffer);
+				return -1;
+			}
+			actsize -= offset;
+			memcpy(buffer, tmp_buffer + offset, actsize);
 			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-	}
-
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
+		} else {
+			/* read the rest of the run at once */
+			actsize = min(filesize - pos,
+				      (loff_t)(run->fclust + run->count - fclust) *
+				      bytesperclust);
+			if (get_cluster(mydata, clust, buffer, actsize)) {
+				printf("Error reading cluster\n");
 				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -642,6 +712,7 @@ static int get_fs_info(fsdata *mydata)
 
 	mydata->fats = bs.fats;
 	mydata->fat_sect = bs.reserved;
+	mydata->vol_id = get_unaligned_le32(volinfo.volume_id);
 
 	mydata->rootdir_sect = mydata->fat_sect + mydata->fatlength * bs.fats;
 
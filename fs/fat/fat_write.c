@@ -486,6 +486,7 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 
 	/* Mark as dirty */
 	mydata->fat_dirty = 1;
+	fat_map_invalidate();
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
@@ -62,6 +62,26 @@ static int sqfs_read_sblk(struct squashfs_super_block **sblk)
 	return 0;
 }
 
+void sqfs_cache_free(void)
+{
+	struct squashfs_cache *cache = &ctxt.cache;
+	struct sqfs_stats stats = cache->stats;
+
+	free(cache->inode_table);
+	free(cache->dir_table);
+	free(cache->dir_pos_list);
+	free(cache->frag_entries);
+	free(cache->frag_block);
+	memset(cache, '\0', sizeof(*cache));
+	cache->stats = stats;
+	cache->stats.cached_bytes = 0;
+}
+
+void sqfs_get_stats(struct sqfs_stats *stats)
+{
+	*stats = ctxt.cache.stats;
+}
+
 static int sqfs_count_tokens(const char *filename)
 {
 	int token_count = 1, l;
@@ -109,6 +129,7 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	unsigned char *metadata_buffer, *metadata, *table;
 	struct squashfs_fragment_block_entry *entries;
 	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_cache *cache = &ctxt.cache;
 	unsigned long dest_len;
 	int block, offset, ret;
 	u16 header;
@@ -120,6 +141,16 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
 		return -EINVAL;
 
+	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+
+	if (cache->frag_entries && cache->frag_meta_index == block) {
+		cache->stats.meta_hits++;
+		*e = cache->frag_entries[offset];
+		return SQFS_COMPRESSED_BLOCK(e->size);
+	}
+	cache->stats.meta_misses++;
+
 	start = get_unaligned_le64(&sblk->fragment_table_start);
 	end = get_unaligned_le64(&sblk->id_table_start);
 	exp_tbl = get_unaligned_le64(&sblk->export_table_start);
@@ -144,9 +175,6 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 		goto out;
 	}
 
-	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
-
 	/*
 	 * Get the start offset of the metadata block that contains the right
 	 * fragment block entry
@@ -200,6 +228,14 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	*e = entries[offset];
 	ret = SQFS_COMPRESSED_BLOCK(e->size);
 
+	if (!cache->frag_entries)
+		cache->stats.cached_bytes += SQFS_METADATA_BLOCK_SIZE;
+	free(cache->frag_entries);
+	cache->frag_entries = entries;
+	cache->frag_meta_index = block;
+	cache->stats.metablks++;
+	entries = NULL;
+
 out:
 	free(entries);
 	free(metadata_buffer);
@@ -795,6 +831,10 @@ static int sqfs_read_inode_table(unsigned char **inode_table)
 		src_table += src_len + SQFS_HEADER_SIZE;
 	}
 
+	ctxt.cache.stats.metablks += metablks_count;
+	ctxt.cache.stats.cached_bytes += metablks_count *
+		SQFS_METADATA_BLOCK_SIZE;
+
 free_itb:
 	free(itb);
 
@@ -844,12 +884,11 @@ static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
 		goto out;
 
 	*dir_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*dir_table)
-		goto out;
-
 	*pos_list = malloc(metablks_count * sizeof(u32));
-	if (!*pos_list)
+	if (!*dir_table || !*pos_list) {
+		metablks_count = -1;
 		goto out;
+	}
 
 	ret = sqfs_get_metablk_pos(*pos_list, dtb, table_offset,
 				   metablks_count);
@@ -899,12 +938,61 @@ out:
 		free(*pos_list);
 		*dir_table = NULL;
 		*pos_list = NULL;
+	} else {
+		ctxt.cache.stats.metablks += metablks_count;
+		ctxt.cache.stats.cached_bytes += metablks_count *
+			(SQFS_METADATA_BLOCK_SIZE + sizeof(u32));
 	}
 	free(dtb);
 
 	return metablks_count;
 }
 
+/* Get the decompressed inode table, reading it if it is not cached yet */
+static int sqfs_get_inode_table(unsigned char **inode_table)
+{
+	struct squashfs_cache *cache = &ctxt.cache;
+	int ret;
+
+	if (cache->inode_table) {
+		cache->stats.meta_hits++;
+	} else {
+		cache->stats.meta_misses++;
+		ret = sqfs_read_inode_table(&cache->inode_table);
+		if (ret)
+			return ret;
+	}
+	*inode_table = cache->inode_table;
+
+	return 0;
+}
+
+/*
+ * Get the decompressed directory table and its metadata block positions,
+ * reading them if they are not cached yet. Returns the number of metadata
+ * blocks, or a value less than 1 on error.
+ */
+static int sqfs_get_directory_table(unsigned char **dir_table, u32 **pos_list)
+{
+	struct squashfs_cache *cache = &ctxt.cache;
+	int count;
+
+	if (cache->dir_table) {
+		cache->stats.meta_hits++;
+	} else {
+		cache->stats.meta_misses++;
+		count = sqfs_read_directory_table(&cache->dir_table,
+						  &cache->dir_pos_list);
+		if (count < 1)
+			return count;
+		cache->dir_metablks = count;
+	}
+	*dir_table = cache->dir_table;
+	*pos_list = cache->dir_pos_list;
+
+	return cache->dir_metablks;
+}
+
 static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 {
 	unsigned char *inode_table = NULL, *dir_table = NULL;
@@ -924,13 +1012,13 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
+	ret = sqfs_get_inode_table(&inode_table);
 	if (ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
+	metablks_count = sqfs_get_directory_table(&dir_table, &pos_list);
 	if (metablks_count < 1) {
 		ret = -EINVAL;
 		goto out;
@@ -992,12 +1080,9 @@ out:
 			free(token_list[j]);
 		free(token_list);
 	}
-	free(pos_list);
 	free(path);
-	if (ret) {
-		free(inode_table);
+	if (ret)
 		free(dirs);
-	}
 
 	return ret;
 }
@@ -1152,6 +1237,16 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 
 	ctxt.sblk = sblk;
 
+	/* Drop the cached metadata if this is not the image it came from */
+	if (ctxt.cache.dev != fs_dev_desc ||
+	    ctxt.cache.part_start != fs_partition->start ||
+	    memcmp(&ctxt.cache.sblk, sblk, sizeof(*sblk))) {
+		sqfs_cache_free();
+		ctxt.cache.dev = fs_dev_desc;
+		ctxt.cache.part_start = fs_partition->start;
+		ctxt.cache.sblk = *sblk;
+	}
+
 	ret = sqfs_decompressor_init(&ctxt);
 	if (ret) {
 		goto error;
@@ -1360,11 +1455,86 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 	return datablk_count;
 }
 
+/*
+ * Get the contents of the fragment block described by 'e', going through the
+ * fragment block cache. Files smaller than a block are usually packed
+ * together into a fragment block, so consecutive loads often share one.
+ */
+static int sqfs_get_fragment(struct squashfs_fragment_block_entry *e,
+			     bool comp, unsigned char **block)
+{
+	u32 block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	struct squashfs_cache *cache = &ctxt.cache;
+	u64 start, n_blks, table_size, table_offset;
+	unsigned char *fragment;
+	unsigned long dest_len;
+	size_t buf_size;
+	int ret;
+
+	if (cache->frag_len && cache->frag_start == e->start) {
+		cache->stats.frag_hits++;
+		*block = cache->frag_block;
+		return 0;
+	}
+	cache->stats.frag_misses++;
+
+	start = lldiv(e->start, ctxt.cur_dev->blksz);
+	table_size = SQFS_BLOCK_SIZE(e->size);
+	table_offset = e->start - (start * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
+		return -EINVAL;
+
+	fragment = malloc_cache_aligned(buf_size);
+	if (!fragment)
+		return -ENOMEM;
+
+	ret = sqfs_disk_read(start, n_blks, fragment);
+	if (ret < 0)
+		goto out;
+
+	if (!cache->frag_block) {
+		cache->frag_block = malloc(block_size);
+		if (!cache->frag_block) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		cache->stats.cached_bytes += block_size;
+	}
+	cache->frag_len = 0;
+
+	if (comp) {
+		dest_len = block_size;
+		ret = sqfs_decompress(&ctxt, cache->frag_block, &dest_len,
+				      fragment + table_offset, table_size);
+		if (ret)
+			goto out;
+	} else {
+		if (table_size > block_size) {
+			ret = -EINVAL;
+			goto out;
+		}
+		memcpy(cache->frag_block, fragment + table_offset, table_size);
+		dest_len = table_size;
+	}
+
+	cache->frag_start = e->start;
+	cache->frag_len = dest_len;
+	*block = cache->frag_block;
+	ret = 0;
+
+out:
+	free(fragment);
+
+	return ret;
+}
+
 static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 			  loff_t len, loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *dir = NULL, *datablock = NULL, *file = NULL, *resolved, *data;
+	unsigned char *fragment_block;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
 	int ret, j, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
@@ -1379,7 +1549,6 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 	unsigned long dest_len;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
-	size_t buf_size;
 
 	*actread = 0;
 
@@ -1579,56 +1748,19 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
-		return -EINVAL;
-
-	fragment = malloc_cache_aligned(buf_size);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	ret = sqfs_get_fragment(&frag_entry, finfo.comp, &fragment_block);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	if (finfo.offset + finfo.size - *actread > ctxt.cache.frag_len) {
+		ret = -EINVAL;
 		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
 	}
+	memcpy(buf + *actread, &fragment_block[finfo.offset],
+	       finfo.size - *actread);
+	*actread = finfo.size;
 
 out:
-	free(fragment);
 	free(datablock);
 	free(file);
 	free(dir);
@@ -1808,8 +1940,6 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
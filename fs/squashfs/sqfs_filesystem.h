@@ -11,6 +11,7 @@
 #include <asm/unaligned.h>
 #include <fs.h>
 #include <part.h>
+#include <squashfs.h>
 #include <stdint.h>
 
 #define SQFS_MAGIC_NUMBER 0x73717368
@@ -71,6 +72,32 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/*
+ * Decompressed metadata is kept across sqfs_close() and dropped by
+ * sqfs_probe() when it finds a different image, so that loading several
+ * files from one image decompresses the tables only once.
+ */
+struct squashfs_cache {
+	/* Image the cache belongs to */
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	struct squashfs_super_block sblk;
+	/* Decompressed inode and directory tables */
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	/* Positions of the directory table's metadata block headers */
+	u32 *dir_pos_list;
+	int dir_metablks;
+	/* Metadata block 'frag_meta_index' of the fragment table */
+	struct squashfs_fragment_block_entry *frag_entries;
+	int frag_meta_index;
+	/* Last fragment block read, at 'frag_start' on disk, 'frag_len' bytes */
+	unsigned char *frag_block;
+	u64 frag_start;
+	unsigned long frag_len;
+	struct sqfs_stats stats;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
@@ -78,6 +105,7 @@ struct squashfs_ctxt {
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
 #endif
+	struct squashfs_cache cache;
 };
 
 struct squashfs_directory_index {
@@ -272,7 +300,7 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() and belong to the metadata cache.
 	 */
 	unsigned char *inode_table;
 	unsigned char *dir_table;
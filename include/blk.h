@@ -10,6 +10,7 @@
 #include <bouncebuf.h>
 #include <dm/uclass-id.h>
 #include <efi.h>
+#include <linux/errno.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -69,6 +70,7 @@ struct blk_desc {
 	bool	lba48;
 	unsigned char	atapi;		/* Use ATAPI protocol */
 	unsigned char	bb;		/* Use bounce buffer */
+	unsigned char	readahead;	/* Sequential reads can be prefetched */
 	lbaint_t	lba;		/* number of blocks */
 	unsigned long	blksz;		/* block size */
 	int		log2blksz;	/* for convenience: log2(blksz) */
@@ -87,6 +89,9 @@ struct blk_desc {
 	 * device. Once these functions are removed we can drop this field.
 	 */
 	struct udevice *bdev;
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	struct blk_readahead *ra;	/* read-ahead state, if any */
+#endif
 #else
 	unsigned long	(*block_read)(struct blk_desc *block_dev,
 				      lbaint_t start,
@@ -118,7 +123,10 @@ struct blk_desc {
  * @param blksz - size in bytes of each block
  * @param buffer - buffer to contain cached data
  *
- * Return: - 1 if block returned from cache, 0 otherwise.
+ * A cache entry which covers only the leading part of the range is used for
+ * those blocks, and the caller reads the remainder from the device.
+ *
+ * Return: - number of leading blocks returned from cache, 0 if none
  */
 int blkcache_read(int iftype, int dev,
 		  lbaint_t start, lbaint_t blkcnt,
@@ -149,23 +157,50 @@ void blkcache_fill(int iftype, int dev,
  */
 void blkcache_invalidate(int iftype, int dev);
 
+/**
+ * blkcache_remove() - discard the cache and statistics of a device which is
+ * being removed
+ *
+ * @iftype - UCLASS_ID_ for type of device
+ * @dev - device index of particular type
+ */
+void blkcache_remove(int iftype, int dev);
+
 /**
  * blkcache_configure() - configure block cache
  *
  * @param blocks - maximum blocks per entry
  * @param entries - maximum entries in cache
+ * @param bytes - maximum bytes of data held in the cache
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned blocks, unsigned entries,
+			unsigned long bytes);
 
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
+	unsigned partials; /* reads only partly satisfied from the cache */
 	unsigned misses;
 	unsigned entries; /* current entry count */
+	unsigned long bytes; /* current size of cached data */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned long max_bytes;
+};
+
+/*
+ * per-device statistics of the block cache
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned partials;
+	unsigned misses;
+	unsigned entries;
+	unsigned long bytes;
 };
 
 /**
@@ -175,6 +210,15 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return per-device statistics and reset
+ *
+ * @param stats - statistics are copied here, one element per device
+ * @param max - number of elements in @stats
+ * Return: number of devices known to the cache, which may exceed @max
+ */
+int blkcache_dev_stats(struct block_cache_dev_stats *stats, int max);
+
 /** blkcache_free() - free all memory allocated to the block cache */
 void blkcache_free(void);
 
@@ -193,10 +237,131 @@ static inline void blkcache_fill(int iftype, int dev,
 
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
+static inline void blkcache_remove(int iftype, int dev) {}
+
 static inline void blkcache_free(void) {}
 
 #endif
 
+/**
+ * struct blk_readahead_stats - statistics of the read-ahead of a device
+ *
+ * @prefetches: Number of read-ahead requests issued
+ * @blocks: Number of blocks read ahead
+ * @used: Number of read-ahead blocks returned to callers
+ * @misses: Number of blocks which callers had to read from the device, not
+ *	being in the read-ahead buffer
+ * @ready: Number of @used blocks which were available without waiting, i.e.
+ *	whose read overlapped with the caller's processing
+ * @waits: Number of times a caller had to wait for a read-ahead to finish
+ * @discarded: Number of read-ahead buffers dropped by a write or erase
+ */
+struct blk_readahead_stats {
+	ulong prefetches;
+	ulong blocks;
+	ulong used;
+	ulong misses;
+	ulong ready;
+	ulong waits;
+	ulong discarded;
+};
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * blk_readahead_read() - attempt to read a set of blocks from read-ahead
+ *
+ * If the blocks are still being read ahead, this waits for that to finish.
+ *
+ * @dev: Block device
+ * @start: First block to read
+ * @blkcnt: Number of blocks to read
+ * @buf: Buffer to hold the data
+ * Return: number of leading blocks returned from the read-ahead buffer
+ */
+lbaint_t blk_readahead_read(struct udevice *dev, lbaint_t start,
+			    lbaint_t blkcnt, void *buf);
+
+/**
+ * blk_readahead_done() - note a completed read and start read-ahead
+ *
+ * This detects sequential access and starts reading the following blocks
+ * into the staging buffer when the caller has used up the previous ones.
+ *
+ * @dev: Block device
+ * @start: First block which was read
+ * @blkcnt: Number of blocks which were read
+ */
+void blk_readahead_done(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
+
+/**
+ * blk_readahead_wait() - wait for a read-ahead in progress to finish
+ *
+ * This waits for the read-ahead of any block device on the same host
+ * controller (parent device), since they share its command slots. It must be
+ * called before accessing the device directly.
+ *
+ * @dev: Block device
+ */
+void blk_readahead_wait(struct udevice *dev);
+
+/**
+ * blk_readahead_invalidate() - drop read-ahead data, e.g. after a write
+ *
+ * @dev: Block device
+ */
+void blk_readahead_invalidate(struct udevice *dev);
+
+/**
+ * blk_readahead_free() - free all read-ahead state of a device
+ *
+ * @dev: Block device
+ */
+void blk_readahead_free(struct udevice *dev);
+
+/**
+ * blk_readahead_configure() - set the read-ahead window of a device
+ *
+ * @dev: Block device
+ * @window: Number of blocks to read ahead, 0 to disable read-ahead
+ * Return: 0 if OK, -ENOSYS if the device does not support read-ahead
+ */
+int blk_readahead_configure(struct udevice *dev, lbaint_t window);
+
+/**
+ * blk_readahead_get_stats() - get read-ahead statistics of a device
+ *
+ * @dev: Block device
+ * @stats: Returns the statistics
+ * Return: 0 if OK, -ENOENT if the device has not used read-ahead
+ */
+int blk_readahead_get_stats(struct udevice *dev,
+			    struct blk_readahead_stats *stats);
+#else
+static inline lbaint_t blk_readahead_read(struct udevice *dev, lbaint_t start,
+					  lbaint_t blkcnt, void *buf)
+{
+	return 0;
+}
+
+static inline void blk_readahead_done(struct udevice *dev, lbaint_t start,
+				      lbaint_t blkcnt) {}
+static inline void blk_readahead_wait(struct udevice *dev) {}
+static inline void blk_readahead_invalidate(struct udevice *dev) {}
+static inline void blk_readahead_free(struct udevice *dev) {}
+
+static inline int blk_readahead_configure(struct udevice *dev,
+					  lbaint_t window)
+{
+	return -ENOSYS;
+}
+
+static inline int blk_readahead_get_stats(struct udevice *dev,
+					  struct blk_readahead_stats *stats)
+{
+	return -ENOSYS;
+}
+#endif
+
 struct udevice;
 
 /* Operations on block devices */
@@ -527,10 +692,15 @@ int blk_get_desc(enum uclass_id uclass_id, int devnum, struct blk_desc **descp);
 static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			      lbaint_t blkcnt, void *buffer)
 {
-	ulong blks_read;
-	if (blkcache_read(block_dev->uclass_id, block_dev->devnum,
-			  start, blkcnt, block_dev->blksz, buffer))
+	ulong blks_read, cached;
+
+	cached = blkcache_read(block_dev->uclass_id, block_dev->devnum,
+			       start, blkcnt, block_dev->blksz, buffer);
+	if (cached == blkcnt)
 		return blkcnt;
+	start += cached;
+	blkcnt -= cached;
+	buffer += cached * block_dev->blksz;
 
 	/*
 	 * We could check if block_read is NULL and return -ENOSYS. But this
@@ -542,7 +712,7 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 		blkcache_fill(block_dev->uclass_id, block_dev->devnum,
 			      start, blkcnt, block_dev->blksz, buffer);
 
-	return blks_read;
+	return cached + blks_read;
 }
 
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Writing an image to a block device as it arrives
+ */
+
+#ifndef __BLK_STREAM_H
+#define __BLK_STREAM_H
+
+#include <blk.h>
+#include <image-sparse.h>
+
+struct z_stream_s;
+
+/* Bytes needed to detect the format, or parse a zstd frame header */
+#define BLK_STREAM_HEAD_MAX	18
+
+/**
+ * struct blk_stream - An image being written to a block device
+ *
+ * The image is passed in pieces to blk_stream_write(), for example as packets
+ * arrive from the network. It may be compressed with gzip or zstd and, once
+ * decompressed, may be an Android sparse image. This is detected from the
+ * data itself. The decompressed image is gathered into a buffer which is
+ * written out whenever it is full, so the image never has to be held in
+ * memory as a whole.
+ *
+ * @desc:	Block device to write to
+ * @start:	First block to write
+ * @count:	Number of blocks available from @start
+ * @ret:	First error seen, returned by all later calls
+ * @in_pos:	Number of image bytes received
+ * @out_pos:	Number of decompressed bytes
+ * @written:	Number of blocks written to the device
+ * @comp:	Compression of the image
+ * @sparse:	Whether the decompressed image is a sparse one
+ * @head:	Start of the image, held until the compression is known, or
+ *		zstd frame header
+ * @head_len:	Number of bytes in @head
+ * @out_head:	Start of the decompressed image, held until it is known
+ *		whether it is a sparse image
+ * @out_len:	Number of bytes in @out_head
+ * @zs:		gzip decompression state
+ * @gz_done:	true if the end of the gzip data has been reached
+ * @zstd:	zstd decompression state
+ * @zstd_wksp:	Workspace for @zstd
+ * @zstd_window: Largest window @zstd can handle, 0 if none
+ * @zstd_left:	Last hint returned by zstd, 0 at the end of a frame
+ * @obuf:	Buffer for decompressed data
+ * @buf:	Blocks waiting to be written
+ * @buf_size:	Size of @buf, a whole number of blocks
+ * @buf_pos:	Byte offset from @start of the data in @buf
+ * @buf_len:	Number of bytes in @buf
+ * @sparse_info: Storage for writing a sparse image
+ * @ss:		State for writing a sparse image
+ */
+struct blk_stream {
+	struct blk_desc *desc;
+	lbaint_t start;
+	lbaint_t count;
+	int ret;
+	u64 in_pos;
+	u64 out_pos;
+	lbaint_t written;
+	enum {
+		BLK_STREAM_DETECT,
+		BLK_STREAM_NONE,
+		BLK_STREAM_GZIP,
+		BLK_STREAM_ZSTD,
+	} comp;
+	enum {
+		BLK_STREAM_UNKNOWN,
+		BLK_STREAM_RAW,
+		BLK_STREAM_SPARSE,
+	} sparse;
+	u8 head[BLK_STREAM_HEAD_MAX];
+	uint head_len;
+	u8 out_head[4];
+	uint out_len;
+	struct z_stream_s *zs;
+	bool gz_done;
+	void *zstd;
+	void *zstd_wksp;
+	size_t zstd_window;
+	size_t zstd_left;
+	void *obuf;
+	void *buf;
+	ulong buf_size;
+	u64 buf_pos;
+	ulong buf_len;
+	struct sparse_storage sparse_info;
+	struct sparse_stream ss;
+};
+
+/**
+ * blk_stream_start() - Start writing an image to a block device
+ *
+ * @bs:		Stream to set up
+ * @desc:	Block device to write to
+ * @start:	First block to write
+ * @count:	Number of blocks available from @start
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int blk_stream_start(struct blk_stream *bs, struct blk_desc *desc,
+		     lbaint_t start, lbaint_t count);
+
+/**
+ * blk_stream_write() - Write the next piece of an image
+ *
+ * Data which was passed before is ignored, so that a piece which arrives
+ * twice does no harm. Data cannot be passed ahead of what is missing.
+ *
+ * @bs:		Stream
+ * @offset:	Offset of @data within the image
+ * @data:	Data to write
+ * @len:	Number of bytes
+ * Return: 0 if OK, -ESPIPE if data before @offset is missing, -ENOSPC if the
+ * image does not fit, -EINVAL if it is not valid, -EIO if writing failed,
+ * -ENOMEM if out of memory. Apart from -ESPIPE, the error is returned by all
+ * later calls.
+ */
+int blk_stream_write(struct blk_stream *bs, u64 offset, const void *data,
+		     ulong len);
+
+/**
+ * blk_stream_finish() - Finish writing an image
+ *
+ * This writes out any data still held, padding the last block with zeroes,
+ * and frees the buffers held by @bs. It must be called even after an error.
+ *
+ * @bs:		Stream
+ * Return: 0 if the whole image was written, -EINVAL if it was cut short, or
+ * the first error seen
+ */
+int blk_stream_finish(struct blk_stream *bs);
+
+#endif
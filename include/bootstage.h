@@ -213,6 +213,11 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_FSP_M,
 	BOOTSTAGE_ID_ACCUM_FSP_S,
 	BOOTSTAGE_ID_ACCUM_MMAP_SPI,
+	BOOTSTAGE_ID_ACCUM_NET,
+	BOOTSTAGE_ID_ACCUM_NET_TFTP,
+	BOOTSTAGE_ID_ACCUM_NET_NFS,
+	BOOTSTAGE_ID_ACCUM_NET_WGET,
+	BOOTSTAGE_ID_ACCUM_NET_TCP,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
@@ -3,6 +3,9 @@
  * Copyright 2014 Broadcom Corporation.
  */
 
+#ifndef __IMAGE_SPARSE_H
+#define __IMAGE_SPARSE_H
+
 #include <compiler.h>
 #include <part.h>
 #include <sparse_format.h>
@@ -40,5 +43,101 @@ static inline int is_sparse_image(void *buf)
 	return 0;
 }
 
+/**
+ * write_sparse_image() - Write a sparse image which is in memory
+ *
+ * The image is passed to sparse_stream_write() in one piece. Errors are
+ * reported through the mssg() method of @info, if any.
+ *
+ * @info:	Storage to write to
+ * @part_name:	Name of the partition, for messages
+ * @data:	Sparse image
+ * @response:	Response buffer for the mssg() method
+ * Return: 0 if OK, -1 on error
+ */
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * struct sparse_stream - A sparse image being written as it arrives
+ *
+ * This holds the state of sparse_stream_write(), so that the image can be
+ * passed in pieces of any size instead of having to be in memory as a whole.
+ *
+ * @info:		Storage to write to
+ * @header:		Sparse image header
+ * @chunk:		Header of the current chunk
+ * @state:		What the next bytes of the image are
+ * @got:		Bytes of the current header or value collected so far
+ * @skip:		Bytes of the last header still to skip
+ * @left:		Bytes of RAW chunk data still to come
+ * @blk:		Next block to write
+ * @chunks:		Number of chunks done
+ * @total_blocks:	Number of image blocks done
+ * @bytes_written:	Number of bytes written by RAW and FILL chunks
+ * @fill_val:		Value of a FILL chunk, or CRC32 of a CRC32 chunk
+ * @blk_buf:		Partial block of RAW data
+ * @blk_len:		Number of bytes in @blk_buf
+ * @fill_buf:		Buffer for writing FILL chunks
+ * @err:		What went wrong, for the mssg() method, or NULL
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	sparse_header_t header;
+	chunk_header_t chunk;
+	enum {
+		SPARSE_STREAM_FILE_HDR,
+		SPARSE_STREAM_CHUNK_HDR,
+		SPARSE_STREAM_RAW,
+		SPARSE_STREAM_FILL,
+		SPARSE_STREAM_CRC32,
+		SPARSE_STREAM_DONE,
+	} state;
+	uint got;
+	uint skip;
+	u64 left;
+	lbaint_t blk;
+	u32 chunks;
+	u32 total_blocks;
+	u64 bytes_written;
+	u32 fill_val;
+	void *blk_buf;
+	uint blk_len;
+	u32 *fill_buf;
+	const char *err;
+};
+
+/**
+ * sparse_stream_start() - Start writing a sparse image in pieces
+ *
+ * @ss:		Stream state to set up
+ * @info:	Storage to write to. Its mssg() method is not used.
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info);
+
+/**
+ * sparse_stream_write() - Write the next piece of a sparse image
+ *
+ * Anything after the last chunk is ignored.
+ *
+ * @ss:		Stream state
+ * @data:	Next bytes of the image
+ * @len:	Number of bytes
+ * Return: 0 if OK, -EINVAL if the image is not valid, -ENOSPC if it does
+ * not fit the storage, -EIO if writing failed
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			size_t len);
+
+/**
+ * sparse_stream_finish() - Finish writing a sparse image in pieces
+ *
+ * This frees the buffers held by @ss, so must be called even after an error.
+ *
+ * @ss:		Stream state
+ * Return: 0 if the whole image was written, -EINVAL if it was cut short
+ */
+int sparse_stream_finish(struct sparse_stream *ss);
+
+#endif
@@ -23,6 +23,7 @@
 struct fdt_region;
 
 #ifdef USE_HOSTCC
+#include <errno.h>
 #include <sys/types.h>
 #include <linux/kconfig.h>
 
@@ -34,6 +35,7 @@ struct fdt_region;
 #include <asm/u-boot.h>
 #include <command.h>
 #include <linker_lists.h>
+#include <linux/errno.h>
 
 #define IMAGE_INDENT_STRING	"   "
 
@@ -1357,6 +1359,103 @@ int fit_image_check_arch(const void *fit, int noffset, uint8_t arch);
 int fit_image_check_type(const void *fit, int noffset, uint8_t type);
 int fit_image_check_comp(const void *fit, int noffset, uint8_t comp);
 
+struct blk_desc;
+
+/**
+ * typedef fit_stream_read_t - Read part of a FIT which is being streamed
+ *
+ * @priv: Private data passed to fit_stream_load()
+ * @offset: Byte offset within the FIT file
+ * @size: Number of bytes to read
+ * @buf: Buffer to read into
+ * Return: 0 if OK, -ve on error (including a short read)
+ */
+typedef int (*fit_stream_read_t)(void *priv, ulong offset, ulong size,
+				 void *buf);
+
+#if CONFIG_IS_ENABLED(FIT_STREAM) && !defined(USE_HOSTCC)
+/**
+ * fit_stream_load() - Load a FIT with external data in chunks
+ *
+ * This reads the FIT structure to @addr, checks the signature of the selected
+ * configuration, then reads the data of each image. Uncompressed images of
+ * the configuration which have a load address are placed straight there;
+ * other images go where they would be if the whole FIT were at @addr.
+ * fit_image_load() uses the placed images without copying them. The image
+ * hashes are not checked here, but by fit_image_load() as for any other FIT.
+ *
+ * @addr: Address to hold the FIT structure
+ * @conf_name: Configuration to load (without '#'), or NULL for the default
+ * @read: Function to read from the FIT file
+ * @priv: Private data for @read
+ * @sizep: Returns the size of the FIT file covered by the images, or NULL
+ * Return: 0 if OK, -ENOEXEC if not a FIT, -ENOENT if the configuration is not
+ *	found, -EACCES on a bad signature, -EXDEV if images overlap,
+ *	other -ve value on a read error
+ */
+int fit_stream_load(ulong addr, const char *conf_name, fit_stream_read_t read,
+		    void *priv, ulong *sizep);
+
+/**
+ * fit_stream_load_fs() - Stream a FIT from a file on a filesystem
+ *
+ * @ifname: Interface name (e.g. "mmc")
+ * @dev_part: Device and partition (e.g. "0:1")
+ * @fname: Filename of the FIT
+ * @addr: Address to hold the FIT structure
+ * @conf_name: Configuration to load, or NULL for the default
+ * Return: 0 if OK, -ve on error, see fit_stream_load()
+ */
+int fit_stream_load_fs(const char *ifname, const char *dev_part,
+		       const char *fname, ulong addr, const char *conf_name);
+
+/**
+ * fit_stream_load_blk() - Stream a FIT from a block device
+ *
+ * @desc: Block device holding the FIT
+ * @start: First block of the FIT
+ * @addr: Address to hold the FIT structure
+ * @conf_name: Configuration to load, or NULL for the default
+ * Return: 0 if OK, -ve on error, see fit_stream_load()
+ */
+int fit_stream_load_blk(struct blk_desc *desc, ulong start, ulong addr,
+			const char *conf_name);
+
+/**
+ * fit_stream_get_data() - Get the data of an image placed by the stream
+ *
+ * @fit: FIT structure which was streamed
+ * @noffset: Image node offset
+ * @data: Returns a pointer to the image data
+ * @size: Returns the size of the image data
+ * Return: 0 if OK, -ENOENT if the image was not placed by fit_stream_load()
+ */
+int fit_stream_get_data(const void *fit, int noffset, const void **data,
+			size_t *size);
+
+/**
+ * fit_stream_reset() - Forget the images placed by the last stream
+ */
+void fit_stream_reset(void);
+#else
+static inline int fit_stream_load(ulong addr, const char *conf_name,
+				  fit_stream_read_t read, void *priv,
+				  ulong *sizep)
+{
+	return -ENOSYS;
+}
+
+static inline int fit_stream_get_data(const void *fit, int noffset,
+				      const void **data, size_t *size)
+{
+	return -ENOENT;
+}
+
+static inline void fit_stream_reset(void)
+{
+}
+#endif
+
 /**
  * fit_check_format() - Check that the FIT is valid
  *
@@ -449,10 +449,47 @@ struct abuf;
 /**
  * zstd_decompress() - Decompress Zstandard data
  *
+ * All the frames are decompressed, one after the other. Anything after the
+ * last valid frame is ignored.
+ *
  * @in: Input buffer to decompress
  * @out: Output buffer to hold the results (must be large enough)
- * Return: size of the decompressed data, or -ve on error
+ * Return: size of the decompressed data, -ENOMEM if out of memory, -EPERM if
+ *	the decompression context could not be set up in its workspace, -EINVAL
+ *	if the data is not valid
  */
 int zstd_decompress(struct abuf *in, struct abuf *out);
 
+/**
+ * struct zstd_frame_info - position of a frame in Zstandard data
+ *
+ * @in_offset: Offset of the frame in the compressed data
+ * @in_size: Size of the frame in the compressed data
+ * @out_offset: Offset of the frame content in the decompressed data, or
+ *	ZSTD_CONTENTSIZE_UNKNOWN if an earlier frame does not record its size
+ * @out_size: Size of the frame content (0 for a skippable frame), or
+ *	ZSTD_CONTENTSIZE_UNKNOWN if the frame does not record it
+ */
+struct zstd_frame_info {
+	size_t in_offset;
+	size_t in_size;
+	unsigned long long out_offset;
+	unsigned long long out_size;
+};
+
+/**
+ * zstd_frame_index() - Find the frames in Zstandard data
+ *
+ * Anything after the last valid frame is ignored.
+ *
+ * @in: Compressed data
+ * @size: Size of the compressed data
+ * @frames: Returns the position of each frame, up to @max_frames of them
+ * @max_frames: Number of entries in @frames, may be 0
+ * Return: number of frames found, or -EINVAL if @in does not start with a
+ *	frame
+ */
+int zstd_frame_index(const void *in, size_t size,
+		     struct zstd_frame_info *frames, int max_frames);
+
 #endif  /* LINUX_ZSTD_H */
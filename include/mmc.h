@@ -66,6 +66,7 @@ struct bd_info;
 #define MMC_CAP_NONREMOVABLE	BIT(14)
 #define MMC_CAP_NEEDS_POLL	BIT(15)
 #define MMC_CAP_CD_ACTIVE_HIGH  BIT(16)
+#define MMC_CAP_CQE		BIT(17)	/* host has a command queue engine */
 
 #define MMC_MODE_8BIT		BIT(30)
 #define MMC_MODE_4BIT		BIT(29)
@@ -208,6 +209,7 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 /*
  * EXT_CSD fields
  */
+#define EXT_CSD_CMDQ_MODE_EN		15	/* R/W/E_P */
 #define EXT_CSD_BOOT_SIZE_MULT_MICRON	125	/* R/W, vendor specific field */
 #define EXT_CSD_ENH_START_ADDR		136	/* R/W */
 #define EXT_CSD_ENH_SIZE_MULT		140	/* R/W */
@@ -239,6 +241,8 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define EXT_CSD_BOOT_MULT		226	/* RO */
 #define EXT_CSD_SEC_FEATURE		231	/* RO */
 #define EXT_CSD_GENERIC_CMD6_TIME       248     /* RO */
+#define EXT_CSD_CMDQ_DEPTH		307	/* RO */
+#define EXT_CSD_CMDQ_SUPPORT		308	/* RO */
 #define EXT_CSD_BKOPS_SUPPORT		502	/* RO */
 
 /*
@@ -314,6 +318,10 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 
 #define EXT_CSD_SEC_FEATURE_TRIM_EN	(1 << 4) /* Support secure & insecure trim */
 
+#define EXT_CSD_CMDQ_MODE_ENABLED	(1 << 0)	/* command queue is on */
+#define EXT_CSD_CMDQ_SUPPORTED		(1 << 0)	/* command queue support */
+#define EXT_CSD_CMDQ_DEPTH_MASK		0x1f		/* queue depth - 1 */
+
 #define R1_ILLEGAL_COMMAND		(1 << 22)
 #define R1_APP_CMD			(1 << 5)
 
@@ -451,6 +459,28 @@ struct mmc_data {
 	uint blocksize;
 };
 
+/**
+ * struct mmc_cqe_task - a data transfer queued on an eMMC command queue
+ *
+ * Tasks are kept in a table indexed by their tag, which is the slot they use
+ * in the queue of the card.
+ *
+ * @dest:	Buffer to read into
+ * @src:	Buffer to write from
+ * @flags:	MMC_DATA_READ or MMC_DATA_WRITE
+ * @blkaddr:	Address of the first block, given as for CMD18/CMD25
+ * @blocks:	Number of blocks to transfer
+ */
+struct mmc_cqe_task {
+	union {
+		char *dest;
+		const char *src;
+	};
+	uint flags;
+	uint blkaddr;
+	uint blocks;
+};
+
 /* forward decl. */
 struct mmc;
 
@@ -572,6 +602,44 @@ struct dm_mmc_ops {
 	 * @return 0 if success, -ve on error
 	 */
 	int (*hs400_prepare_ddr)(struct udevice *dev);
+
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	/**
+	 * cqe_enable() - Start or halt the command queue engine
+	 *
+	 * The card is switched into command queueing mode before the
+	 * engine is started and out of it after the engine is halted. Tasks
+	 * still queued when the engine is halted are discarded.
+	 *
+	 * @dev:	Device to update
+	 * @enable:	true to start the engine, false to halt it
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*cqe_enable)(struct udevice *dev, bool enable);
+
+	/**
+	 * cqe_submit() - Queue tasks with one doorbell write
+	 *
+	 * @dev:	Device to queue on
+	 * @tasks:	Table of tasks, indexed by tag
+	 * @tags:	Mask of the tags to queue, which must be free
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*cqe_submit)(struct udevice *dev,
+			  const struct mmc_cqe_task *tasks, u32 tags);
+
+	/**
+	 * cqe_wait() - Wait for queued tasks to complete
+	 *
+	 * @dev:	Device to wait on
+	 * @donep:	Returns the mask of tags which have completed
+	 * @errorsp:	Returns the mask of completed tags which failed
+	 * @timeout_us:	Time to wait for at least one task to complete
+	 * @return 0 if OK, -ETIMEDOUT if nothing completed in time
+	 */
+	int (*cqe_wait)(struct udevice *dev, u32 *donep, u32 *errorsp,
+			int timeout_us);
+#endif
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -676,6 +744,21 @@ static inline bool mmc_is_mode_ddr(enum bus_mode mode)
 		  MMC_CAP(UHS_SDR50) | MMC_CAP(UHS_SDR104) | \
 		  MMC_CAP(UHS_DDR50))
 
+/**
+ * struct mmc_cqe_stats - statistics for transfers on the command queue
+ *
+ * @tasks:	Number of tasks completed
+ * @bytes:	Number of bytes transferred by those tasks
+ * @time_us:	Time spent in queued transfers
+ * @max_depth:	Largest number of tasks queued at once
+ */
+struct mmc_cqe_stats {
+	u64 tasks;
+	u64 bytes;
+	u64 time_us;
+	uint max_depth;
+};
+
 static inline bool supports_uhs(uint caps)
 {
 #if CONFIG_IS_ENABLED(MMC_UHS_SUPPORT)
@@ -772,6 +855,13 @@ struct mmc {
 
 	enum bus_mode user_speed_mode; /* input speed mode from user */
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	u8 cqe_depth;		/* command queue depth, 0 if not in use */
+	bool cqe_on;		/* card and host are in queueing mode */
+	struct mmc_cqe_stats cqe_read;
+	struct mmc_cqe_stats cqe_write;
+#endif
+
 	/*
 	 * If CONFIG_CYCLIC is not set, struct cyclic_info is
 	 * zero-size structure and does not add any space here.
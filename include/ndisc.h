@@ -89,6 +89,23 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len);
  */
 void ndisc_request(void);
 
+/**
+ * ndisc_next_hop() - Get the address to resolve to reach an IPv6 address
+ *
+ * @dest:	Destination address
+ * @hop:	Returns @dest if it is on our subnet, else the gateway, if set
+ */
+void ndisc_next_hop(struct in6_addr *dest, struct in6_addr *hop);
+
+/**
+ * ndisc_probe() - Send a neighbour solicitation outside of ND resolution
+ *
+ * This uses its own packet buffer, so it leaves net_tx_packet alone.
+ *
+ * @neigh_addr:	Address to solicit
+ */
+void ndisc_probe(struct in6_addr *neigh_addr);
+
 /**
  * ndisc_init() - Check ND response timeout
  *
@@ -112,6 +129,15 @@ static inline void ndisc_request(void)
 {
 }
 
+static inline void ndisc_next_hop(struct in6_addr *dest, struct in6_addr *hop)
+{
+	*hop = *dest;
+}
+
+static inline void ndisc_probe(struct in6_addr *neigh_addr)
+{
+}
+
 static inline int ndisc_timeout_check(void)
 {
 	return 0;
@@ -75,6 +75,8 @@ struct ip_udp_hdr {
 
 /* Number of packets processed together */
 #define ETH_PACKETS_BATCH_RECV	32
+/* Number of frames which can be held back to be sent together */
+#define ETH_PACKETS_BATCH_SEND	8
 
 /* ARP hardware address length */
 #define ARP_HLEN 6
@@ -152,6 +154,20 @@ int ip_checksum_ok(const void *addr, unsigned int nbytes);
  */
 unsigned add_ip_checksums(unsigned offset, unsigned sum, unsigned int new_sum);
 
+/**
+ * net_csum_fill() - Fill in the TCP or UDP checksum of a frame
+ *
+ * This does in software what a device with ETH_OFFLOAD_TX_CSUM does for a
+ * frame: the checksum field holds the sum of the pseudo-header and is replaced
+ * by the checksum of everything from @start to the end of the frame.
+ *
+ * @pkt:	Start of the frame (must be 16-bit aligned)
+ * @len:	Length of the frame in bytes
+ * @start:	Offset of the TCP or UDP header
+ * @offset:	Offset of the checksum field from @start
+ */
+void net_csum_fill(uchar *pkt, uint len, uint start, uint offset);
+
 /*
  * The devname can be either an exact name given by the driver or device tree
  * or it can be an alias of the form "eth%d"
@@ -242,6 +258,96 @@ enum eth_recv_flags {
 	ETH_RECV_CHECK_DEVICE		= 1 << 0,
 };
 
+/* Maximum number of parts in the destination for a received payload */
+#define ETH_RX_SG_MAX		4
+
+/**
+ * struct eth_rx_sg - part of the destination for a received payload
+ *
+ * @addr: Start of this part
+ * @len: Number of bytes in this part
+ */
+struct eth_rx_sg {
+	void *addr;
+	uint len;
+};
+
+/**
+ * struct eth_rx_dest - where to put the payload of the next received frame
+ *
+ * A protocol which knows what the next frame should carry, such as the next
+ * block of a file, can post this so that the driver places the bytes after
+ * the headers straight into their destination. The headers, and any bytes
+ * which do not fit in the destination, stay where they are in the driver's
+ * buffer.
+ *
+ * @hdr_len: Number of bytes at the start of the frame to leave in the driver's
+ *	buffer
+ * @sg: Parts of the destination, filled in order
+ * @count: Number of parts in @sg
+ * @claim: Check that a frame, of which @len bytes were received into @pkt
+ *	(with a hole for the placed bytes), is the one which the destination
+ *	was posted for. If not, the placed bytes are copied back into the hole
+ *	before the frame is processed.
+ */
+struct eth_rx_dest {
+	uint hdr_len;
+	struct eth_rx_sg sg[ETH_RX_SG_MAX];
+	int count;
+	bool (*claim)(const uchar *pkt, int len);
+};
+
+/*
+ * Destination holding part of the frame being processed, or NULL if it is all
+ * in the receive buffer
+ */
+extern const struct eth_rx_dest *net_rx_placed;
+
+/**
+ * struct eth_rx_pkt - a frame returned by the recv_batch() method
+ *
+ * @packet: Start of the frame
+ * @len: Length of the frame in bytes
+ * @placed: Destination holding the payload of the frame, or NULL if it is all
+ *	at @packet. This replaces eth_rx_placed() for frames received in a batch.
+ * @csum_valid: true if the device checked the TCP or UDP checksum of the
+ *	frame. This replaces eth_rx_csum_valid() for frames received in a batch.
+ */
+struct eth_rx_pkt {
+	uchar *packet;
+	int len;
+	const struct eth_rx_dest *placed;
+	bool csum_valid;
+};
+
+/**
+ * struct eth_tx_pkt - a frame passed to the send_batch() method
+ *
+ * @packet: Start of the frame
+ * @len: Length of the frame in bytes
+ * @csum_start: Offset of the TCP or UDP header whose checksum the device must
+ *	fill in, or 0 if the frame is complete. The checksum field holds the sum
+ *	of the pseudo-header, as for net_csum_fill().
+ * @csum_offset: Offset of the checksum field from @csum_start
+ */
+struct eth_tx_pkt {
+	void *packet;
+	int len;
+	u16 csum_start;
+	u16 csum_offset;
+};
+
+/* Work which an Ethernet device can do for the network stack */
+#define ETH_OFFLOAD_TX_CSUM	BIT(0)	/* fill in TCP/UDP checksums */
+#define ETH_OFFLOAD_RX_CSUM	BIT(1)	/* check TCP/UDP checksums */
+#define ETH_OFFLOAD_RX_DROPS	BIT(2)	/* count drops with net_stats_rx_drop() */
+
+/*
+ * true if the device checked the TCP or UDP checksum of the frame being
+ * processed
+ */
+extern bool net_rx_csum_valid;
+
 /**
  * struct eth_ops - functions of Ethernet MAC controllers
  *
@@ -271,6 +377,24 @@ enum eth_recv_flags {
  * get_sset_count: Number of statistics counters
  * get_string: Names of the statistic counters
  * get_stats: The values of the statistic counters
+ * post_rx: Take a copy of where to put the payload of the next frame received,
+ *	    or stop doing that if @dest is NULL. The next time a frame longer
+ *	    than the headers is received, recv() places its payload there and
+ *	    reports it with eth_rx_placed(), after which the destination is used
+ *	    up - optional
+ * recv_batch: Like recv(), but return up to @max frames which are waiting in
+ *	       @pkts, making them all visible to the CPU at once, e.g. with a
+ *	       single cache invalidation covering their buffers. Returns the
+ *	       number of frames, 0 or -EAGAIN if there are none, or -ENOSYS to
+ *	       have recv() used instead. The frames are processed in order and
+ *	       then handed back together - optional
+ * free_batch: Hand back the @count frames returned by the last call to
+ *	       recv_batch(). If this is not provided, free_pkt() is called for
+ *	       each frame - optional
+ * send_batch: Send the @count frames in @pkts, starting the hardware once for
+ *	       all of them. Frames with a csum_start need their checksum filled
+ *	       in, which is only asked of devices with ETH_OFFLOAD_TX_CSUM.
+ *	       Returns the number of frames sent, or -ve on error - optional
  */
 struct eth_ops {
 	int (*start)(struct udevice *dev);
@@ -285,6 +409,13 @@ struct eth_ops {
 	int (*get_sset_count)(struct udevice *dev);
 	void (*get_strings)(struct udevice *dev, u8 *data);
 	void (*get_stats)(struct udevice *dev, u64 *data);
+	int (*post_rx)(struct udevice *dev, const struct eth_rx_dest *dest);
+	int (*recv_batch)(struct udevice *dev, int flags,
+			  struct eth_rx_pkt *pkts, int max);
+	int (*free_batch)(struct udevice *dev, struct eth_rx_pkt *pkts,
+			  int count);
+	int (*send_batch)(struct udevice *dev, struct eth_tx_pkt *pkts,
+			  int count);
 };
 
 #define eth_get_ops(dev) ((struct eth_ops *)(dev)->driver->ops)
@@ -293,6 +424,113 @@ struct udevice *eth_get_dev(void); /* get the current device */
 void eth_set_dev(struct udevice *dev); /* set a device */
 unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 int eth_rx(void);                      /* Check for received packets */
+
+/**
+ * eth_rx_post() - Post where to put the payload of the next frame received
+ *
+ * See struct eth_rx_dest. The destination may be written to even if no frame
+ * is ever placed there, so it should only cover memory which does not yet hold
+ * anything of value. Once it is withdrawn, or the device is stopped, nothing
+ * more is written to it: a driver which handed it to the device ahead of time
+ * takes it back, resetting the device if need be.
+ *
+ * @dest: Destination, or NULL to withdraw the last one
+ * Return: 0 if OK, -ENOSYS if the current device does not support it, other
+ *	-ve on error
+ */
+int eth_rx_post(const struct eth_rx_dest *dest);
+
+/**
+ * eth_rx_placed() - Report that the payload of a frame went to a destination
+ *
+ * This is called by drivers from their recv() method. @dest must stay valid
+ * until the frame is freed.
+ *
+ * @dest: Destination holding the bytes after the headers
+ */
+void eth_rx_placed(const struct eth_rx_dest *dest);
+
+/**
+ * eth_rx_csum_valid() - Report that the device checked the TCP/UDP checksum
+ *
+ * This is called by drivers from their recv() method, for a frame whose TCP or
+ * UDP checksum the device found to be correct. It is ignored unless the device
+ * has ETH_OFFLOAD_RX_CSUM.
+ */
+void eth_rx_csum_valid(void);
+
+/**
+ * eth_set_offload() - Set the work which an Ethernet device can do
+ *
+ * This is called by drivers, normally from their probe() method.
+ * ETH_OFFLOAD_TX_CSUM is only accepted from drivers with send_batch().
+ *
+ * @dev: Ethernet device
+ * @offload: Mask of ETH_OFFLOAD_... flags
+ */
+void eth_set_offload(struct udevice *dev, uint offload);
+
+/**
+ * eth_get_offload() - Get the work which an Ethernet device can do
+ *
+ * @dev: Ethernet device, or NULL
+ * Return: mask of ETH_OFFLOAD_... flags, 0 if @dev is NULL
+ */
+uint eth_get_offload(struct udevice *dev);
+
+/**
+ * eth_send_csum() - Send a frame, leaving its TCP/UDP checksum to the device
+ *
+ * If the current device does not have ETH_OFFLOAD_TX_CSUM, the checksum is
+ * filled in here instead.
+ *
+ * @packet: Start of the frame
+ * @length: Length of the frame in bytes
+ * @csum_start: Offset of the TCP or UDP header, or 0 if the frame is complete
+ * @csum_offset: Offset of the checksum field from @csum_start. The field must
+ *	hold the sum of the pseudo-header, as for net_csum_fill().
+ * Return: 0 if OK, -ve on error
+ */
+int eth_send_csum(void *packet, int length, uint csum_start, uint csum_offset);
+
+/**
+ * eth_send_hold() - Start holding back frames to send them together
+ *
+ * Until eth_send_flush() is called, frames passed to eth_send() are copied
+ * and sent in batches through the send_batch() method of the current device.
+ * This has no effect if the device does not have that method.
+ */
+void eth_send_hold(void);
+
+/**
+ * eth_send_flush() - Send the frames held back since eth_send_hold()
+ *
+ * This also stops holding back frames.
+ *
+ * Return: 0 if OK, -ve on error
+ */
+int eth_send_flush(void);
+
+/**
+ * eth_free_batch() - Hand back frames returned by the recv_batch() method
+ *
+ * This uses free_batch() if the driver has it, else free_pkt() for each frame.
+ *
+ * @dev: Ethernet device which received the frames
+ * @pkts: Frames to hand back
+ * @count: Number of frames in @pkts
+ */
+void eth_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts, int count);
+
+/**
+ * eth_rx_data() - Find the bytes at an offset in the frame being processed
+ *
+ * @pkt: Start of the frame
+ * @offset: Offset of the bytes within the frame
+ * @lenp: Returns the number of bytes at that place, up to the value passed in
+ * Return: Pointer to the bytes
+ */
+const uchar *eth_rx_data(const uchar *pkt, uint offset, uint *lenp);
 void eth_halt(void);			/* stop SCC */
 const char *eth_get_name(void);		/* get name of current device */
 int eth_get_dev_index(void);
@@ -568,6 +806,11 @@ enum wget_http_method {
  * @hdr_cont_len:	content length according to headers. Filled by wget
  * @headers:		buffer for headers. Filled by wget.
  * @silent:		do not print anything to the console. Filled by client.
+ * @range_done:		called as each part of the file is received, with
+ *			its address, offset in the file and length, e.g. to
+ *			check its hash. The whole file is one part unless
+ *			it is fetched in ranges. Return 0 if OK, or -ve
+ *			to fail the download. Filled by client, may be NULL.
  */
 struct wget_http_info {
 	enum wget_http_method method;
@@ -579,6 +822,8 @@ struct wget_http_info {
 	u32 hdr_cont_len;
 	char *headers;
 	bool silent;
+	int (*range_done)(struct wget_http_info *info, ulong addr,
+			  ulong offset, ulong len);
 };
 
 extern struct wget_http_info default_wget_info;
@@ -19,6 +19,7 @@
 #include <linux/string.h>
 
 struct bd_info;
+struct blk_stream;
 struct cmd_tbl;
 struct udevice;
 
@@ -314,6 +315,8 @@ extern bool	net_boot_file_name_explicit;
 extern u32	net_boot_file_size;
 /* Boot file size in blocks as reported by the DHCP server */
 extern u32	net_boot_file_expected_size_in_blocks;
+/* Block device to write downloads to as they arrive, instead of memory */
+extern struct blk_stream *net_blk_stream;
 
 #if defined(CONFIG_DNS)
 extern char *net_dns_resolve;		/* The host to resolve  */
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Cache of neighbours' Ethernet addresses, learnt through ARP and IPv6
+ * neighbour discovery
+ */
+
+#ifndef __NET_NEIGH_H__
+#define __NET_NEIGH_H__
+
+#include <net6.h>
+
+struct udevice;
+
+/**
+ * struct neigh_entry - An entry in the neighbour cache
+ *
+ * @dev:	Ethernet device the neighbour was seen on, NULL if unused
+ * @addr:	IPv6 address, or the IPv4 address in its first 32 bits
+ * @ip6:	true if @addr is an IPv6 address
+ * @stale:	true if the entry is in use and should be confirmed again
+ * @ethaddr:	Ethernet address of the neighbour
+ * @updated:	Time the entry was last confirmed, in milliseconds
+ * @used:	Time the entry was last looked up, in milliseconds
+ * @probed:	Time the last probe for the entry was sent, in milliseconds
+ */
+struct neigh_entry {
+	struct udevice *dev;
+	struct in6_addr addr;
+	bool ip6;
+	bool stale;
+	uchar ethaddr[ARP_HLEN];
+	ulong updated;
+	ulong used;
+	ulong probed;
+};
+
+/**
+ * struct neigh_stats - Neighbour cache statistics
+ *
+ * @hits:	Number of lookups which found an address
+ * @misses:	Number of lookups which did not
+ * @probes:	Number of probes sent to refresh entries in use
+ * @expired:	Number of entries dropped after their time to live
+ * @evicted:	Number of entries dropped to make room for another
+ */
+struct neigh_stats {
+	ulong hits;
+	ulong misses;
+	ulong probes;
+	ulong expired;
+	ulong evicted;
+};
+
+#if IS_ENABLED(CONFIG_NET_NEIGH)
+/**
+ * neigh_lookup() - Look up the Ethernet address of an IPv4 neighbour
+ *
+ * Only entries learnt on the current Ethernet device are considered.
+ *
+ * @ip:		IPv4 address of the neighbour
+ * @ethaddr:	Returns the Ethernet address, if found
+ * Return: true if the address was found, false if not
+ */
+bool neigh_lookup(struct in_addr ip, uchar *ethaddr);
+
+/**
+ * neigh_lookup6() - Look up the Ethernet address of an IPv6 neighbour
+ *
+ * @ip6:	IPv6 address of the neighbour
+ * @ethaddr:	Returns the Ethernet address, if found
+ * Return: true if the address was found, false if not
+ */
+bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr);
+
+/**
+ * neigh_update() - Record the Ethernet address of an IPv4 neighbour
+ *
+ * @ip:		IPv4 address of the neighbour
+ * @ethaddr:	Its Ethernet address
+ * @add:	true to add an entry if there is none, false to only
+ *		refresh an existing one
+ */
+void neigh_update(struct in_addr ip, const uchar *ethaddr, bool add);
+
+/**
+ * neigh_update6() - Record the Ethernet address of an IPv6 neighbour
+ *
+ * @ip6:	IPv6 address of the neighbour
+ * @ethaddr:	Its Ethernet address
+ * @add:	true to add an entry if there is none, false to only
+ *		refresh an existing one
+ */
+void neigh_update6(const struct in6_addr *ip6, const uchar *ethaddr,
+		   bool add);
+
+/**
+ * neigh_refresh() - Send the probes for stale entries which are due
+ *
+ * This is called from the net_loop() polling loop, where the current
+ * Ethernet device is running and no other packet is being built. Nothing is
+ * sent while an address is being resolved.
+ */
+void neigh_refresh(void);
+
+/**
+ * neigh_flush() - Drop entries from the neighbour cache
+ *
+ * @dev:	Ethernet device whose entries to drop, NULL for all
+ */
+void neigh_flush(struct udevice *dev);
+
+/**
+ * neigh_get_entry() - Get an entry of the neighbour cache
+ *
+ * @index:	Index of the entry, from 0
+ * Return: the entry, which is unused if its @dev is NULL, or NULL if @index
+ * is past the end of the cache
+ */
+const struct neigh_entry *neigh_get_entry(int index);
+
+/**
+ * neigh_get_stats() - Get the neighbour cache statistics
+ *
+ * Return: the statistics, counted since the last neigh_flush(NULL)
+ */
+const struct neigh_stats *neigh_get_stats(void);
+#else
+static inline bool neigh_lookup(struct in_addr ip, uchar *ethaddr)
+{
+	return false;
+}
+
+static inline bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr)
+{
+	return false;
+}
+
+static inline void neigh_update(struct in_addr ip, const uchar *ethaddr,
+				bool add)
+{
+}
+
+static inline void neigh_update6(const struct in6_addr *ip6,
+				 const uchar *ethaddr, bool add)
+{
+}
+
+static inline void neigh_refresh(void)
+{
+}
+
+static inline void neigh_flush(struct udevice *dev)
+{
+}
+#endif
+
+#endif /* __NET_NEIGH_H__ */
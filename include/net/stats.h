@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Per-protocol statistics for network transfers
+ */
+
+#ifndef __NET_STATS_H__
+#define __NET_STATS_H__
+
+#include <linux/types.h>
+
+enum proto_t;
+
+/**
+ * enum net_stats_proto - Protocols which keep statistics
+ *
+ * @NET_STATS_TFTP:	TFTP, counted in blocks
+ * @NET_STATS_NFS:	NFS, counted in READ replies
+ * @NET_STATS_WGET:	HTTP, counting the file data received
+ * @NET_STATS_TCP:	TCP, counted in segments, for wget and fastboot
+ * @NET_STATS_COUNT:	Number of protocols
+ */
+enum net_stats_proto {
+	NET_STATS_TFTP,
+	NET_STATS_NFS,
+	NET_STATS_WGET,
+	NET_STATS_TCP,
+
+	NET_STATS_COUNT,
+};
+
+/* Number of seconds of transfer rate kept for the last transfer */
+#define NET_STATS_RATE_SLOTS	16
+
+/**
+ * struct net_proto_stats - Statistics for one protocol
+ *
+ * The counters add up all the transfers since the statistics were last
+ * reset, while the rate history is that of the last transfer.
+ *
+ * @transfers:	Number of transfers
+ * @rx_packets:	Number of packets received which carried new data
+ * @rx_bytes:	Number of bytes of new data received
+ * @retransmits: Number of requests or segments sent again, after a loss or
+ *		a timeout
+ * @dups:	Number of packets received with data which was already there
+ * @ooo:	Number of packets received ahead of a missing one
+ * @rtt_count:	Number of round-trip time samples
+ * @rtt_min:	Shortest round-trip time, in microseconds
+ * @rtt_max:	Longest round-trip time, in microseconds
+ * @rtt_sum:	Sum of the round-trip times, in microseconds
+ * @time_ms:	Time spent in transfers, in milliseconds
+ * @rate:	Data received in each second of the last transfer, in KiB. The
+ *		last @rate_count seconds are kept, wrapping around.
+ * @rate_count:	Number of seconds recorded in @rate
+ * @active:	true while a transfer with this protocol is running
+ * @start:	Time the transfer started, in milliseconds
+ * @slot_start:	Time the current second of @rate started, in milliseconds
+ * @slot_bytes:	Data received in the current second of @rate
+ * @rtt_start:	Time the packet being timed was sent, in microseconds, 0 if
+ *		none is
+ */
+struct net_proto_stats {
+	ulong transfers;
+	ulong rx_packets;
+	u64 rx_bytes;
+	ulong retransmits;
+	ulong dups;
+	ulong ooo;
+	ulong rtt_count;
+	ulong rtt_min;
+	ulong rtt_max;
+	u64 rtt_sum;
+	ulong time_ms;
+	u32 rate[NET_STATS_RATE_SLOTS];
+	uint rate_count;
+
+	/* private: */
+	bool active;
+	ulong start;
+	ulong slot_start;
+	ulong slot_bytes;
+	ulong rtt_start;
+};
+
+/**
+ * struct net_stats - Statistics for the network stack
+ *
+ * @proto:	Statistics for each protocol
+ * @rx_drops:	Number of packets dropped by Ethernet drivers because their
+ *		receive queue was full
+ * @rx_drops_unknown: true if a transfer used a device whose driver does not
+ *		count its drops (without ETH_OFFLOAD_RX_DROPS), so that
+ *		@rx_drops is only a lower bound
+ */
+struct net_stats {
+	struct net_proto_stats proto[NET_STATS_COUNT];
+	ulong rx_drops;
+	bool rx_drops_unknown;
+};
+
+/**
+ * net_stats_name() - Get the name of a protocol
+ *
+ * @proto:	Protocol
+ * Return: Its name, e.g. "tftp"
+ */
+const char *net_stats_name(enum net_stats_proto proto);
+
+/**
+ * net_stats_get() - Get the statistics for the network stack
+ *
+ * Return: Statistics, including all finished transfers
+ */
+const struct net_stats *net_stats_get(void);
+
+/**
+ * net_stats_reset() - Reset all the statistics
+ */
+void net_stats_reset(void);
+
+/**
+ * net_stats_start() - Start counting a transfer
+ *
+ * This is called by net_loop() once the Ethernet device is running. Counts
+ * left from a transfer which was not ended are dropped.
+ *
+ * @protocol:	Protocol net_loop() is running
+ */
+void net_stats_start(enum proto_t protocol);
+
+/**
+ * net_stats_end() - Finish counting a transfer
+ *
+ * The counts are added to the statistics and, with bootstage, the time
+ * spent is accumulated in the bootstage report, in total and per protocol.
+ */
+void net_stats_end(void);
+
+#if IS_ENABLED(CONFIG_NET_STATS)
+/**
+ * net_stats_rx() - Count a packet which carried new data
+ *
+ * @proto:	Protocol
+ * @bytes:	Number of bytes of new data
+ */
+void net_stats_rx(enum net_stats_proto proto, uint bytes);
+
+/**
+ * net_stats_retransmit() - Count a request or segment sent again
+ *
+ * Any round-trip time being measured is dropped, since it is not known which
+ * of the packets an answer is for.
+ *
+ * @proto:	Protocol
+ */
+void net_stats_retransmit(enum net_stats_proto proto);
+
+/**
+ * net_stats_dup() - Count a packet with data which was already received
+ *
+ * @proto:	Protocol
+ */
+void net_stats_dup(enum net_stats_proto proto);
+
+/**
+ * net_stats_ooo() - Count a packet received ahead of a missing one
+ *
+ * @proto:	Protocol
+ */
+void net_stats_ooo(enum net_stats_proto proto);
+
+/**
+ * net_stats_rtt() - Add a round-trip time sample
+ *
+ * @proto:	Protocol
+ * @us:		Round-trip time in microseconds
+ */
+void net_stats_rtt(enum net_stats_proto proto, ulong us);
+
+/**
+ * net_stats_rtt_start() - Start timing a round trip
+ *
+ * This is for protocols with a single request outstanding: the time until
+ * net_stats_rtt_end() is called is added as a sample. Nothing is done if a
+ * round trip is already being timed.
+ *
+ * @proto:	Protocol
+ */
+void net_stats_rtt_start(enum net_stats_proto proto);
+
+/**
+ * net_stats_rtt_end() - Finish timing a round trip
+ *
+ * @proto:	Protocol
+ */
+void net_stats_rtt_end(enum net_stats_proto proto);
+
+/**
+ * net_stats_rx_drop() - Count packets dropped by an Ethernet driver
+ *
+ * Drivers call this when a packet is lost because their receive queue is
+ * full. Those which do set ETH_OFFLOAD_RX_DROPS.
+ *
+ * @count:	Number of packets dropped
+ */
+void net_stats_rx_drop(uint count);
+#else
+static inline void net_stats_rx(enum net_stats_proto proto, uint bytes)
+{
+}
+
+static inline void net_stats_retransmit(enum net_stats_proto proto)
+{
+}
+
+static inline void net_stats_dup(enum net_stats_proto proto)
+{
+}
+
+static inline void net_stats_ooo(enum net_stats_proto proto)
+{
+}
+
+static inline void net_stats_rtt(enum net_stats_proto proto, ulong us)
+{
+}
+
+static inline void net_stats_rtt_start(enum net_stats_proto proto)
+{
+}
+
+static inline void net_stats_rtt_end(enum net_stats_proto proto)
+{
+}
+
+static inline void net_stats_rx_drop(uint count)
+{
+}
+#endif
+
+#endif /* __NET_STATS_H__ */
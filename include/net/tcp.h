@@ -87,6 +87,7 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
 #define TCP_SCALE	0x01		/* Scale			*/
+#define TCP_MAX_SCALE	14		/* Largest scale (RFC 7323)	*/
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -144,6 +145,13 @@ struct sack_edges {
 
 #define TCP_SACK_HILLS	4
 
+/*
+ * Only three hills fit in the options next to the timestamp, but more are
+ * kept, so that data received beyond them need not be sent again
+ */
+#define TCP_SACK_REPORT	3
+#define TCP_RX_HILLS	16
+
 /**
  * struct tcp_sack_v - TCP option structure for SACK
  * @kind: Field ID
@@ -337,6 +345,8 @@ enum tcp_status {
  * @status:		TCP stream status (OK or ERR)
  * @rx_packets:		total number of received packets
  * @tx_packets:		total number of transmitted packets
+ * @rx_ooo:		number of data segments received ahead of a hole
+ * @tx_acks:		number of ACKs sent for received data
  *
  * @fin_rx:		Non-zero if TCP_FIN was received
  * @fin_rx_seq:		TCP sequence of rx FIN bit
@@ -353,13 +363,20 @@ enum tcp_status {
  * @irs:		Initial receive sequence number
  * @rcv_nxt:		Receive next
  * @rcv_wnd:		Receive window (in bytes)
+ * @rcv_wnd_scale:	Shift applied to the receive window we advertise
  *
  * @loc_timestamp:	Local timestamp
  * @rmt_timestamp:	Remote timestamp
  *
  * @rmt_win_scale:	Remote window scale factor
+ * @rmt_win_scale_ok:	Non-zero if the remote sent a window scale option
  *
- * @lost:		Used for SACK
+ * @ack_pending:	Number of segments received but not yet acknowledged
+ * @ack_time:		Time when the first of those segments arrived (ticks)
+ *
+ * @rx_hill:		Data received beyond @rcv_nxt, in sequence order
+ * @rx_hills:		Number of entries in @rx_hill
+ * @lost:		Used for SACK, reports the first hills of @rx_hill
  *
  * @retry_cnt:		Number of retry attempts remaining. Only SYN, FIN
  *			  or DATA segments are tried to retransmit.
@@ -368,6 +385,8 @@ enum tcp_status {
  * @retry_seq_num:	TCP sequence for retransmit
  * retry_tx_len:	Number of data to transmit
  * @retry_tx_offs:	Position in the TX stream
+ * @retry_sent:		Time the segment was first sent (us), 0 once it has
+ *			  been sent again, to time the round trip
  */
 struct tcp_stream {
 	struct in_addr	rhost;
@@ -396,6 +415,8 @@ struct tcp_stream {
 	enum tcp_status	status;
 	u32		rx_packets;
 	u32		tx_packets;
+	u32		rx_ooo;
+	u32		tx_acks;
 
 	int		fin_rx;
 	u32		fin_rx_seq;
@@ -413,6 +434,7 @@ struct tcp_stream {
 	u32		irs;
 	u32		rcv_nxt;
 	u32		rcv_wnd;
+	u8		rcv_wnd_scale;
 
 	/* TCP option timestamp */
 	u32		loc_timestamp;
@@ -420,8 +442,15 @@ struct tcp_stream {
 
 	/* TCP window scale */
 	u8		rmt_win_scale;
+	u8		rmt_win_scale_ok;
+
+	/* delayed ACK */
+	int		ack_pending;
+	ulong		ack_time;
 
 	/* TCP sliding window control used to request re-TX */
+	struct sack_edges rx_hill[TCP_RX_HILLS];
+	int		rx_hills;
 	struct tcp_sack_v lost;
 
 	/* used for data retransmission */
@@ -431,6 +460,7 @@ struct tcp_stream {
 	u32		retry_seq_num;
 	u32		retry_tx_len;
 	u32		retry_tx_offs;
+	ulong		retry_sent;
 };
 
 void tcp_init(void);
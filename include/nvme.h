@@ -78,6 +78,16 @@ int nvme_scan_namespace(void);
  */
 int nvme_print_info(struct udevice *udev);
 
+/**
+ * nvme_print_stats - print the transfer statistics of a namespace
+ *
+ * This prints the number of commands and bytes read and written, along with
+ * the rates achieved while commands were outstanding and the deepest queue.
+ *
+ * @udev:	NVMe namespace block device
+ */
+void nvme_print_stats(struct udevice *udev);
+
 /**
  * nvme_get_namespace_id - return namespace identifier
  *
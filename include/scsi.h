@@ -13,6 +13,17 @@
 
 struct udevice;
 
+/**
+ * struct scsi_sg - one segment of the data for a command
+ *
+ * @addr: Start of the segment
+ * @len: Length of the segment in bytes
+ */
+struct scsi_sg {
+	unsigned char *addr;
+	unsigned long len;
+};
+
 /**
  * struct scsi_cmd - information about a SCSI command to be processed
  *
@@ -33,6 +44,11 @@ struct udevice;
  * @trans_bytes: tranfered bytes
  * @priv: Private value
  * @dma_dir: Direction of data structure
+ * @sg: Segments holding the data, in order, if @sg_count is not 0. The host
+ *	then transfers to and from these instead of @pdata, which still points
+ *	to the caller's buffer
+ * @sg_count: Number of segments in @sg, never more than the host's
+ *	@max_segments
  */
 struct scsi_cmd {
 	unsigned char cmd[16];
@@ -54,6 +70,8 @@ struct scsi_cmd {
 
 	unsigned int priv;
 	enum dma_data_direction dma_dir;
+	struct scsi_sg *sg;
+	unsigned int sg_count;
 };
 
 /*-----------------------------------------------------------
@@ -179,6 +197,7 @@ struct scsi_cmd {
 #define SCSI_VERIFY		0x2F		/* Verify (O) */
 #define SCSI_WRITE6		0x0A		/* Write 6-Byte (MANDATORY) */
 #define SCSI_WRITE10	0x2A		/* Write 10-Byte (MANDATORY) */
+#define SCSI_WRITE16	0x8A		/* Write 16-Byte (O) */
 #define SCSI_WRT_VERIFY	0x2E		/* Write and Verify (O) */
 #define SCSI_WRITE_LONG	0x3F		/* Write Long (O) */
 #define SCSI_WRITE_SAME	0x41		/* Write Same (O) */
@@ -269,12 +288,21 @@ struct __packed scsi_write10_req {
  * @max_lun: Maximum number of logical units
  * @max_id: Maximum number of target ids
  * @max_bytes_per_req: Maximum number of bytes per read/write request
+ * @queue_depth: Number of commands the host can have outstanding at once, 0
+ *	or 1 if it works on one at a time
+ * @max_segments: Largest number of segments the host takes in a command's
+ *	@sg list, at least 3, or 0 if it only takes @pdata
+ * @max_seg_bytes: Largest segment the host takes, 0 for no limit
  */
 struct scsi_plat {
 	unsigned long base;
 	unsigned long max_lun;
 	unsigned long max_id;
 	unsigned long max_bytes_per_req;
+	bool readahead;		/* block devices may read ahead */
+	uint queue_depth;
+	uint max_segments;
+	unsigned long max_seg_bytes;
 };
 
 /* Operations for SCSI */
@@ -288,6 +316,23 @@ struct scsi_ops {
 	 */
 	int (*exec)(struct udevice *dev, struct scsi_cmd *cmd);
 
+	/**
+	 * exec_queue() - execute several commands at once
+	 *
+	 * This is optional. The commands are passed to the device without
+	 * waiting for the ones before them, up to the host's queue depth, so
+	 * that the device can work on them together. They may complete in any
+	 * order.
+	 *
+	 * @dev:	SCSI bus
+	 * @cmds:	Commands to execute
+	 * @count:	Number of commands
+	 * @return number of commands at the start of @cmds which succeeded,
+	 *	i.e. @count if they all did
+	 */
+	int (*exec_queue)(struct udevice *dev, struct scsi_cmd *cmds,
+			  int count);
+
 	/**
 	 * bus_reset() - reset the bus
 	 *
@@ -328,6 +373,20 @@ extern struct scsi_ops scsi_ops;
  */
 int scsi_exec(struct udevice *dev, struct scsi_cmd *cmd);
 
+/**
+ * scsi_exec_queue() - execute several commands at once
+ *
+ * If the host cannot queue commands they are executed one after the other,
+ * stopping at the first which fails.
+ *
+ * @dev:	SCSI bus
+ * @cmds:	Commands to execute
+ * @count:	Number of commands
+ * Return: number of commands at the start of @cmds which succeeded, i.e.
+ * @count if they all did, -ENOSYS if the host cannot execute commands
+ */
+int scsi_exec_queue(struct udevice *dev, struct scsi_cmd *cmds, int count);
+
 /**
  * scsi_bus_reset() - reset the bus
  *
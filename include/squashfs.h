@@ -12,6 +12,25 @@
 
 struct disk_partition;
 
+/**
+ * struct sqfs_stats - SquashFS cache statistics
+ *
+ * @meta_hits: Metadata lookups served from the cache
+ * @meta_misses: Metadata lookups which had to read and decompress the image
+ * @metablks: Number of metadata blocks decompressed
+ * @frag_hits: Fragment block lookups served from the cache
+ * @frag_misses: Fragment block lookups which had to read the image
+ * @cached_bytes: Bytes of decompressed data held by the cache
+ */
+struct sqfs_stats {
+	unsigned long meta_hits;
+	unsigned long meta_misses;
+	unsigned long metablks;
+	unsigned long frag_hits;
+	unsigned long frag_misses;
+	unsigned long cached_bytes;
+};
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp);
 int sqfs_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp);
 int sqfs_probe(struct blk_desc *fs_dev_desc,
@@ -23,4 +42,16 @@ int sqfs_exists(const char *filename);
 void sqfs_close(void);
 void sqfs_closedir(struct fs_dir_stream *dirs);
 
+/**
+ * sqfs_get_stats() - Get the statistics of the SquashFS caches
+ *
+ * @stats: Returns the statistics
+ */
+void sqfs_get_stats(struct sqfs_stats *stats);
+
+/**
+ * sqfs_cache_free() - Drop all data cached from SquashFS images
+ */
+void sqfs_cache_free(void);
+
 #endif /* SQFS_H  */
@@ -99,6 +99,74 @@ uint32_t crc32_no_comp(uint32_t crc, const unsigned char *buf, uint len);
 void crc32_wd_buf(const uint8_t *input, uint ilen, uint8_t *output,
 		  uint chunk_sz);
 
+/**
+ * enum crc32_impl - Implementations of the CRC32 calculation
+ *
+ * crc32() picks the fastest of these which the CPU supports. The others are
+ * available through crc32_no_comp_impl() for testing and benchmarking.
+ *
+ * @CRC32_IMPL_TABLE: Byte-wise table lookup
+ * @CRC32_IMPL_SLICE8: Slice-by-8 table lookup, eight bytes at a time
+ * @CRC32_IMPL_ARCH: CPU-specific instructions, see crc32_arch()
+ * @CRC32_IMPL_COUNT: Number of implementations
+ */
+enum crc32_impl {
+	CRC32_IMPL_TABLE,
+	CRC32_IMPL_SLICE8,
+	CRC32_IMPL_ARCH,
+
+	CRC32_IMPL_COUNT,
+};
+
+/**
+ * crc32_impl_name() - Get the name of a CRC32 implementation
+ *
+ * @impl: Implementation to check
+ * Return: name of the implementation, e.g. "slice-by-8"
+ */
+const char *crc32_impl_name(enum crc32_impl impl);
+
+/**
+ * crc32_no_comp_impl() - Calculate the CRC32 with a particular implementation
+ *
+ * This is the same as crc32_no_comp() but does not select the implementation
+ * automatically.
+ *
+ * @impl: Implementation to use
+ * @crcp: Input crc to chain from, updated with the checksum on success
+ * @buf: Bytes to checksum
+ * @len: Number of bytes to checksum
+ * Return: 0 if OK, -ENOSYS if the implementation is not built in or is not
+ *	supported by this CPU
+ */
+int crc32_no_comp_impl(enum crc32_impl impl, uint32_t *crcp, const uint8_t *buf,
+		       uint len);
+
+/**
+ * crc32_arch_supported() - Check whether the CPU can run crc32_arch()
+ *
+ * This is provided by the architecture when CONFIG_CRC32_ARCH is enabled. It
+ * is called once, the first time a CRC32 is calculated.
+ *
+ * Return: true if crc32_arch() can be used
+ */
+bool crc32_arch_supported(void);
+
+/**
+ * crc32_arch() - Calculate the CRC32 using CPU-specific instructions
+ *
+ * This is provided by the architecture when CONFIG_CRC32_ARCH is enabled. It
+ * may leave some bytes at the end of the buffer unprocessed, e.g. if it only
+ * handles whole blocks, in which case the caller checksums the rest.
+ *
+ * @crcp: Input crc to chain from (no one's complement), updated with the
+ *	checksum of the bytes processed
+ * @buf: Bytes to checksum
+ * @len: Number of bytes to checksum
+ * Return: number of bytes processed
+ */
+uint crc32_arch(uint32_t *crcp, const uint8_t *buf, uint len);
+
 /* lib/crc32c.c */
 
 /**
@@ -126,4 +194,43 @@ void crc32c_init(uint32_t *crc32c_table, uint32_t pol);
 uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
 		    uint32_t *crc32c_table);
 
+/**
+ * crc32c_table_cal() - Perform CRC32 on a buffer using only the table
+ *
+ * This is the same as crc32c_cal() but never uses crc32c_arch(). It is
+ * intended for testing and benchmarking.
+ *
+ * @crc: Previous crc (use 0 at start)
+ * @data: Data bytes to checksum
+ * @length: Number of bytes to process
+ * @crc32c_table:: CRC table
+ * Return: checksum value
+ */
+uint32_t crc32c_table_cal(uint32_t crc, const char *data, int length,
+			  uint32_t *crc32c_table);
+
+/**
+ * crc32c_arch_supported() - Check whether the CPU can run crc32c_arch()
+ *
+ * This is provided by the architecture when CONFIG_CRC32_ARCH is enabled.
+ *
+ * Return: true if crc32c_arch() can be used
+ */
+bool crc32c_arch_supported(void);
+
+/**
+ * crc32c_arch() - Calculate the CRC32C using CPU-specific instructions
+ *
+ * This uses the Castagnoli polynomial (0x82f63b78 bit-reflected), so it can
+ * only stand in for crc32c_cal() when the table was set up with that
+ * polynomial. Like crc32_arch() it may leave some bytes at the end of the
+ * buffer unprocessed.
+ *
+ * @crcp: Previous crc, updated with the checksum of the bytes processed
+ * @buf: Bytes to checksum
+ * @len: Number of bytes to checksum
+ * Return: number of bytes processed
+ */
+uint crc32c_arch(uint32_t *crcp, const uint8_t *buf, uint len);
+
 #endif /* _UBOOT_CRC_H */
@@ -78,6 +78,19 @@ void sha1_update(sha1_context *ctx, const unsigned char *input,
  */
 void sha1_finish( sha1_context *ctx, unsigned char output[20] );
 
+/**
+ * \brief	   SHA-1 process whole 64-byte blocks using only C code
+ *
+ * sha1_process() may be overridden by the architecture, which can fall
+ * back to this if the CPU lacks the required instructions.
+ *
+ * \param ctx	   SHA-1 context
+ * \param data	   buffer holding the data
+ * \param blocks   number of 64-byte blocks in the buffer
+ */
+void sha1_process_generic(sha1_context *ctx, const unsigned char *data,
+			  unsigned int blocks);
+
 /**
  * \brief	   Output = SHA-1( input buffer ), with watchdog triggering
  *
@@ -34,6 +34,19 @@ void sha256_starts(sha256_context * ctx);
 void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length);
 void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 
+/**
+ * sha256_process_generic() - Hash whole 64-byte blocks using only C code
+ *
+ * sha256_process() may be overridden by the architecture, which can fall
+ * back to this if the CPU lacks the required instructions.
+ *
+ * @ctx: SHA-256 context
+ * @data: Data to hash
+ * @blocks: Number of 64-byte blocks in @data
+ */
+void sha256_process_generic(sha256_context *ctx, const unsigned char *data,
+			    unsigned int blocks);
+
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
@@ -30,6 +30,29 @@ typedef struct {
 
 extern const uint8_t sha512_der_prefix[];
 
+/**
+ * sha512_process() - Hash whole blocks into a SHA-384/SHA-512 state
+ *
+ * This is a weak function which architectures can override to use CPU
+ * instructions, falling back to sha512_process_generic() if the CPU does not
+ * have them.
+ *
+ * @state: Hash state (eight 64-bit words)
+ * @data: Data to hash
+ * @blocks: Number of SHA512_BLOCK_SIZE blocks in @data
+ */
+void sha512_process(uint64_t *state, const uint8_t *data, unsigned int blocks);
+
+/**
+ * sha512_process_generic() - Hash whole blocks using only C code
+ *
+ * @state: Hash state (eight 64-bit words)
+ * @data: Data to hash
+ * @blocks: Number of SHA512_BLOCK_SIZE blocks in @data
+ */
+void sha512_process_generic(uint64_t *state, const uint8_t *data,
+			    unsigned int blocks);
+
 void sha512_starts(sha512_context * ctx);
 void sha512_update(sha512_context *ctx, const uint8_t *input, uint32_t length);
 void sha512_finish(sha512_context * ctx, uint8_t digest[SHA512_SUM_LEN]);
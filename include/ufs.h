@@ -2,8 +2,51 @@
 #ifndef _UFS_H
 #define _UFS_H
 
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct blk_desc;
 struct udevice;
 
+/**
+ * struct ufs_bulk_stats - Result of a bulk transfer
+ *
+ * @bytes: Number of bytes written
+ * @time_us: Time taken, in microseconds
+ * @rate: Rate achieved, in KB/s (1000 bytes per second)
+ */
+struct ufs_bulk_stats {
+	u64 bytes;
+	ulong time_us;
+	ulong rate;
+};
+
+/**
+ * struct ufs_status - State of a UFS link and device
+ *
+ * @gear: Gear the link is running at
+ * @max_gear: Highest gear the link supports
+ * @lanes: Number of lanes in use
+ * @hs: true if the link is in a high-speed (HS) mode, false for PWM
+ * @wb_sup: true if the device has a WriteBooster buffer the driver can use
+ * @wb_enabled: true if writes currently go through the WriteBooster buffer
+ * @wb_avail: Space left in the WriteBooster buffer, in percent, or -1 if not
+ *	known
+ * @bulk_active: true while a bulk transfer is in progress
+ * @bulk_last: Result of the last bulk transfer
+ */
+struct ufs_status {
+	uint gear;
+	uint max_gear;
+	uint lanes;
+	bool hs;
+	bool wb_sup;
+	bool wb_enabled;
+	int wb_avail;
+	bool bulk_active;
+	struct ufs_bulk_stats bulk_last;
+};
+
 /**
  * ufs_probe() - initialize all devices in the UFS uclass
  *
@@ -29,4 +72,88 @@ int ufs_probe_dev(int index);
  * Return: 0 if Ok, -ve on error
  */
 int ufs_scsi_bind(struct udevice *ufs_dev, struct udevice **scsi_devp);
+
+#if IS_ENABLED(CONFIG_UFS)
+/**
+ * ufs_blk_host() - Get the UFS device holding a block device
+ *
+ * @desc: Block device
+ * Return: UFS device, or NULL if @desc is not on a UFS device
+ */
+struct udevice *ufs_blk_host(struct blk_desc *desc);
+
+/**
+ * ufs_bulk_begin() - Start a bulk transfer
+ *
+ * This is for large writes, such as flashing an image. The link is moved to
+ * the highest gear and, if the device has one, writes go through the
+ * WriteBooster buffer until ufs_bulk_end() is called. Nothing is done if a
+ * bulk transfer is already in progress.
+ *
+ * @dev: UFS device
+ * Return: 0 if OK, -ve on error
+ */
+int ufs_bulk_begin(struct udevice *dev);
+
+/**
+ * ufs_bulk_end() - Finish a bulk transfer
+ *
+ * The WriteBooster buffer is turned off and left to flush in the background,
+ * and the link goes back to the gear used outside bulk transfers. The data
+ * written and the rate achieved are reported.
+ *
+ * @dev: UFS device
+ * @stats: Returns the result of the transfer, or NULL if not wanted
+ * Return: 0 if OK, -EINVAL if no bulk transfer is in progress, other -ve
+ * value on error
+ */
+int ufs_bulk_end(struct udevice *dev, struct ufs_bulk_stats *stats);
+
+/**
+ * ufs_wb_enable() - Turn the WriteBooster buffer on or off
+ *
+ * @dev: UFS device
+ * @enable: true to send writes through the buffer
+ * Return: 0 if OK, -EOPNOTSUPP if the device has no buffer, other -ve value on
+ * error
+ */
+int ufs_wb_enable(struct udevice *dev, bool enable);
+
+/**
+ * ufs_wb_flush() - Flush the WriteBooster buffer to normal storage
+ *
+ * This waits for the flush to finish.
+ *
+ * @dev: UFS device
+ * Return: 0 if OK, -EOPNOTSUPP if the device has no buffer, -ETIMEDOUT if the
+ * flush did not finish, other -ve value on error
+ */
+int ufs_wb_flush(struct udevice *dev);
+
+/**
+ * ufs_get_status() - Get the state of a UFS link and device
+ *
+ * @dev: UFS device
+ * @status: Returns the state
+ * Return: 0 if OK, -ve on error
+ */
+int ufs_get_status(struct udevice *dev, struct ufs_status *status);
+#else
+static inline struct udevice *ufs_blk_host(struct blk_desc *desc)
+{
+	return NULL;
+}
+
+static inline int ufs_bulk_begin(struct udevice *dev)
+{
+	return -ENOSYS;
+}
+
+static inline int ufs_bulk_end(struct udevice *dev,
+			       struct ufs_bulk_stats *stats)
+{
+	return -ENOSYS;
+}
+#endif
+
 #endif
@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Writing an image to a block device as it arrives
+ *
+ * The image goes through up to three stages: decompression, if it starts with
+ * a gzip or zstd magic number, then the sparse image parser, if the
+ * decompressed data starts with the sparse magic number, then a buffer of
+ * blocks which is written out to the device each time it fills up.
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <blk.h>
+#include <blk_stream.h>
+#include <image-sparse.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <u-boot/zlib.h>
+#include <asm/unaligned.h>
+#include <linux/errno.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#include <linux/zstd.h>
+
+#define BLK_STREAM_OBUF_SIZE	SZ_64K
+
+static const u8 gzip_magic[] = { 0x1f, 0x8b };
+static const u8 zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+int blk_stream_start(struct blk_stream *bs, struct blk_desc *desc,
+		     lbaint_t start, lbaint_t count)
+{
+	memset(bs, '\0', sizeof(*bs));
+	bs->desc = desc;
+	bs->start = start;
+	bs->count = count;
+
+	bs->buf_size = max_t(ulong, rounddown(CONFIG_BLK_STREAM_BUF_SIZE,
+					      desc->blksz), desc->blksz);
+	bs->buf = memalign(ARCH_DMA_MINALIGN, bs->buf_size);
+	if (!bs->buf)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int blk_stream_flush(struct blk_stream *bs)
+{
+	ulong blksz = bs->desc->blksz;
+	lbaint_t blk, blkcnt;
+
+	if (!bs->buf_len)
+		return 0;
+
+	blkcnt = DIV_ROUND_UP(bs->buf_len, blksz);
+	memset(bs->buf + bs->buf_len, '\0', blkcnt * blksz - bs->buf_len);
+	blk = bs->start + div_u64(bs->buf_pos, blksz);
+	log_debug("writing " LBAFU " blocks at " LBAFU "\n", blkcnt, blk);
+	if (blk_dwrite(bs->desc, blk, blkcnt, bs->buf) != blkcnt)
+		return -EIO;
+	bs->written += blkcnt;
+	bs->buf_pos += bs->buf_len;
+	bs->buf_len = 0;
+
+	return 0;
+}
+
+/* Write decompressed data at byte offset @pos from the first block */
+static int blk_stream_put(struct blk_stream *bs, u64 pos, const void *data,
+			  ulong len)
+{
+	ulong n;
+	int ret;
+
+	if (pos + len > (u64)bs->count * bs->desc->blksz)
+		return -ENOSPC;
+
+	if (bs->buf_len && pos != bs->buf_pos + bs->buf_len) {
+		ret = blk_stream_flush(bs);
+		if (ret)
+			return ret;
+	}
+	if (!bs->buf_len)
+		bs->buf_pos = pos;
+
+	while (len) {
+		n = min(len, bs->buf_size - bs->buf_len);
+		memcpy(bs->buf + bs->buf_len, data, n);
+		bs->buf_len += n;
+		data += n;
+		len -= n;
+		if (bs->buf_len == bs->buf_size) {
+			ret = blk_stream_flush(bs);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static lbaint_t blk_stream_sparse_write(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					const void *buffer)
+{
+	struct blk_stream *bs = info->priv;
+	ulong blksz = info->blksz;
+
+	if (blk_stream_put(bs, (u64)(blk - info->start) * blksz, buffer,
+			   blkcnt * blksz))
+		return 0;
+
+	return blkcnt;
+}
+
+static lbaint_t blk_stream_sparse_reserve(struct sparse_storage *info,
+					  lbaint_t blk, lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+static int blk_stream_sparse_start(struct blk_stream *bs)
+{
+	struct sparse_storage *info = &bs->sparse_info;
+
+	info->blksz = bs->desc->blksz;
+	info->start = bs->start;
+	info->size = bs->count;
+	info->priv = bs;
+	info->write = blk_stream_sparse_write;
+	info->reserve = blk_stream_sparse_reserve;
+
+	return sparse_stream_start(&bs->ss, info);
+}
+
+/* Pass on decompressed data */
+static int blk_stream_output(struct blk_stream *bs, const void *data,
+			     ulong len)
+{
+	u8 head[sizeof(bs->out_head)];
+	ulong n;
+	int ret;
+
+	if (bs->sparse == BLK_STREAM_UNKNOWN) {
+		n = min_t(ulong, len, sizeof(bs->out_head) - bs->out_len);
+		memcpy(bs->out_head + bs->out_len, data, n);
+		bs->out_len += n;
+		if (bs->out_len < sizeof(bs->out_head))
+			return 0;
+		data += n;
+		len -= n;
+
+		memcpy(head, bs->out_head, sizeof(head));
+		if (get_unaligned_le32(head) == SPARSE_HEADER_MAGIC) {
+			log_debug("sparse image\n");
+			ret = blk_stream_sparse_start(bs);
+			if (ret)
+				return ret;
+			bs->sparse = BLK_STREAM_SPARSE;
+		} else {
+			bs->sparse = BLK_STREAM_RAW;
+		}
+		ret = blk_stream_output(bs, head, sizeof(head));
+		if (ret)
+			return ret;
+	}
+
+	if (bs->sparse == BLK_STREAM_SPARSE) {
+		ret = sparse_stream_write(&bs->ss, data, len);
+	} else {
+		ret = blk_stream_put(bs, bs->out_pos, data, len);
+		bs->out_pos += len;
+	}
+
+	return ret;
+}
+
+static int blk_stream_gunzip(struct blk_stream *bs, const void *data,
+			     ulong len)
+{
+	z_stream *zs = bs->zs;
+	ulong n;
+	int ret;
+
+	zs->next_in = (void *)data;
+	zs->avail_in = len;
+	while (!bs->gz_done) {
+		zs->next_out = bs->obuf;
+		zs->avail_out = BLK_STREAM_OBUF_SIZE;
+		ret = inflate(zs, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			log_err("gzip error %d\n", ret);
+			return -EINVAL;
+		}
+		if (ret == Z_STREAM_END)
+			bs->gz_done = true;
+
+		n = BLK_STREAM_OBUF_SIZE - zs->avail_out;
+		if (n) {
+			ret = blk_stream_output(bs, bs->obuf, n);
+			if (ret)
+				return ret;
+		}
+		if (!zs->avail_in && zs->avail_out)
+			break;
+	}
+
+	return 0;
+}
+
+/* Decompress the current zstd frame, returning the bytes used or -ve error */
+static long blk_stream_unzstd(struct blk_stream *bs, const void *data,
+			      ulong len)
+{
+	zstd_in_buffer in = { .src = data, .size = len };
+	zstd_out_buffer out;
+	size_t res;
+	int ret;
+
+	do {
+		out.dst = bs->obuf;
+		out.size = BLK_STREAM_OBUF_SIZE;
+		out.pos = 0;
+		res = zstd_decompress_stream(bs->zstd, &out, &in);
+		if (zstd_is_error(res)) {
+			log_err("zstd error: %s\n", zstd_get_error_name(res));
+			return -EINVAL;
+		}
+		bs->zstd_left = res;
+		if (out.pos) {
+			ret = blk_stream_output(bs, bs->obuf, out.pos);
+			if (ret)
+				return ret;
+		}
+	} while (res && (in.pos < in.size || out.pos == out.size));
+
+	return in.pos;
+}
+
+/*
+ * Start each zstd frame whose header is complete in @bs->head. The window is
+ * sized from the frame header, so it is grown when a later frame needs more
+ * than the ones before it. Skippable frames have no window.
+ */
+static int blk_stream_zstd_frame(struct blk_stream *bs)
+{
+	zstd_frame_header params;
+	size_t window, size, res;
+	long used;
+
+	while (bs->head_len && !bs->zstd_left) {
+		res = zstd_get_frame_header(&params, bs->head, bs->head_len);
+		if (zstd_is_error(res))
+			return -EINVAL;
+		if (res)
+			return bs->head_len == sizeof(bs->head) ? -EINVAL : 0;
+
+		window = max_t(size_t, params.windowSize, SZ_1K);
+		if (window > bs->zstd_window) {
+			free(bs->zstd_wksp);
+			bs->zstd_window = 0;
+			bs->zstd = NULL;
+			size = zstd_dstream_workspace_bound(window);
+			bs->zstd_wksp = malloc(size);
+			if (!bs->zstd_wksp)
+				return -ENOMEM;
+			bs->zstd = zstd_init_dstream(window, bs->zstd_wksp,
+						     size);
+			if (!bs->zstd)
+				return -EINVAL;
+			bs->zstd_window = window;
+		}
+
+		/* a short frame may end within @bs->head; keep the rest */
+		used = blk_stream_unzstd(bs, bs->head, bs->head_len);
+		if (used < 0)
+			return used;
+		bs->head_len -= used;
+		memmove(bs->head, bs->head + used, bs->head_len);
+	}
+
+	return 0;
+}
+
+/* Pass on data from the image, once its compression is known */
+static int blk_stream_decomp(struct blk_stream *bs, const void *data,
+			     ulong len)
+{
+	long used;
+	ulong n;
+	int ret;
+
+	if (IS_ENABLED(CONFIG_GZIP) && bs->comp == BLK_STREAM_GZIP)
+		return blk_stream_gunzip(bs, data, len);
+
+	if (IS_ENABLED(CONFIG_ZSTD) && bs->comp == BLK_STREAM_ZSTD) {
+		while (len) {
+			if (bs->zstd_left) {
+				used = blk_stream_unzstd(bs, data, len);
+				if (used < 0)
+					return used;
+				n = used;
+			} else {
+				/* collect the header of the next frame */
+				n = min_t(ulong, len,
+					  sizeof(bs->head) - bs->head_len);
+				memcpy(bs->head + bs->head_len, data, n);
+				bs->head_len += n;
+				ret = blk_stream_zstd_frame(bs);
+				if (ret)
+					return ret;
+			}
+			data += n;
+			len -= n;
+		}
+
+		return 0;
+	}
+
+	return blk_stream_output(bs, data, len);
+}
+
+static int blk_stream_set_comp(struct blk_stream *bs)
+{
+	u8 head[4];
+	uint len = bs->head_len;
+
+	if (IS_ENABLED(CONFIG_ZSTD) && len == sizeof(zstd_magic) &&
+	    (!memcmp(bs->head, zstd_magic, len) ||
+	     (get_unaligned_le32(bs->head) & ZSTD_MAGIC_SKIPPABLE_MASK) ==
+	     ZSTD_MAGIC_SKIPPABLE_START)) {
+		log_debug("zstd image\n");
+		bs->comp = BLK_STREAM_ZSTD;
+	} else if (IS_ENABLED(CONFIG_GZIP) && len >= sizeof(gzip_magic) &&
+		   !memcmp(bs->head, gzip_magic, sizeof(gzip_magic))) {
+		log_debug("gzip image\n");
+		bs->comp = BLK_STREAM_GZIP;
+		bs->zs = calloc(1, sizeof(*bs->zs));
+		if (!bs->zs)
+			return -ENOMEM;
+		/* gzip header, checked with its CRC and length */
+		if (inflateInit2(bs->zs, 16 + MAX_WBITS) != Z_OK) {
+			free(bs->zs);
+			bs->zs = NULL;
+			return -ENOMEM;
+		}
+	} else {
+		bs->comp = BLK_STREAM_NONE;
+	}
+	if (bs->comp != BLK_STREAM_NONE) {
+		bs->obuf = malloc(BLK_STREAM_OBUF_SIZE);
+		if (!bs->obuf)
+			return -ENOMEM;
+	}
+
+	memcpy(head, bs->head, len);
+	bs->head_len = 0;
+
+	return blk_stream_decomp(bs, head, len);
+}
+
+static int blk_stream_input(struct blk_stream *bs, const void *data,
+			    ulong len)
+{
+	ulong n;
+	int ret;
+
+	if (bs->comp == BLK_STREAM_DETECT) {
+		n = min_t(ulong, len, 4 - bs->head_len);
+		memcpy(bs->head + bs->head_len, data, n);
+		bs->head_len += n;
+		if (bs->head_len < 4)
+			return 0;
+		data += n;
+		len -= n;
+		ret = blk_stream_set_comp(bs);
+		if (ret)
+			return ret;
+	}
+
+	return len ? blk_stream_decomp(bs, data, len) : 0;
+}
+
+int blk_stream_write(struct blk_stream *bs, u64 offset, const void *data,
+		     ulong len)
+{
+	ulong skip;
+	int ret;
+
+	if (bs->ret)
+		return bs->ret;
+	if (offset > bs->in_pos)
+		return -ESPIPE;
+	if (offset + len <= bs->in_pos)
+		return 0;
+
+	skip = bs->in_pos - offset;
+	data += skip;
+	len -= skip;
+	bs->in_pos += len;
+	ret = blk_stream_input(bs, data, len);
+	if (ret) {
+		log_debug("stream failed at %llx (err=%d)\n", bs->in_pos, ret);
+		bs->ret = ret;
+	}
+
+	return ret;
+}
+
+int blk_stream_finish(struct blk_stream *bs)
+{
+	u8 head[sizeof(bs->out_head)];
+	int ret = bs->ret;
+
+	/* too short to tell */
+	if (!ret && bs->comp == BLK_STREAM_DETECT)
+		ret = blk_stream_set_comp(bs);
+	if (!ret) {
+		if (bs->comp == BLK_STREAM_GZIP && !bs->gz_done)
+			ret = -EINVAL;
+		else if (bs->comp == BLK_STREAM_ZSTD &&
+			 (!bs->zstd || bs->zstd_left || bs->head_len))
+			ret = -EINVAL;
+	}
+	if (!ret && bs->sparse == BLK_STREAM_UNKNOWN) {
+		bs->sparse = BLK_STREAM_RAW;
+		memcpy(head, bs->out_head, bs->out_len);
+		ret = blk_stream_output(bs, head, bs->out_len);
+	}
+
+	if (bs->sparse == BLK_STREAM_SPARSE) {
+		int err = sparse_stream_finish(&bs->ss);
+
+		if (!ret)
+			ret = err;
+	}
+	if (!ret)
+		ret = blk_stream_flush(bs);
+
+	if (IS_ENABLED(CONFIG_GZIP) && bs->zs) {
+		inflateEnd(bs->zs);
+		free(bs->zs);
+		bs->zs = NULL;
+	}
+	free(bs->zstd_wksp);
+	free(bs->obuf);
+	free(bs->buf);
+	bs->zstd = NULL;
+	bs->zstd_wksp = NULL;
+	bs->zstd_window = 0;
+	bs->obuf = NULL;
+	bs->buf = NULL;
+	if (!bs->ret)
+		bs->ret = ret;
+
+	return ret;
+}
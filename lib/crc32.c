@@ -15,6 +15,7 @@
 #endif
 #include <compiler.h>
 #include <u-boot/crc.h>
+#include <linux/errno.h>
 
 #if defined(CONFIG_HW_WATCHDOG) || defined(CONFIG_WATCHDOG)
 #include <watchdog.h>
@@ -29,6 +30,20 @@
 
 #define tole(x) cpu_to_le32(x)
 
+#ifndef USE_HOSTCC
+#if CONFIG_IS_ENABLED(CRC32_ARCH)
+#define CRC32_USE_ARCH
+#endif
+#if CONFIG_IS_ENABLED(CRC32_SLICE_BY_8) && __BYTE_ORDER == __LITTLE_ENDIAN
+#define CRC32_USE_SLICE8
+#endif
+#endif
+
+/* The table is still needed as a fallback if the instructions are missing */
+#if !defined(CONFIG_ARM64_CRC32) || defined(CRC32_USE_ARCH)
+#define CRC32_USE_TABLE
+#endif
+
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
 
 static int __efi_runtime_data crc_table_empty = 1;
@@ -82,7 +97,7 @@ static void __efi_runtime make_crc_table(void)
   }
   crc_table_empty = 0;
 }
-#elif !defined(CONFIG_ARM64_CRC32)
+#elif defined(CRC32_USE_TABLE)
 /* ========================================================================
  * Table of CRC-32's of all single-byte values (made by make_crc_table)
  */
@@ -177,17 +192,10 @@ const uint32_t * ZEXPORT get_crc_table()
 
 /* ========================================================================= */
 
-/* No ones complement version. JFFS2 (and other things ?)
- * don't use ones compliment in their CRC calculations.
- */
-uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
+#ifdef CRC32_USE_TABLE
+static uint32_t __efi_runtime crc32_table_calc(uint32_t crc, const Bytef *buf,
+					       uInt len)
 {
-#ifdef CONFIG_ARM64_CRC32
-    crc = cpu_to_le32(crc);
-    while (len--)
-        crc = __builtin_aarch64_crc32b(crc, *buf++);
-    return le32_to_cpu(crc);
-#else
     const uint32_t *tab = crc_table;
     const uint32_t *b =(const uint32_t *)buf;
     size_t rem_len;
@@ -225,10 +233,150 @@ uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
     }
 
     return le32_to_cpu(crc);
+}
+#endif
+
+#ifdef CRC32_USE_SLICE8
+
+/*
+ * crc_table8[k][n] is the CRC of byte n followed by k + 1 zero bytes, so that
+ * eight bytes can be folded into the CRC with eight independent lookups
+ */
+static int __efi_runtime_data crc_table8_empty = 1;
+static uint32_t __efi_runtime_data crc_table8[7][256];
+
+static void __efi_runtime make_crc_table8(void)
+{
+	const uint32_t *prev = crc_table;
+	int k, n;
+
+#ifdef CONFIG_DYNAMIC_CRC_TABLE
+	if (crc_table_empty)
+		make_crc_table();
+#endif
+	for (k = 0; k < 7; k++) {
+		for (n = 0; n < 256; n++)
+			crc_table8[k][n] = (prev[n] >> 8) ^
+				crc_table[prev[n] & 0xff];
+		prev = crc_table8[k];
+	}
+	crc_table8_empty = 0;
+}
+
+static uint32_t __efi_runtime crc32_slice8_calc(uint32_t crc, const Bytef *buf,
+						uInt len)
+{
+	const uint32_t (*tab)[256] = crc_table8;
+
+	if (crc_table8_empty)
+		make_crc_table8();
+
+	for (; len && ((ulong)buf & 7); len--)
+		crc = crc_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	for (; len >= 8; len -= 8, buf += 8) {
+		uint32_t lo = *(const uint32_t *)buf ^ crc;
+		uint32_t hi = *(const uint32_t *)(buf + 4);
+
+		crc = tab[6][lo & 0xff] ^ tab[5][(lo >> 8) & 0xff] ^
+			tab[4][(lo >> 16) & 0xff] ^ tab[3][lo >> 24] ^
+			tab[2][hi & 0xff] ^ tab[1][(hi >> 8) & 0xff] ^
+			tab[0][(hi >> 16) & 0xff] ^ crc_table[hi >> 24];
+	}
+
+	for (; len; len--)
+		crc = crc_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+#endif
+
+#ifdef CRC32_USE_ARCH
+/* 0 if not checked yet, 1 if the CPU supports crc32_arch(), else -1 */
+static int __efi_runtime_data crc32_arch_state;
+
+static bool __efi_runtime crc32_arch_ok(void)
+{
+	if (!crc32_arch_state)
+		crc32_arch_state = crc32_arch_supported() ? 1 : -1;
+
+	return crc32_arch_state > 0;
+}
+#endif
+
+/* No ones complement version. JFFS2 (and other things ?)
+ * don't use ones compliment in their CRC calculations.
+ */
+uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
+{
+#ifdef CRC32_USE_ARCH
+	if (crc32_arch_ok()) {
+		uInt done = crc32_arch(&crc, buf, len);
+
+		buf += done;
+		len -= done;
+	}
+#elif defined(CONFIG_ARM64_CRC32)
+	crc = cpu_to_le32(crc);
+	while (len--)
+		crc = __builtin_aarch64_crc32b(crc, *buf++);
+	return le32_to_cpu(crc);
+#endif
+#ifdef CRC32_USE_SLICE8
+	return crc32_slice8_calc(crc, buf, len);
+#elif defined(CRC32_USE_TABLE)
+	return crc32_table_calc(crc, buf, len);
 #endif
 }
 #undef DO_CRC
 
+#ifndef USE_HOSTCC
+static const char *const crc32_impl_names[CRC32_IMPL_COUNT] = {
+	[CRC32_IMPL_TABLE]	= "table",
+	[CRC32_IMPL_SLICE8]	= "slice-by-8",
+	[CRC32_IMPL_ARCH]	= "arch",
+};
+
+const char *crc32_impl_name(enum crc32_impl impl)
+{
+	if (impl >= CRC32_IMPL_COUNT)
+		return "(unknown)";
+
+	return crc32_impl_names[impl];
+}
+
+int crc32_no_comp_impl(enum crc32_impl impl, uint32_t *crcp, const uint8_t *buf,
+		       uint len)
+{
+	switch (impl) {
+#ifdef CRC32_USE_TABLE
+	case CRC32_IMPL_TABLE:
+		*crcp = crc32_table_calc(*crcp, buf, len);
+		return 0;
+#endif
+#ifdef CRC32_USE_SLICE8
+	case CRC32_IMPL_SLICE8:
+		*crcp = crc32_slice8_calc(*crcp, buf, len);
+		return 0;
+#endif
+#ifdef CRC32_USE_ARCH
+	case CRC32_IMPL_ARCH: {
+		uint done;
+
+		if (!crc32_arch_ok())
+			return -ENOSYS;
+		done = crc32_arch(crcp, buf, len);
+		if (done < len)
+			*crcp = crc32_table_calc(*crcp, buf + done, len - done);
+		return 0;
+	}
+#endif
+	default:
+		return -ENOSYS;
+	}
+}
+#endif
+
 uint32_t __efi_runtime crc32(uint32_t crc, const Bytef *p, uInt len)
 {
      return crc32_no_comp(crc ^ 0xffffffffL, p, len) ^ 0xffffffffL;
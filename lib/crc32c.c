@@ -11,9 +11,13 @@
  */
 
 #include <compiler.h>
+#include <u-boot/crc.h>
 
-uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
-		    uint32_t *crc32c_table)
+/* Bit-reflected Castagnoli polynomial, as implemented by crc32c_arch() */
+#define CRC32C_POLY_LE	0x82f63b78
+
+uint32_t crc32c_table_cal(uint32_t crc, const char *data, int length,
+			  uint32_t *crc32c_table)
 {
 	while (length--)
 		crc = crc32c_table[(u8)(crc ^ *data++)] ^ (crc >> 8);
@@ -21,6 +25,39 @@ uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
 	return crc;
 }
 
+#if CONFIG_IS_ENABLED(CRC32_ARCH)
+/* 0 if not checked yet, 1 if the CPU supports crc32c_arch(), else -1 */
+static int crc32c_arch_state;
+
+static bool crc32c_arch_ok(void)
+{
+	if (!crc32c_arch_state)
+		crc32c_arch_state = crc32c_arch_supported() ? 1 : -1;
+
+	return crc32c_arch_state > 0;
+}
+#endif
+
+uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
+		    uint32_t *crc32c_table)
+{
+#if CONFIG_IS_ENABLED(CRC32_ARCH)
+	/*
+	 * The table entry for 0x80 is the polynomial itself, which tells us
+	 * whether the instructions compute the CRC the caller asked for
+	 */
+	if (length > 0 && crc32c_table[0x80] == CRC32C_POLY_LE &&
+	    crc32c_arch_ok()) {
+		uint done = crc32c_arch(&crc, (const uint8_t *)data, length);
+
+		data += done;
+		length -= done;
+	}
+#endif
+
+	return crc32c_table_cal(crc, data, length, crc32c_table);
+}
+
 void crc32c_init(uint32_t *crc32c_table, uint32_t pol)
 {
 	int i, j;
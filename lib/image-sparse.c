@@ -48,214 +48,329 @@
 
 static void default_log(const char *ignored, char *response) {}
 
-int write_sparse_image(struct sparse_storage *info,
-		       const char *part_name, void *data, char *response)
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info)
 {
-	lbaint_t blk;
-	lbaint_t blkcnt;
-	lbaint_t blks;
-	uint64_t bytes_written = 0;
-	unsigned int chunk;
-	unsigned int offset;
-	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
 	int fill_buf_num_blks;
-	int i;
-	int j;
+
+	memset(ss, '\0', sizeof(*ss));
+	ss->info = info;
+	ss->state = SPARSE_STREAM_FILE_HDR;
+	ss->blk = info->start;
 
 	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	ss->blk_buf = memalign(ARCH_DMA_MINALIGN,
+			       ROUNDUP(info->blksz, ARCH_DMA_MINALIGN));
+	ss->fill_buf = memalign(ARCH_DMA_MINALIGN,
+				ROUNDUP(info->blksz * fill_buf_num_blks,
+					ARCH_DMA_MINALIGN));
+	if (!ss->blk_buf || !ss->fill_buf) {
+		sparse_stream_finish(ss);
+		return -ENOMEM;
+	}
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	return 0;
+}
+
+/* Collect the next bytes of a header or value of @size bytes at @buf */
+static size_t sparse_stream_collect(struct sparse_stream *ss, void *buf,
+				    uint size, const void *data, size_t len)
+{
+	size_t n = min_t(size_t, size - ss->got, len);
+
+	memcpy(buf + ss->got, data, n);
+	ss->got += n;
 
-	data += sparse_header->file_hdr_sz;
-	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t)) {
-		/*
-		 * Skip the remaining bytes in a header that is longer than
-		 * we expected.
-		 */
-		data += (sparse_header->file_hdr_sz - sizeof(sparse_header_t));
+	return n;
+}
+
+static int sparse_stream_put(struct sparse_stream *ss, const void *buf,
+			     lbaint_t blkcnt)
+{
+	lbaint_t blks;
+
+	/* blks might be > blkcnt (eg. NAND bad-blocks) */
+	blks = ss->info->write(ss->info, ss->blk, blkcnt, buf);
+	if (blks < blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, ss->blk, blks);
+		ss->err = "flash write failure";
+		return -EIO;
 	}
+	ss->blk += blks;
+	ss->bytes_written += (u64)blkcnt * ss->info->blksz;
 
-	if (!info->mssg)
-		info->mssg = default_log;
+	return 0;
+}
 
-	debug("=== Sparse Image Header ===\n");
-	debug("magic: 0x%x\n", sparse_header->magic);
-	debug("major_version: 0x%x\n", sparse_header->major_version);
-	debug("minor_version: 0x%x\n", sparse_header->minor_version);
-	debug("file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
-	debug("chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
-	debug("blk_sz: %d\n", sparse_header->blk_sz);
-	debug("total_blks: %d\n", sparse_header->total_blks);
-	debug("total_chunks: %d\n", sparse_header->total_chunks);
+static void sparse_stream_chunk_done(struct sparse_stream *ss)
+{
+	ss->total_blocks += le32_to_cpu(ss->chunk.chunk_sz);
+	ss->chunks++;
+	ss->got = 0;
+	if (ss->chunks == le32_to_cpu(ss->header.total_chunks))
+		ss->state = SPARSE_STREAM_DONE;
+	else
+		ss->state = SPARSE_STREAM_CHUNK_HDR;
+}
 
-	/*
-	 * Verify that the sparse block size is a multiple of our
-	 * storage backend block size
-	 */
-	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
-	if (offset) {
-		printf("%s: Sparse image block size issue [%u]\n",
-		       __func__, sparse_header->blk_sz);
-		info->mssg("sparse image block size issue", response);
-		return -1;
+static int sparse_stream_file_hdr(struct sparse_stream *ss)
+{
+	sparse_header_t *hdr = &ss->header;
+	u32 blk_sz = le32_to_cpu(hdr->blk_sz);
+
+	if (le32_to_cpu(hdr->magic) != SPARSE_HEADER_MAGIC ||
+	    le16_to_cpu(hdr->major_version) != 1 ||
+	    le16_to_cpu(hdr->file_hdr_sz) < sizeof(sparse_header_t) ||
+	    le16_to_cpu(hdr->chunk_hdr_sz) < sizeof(chunk_header_t)) {
+		log_err("Bad sparse image header\n");
+		ss->err = "bad sparse image header";
+		return -EINVAL;
+	}
+	if (!blk_sz || blk_sz % ss->info->blksz) {
+		log_err("Sparse image block size issue [%u]\n", blk_sz);
+		ss->err = "sparse image block size issue";
+		return -EINVAL;
 	}
 
-	puts("Flashing Sparse Image\n");
+	ss->skip = le16_to_cpu(hdr->file_hdr_sz) - sizeof(sparse_header_t);
+	ss->got = 0;
+	if (hdr->total_chunks)
+		ss->state = SPARSE_STREAM_CHUNK_HDR;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+
+	return 0;
+}
+
+static int sparse_stream_chunk_hdr(struct sparse_stream *ss)
+{
+	struct sparse_storage *info = ss->info;
+	chunk_header_t *chunk = &ss->chunk;
+	uint chunk_hdr_sz = le16_to_cpu(ss->header.chunk_hdr_sz);
+	u64 chunk_data_sz;
+	u64 data_sz = 0;
+	lbaint_t blkcnt;
+
+	chunk_data_sz = (u64)le32_to_cpu(ss->header.blk_sz) *
+			le32_to_cpu(chunk->chunk_sz);
+	blkcnt = div_u64(chunk_data_sz, info->blksz);
+
+	switch (le16_to_cpu(chunk->chunk_type)) {
+	case CHUNK_TYPE_RAW:
+		data_sz = chunk_data_sz;
+		ss->state = SPARSE_STREAM_RAW;
+		break;
+	case CHUNK_TYPE_FILL:
+		data_sz = sizeof(u32);
+		ss->state = SPARSE_STREAM_FILL;
+		break;
+	case CHUNK_TYPE_DONT_CARE:
+		break;
+	case CHUNK_TYPE_CRC32:
+		data_sz = sizeof(u32);
+		ss->state = SPARSE_STREAM_CRC32;
+		break;
+	default:
+		log_err("Unknown chunk type: %x\n",
+			le16_to_cpu(chunk->chunk_type));
+		ss->err = "Unknown chunk type";
+		return -EINVAL;
+	}
+	if (le32_to_cpu(chunk->total_sz) != chunk_hdr_sz + data_sz) {
+		log_err("Bogus chunk size for chunk type %x\n",
+			le16_to_cpu(chunk->chunk_type));
+		ss->err = "Bogus chunk size";
+		return -EINVAL;
+	}
+	if (ss->blk + blkcnt > info->start + info->size) {
+		log_err("Request would exceed partition size!\n");
+		ss->err = "Request would exceed partition size!";
+		return -ENOSPC;
+	}
+
+	ss->skip = chunk_hdr_sz - sizeof(chunk_header_t);
+	ss->got = 0;
+	ss->left = chunk_data_sz;
+	if (le16_to_cpu(chunk->chunk_type) == CHUNK_TYPE_DONT_CARE) {
+		ss->blk += info->reserve(info, ss->blk, blkcnt);
+		sparse_stream_chunk_done(ss);
+	} else if (ss->state == SPARSE_STREAM_RAW && !ss->left) {
+		sparse_stream_chunk_done(ss);
+	}
+
+	return 0;
+}
+
+static int sparse_stream_fill(struct sparse_stream *ss)
+{
+	lbaint_t blksz = ss->info->blksz;
+	lbaint_t fill_buf_num_blks;
+	lbaint_t blkcnt, j;
+	int i, ret;
+
+	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / blksz;
+	for (i = 0; i < blksz * fill_buf_num_blks / sizeof(u32); i++)
+		ss->fill_buf[i] = ss->fill_val;
+
+	blkcnt = div_u64(ss->left, blksz);
+	while (blkcnt) {
+		j = min(blkcnt, fill_buf_num_blks);
+		ret = sparse_stream_put(ss, ss->fill_buf, j);
+		if (ret)
+			return ret;
+		blkcnt -= j;
+	}
+	sparse_stream_chunk_done(ss);
+
+	return 0;
+}
+
+/* Write the next RAW chunk data, returning the number of bytes used */
+static long sparse_stream_raw(struct sparse_stream *ss, const void *data,
+			      size_t len)
+{
+	lbaint_t blksz = ss->info->blksz;
+	lbaint_t blkcnt;
+	size_t n;
+	int ret;
 
-	/* Start processing chunks */
-	blk = info->start;
-	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
-		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
-
-		if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
-			debug("=== Chunk Header ===\n");
-			debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
-			debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
-			debug("total_size: 0x%x\n", chunk_header->total_sz);
+	n = min_t(u64, len, ss->left);
+	if (ss->blk_len || n < blksz) {
+		/* gather a partial block */
+		n = min_t(size_t, n, blksz - ss->blk_len);
+		memcpy(ss->blk_buf + ss->blk_len, data, n);
+		ss->blk_len += n;
+		if (ss->blk_len == blksz) {
+			ret = sparse_stream_put(ss, ss->blk_buf, 1);
+			if (ret)
+				return ret;
+			ss->blk_len = 0;
 		}
+	} else {
+		blkcnt = n / blksz;
+		n = blkcnt * blksz;
+		ret = sparse_stream_put(ss, data, blkcnt);
+		if (ret)
+			return ret;
+	}
+
+	ss->left -= n;
+	if (!ss->left)
+		sparse_stream_chunk_done(ss);
 
-		if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t)) {
-			/*
-			 * Skip the remaining bytes in a header that is longer
-			 * than we expected.
-			 */
-			data += (sparse_header->chunk_hdr_sz -
-				 sizeof(chunk_header_t));
+	return n;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			size_t len)
+{
+	long n;
+	int ret = 0;
+
+	while (len && ss->state != SPARSE_STREAM_DONE) {
+		if (ss->skip) {
+			n = min_t(size_t, ss->skip, len);
+			ss->skip -= n;
+			data += n;
+			len -= n;
+			continue;
 		}
 
-		chunk_data_sz = ((u64)sparse_header->blk_sz) * chunk_header->chunk_sz;
-		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
-		switch (chunk_header->chunk_type) {
-		case CHUNK_TYPE_RAW:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
-				info->mssg("Bogus chunk size for chunk type Raw",
-					   response);
-				return -1;
-			}
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			blks = info->write(info, blk, blkcnt, data);
-			/* blks might be > blkcnt (eg. NAND bad-blocks) */
-			if (blks < blkcnt) {
-				printf("%s: %s" LBAFU " [" LBAFU "]\n",
-				       __func__, "Write failed, block #",
-				       blk, blks);
-				info->mssg("flash write failure", response);
-				return -1;
-			}
-			blk += blks;
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
+		switch (ss->state) {
+		case SPARSE_STREAM_FILE_HDR:
+			n = sparse_stream_collect(ss, &ss->header,
+						  sizeof(ss->header), data,
+						  len);
+			if (ss->got == sizeof(ss->header))
+				ret = sparse_stream_file_hdr(ss);
 			break;
-
-		case CHUNK_TYPE_FILL:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
-				info->mssg("Bogus chunk size for chunk type FILL", response);
-				return -1;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
-
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
-							 sparse_header->blk_sz);
-			free(fill_buf);
+		case SPARSE_STREAM_CHUNK_HDR:
+			n = sparse_stream_collect(ss, &ss->chunk,
+						  sizeof(ss->chunk), data, len);
+			if (ss->got == sizeof(ss->chunk))
+				ret = sparse_stream_chunk_hdr(ss);
 			break;
-
-		case CHUNK_TYPE_DONT_CARE:
-			blk += info->reserve(info, blk, blkcnt);
-			total_blocks += chunk_header->chunk_sz;
+		case SPARSE_STREAM_RAW:
+			n = sparse_stream_raw(ss, data, len);
+			if (n < 0)
+				ret = n;
 			break;
-
-		case CHUNK_TYPE_CRC32:
-			if (chunk_header->total_sz !=
-			    sparse_header->chunk_hdr_sz + sizeof(uint32_t)) {
-				info->mssg("Bogus chunk size for chunk type CRC32",
-					   response);
-				return -1;
-			}
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
+		case SPARSE_STREAM_FILL:
+			n = sparse_stream_collect(ss, &ss->fill_val,
+						  sizeof(ss->fill_val), data,
+						  len);
+			if (ss->got == sizeof(ss->fill_val))
+				ret = sparse_stream_fill(ss);
+			break;
+		case SPARSE_STREAM_CRC32:
+			/* the checksum is not checked */
+			n = sparse_stream_collect(ss, &ss->fill_val,
+						  sizeof(ss->fill_val), data,
+						  len);
+			if (ss->got == sizeof(ss->fill_val))
+				sparse_stream_chunk_done(ss);
 			break;
-
 		default:
-			printf("%s: Unknown chunk type: %x\n", __func__,
-			       chunk_header->chunk_type);
-			info->mssg("Unknown chunk type", response);
-			return -1;
+			n = len;
+			break;
 		}
+		if (ret)
+			return ret;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss)
+{
+	int ret = 0;
+
+	if (ss->state != SPARSE_STREAM_DONE ||
+	    ss->total_blocks != le32_to_cpu(ss->header.total_blks)) {
+		log_debug("Wrote %u blocks, expected to write %u blocks\n",
+			  ss->total_blocks,
+			  le32_to_cpu(ss->header.total_blks));
+		ret = -EINVAL;
 	}
+	free(ss->blk_buf);
+	free(ss->fill_buf);
+	ss->blk_buf = NULL;
+	ss->fill_buf = NULL;
 
-	debug("Wrote %d blocks, expected to write %d blocks\n",
-	      total_blocks, sparse_header->total_blks);
-	printf("........ wrote %llu bytes to '%s'\n", bytes_written, part_name);
+	return ret;
+}
+
+int write_sparse_image(struct sparse_storage *info,
+		       const char *part_name, void *data, char *response)
+{
+	struct sparse_stream ss;
+	int ret, err;
 
-	if (total_blocks != sparse_header->total_blks) {
+	if (!info->mssg)
+		info->mssg = default_log;
+
+	if (sparse_stream_start(&ss, info)) {
+		info->mssg("Malloc failed for sparse image", response);
+		return -1;
+	}
+
+	puts("Flashing Sparse Image\n");
+
+	/*
+	 * The size of the image is not known, but the stream stops after the
+	 * last chunk, so it never looks past the end of a valid image
+	 */
+	ret = sparse_stream_write(&ss, data, SIZE_MAX);
+	err = sparse_stream_finish(&ss);
+	if (ret) {
+		info->mssg(ss.err, response);
+		return -1;
+	}
+	printf("........ wrote %llu bytes to '%s'\n", ss.bytes_written,
+	       part_name);
+	if (err) {
 		info->mssg("sparse image write failure", response);
 		return -1;
 	}
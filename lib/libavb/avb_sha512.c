@@ -10,6 +10,15 @@
 
 #include "avb_sha.h"
 
+/*
+ * Use U-Boot's SHA-512 block function when it is built, so that any
+ * architecture acceleration applies to AVB too
+ */
+#if CONFIG_IS_ENABLED(SHA512_LEGACY)
+#include <u-boot/sha512.h>
+#define AVB_SHA512_USE_UBOOT
+#endif
+
 #define SHFR(x, n) (x >> n)
 #define ROTR(x, n) ((x >> n) | (x << ((sizeof(x) << 3) - n)))
 #define ROTL(x, n) ((x << n) | (x >> ((sizeof(x) << 3) - n)))
@@ -73,6 +82,7 @@ static const uint64_t sha512_h0[8] = {0x6a09e667f3bcc908ULL,
                                       0x1f83d9abfb41bd6bULL,
                                       0x5be0cd19137e2179ULL};
 
+#ifndef AVB_SHA512_USE_UBOOT
 static const uint64_t sha512_k[80] = {
     0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
     0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
@@ -101,6 +111,7 @@ static const uint64_t sha512_k[80] = {
     0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
     0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
     0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+#endif
 
 /* SHA-512 implementation */
 
@@ -125,6 +136,13 @@ void avb_sha512_init(AvbSHA512Ctx* ctx) {
   ctx->tot_len = 0;
 }
 
+#ifdef AVB_SHA512_USE_UBOOT
+static void SHA512_transform(AvbSHA512Ctx* ctx,
+                             const uint8_t* message,
+                             size_t block_nb) {
+  sha512_process(ctx->h, message, block_nb);
+}
+#else
 static void SHA512_transform(AvbSHA512Ctx* ctx,
                              const uint8_t* message,
                              size_t block_nb) {
@@ -290,6 +308,7 @@ static void SHA512_transform(AvbSHA512Ctx* ctx,
 #endif /* UNROLL_LOOPS_SHA512 */
   }
 }
+#endif /* AVB_SHA512_USE_UBOOT */
 
 void avb_sha512_update(AvbSHA512Ctx* ctx, const uint8_t* data, size_t len) {
   size_t block_nb;
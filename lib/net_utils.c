@@ -225,3 +225,16 @@ int ip_checksum_ok(const void *addr, uint nbytes)
 {
 	return !(compute_ip_checksum(addr, nbytes) & 0xfffe);
 }
+
+void net_csum_fill(uchar *pkt, uint len, uint start, uint offset)
+{
+	u16 *field = (u16 *)(pkt + start + offset);
+	uint sum;
+
+	if (start + offset + sizeof(*field) > len)
+		return;
+
+	/* A UDP checksum of 0 means that there is none, so use 0xffff */
+	sum = compute_ip_checksum(pkt + start, len - start);
+	*field = sum ?: 0xffff;
+}
@@ -218,8 +218,8 @@ static void __maybe_unused sha1_process_one(sha1_context *ctx, const unsigned ch
 	ctx->state[4] += E;
 }
 
-__weak void sha1_process(sha1_context *ctx, const unsigned char *data,
-			 unsigned int blocks)
+void sha1_process_generic(sha1_context *ctx, const unsigned char *data,
+			     unsigned int blocks)
 {
 	if (!blocks)
 		return;
@@ -230,6 +230,12 @@ __weak void sha1_process(sha1_context *ctx, const unsigned char *data,
 	}
 }
 
+__weak void sha1_process(sha1_context *ctx, const unsigned char *data,
+			 unsigned int blocks)
+{
+	sha1_process_generic(ctx, data, blocks);
+}
+
 /*
  * SHA-1 process buffer
  */
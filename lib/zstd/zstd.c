@@ -11,19 +11,80 @@
 #include <linux/errno.h>
 #include <linux/zstd.h>
 
+int zstd_frame_index(const void *in, size_t size,
+		     struct zstd_frame_info *frames, int max_frames)
+{
+	unsigned long long out_offset = 0;
+	size_t offset = 0;
+	int count = 0;
+
+	while (offset < size) {
+		const void *ptr = in + offset;
+		zstd_frame_header hdr;
+		unsigned long long out_size;
+		size_t len;
+
+		/*
+		 * There may be junk after the last frame, which is ignored, but
+		 * the data must start with a frame
+		 */
+		len = zstd_find_frame_compressed_size(ptr, size - offset);
+		if (zstd_is_error(len) ||
+		    zstd_get_frame_header(&hdr, ptr, size - offset)) {
+			if (count)
+				break;
+			log_err("%s: failed to detect compressed size: %d\n",
+				__func__, zstd_is_error(len) ?
+				zstd_get_error_code(len) : 0);
+			return -EINVAL;
+		}
+
+		out_size = hdr.frameType == ZSTD_skippableFrame ? 0 :
+			hdr.frameContentSize;
+		if (count < max_frames) {
+			struct zstd_frame_info *frame = &frames[count];
+
+			frame->in_offset = offset;
+			frame->in_size = len;
+			frame->out_offset = out_offset;
+			frame->out_size = out_size;
+		}
+		if (out_size == ZSTD_CONTENTSIZE_UNKNOWN)
+			out_offset = ZSTD_CONTENTSIZE_UNKNOWN;
+		else if (out_offset != ZSTD_CONTENTSIZE_UNKNOWN)
+			out_offset += out_size;
+		offset += len;
+		count++;
+	}
+
+	return count;
+}
+
 int zstd_decompress(struct abuf *in, struct abuf *out)
 {
+	struct zstd_frame_info *frames, *last;
 	zstd_dctx *ctx;
 	size_t wsize, len;
 	void *workspace;
+	int count;
 	int ret;
 
+	count = zstd_frame_index(abuf_data(in), abuf_size(in), NULL, 0);
+	if (count < 0)
+		return count;
+	frames = malloc(count * sizeof(*frames));
+	if (!frames)
+		return -ENOMEM;
+	zstd_frame_index(abuf_data(in), abuf_size(in), frames, count);
+	last = &frames[count - 1];
+
 	wsize = zstd_dctx_workspace_bound();
 	workspace = malloc(wsize);
 	if (!workspace) {
 		debug("%s: cannot allocate workspace of size %zu\n", __func__,
 			wsize);
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto do_free_frames;
 	}
 
 	ctx = zstd_init_dctx(workspace, wsize);
@@ -33,20 +94,10 @@ int zstd_decompress(struct abuf *in, struct abuf *out)
 		goto do_free;
 	}
 
-	/*
-	 * Find out how large the frame actually is, there may be junk at
-	 * the end of the frame that zstd_decompress_dctx() can't handle.
-	 */
-	len = zstd_find_frame_compressed_size(abuf_data(in), abuf_size(in));
-	if (zstd_is_error(len)) {
-		log_err("%s: failed to detect compressed size: %d\n", __func__,
-			zstd_get_error_code(len));
-		ret = -EINVAL;
-		goto do_free;
-	}
-
+	/* Leave out any junk after the last frame, which zstd can't handle */
 	len = zstd_decompress_dctx(ctx, abuf_data(out), abuf_size(out),
-				   abuf_data(in), len);
+				   abuf_data(in),
+				   last->in_offset + last->in_size);
 	if (zstd_is_error(len)) {
 		log_err("%s: failed to decompress: %d\n", __func__,
 			zstd_get_error_code(len));
@@ -57,5 +108,7 @@ int zstd_decompress(struct abuf *in, struct abuf *out)
 	ret = len;
 do_free:
 	free(workspace);
+do_free_frames:
+	free(frames);
 	return ret;
 }
@@ -13,6 +13,7 @@
 #include <net.h>
 #include <vsprintf.h>
 #include <linux/delay.h>
+#include <net/neigh.h>
 
 #include "arp.h"
 
@@ -67,19 +68,21 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	net_send_packet(arp_tx_packet, eth_hdr_size + ARP_HDR_SIZE);
 }
 
+struct in_addr arp_next_hop(struct in_addr ip)
+{
+	if ((ip.s_addr & net_netmask.s_addr) !=
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr)
+		return net_gateway;
+
+	return ip;
+}
+
 void arp_request(void)
 {
 	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
-		if (net_gateway.s_addr == 0) {
-			puts("## Warning: gatewayip needed but not set\n");
-			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-		} else {
-			net_arp_wait_reply_ip = net_gateway;
-		}
-	} else {
-		net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-	}
+	    (net_ip.s_addr & net_netmask.s_addr) && !net_gateway.s_addr)
+		puts("## Warning: gatewayip needed but not set\n");
+	net_arp_wait_reply_ip = arp_next_hop(net_arp_wait_packet_ip);
 
 	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
 }
@@ -149,6 +152,9 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 
 	switch (ntohs(arp->ar_op)) {
 	case ARPOP_REQUEST:
+		/* the sender is likely to be talking to us soon */
+		neigh_update(net_read_ip(&arp->ar_spa), &arp->ar_sha, true);
+
 		/* reply with our IP address */
 		debug_cond(DEBUG_DEV_PKT, "Got ARP REQUEST, return our IP\n");
 		eth_hdr_size = net_update_ether(et, et->et_src, PROT_ARP);
@@ -177,6 +183,11 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 		return;
 
 	case ARPOP_REPLY:		/* arp reply */
+		reply_ip_addr = net_read_ip(&arp->ar_spa);
+
+		/* this may confirm a cached address */
+		neigh_update(reply_ip_addr, &arp->ar_sha, false);
+
 		/* are we waiting for a reply? */
 		if (!arp_is_waiting())
 			break;
@@ -188,14 +199,14 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 			env_set("serveraddr", buf);
 		}
 
-		reply_ip_addr = net_read_ip(&arp->ar_spa);
-
 		/* matched waiting packet's address */
 		if (reply_ip_addr.s_addr == net_arp_wait_reply_ip.s_addr) {
 			debug_cond(DEBUG_DEV_PKT,
 				   "Got ARP REPLY, set eth addr (%pM)\n",
 				   arp->ar_data);
 
+			neigh_update(reply_ip_addr, &arp->ar_sha, true);
+
 			/* save address for later use */
 			if (arp_wait_packet_ethaddr != NULL)
 				memcpy(arp_wait_packet_ethaddr,
@@ -20,6 +20,14 @@ extern int arp_wait_try;
 extern uchar *arp_tx_packet;
 
 void arp_init(void);
+
+/**
+ * arp_next_hop() - Get the address to resolve to reach an IPv4 address
+ *
+ * @ip:		Destination address
+ * Return: @ip if it is on our subnet, else the gateway, if set
+ */
+struct in_addr arp_next_hop(struct in_addr ip);
 void arp_request(void);
 void arp_raw_request(struct in_addr source_ip, const uchar *targetEther,
 	struct in_addr target_ip);
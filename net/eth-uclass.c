@@ -12,11 +12,13 @@
 #include <dm.h>
 #include <env.h>
 #include <log.h>
+#include <malloc.h>
 #include <net.h>
 #include <nvmem.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
+#include <net/neigh.h>
 #include <net/pcap.h>
 #include "eth_internal.h"
 #include <eth_phy.h>
@@ -27,10 +29,12 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @offload: Work which the device can do for the stack (ETH_OFFLOAD_...)
  */
 struct eth_device_priv {
 	enum eth_state_t state;
 	bool running;
+	uint offload;
 };
 
 /**
@@ -45,6 +49,15 @@ struct eth_uclass_priv {
 	bool no_bootdevs;
 };
 
+const struct eth_rx_dest *net_rx_placed;
+bool net_rx_csum_valid;
+
+/* Frames held back by eth_send_hold(), with copies of their contents */
+static struct eth_tx_pkt eth_tx_pkts[ETH_PACKETS_BATCH_SEND];
+static uchar *eth_tx_bufs;
+static int eth_tx_count;
+static bool eth_tx_holding;
+
 /* eth_errno - This stores the most recent failure code from DM functions */
 static int eth_errno;
 /* Are we currently in eth_init() or eth_halt()? */
@@ -395,6 +408,8 @@ void eth_halt(void)
 	eth_get_ops(current)->stop(current);
 	priv->state = ETH_STATE_PASSIVE;
 	priv->running = false;
+	eth_tx_count = 0;
+	eth_tx_holding = false;
 
 end:
 	in_init_halt = false;
@@ -411,9 +426,86 @@ int eth_is_active(struct udevice *dev)
 	return priv->state == ETH_STATE_ACTIVE;
 }
 
-int eth_send(void *packet, int length)
+void eth_set_offload(struct udevice *dev, uint offload)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	if (!eth_get_ops(dev)->send_batch)
+		offload &= ~ETH_OFFLOAD_TX_CSUM;
+	priv->offload = offload;
+}
+
+uint eth_get_offload(struct udevice *dev)
+{
+	struct eth_device_priv *priv;
+
+	if (!dev)
+		return 0;
+	priv = dev_get_uclass_priv(dev);
+
+	return priv->offload;
+}
+
+/* Send the frames held back so far, in one call to the driver */
+static int eth_send_held(struct udevice *dev)
+{
+	int count = eth_tx_count;
+	int ret;
+	int i;
+
+	if (!count)
+		return 0;
+	eth_tx_count = 0;
+
+	ret = eth_get_ops(dev)->send_batch(dev, eth_tx_pkts, count);
+	if (ret < 0) {
+		debug("%s: send_batch() returned error %d\n", __func__, ret);
+		return ret;
+	}
+	if (IS_ENABLED(CONFIG_CMD_PCAP)) {
+		for (i = 0; i < ret; i++)
+			pcap_post(eth_tx_pkts[i].packet, eth_tx_pkts[i].len,
+				  true);
+	}
+
+	return ret < count ? -EIO : 0;
+}
+
+/* Copy a frame to send later, returning false if it must be sent now */
+static bool eth_send_queue(struct udevice *dev, const struct eth_tx_pkt *pkt)
+{
+	struct eth_tx_pkt *held;
+
+	if (pkt->len > PKTSIZE_ALIGN)
+		return false;
+	if (!eth_tx_bufs) {
+		eth_tx_bufs = memalign(ARCH_DMA_MINALIGN,
+				       ETH_PACKETS_BATCH_SEND * PKTSIZE_ALIGN);
+		if (!eth_tx_bufs)
+			return false;
+	}
+	if (eth_tx_count == ETH_PACKETS_BATCH_SEND)
+		eth_send_held(dev);
+
+	held = &eth_tx_pkts[eth_tx_count];
+	*held = *pkt;
+	held->packet = eth_tx_bufs + eth_tx_count * PKTSIZE_ALIGN;
+	memcpy(held->packet, pkt->packet, pkt->len);
+	eth_tx_count++;
+
+	return true;
+}
+
+int eth_send_csum(void *packet, int length, uint csum_start, uint csum_offset)
 {
+	struct eth_tx_pkt pkt = {
+		.packet = packet,
+		.len = length,
+		.csum_start = csum_start,
+		.csum_offset = csum_offset,
+	};
 	struct udevice *current;
+	struct eth_ops *ops;
 	int ret;
 
 	current = eth_get_dev();
@@ -423,7 +515,23 @@ int eth_send(void *packet, int length)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	ret = eth_get_ops(current)->send(current, packet, length);
+	ops = eth_get_ops(current);
+	if (csum_start && !(eth_get_offload(current) & ETH_OFFLOAD_TX_CSUM)) {
+		net_csum_fill(packet, length, csum_start, csum_offset);
+		pkt.csum_start = 0;
+	}
+	if (eth_tx_holding && ops->send_batch && eth_send_queue(current, &pkt))
+		return 0;
+
+	if (pkt.csum_start) {
+		ret = ops->send_batch(current, &pkt, 1);
+		if (!ret)
+			ret = -EIO;
+		else if (ret > 0)
+			ret = 0;
+	} else {
+		ret = ops->send(current, packet, length);
+	}
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
@@ -435,10 +543,153 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+int eth_send(void *packet, int length)
+{
+	return eth_send_csum(packet, length, 0, 0);
+}
+
+void eth_send_hold(void)
+{
+	eth_tx_holding = true;
+}
+
+int eth_send_flush(void)
+{
+	struct udevice *current;
+
+	eth_tx_holding = false;
+	current = eth_get_dev();
+	if (!eth_tx_count)
+		return 0;
+	if (!eth_is_active(current)) {
+		eth_tx_count = 0;
+		return -EINVAL;
+	}
+
+	return eth_send_held(current);
+}
+
+int eth_rx_post(const struct eth_rx_dest *dest)
+{
+	struct udevice *current;
+
+	current = eth_get_dev();
+	if (!current)
+		return -ENODEV;
+
+	if (!eth_is_active(current))
+		return -EINVAL;
+
+	if (!eth_get_ops(current)->post_rx)
+		return -ENOSYS;
+
+	return eth_get_ops(current)->post_rx(current, dest);
+}
+
+void eth_rx_placed(const struct eth_rx_dest *dest)
+{
+	net_rx_placed = dest;
+}
+
+void eth_rx_csum_valid(void)
+{
+	net_rx_csum_valid = true;
+}
+
+const uchar *eth_rx_data(const uchar *pkt, uint offset, uint *lenp)
+{
+	const struct eth_rx_dest *dest = net_rx_placed;
+	uint start;
+	int i;
+
+	if (dest && offset >= dest->hdr_len) {
+		start = dest->hdr_len;
+		for (i = 0; i < dest->count; i++) {
+			const struct eth_rx_sg *sg = &dest->sg[i];
+
+			if (offset < start + sg->len) {
+				*lenp = min(*lenp, start + sg->len - offset);
+				return sg->addr + offset - start;
+			}
+			start += sg->len;
+		}
+	} else if (dest) {
+		*lenp = min(*lenp, dest->hdr_len - offset);
+	}
+
+	return pkt + offset;
+}
+
+/*
+ * Check that the payload of a frame was placed where the protocol wanted it.
+ * If not, copy it back into the frame so that it can be processed as normal.
+ */
+static void eth_rx_claim(uchar *pkt, int len)
+{
+	const struct eth_rx_dest *dest = net_rx_placed;
+	uint offset = dest->hdr_len;
+	int i;
+
+	if (dest->claim && dest->claim(pkt, len))
+		return;
+
+	net_rx_placed = NULL;
+	for (i = 0; i < dest->count && offset < len; i++) {
+		uint part = min_t(uint, dest->sg[i].len, len - offset);
+
+		memcpy(pkt + offset, dest->sg[i].addr, part);
+		offset += part;
+	}
+}
+
+void eth_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts, int count)
+{
+	struct eth_ops *ops = eth_get_ops(dev);
+	int i;
+
+	if (ops->free_batch) {
+		ops->free_batch(dev, pkts, count);
+		return;
+	}
+	for (i = 0; ops->free_pkt && i < count; i++)
+		ops->free_pkt(dev, pkts[i].packet, pkts[i].len);
+}
+
+/*
+ * Take a whole batch of frames from the driver, process them in order, then
+ * hand them all back. Returns -ENOSYS if the driver cannot do this.
+ */
+static int eth_rx_batch(struct udevice *dev)
+{
+	struct eth_rx_pkt pkts[ETH_PACKETS_BATCH_RECV];
+	bool rx_csum = eth_get_offload(dev) & ETH_OFFLOAD_RX_CSUM;
+	int count;
+	int i;
+
+	count = eth_get_ops(dev)->recv_batch(dev, ETH_RECV_CHECK_DEVICE, pkts,
+					     ARRAY_SIZE(pkts));
+	if (count <= 0)
+		return count;
+
+	for (i = 0; i < count && eth_is_active(dev); i++) {
+		net_rx_placed = pkts[i].placed;
+		net_rx_csum_valid = rx_csum && pkts[i].csum_valid;
+		if (net_rx_placed)
+			eth_rx_claim(pkts[i].packet, pkts[i].len);
+		net_process_received_packet(pkts[i].packet, pkts[i].len);
+		net_rx_placed = NULL;
+	}
+	net_rx_csum_valid = false;
+	eth_free_batch(dev, pkts, count);
+
+	return pkts[count - 1].len;
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
 	uchar *packet;
+	bool rx_csum;
 	int flags;
 	int ret;
 	int i;
@@ -450,13 +701,29 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
+	if (eth_get_ops(current)->recv_batch) {
+		ret = eth_rx_batch(current);
+		if (ret != -ENOSYS)
+			goto done;
+	}
+
 	/* Process up to 32 packets at one time */
 	flags = ETH_RECV_CHECK_DEVICE;
+	rx_csum = eth_get_offload(current) & ETH_OFFLOAD_RX_CSUM;
 	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
+		net_rx_placed = NULL;
+		net_rx_csum_valid = false;
 		ret = eth_get_ops(current)->recv(current, flags, &packet);
 		flags = 0;
-		if (ret > 0)
+		if (!rx_csum)
+			net_rx_csum_valid = false;
+		if (ret > 0) {
+			if (net_rx_placed)
+				eth_rx_claim(packet, ret);
 			net_process_received_packet(packet, ret);
+			net_rx_placed = NULL;
+		}
+		net_rx_csum_valid = false;
 		if (ret >= 0 && eth_get_ops(current)->free_pkt)
 			eth_get_ops(current)->free_pkt(current, packet, ret);
 		if (ret <= 0)
@@ -464,6 +731,7 @@ int eth_rx(void)
 		if (!eth_is_active(current))
 			break;
 	}
+done:
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
@@ -651,6 +919,7 @@ static int eth_pre_remove(struct udevice *dev)
 	struct eth_pdata *pdata = dev_get_plat(dev);
 
 	eth_get_ops(dev)->stop(dev);
+	neigh_flush(dev);
 
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
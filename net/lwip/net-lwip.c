@@ -310,9 +310,42 @@ static struct pbuf *alloc_pbuf_and_copy(uchar *data, int len)
 	return p;
 }
 
-int net_lwip_rx(struct udevice *udev, struct netif *netif)
+static void net_lwip_input(struct udevice *udev, struct netif *netif,
+			   uchar *packet, int len)
 {
 	struct pbuf *pbuf;
+
+	if (CONFIG_IS_ENABLED(LWIP_DEBUG_RXTX)) {
+		printf("net_lwip_tx: %u bytes, udev %s \n", len, udev->name);
+		print_hex_dump("net_lwip_rx: ", 0, 16, 1, packet, len, true);
+	}
+
+	pbuf = alloc_pbuf_and_copy(packet, len);
+	if (pbuf)
+		netif->input(pbuf, netif);
+}
+
+/* Copy a whole batch of frames into lwIP, then hand them all back */
+static int net_lwip_rx_batch(struct udevice *udev, struct netif *netif)
+{
+	struct eth_rx_pkt pkts[ETH_PACKETS_BATCH_RECV];
+	int count;
+	int i;
+
+	count = eth_get_ops(udev)->recv_batch(udev, ETH_RECV_CHECK_DEVICE,
+					      pkts, ARRAY_SIZE(pkts));
+	if (count <= 0)
+		return count;
+
+	for (i = 0; i < count; i++)
+		net_lwip_input(udev, netif, pkts[i].packet, pkts[i].len);
+	eth_free_batch(udev, pkts, count);
+
+	return pkts[count - 1].len;
+}
+
+int net_lwip_rx(struct udevice *udev, struct netif *netif)
+{
 	uchar *packet;
 	int flags;
 	int len;
@@ -326,28 +359,25 @@ int net_lwip_rx(struct udevice *udev, struct netif *netif)
 	if (!eth_is_active(udev))
 		return -EINVAL;
 
+	if (eth_get_ops(udev)->recv_batch) {
+		len = net_lwip_rx_batch(udev, netif);
+		if (len != -ENOSYS)
+			goto done;
+	}
+
 	flags = ETH_RECV_CHECK_DEVICE;
 	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
 		len = eth_get_ops(udev)->recv(udev, flags, &packet);
 		flags = 0;
 
-		if (len > 0) {
-			if (CONFIG_IS_ENABLED(LWIP_DEBUG_RXTX)) {
-				printf("net_lwip_tx: %u bytes, udev %s \n", len,
-				       udev->name);
-				print_hex_dump("net_lwip_rx: ", 0, 16, 1,
-					       packet, len, true);
-			}
-
-			pbuf = alloc_pbuf_and_copy(packet, len);
-			if (pbuf)
-				netif->input(pbuf, netif);
-		}
+		if (len > 0)
+			net_lwip_input(udev, netif, packet, len);
 		if (len >= 0 && eth_get_ops(udev)->free_pkt)
 			eth_get_ops(udev)->free_pkt(udev, packet, len);
 		if (len <= 0)
 			break;
 	}
+done:
 	if (len == -EAGAIN)
 		len = 0;
 
@@ -246,6 +246,12 @@ static void httpc_result_cb(void *arg, httpc_result_t httpc_result,
 		printf("Bytes transferred = %lu (%lx hex)\n", ctx->size,
 		       ctx->size);
 	}
+	if (wget_info->range_done &&
+	    wget_info->range_done(wget_info, ctx->saved_daddr, 0, ctx->size)) {
+		log_err("Download failed to verify\n");
+		ctx->done = FAILURE;
+		return;
+	}
 	if (wget_info->set_bootdev)
 		efi_set_bootdev("Http", ctx->server_name, ctx->path, map_sysmem(ctx->saved_daddr, 0),
 				rx_content_len);
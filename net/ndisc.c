@@ -14,6 +14,7 @@
 #include <ndisc.h>
 #include <stdlib.h>
 #include <linux/delay.h>
+#include <net/neigh.h>
 
 /* IPv6 destination address of packet waiting for ND */
 struct in6_addr net_nd_sol_packet_ip6 = ZERO_IPV6_ADDR;
@@ -97,7 +98,7 @@ static int ndisc_has_option(struct ip6_hdr *ip6, __u8 type)
 	return ndisc->opt[0] == type;
 }
 
-static void ip6_send_ns(struct in6_addr *neigh_addr)
+static void ip6_send_ns(uchar *tx_pkt, struct in6_addr *neigh_addr)
 {
 	struct in6_addr dst_adr;
 	unsigned char enetaddr[6];
@@ -116,7 +117,7 @@ static void ip6_send_ns(struct in6_addr *neigh_addr)
 	len = sizeof(struct icmp6hdr) + IN6ADDRSZ +
 	    IP6_NDISC_OPT_SPACE(INETHADDRSZ);
 
-	pkt = (uchar *)net_tx_packet;
+	pkt = tx_pkt;
 	pkt += net_set_ether(pkt, enetaddr, PROT_IP6);
 	pkt += ip6_add_hdr(pkt, &net_link_local_ip6, &dst_adr, PROT_ICMPV6,
 			   IPV6_NDISC_HOPLIMIT, len);
@@ -141,7 +142,7 @@ static void ip6_send_ns(struct in6_addr *neigh_addr)
 	pkt += len;
 
 	/* send it! */
-	net_send_packet(net_tx_packet, (pkt - net_tx_packet));
+	net_send_packet(tx_pkt, (pkt - tx_pkt));
 }
 
 /*
@@ -258,21 +259,29 @@ ip6_send_na(uchar *eth_dst_addr, struct in6_addr *neigh_addr,
 	net_send_packet(net_tx_packet, (pkt - net_tx_packet));
 }
 
+void ndisc_next_hop(struct in6_addr *dest, struct in6_addr *hop)
+{
+	if (!ip6_addr_in_subnet(&net_ip6, dest, net_prefix_length) &&
+	    !ip6_is_unspecified_addr(&net_gateway6))
+		net_copy_ip6(hop, &net_gateway6);
+	else
+		net_copy_ip6(hop, dest);
+}
+
 void ndisc_request(void)
 {
 	if (!ip6_addr_in_subnet(&net_ip6, &net_nd_sol_packet_ip6,
-				net_prefix_length)) {
-		if (ip6_is_unspecified_addr(&net_gateway6)) {
-			puts("## Warning: gatewayip6 is needed but not set\n");
-			net_nd_rep_packet_ip6 = net_nd_sol_packet_ip6;
-		} else {
-			net_nd_rep_packet_ip6 = net_gateway6;
-		}
-	} else {
-		net_nd_rep_packet_ip6 = net_nd_sol_packet_ip6;
-	}
+				net_prefix_length) &&
+	    ip6_is_unspecified_addr(&net_gateway6))
+		puts("## Warning: gatewayip6 is needed but not set\n");
+	ndisc_next_hop(&net_nd_sol_packet_ip6, &net_nd_rep_packet_ip6);
+
+	ip6_send_ns(net_tx_packet, &net_nd_rep_packet_ip6);
+}
 
-	ip6_send_ns(&net_nd_rep_packet_ip6);
+void ndisc_probe(struct in6_addr *neigh_addr)
+{
+	ip6_send_ns(net_get_async_tx_pkt_buf(), neigh_addr);
 }
 
 int ndisc_timeout_check(void)
@@ -444,12 +453,22 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 		if (ip6_is_our_addr(&ndisc->target) &&
 		    ndisc_has_option(ip6, ND_OPT_SOURCE_LL_ADDR)) {
 			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+			/* the sender is likely to be talking to us soon */
+			if (!ip6_is_unspecified_addr(&ip6->saddr))
+				neigh_update6(&ip6->saddr, neigh_eth_addr,
+					      true);
 			ip6_send_na(neigh_eth_addr, &ip6->saddr,
 				    &ndisc->target);
 		}
 		break;
 
 	case IPV6_NDISC_NEIGHBOUR_ADVERTISEMENT:
+		/* this may confirm a cached address */
+		if (ndisc_has_option(ip6, ND_OPT_TARGET_LL_ADDR)) {
+			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+			neigh_update6(&ndisc->target, neigh_eth_addr, false);
+		}
+
 		/* are we waiting for a reply ? */
 		if (ip6_is_unspecified_addr(&net_nd_sol_packet_ip6))
 			break;
@@ -458,6 +477,7 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 			    sizeof(struct in6_addr)) == 0) &&
 		    ndisc_has_option(ip6, ND_OPT_TARGET_LL_ADDR)) {
 			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+			neigh_update6(&ndisc->target, neigh_eth_addr, true);
 
 			/* save address for later use */
 			if (net_nd_packet_mac)
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Cache of neighbours' Ethernet addresses
+ *
+ * ARP and neighbour discovery only track the one address being resolved, so
+ * each transfer would otherwise start by resolving its server or gateway
+ * again. Addresses are kept here for CONFIG_NET_NEIGH_TTL seconds after they
+ * were last confirmed by the neighbour. A cyclic function drops entries which
+ * have expired and marks those which are in use and getting old, and
+ * net_loop() sends the probes for them, since the device is only running
+ * there.
+ */
+
+#include <cyclic.h>
+#include <log.h>
+#include <net.h>
+#include <net6.h>
+#include <ndisc.h>
+#include <time.h>
+#include <net/neigh.h>
+
+#include "arp.h"
+
+#define NEIGH_TTL_MS		(CONFIG_NET_NEIGH_TTL * 1000UL)
+/* Entries in use are probed once they are this old */
+#define NEIGH_STALE_MS		(NEIGH_TTL_MS / 4 * 3)
+/* Time between probes for an entry, and between runs of neigh_cyclic() */
+#define NEIGH_PROBE_MS		1000UL
+
+static struct neigh_entry neigh_table[CONFIG_NET_NEIGH_ENTRIES];
+static struct neigh_stats neigh_stats;
+static struct cyclic_info neigh_cyclic_info;
+
+static void neigh_set_addr(struct in6_addr *addr, struct in_addr ip)
+{
+	memset(addr, '\0', sizeof(*addr));
+	addr->s6_addr32[0] = ip.s_addr;
+}
+
+static struct neigh_entry *neigh_find(struct udevice *dev,
+				      const struct in6_addr *addr, bool ip6)
+{
+	struct neigh_entry *entry;
+
+	for (entry = neigh_table; entry < neigh_table + ARRAY_SIZE(neigh_table);
+	     entry++) {
+		if (entry->dev == dev && entry->ip6 == ip6 &&
+		    !memcmp(&entry->addr, addr, sizeof(*addr)))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void neigh_drop(struct neigh_entry *entry)
+{
+	memset(entry, '\0', sizeof(*entry));
+}
+
+static bool neigh_get(const struct in6_addr *addr, bool ip6, uchar *ethaddr)
+{
+	struct udevice *dev = eth_get_dev();
+	struct neigh_entry *entry = NULL;
+	ulong now = get_timer(0);
+
+	if (dev)
+		entry = neigh_find(dev, addr, ip6);
+	if (entry && now - entry->updated >= NEIGH_TTL_MS) {
+		neigh_drop(entry);
+		neigh_stats.expired++;
+		entry = NULL;
+	}
+	if (!entry) {
+		neigh_stats.misses++;
+		return false;
+	}
+
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+	entry->used = now;
+	neigh_stats.hits++;
+
+	return true;
+}
+
+static void neigh_cyclic(struct cyclic_info *c)
+{
+	struct neigh_entry *entry;
+	ulong now = get_timer(0);
+
+	for (entry = neigh_table; entry < neigh_table + ARRAY_SIZE(neigh_table);
+	     entry++) {
+		if (!entry->dev)
+			continue;
+		if (now - entry->updated >= NEIGH_TTL_MS) {
+			neigh_drop(entry);
+			neigh_stats.expired++;
+		} else if (now - entry->updated >= NEIGH_STALE_MS &&
+			   entry->used - entry->updated < NEIGH_TTL_MS) {
+			/* used since it was last confirmed */
+			entry->stale = true;
+		}
+	}
+}
+
+static void neigh_set(const struct in6_addr *addr, bool ip6,
+		      const uchar *ethaddr, bool add)
+{
+	struct udevice *dev = eth_get_dev();
+	struct neigh_entry *entry, *oldest;
+
+	if (!dev || !is_valid_ethaddr(ethaddr))
+		return;
+
+	entry = neigh_find(dev, addr, ip6);
+	if (!entry) {
+		if (!add)
+			return;
+
+		/* take a free entry, or else the least recently updated */
+		oldest = neigh_table;
+		for (entry = neigh_table;
+		     entry < neigh_table + ARRAY_SIZE(neigh_table); entry++) {
+			if (!entry->dev)
+				break;
+			if ((long)(entry->updated - oldest->updated) < 0)
+				oldest = entry;
+		}
+		if (entry == neigh_table + ARRAY_SIZE(neigh_table)) {
+			entry = oldest;
+			neigh_stats.evicted++;
+		}
+		neigh_drop(entry);
+		entry->dev = dev;
+		entry->addr = *addr;
+		entry->ip6 = ip6;
+		cyclic_register(&neigh_cyclic_info, neigh_cyclic,
+				NEIGH_PROBE_MS * 1000, "neigh");
+	}
+
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->updated = get_timer(0);
+	/* not used since being confirmed */
+	entry->used = entry->updated - NEIGH_TTL_MS;
+	entry->stale = false;
+}
+
+bool neigh_lookup(struct in_addr ip, uchar *ethaddr)
+{
+	struct in6_addr addr;
+
+	neigh_set_addr(&addr, ip);
+
+	return neigh_get(&addr, false, ethaddr);
+}
+
+bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr)
+{
+	return neigh_get(ip6, true, ethaddr);
+}
+
+void neigh_update(struct in_addr ip, const uchar *ethaddr, bool add)
+{
+	struct in6_addr addr;
+
+	if (!ip.s_addr)
+		return;
+	neigh_set_addr(&addr, ip);
+	neigh_set(&addr, false, ethaddr, add);
+}
+
+void neigh_update6(const struct in6_addr *ip6, const uchar *ethaddr, bool add)
+{
+	neigh_set(ip6, true, ethaddr, add);
+}
+
+void neigh_refresh(void)
+{
+	struct udevice *dev = eth_get_dev();
+	struct neigh_entry *entry;
+	ulong now;
+
+	/* leave the packet waiting for an address alone */
+	if (arp_is_waiting() ||
+	    (IS_ENABLED(CONFIG_IPV6) &&
+	     !ip6_is_unspecified_addr(&net_nd_sol_packet_ip6)))
+		return;
+
+	now = get_timer(0);
+	for (entry = neigh_table; entry < neigh_table + ARRAY_SIZE(neigh_table);
+	     entry++) {
+		if (!entry->stale || entry->dev != dev ||
+		    now - entry->probed < NEIGH_PROBE_MS)
+			continue;
+
+		if (entry->ip6) {
+			if (!IS_ENABLED(CONFIG_IPV6))
+				continue;
+			debug("neigh: probing %pI6c\n", &entry->addr);
+			ndisc_probe(&entry->addr);
+		} else {
+			struct in_addr ip;
+
+			ip.s_addr = entry->addr.s6_addr32[0];
+			if (!net_ip.s_addr)
+				continue;
+			debug("neigh: probing %pI4\n", &ip);
+			arp_raw_request(net_ip, entry->ethaddr, ip);
+		}
+		entry->probed = now;
+		neigh_stats.probes++;
+	}
+}
+
+void neigh_flush(struct udevice *dev)
+{
+	struct neigh_entry *entry;
+
+	for (entry = neigh_table; entry < neigh_table + ARRAY_SIZE(neigh_table);
+	     entry++) {
+		if (!dev || entry->dev == dev)
+			neigh_drop(entry);
+	}
+
+	if (!dev) {
+		memset(&neigh_stats, '\0', sizeof(neigh_stats));
+		cyclic_unregister(&neigh_cyclic_info);
+	}
+}
+
+const struct neigh_entry *neigh_get_entry(int index)
+{
+	if (index < 0 || index >= ARRAY_SIZE(neigh_table))
+		return NULL;
+
+	return &neigh_table[index];
+}
+
+const struct neigh_stats *neigh_get_stats(void)
+{
+	return &neigh_stats;
+}
@@ -102,9 +102,11 @@
 #include <net/fastboot_udp.h>
 #include <net/fastboot_tcp.h>
 #include <net/ncsi.h>
+#include <net/neigh.h>
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
+#include <net/stats.h>
 #include <net/tcp.h>
 #include <net/tftp.h>
 #include <net/udp.h>
@@ -186,6 +188,8 @@ bool net_boot_file_name_explicit;
 u32 net_boot_file_size;
 /* Boot file size in blocks as reported by the DHCP server */
 u32 net_boot_file_expected_size_in_blocks;
+/* Block device to write downloads to as they arrive, instead of memory */
+struct blk_stream *net_blk_stream;
 
 static uchar net_pkt_buf[(PKTBUFSRX+1) * PKTSIZE_ALIGN + PKTALIGN];
 /* Receive packets */
@@ -396,6 +400,7 @@ static void net_clear_handlers(void)
 static void net_cleanup_loop(void)
 {
 	net_clear_handlers();
+	eth_rx_post(NULL);
 }
 
 int net_init(void)
@@ -469,6 +474,8 @@ int net_loop(enum proto_t protocol)
 	} else {
 		eth_init_state_only();
 	}
+	if (IS_ENABLED(CONFIG_NET_STATS))
+		net_stats_start(protocol);
 
 restart:
 #ifdef CONFIG_USB_KEYBOARD
@@ -641,6 +648,8 @@ restart:
 		if (arp_timeout_check() > 0)
 			time_start = get_timer(0);
 
+		neigh_refresh();
+
 		if (IS_ENABLED(CONFIG_IPV6)) {
 			if (use_ip6 && (ndisc_timeout_check() > 0))
 				time_start = get_timer(0);
@@ -766,6 +775,8 @@ done:
 	net_set_icmp_handler(NULL);
 #endif
 	net_set_state(prev_net_state);
+	if (IS_ENABLED(CONFIG_NET_STATS))
+		net_stats_end();
 
 #if defined(CONFIG_CMD_PCAP)
 	if (pcap_active())
@@ -921,6 +932,29 @@ int net_send_tcp_packet(int payload_len, struct in_addr dhost, int dport,
 }
 #endif
 
+/*
+ * Put the sum of the pseudo-header in the TCP or UDP checksum field of a packet,
+ * for the device to fill in the rest
+ */
+static void net_csum_seed(struct ip_udp_hdr *ip, uint csum_offset)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __packed ph;
+	u16 *field = (void *)ip + IP_HDR_SIZE + csum_offset;
+
+	net_copy_ip(&ph.src, &ip->ip_src);
+	net_copy_ip(&ph.dst, &ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = ip->ip_p;
+	ph.len = htons(ntohs(ip->ip_len) - IP_HDR_SIZE);
+	*field = ~compute_ip_checksum(&ph, sizeof(ph));
+}
+
 int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		       int payload_len, int proto, u8 action, u32 tcp_seq_num,
 		       u32 tcp_ack_num)
@@ -928,6 +962,8 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	uchar *pkt;
 	int eth_hdr_size;
 	int pkt_hdr_size;
+	uint csum_offset;
+	uint csum_start = 0;
 #if defined(CONFIG_PROT_TCP)
 	struct tcp_stream *tcp;
 #endif
@@ -945,6 +981,10 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
 
+	/* the neighbour cache may save an ARP request */
+	if (!memcmp(ether, net_null_ethaddr, ARP_HLEN))
+		neigh_lookup(arp_next_hop(dest), ether);
+
 	pkt = (uchar *)net_tx_packet;
 
 	eth_hdr_size = net_set_ether(pkt, ether, PROT_IP);
@@ -954,6 +994,8 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		net_set_udp_header(pkt + eth_hdr_size, dest, dport, sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
+		csum_offset = offsetof(struct ip_udp_hdr, udp_xsum) -
+			IP_HDR_SIZE;
 		break;
 #if defined(CONFIG_PROT_TCP)
 	case IPPROTO_TCP:
@@ -966,12 +1008,23 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 					     payload_len, action, tcp_seq_num,
 					     tcp_ack_num);
 		tcp_stream_put(tcp);
+		csum_offset = offsetof(struct ip_tcp_hdr, tcp_xsum) -
+			IP_HDR_SIZE;
 		break;
 #endif
 	default:
 		return -EINVAL;
 	}
 
+	/*
+	 * A device which fills in checksums does it for UDP too, which is
+	 * otherwise sent without one
+	 */
+	if (eth_get_offload(eth_get_dev()) & ETH_OFFLOAD_TX_CSUM) {
+		csum_start = eth_hdr_size + IP_HDR_SIZE;
+		net_csum_seed((void *)pkt + eth_hdr_size, csum_offset);
+	}
+
 	/* if MAC address was not discovered yet, do an ARP request */
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
 		debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &dest);
@@ -982,6 +1035,9 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 
 		/* size of the waiting packet */
 		arp_wait_tx_packet_size = pkt_hdr_size + payload_len;
+		if (csum_start)
+			net_csum_fill(pkt, arp_wait_tx_packet_size, csum_start,
+				      csum_offset);
 
 		/* and do the ARP request */
 		arp_wait_try = 1;
@@ -991,7 +1047,12 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	} else {
 		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
 			   &dest, ether);
-		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
+		if (DEBUG_NET_PKT_TRACE)
+			print_hex_dump_bytes("tx: ", DUMP_PREFIX_OFFSET,
+					     net_tx_packet,
+					     pkt_hdr_size + payload_len);
+		eth_send_csum(net_tx_packet, pkt_hdr_size + payload_len,
+			      csum_start, csum_offset);
 		return 0;	/* transmitted */
 	}
 }
@@ -1207,6 +1268,28 @@ static void receive_icmp(struct ip_udp_hdr *ip, int len,
 	}
 }
 
+/*
+ * Add up @len bytes of a frame from @offset as 16-bit words, where the payload
+ * was placed in a posted destination instead of the frame itself
+ */
+static ulong net_sum_placed(ulong xsum, const uchar *pkt, uint offset,
+			    uint len)
+{
+	uint pos = 0;
+
+	while (len) {
+		uint part = len;
+		const uchar *ptr = eth_rx_data(pkt, offset, &part);
+
+		offset += part;
+		len -= part;
+		for (; part; part--, pos++)
+			xsum += pos & 1 ? *ptr++ : *ptr++ << 8;
+	}
+
+	return xsum;
+}
+
 void net_process_received_packet(uchar *in_packet, int len)
 {
 	struct ethernet_hdr *et;
@@ -1374,6 +1457,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 		 * a fragment, and either the complete packet or NULL if
 		 * it is a fragment (if !CONFIG_IP_DEFRAG, it returns NULL)
 		 */
+		/* A device cannot check the checksum of a fragmented packet */
+		if (ip->ip_off & htons(IP_OFFS | IP_FLAGS_MFRAG))
+			net_rx_csum_valid = false;
 		ip = net_defragment(ip, &len);
 		if (!ip)
 			return;
@@ -1421,7 +1507,8 @@ void net_process_received_packet(uchar *in_packet, int len)
 			   "received UDP (to=%pI4, from=%pI4, len=%d)\n",
 			   &dst_ip, &src_ip, len);
 
-		if (IS_ENABLED(CONFIG_UDP_CHECKSUM) && ip->udp_xsum != 0) {
+		if (IS_ENABLED(CONFIG_UDP_CHECKSUM) && ip->udp_xsum != 0 &&
+		    !net_rx_csum_valid) {
 			ulong   xsum;
 			u8 *sumptr;
 			ushort  sumlen;
@@ -1436,14 +1523,19 @@ void net_process_received_packet(uchar *in_packet, int len)
 			sumlen = ntohs(ip->udp_len);
 			sumptr = (u8 *)&ip->udp_src;
 
-			while (sumlen > 1) {
-				/* inlined ntohs() to avoid alignment errors */
-				xsum += (sumptr[0] << 8) + sumptr[1];
-				sumptr += 2;
-				sumlen -= 2;
+			if (net_rx_placed) {
+				xsum = net_sum_placed(xsum, in_packet,
+						      sumptr - in_packet, sumlen);
+			} else {
+				while (sumlen > 1) {
+					/* inlined ntohs() to avoid alignment errors */
+					xsum += (sumptr[0] << 8) + sumptr[1];
+					sumptr += 2;
+					sumlen -= 2;
+				}
+				if (sumlen > 0)
+					xsum += (sumptr[0] << 8) + sumptr[0];
 			}
-			if (sumlen > 0)
-				xsum += (sumptr[0] << 8) + sumptr[0];
 			while ((xsum >> 16) != 0) {
 				xsum = (xsum & 0x0000ffff) +
 				       ((xsum >> 16) & 0x0000ffff);
@@ -15,6 +15,7 @@
 #include <net6.h>
 #include <ndisc.h>
 #include <vsprintf.h>
+#include <net/neigh.h>
 
 /* NULL IPv6 address */
 struct in6_addr const net_null_addr_ip6 = ZERO_IPV6_ADDR;
@@ -344,6 +345,14 @@ int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
 	udp->udp_xsum = csum_ipv6_magic(&net_ip6, dest, len + UDP_HDR_SIZE,
 					IPPROTO_UDP, csum_p);
 
+	/* the neighbour cache may save a neighbour solicitation */
+	if (!memcmp(ether, net_null_ethaddr, 6)) {
+		struct in6_addr hop;
+
+		ndisc_next_hop(dest, &hop);
+		neigh_lookup6(&hop, ether);
+	}
+
 	/* if MAC address was not discovered yet, save the packet and do
 	 * neighbour discovery
 	 */
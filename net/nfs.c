@@ -32,6 +32,7 @@
 
 #include <command.h>
 #include <display_options.h>
+#include <env.h>
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 #include <flash.h>
 #endif
@@ -43,6 +44,7 @@
 #include "nfs.h"
 #include "bootp.h"
 #include <time.h>
+#include <net/stats.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
 #define NFS_RETRY_COUNT 30
@@ -52,10 +54,33 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
+/**
+ * struct nfs_read_slot - a READ request which is in flight
+ *
+ * @id: RPC transaction ID of the request, 0 if the slot is free
+ * @offset: Offset in the file of the data requested
+ * @len: Number of bytes requested
+ * @sent: Time when the request was last sent, from timer_get_us()
+ * @retries: Number of times the request has been resent
+ */
+struct nfs_read_slot {
+	ulong id;
+	uint offset;
+	uint len;
+	ulong sent;
+	int retries;
+};
+
+static struct nfs_read_slot nfs_read_slots[CONFIG_NFS_READ_WINDOW];
+static int nfs_read_window;	/* Number of slots used for this transfer */
+static uint nfs_read_next;	/* Offset of the next new READ request */
+static uint nfs_read_end;	/* Size of the file, once EOF is seen */
+static bool nfs_read_eof;
+static ulong nfs_read_bytes;	/* Bytes received, for the progress bar */
+static int nfs_read_hashes;
+
 static char dirfh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle of directory */
 static unsigned int dirfh3_length; /* (variable) length of dirfh when NFSv3 */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
@@ -181,15 +206,14 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_send(ulong id, int rpc_prog, int rpc_proc, uint32_t *data,
+		     int datalen)
 {
 	struct rpc_t rpc_pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
 	rpc_pkt.u.call.id = htonl(id);
 	rpc_pkt.u.call.type = htonl(MSG_CALL);
 	rpc_pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
@@ -256,6 +280,11 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_send(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -395,7 +424,7 @@ static void nfs_lookup_req(char *fname)
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read_slot *slot)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -407,22 +436,130 @@ static void nfs_read_req(int offset, int readlen)
 	if (choosen_nfs_version != NFS_V3) {
 		memcpy(p, filefh, NFS_FHSIZE);
 		p += (NFS_FHSIZE / 4);
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
 		*p++ = 0;
 	} else { /* NFS_V3 */
 		*p++ = htonl(filefh3_length);
 		memcpy(p, filefh, filefh3_length);
 		p += (filefh3_length / 4);
 		*p++ = htonl(0); /* offset is 64-bit long, so fill with 0 */
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
 		*p++ = 0;
 	}
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	slot->sent = timer_get_us();
+	rpc_send(slot->id, PROG_NFS, NFS_READ, data, len);
+}
+
+/* Send a new READ request for @len bytes at @offset, using @slot */
+static void nfs_read_issue(struct nfs_read_slot *slot, uint offset, uint len)
+{
+	slot->id = ++rpc_id;
+	slot->offset = offset;
+	slot->len = len;
+	slot->retries = 0;
+	nfs_read_req(slot);
+}
+
+/*
+ * Keep the window full of READ requests until the end of the file is known.
+ * The requests are sent together, so the device is only started once.
+ */
+static void nfs_read_fill(void)
+{
+	int i;
+
+	eth_send_hold();
+	for (i = 0; i < nfs_read_window; i++) {
+		struct nfs_read_slot *slot = &nfs_read_slots[i];
+
+		if (slot->id)
+			continue;
+		if (nfs_read_eof && nfs_read_next >= nfs_read_end)
+			break;
+		nfs_read_issue(slot, nfs_read_next, NFS_READ_SIZE);
+		nfs_read_next += NFS_READ_SIZE;
+	}
+	eth_send_flush();
+}
+
+/**
+ * nfs_read_resend() - Resend READ requests which have not been answered
+ *
+ * Only the requests which have been waiting for at least @timeout are sent
+ * again, using the same transaction ID, so a late reply is still accepted.
+ *
+ * @timeout: Time to wait for a reply in milliseconds, 0 to resend everything
+ * Return: 0 if OK, -ETIMEDOUT if a request has been resent too many times
+ */
+static int nfs_read_resend(ulong timeout)
+{
+	int ret = 0;
+	int i;
+
+	eth_send_hold();
+	for (i = 0; i < nfs_read_window; i++) {
+		struct nfs_read_slot *slot = &nfs_read_slots[i];
+
+		if (!slot->id || timer_get_us() - slot->sent < timeout * 1000)
+			continue;
+		if (++slot->retries > NFS_RETRY_COUNT) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+		debug("%s: offset %x\n", __func__, slot->offset);
+		net_stats_retransmit(NET_STATS_NFS);
+		nfs_read_req(slot);
+	}
+	eth_send_flush();
+
+	return ret;
+}
+
+/* Check whether all the data up to the end of the file has been received */
+static bool nfs_read_done(void)
+{
+	int i;
+
+	if (!nfs_read_eof)
+		return false;
+	for (i = 0; i < nfs_read_window; i++) {
+		struct nfs_read_slot *slot = &nfs_read_slots[i];
+
+		if (slot->id && slot->offset < nfs_read_end)
+			return false;
+	}
+
+	return true;
+}
+
+/* Check whether a request for earlier data than @slot is still waiting */
+static bool nfs_read_overtaken(struct nfs_read_slot *slot)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id &&
+		    nfs_read_slots[i].offset < slot->offset)
+			return true;
+	}
+
+	return false;
+}
+
+static void nfs_read_start(void)
+{
+	memset(nfs_read_slots, '\0', sizeof(nfs_read_slots));
+	nfs_read_next = 0;
+	nfs_read_end = 0;
+	nfs_read_eof = false;
+	nfs_read_bytes = 0;
+	nfs_read_hashes = 0;
+	nfs_read_fill();
 }
 
 /**************************************************************************
@@ -455,7 +592,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_resend(0);
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -711,20 +848,44 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
+static void nfs_read_progress(int rlen)
+{
+	const ulong step = NFS_READ_SIZE / 2 * 10;
+
+	nfs_read_bytes += rlen;
+	for (; nfs_read_hashes * step < nfs_read_bytes; nfs_read_hashes++) {
+		if (nfs_read_hashes && !(nfs_read_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+	}
+}
+
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
+	struct nfs_read_slot *slot = NULL;
 	struct rpc_t rpc_pkt;
+	bool eof = false;
 	int rlen;
 	uchar *data_ptr;
+	int i;
 
 	debug("%s\n", __func__);
 
 	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	/* Replies may arrive in any order, so find the matching request */
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id &&
+		    nfs_read_slots[i].id == ntohl(rpc_pkt.u.reply.id)) {
+			slot = &nfs_read_slots[i];
+			break;
+		}
+	}
+	if (!slot) {
+		/* most likely the answer to a request which was resent */
+		net_stats_dup(NET_STATS_NFS);
 		return -NFS_RPC_DROP;
+	}
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -737,12 +898,6 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (choosen_nfs_version != NFS_V3) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
@@ -752,8 +907,8 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
-		/* Skip unused values :
-			EOF:		32 bits value,
+		eof = rpc_pkt.u.reply.data[2 + nfsv3_data_offset];
+		/* Skip unused value :
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
@@ -762,9 +917,31 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
 			return -9999;
-
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	if (rlen < 0 || rlen > slot->len)
+		return -9999;
+
+	if (rlen && store_block(data_ptr, slot->offset, rlen))
+		return -9999;
+
+	/* a reply to a request which was resent cannot be timed */
+	if (!slot->retries)
+		net_stats_rtt(NET_STATS_NFS, timer_get_us() - slot->sent);
+	if (IS_ENABLED(CONFIG_NET_STATS) && nfs_read_overtaken(slot))
+		net_stats_ooo(NET_STATS_NFS);
+	net_stats_rx(NET_STATS_NFS, rlen);
+	nfs_read_progress(rlen);
+
+	if (eof || !rlen) {
+		if (!nfs_read_eof || slot->offset + rlen < nfs_read_end)
+			nfs_read_end = slot->offset + rlen;
+		nfs_read_eof = true;
+		slot->id = 0;
+	} else if (rlen < slot->len) {
+		/* Short read: ask for the rest of the block */
+		nfs_read_issue(slot, slot->offset + rlen, slot->len - rlen);
+	} else {
+		slot->id = 0;
+	}
 
 	return rlen;
 }
@@ -782,6 +959,9 @@ static void nfs_timeout_handler(void)
 		net_set_timeout_handler(nfs_timeout +
 					nfs_timeout * nfs_timeout_count,
 					nfs_timeout_handler);
+		/* READ requests are counted as they are sent again */
+		if (nfs_state != STATE_READ_REQ)
+			net_stats_retransmit(NET_STATS_NFS);
 		nfs_send();
 	}
 }
@@ -865,9 +1045,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_read_start();
 		}
 		break;
 
@@ -894,15 +1072,20 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0 && !nfs_read_done()) {
+			/* Other requests may have been lost while this one got through */
+			if (nfs_read_resend(nfs_timeout)) {
+				puts("\nRetry count exceeded; starting again\n");
+				net_start_again();
+				break;
+			}
+			nfs_read_fill();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
+			if (rlen >= 0)
 				nfs_download_state = NETLOOP_SUCCESS;
 			if (rlen < 0)
 				debug("NFS READ error (%d)\n", rlen);
@@ -973,6 +1156,10 @@ void nfs_start(void)
 	nfs_timeout_count = 0;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
+	nfs_read_window = env_get_ulong("nfswindowsize", 10,
+					CONFIG_NFS_READ_WINDOW);
+	nfs_read_window = clamp(nfs_read_window, 1, CONFIG_NFS_READ_WINDOW);
+
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
 	nfs_our_port = 1000;
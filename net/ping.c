@@ -12,6 +12,7 @@
 #include "arp.h"
 #include <log.h>
 #include <net.h>
+#include <net/neigh.h>
 
 static ushort ping_seq_number;
 
@@ -37,10 +38,22 @@ static void set_icmp_header(uchar *pkt, struct in_addr dest)
 
 static int ping_send(void)
 {
+	uchar ether[ARP_HLEN];
 	uchar *pkt;
 	int eth_hdr_size;
 
-	/* XXX always send arp request */
+	if (neigh_lookup(arp_next_hop(net_ping_ip), ether)) {
+		debug_cond(DEBUG_DEV_PKT, "sending ping to %pI4\n",
+			   &net_ping_ip);
+
+		eth_hdr_size = net_set_ether(net_tx_packet, ether, PROT_IP);
+		set_icmp_header(net_tx_packet + eth_hdr_size, net_ping_ip);
+		net_send_packet(net_tx_packet,
+				eth_hdr_size + IP_ICMP_HDR_SIZE);
+		return 0;	/* transmitted */
+	}
+
+	/* otherwise send an arp request first */
 
 	debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &net_ping_ip);
 
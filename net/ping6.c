@@ -11,6 +11,7 @@
 
 #include <net.h>
 #include <net6.h>
+#include <net/neigh.h>
 #include "ndisc.h"
 
 static ushort seq_no;
@@ -54,10 +55,19 @@ ip6_make_ping(uchar *eth_dst_addr, struct in6_addr *neigh_addr, uchar *pkt)
 
 int ping6_send(void)
 {
+	struct in6_addr hop;
 	uchar *pkt;
 	static uchar mac[6];
 
-	/* always send neighbor solicit */
+	ndisc_next_hop(&net_ping_ip6, &hop);
+	if (neigh_lookup6(&hop, mac)) {
+		pkt = net_tx_packet;
+		pkt += ip6_make_ping(mac, &net_ping_ip6, pkt);
+		net_send_packet(net_tx_packet, pkt - net_tx_packet);
+		return 0;	/* transmitted */
+	}
+
+	/* otherwise send a neighbor solicit first */
 
 	memcpy(mac, net_null_ethaddr, 6);
 
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Per-protocol statistics for network transfers
+ *
+ * The protocols count what happens to their packets here: new data, packets
+ * sent again, duplicates, packets arriving out of order and round-trip
+ * times. The counts for a transfer are kept apart while it runs and added to
+ * the totals when net_loop() finishes, so that a slow transfer can be told
+ * apart from a slow server or a driver dropping packets. The time spent by
+ * each protocol is accumulated in its own bootstage record.
+ */
+
+#include <bootstage.h>
+#include <log.h>
+#include <net.h>
+#include <time.h>
+#include <linux/math64.h>
+#include <net/stats.h>
+
+static const char *const net_stats_names[NET_STATS_COUNT] = {
+	[NET_STATS_TFTP]	= "tftp",
+	[NET_STATS_NFS]		= "nfs",
+	[NET_STATS_WGET]	= "wget",
+	[NET_STATS_TCP]		= "tcp",
+};
+
+static const enum bootstage_id net_stats_ids[NET_STATS_COUNT] = {
+	[NET_STATS_TFTP]	= BOOTSTAGE_ID_ACCUM_NET_TFTP,
+	[NET_STATS_NFS]		= BOOTSTAGE_ID_ACCUM_NET_NFS,
+	[NET_STATS_WGET]	= BOOTSTAGE_ID_ACCUM_NET_WGET,
+	[NET_STATS_TCP]		= BOOTSTAGE_ID_ACCUM_NET_TCP,
+};
+
+/* Totals, and the counts for the transfer in progress */
+static struct net_stats net_stats;
+static struct net_proto_stats net_stats_cur[NET_STATS_COUNT];
+
+const char *net_stats_name(enum net_stats_proto proto)
+{
+	return net_stats_names[proto];
+}
+
+const struct net_stats *net_stats_get(void)
+{
+	return &net_stats;
+}
+
+void net_stats_reset(void)
+{
+	memset(&net_stats, '\0', sizeof(net_stats));
+}
+
+/* Record the rate for each second which has passed, up to @now */
+static void net_stats_rate(struct net_proto_stats *s, ulong now)
+{
+	while (now - s->slot_start >= 1000) {
+		s->rate[s->rate_count++ % NET_STATS_RATE_SLOTS] =
+			s->slot_bytes / 1024;
+		s->slot_bytes = 0;
+		s->slot_start += 1000;
+	}
+}
+
+void net_stats_start(enum proto_t protocol)
+{
+	ulong now = get_timer(0);
+	int i;
+
+	memset(net_stats_cur, '\0', sizeof(net_stats_cur));
+	switch (protocol) {
+	case TFTPGET:
+	case TFTPPUT:
+	case TFTPSRV:
+		net_stats_cur[NET_STATS_TFTP].active = true;
+		break;
+	case NFS:
+		net_stats_cur[NET_STATS_NFS].active = true;
+		break;
+	case WGET:
+		net_stats_cur[NET_STATS_WGET].active = true;
+		net_stats_cur[NET_STATS_TCP].active = true;
+		break;
+	case FASTBOOT_TCP:
+		net_stats_cur[NET_STATS_TCP].active = true;
+		break;
+	default:
+		return;
+	}
+
+	for (i = 0; i < NET_STATS_COUNT; i++) {
+		net_stats_cur[i].start = now;
+		net_stats_cur[i].slot_start = now;
+		if (net_stats_cur[i].active)
+			bootstage_start(net_stats_ids[i], net_stats_names[i]);
+	}
+	if (!(eth_get_offload(eth_get_dev()) & ETH_OFFLOAD_RX_DROPS))
+		net_stats.rx_drops_unknown = true;
+	bootstage_start(BOOTSTAGE_ID_ACCUM_NET, "net");
+}
+
+void net_stats_end(void)
+{
+	ulong now = get_timer(0);
+	bool active = false;
+	int i;
+
+	for (i = 0; i < NET_STATS_COUNT; i++) {
+		struct net_proto_stats *s = &net_stats_cur[i];
+		struct net_proto_stats *t = &net_stats.proto[i];
+		ulong left;
+		u64 bytes;
+
+		if (!s->active && !s->rx_packets && !s->retransmits)
+			continue;
+
+		t->rx_packets += s->rx_packets;
+		t->rx_bytes += s->rx_bytes;
+		t->retransmits += s->retransmits;
+		t->dups += s->dups;
+		t->ooo += s->ooo;
+		if (s->rtt_count) {
+			if (!t->rtt_count || s->rtt_min < t->rtt_min)
+				t->rtt_min = s->rtt_min;
+			t->rtt_max = max(t->rtt_max, s->rtt_max);
+			t->rtt_count += s->rtt_count;
+			t->rtt_sum += s->rtt_sum;
+		}
+		if (!s->active)
+			continue;
+
+		active = true;
+		s->time_ms = now - s->start;
+		t->transfers++;
+		t->time_ms += s->time_ms;
+
+		/* The last part of a second counts in proportion */
+		net_stats_rate(s, now);
+		left = max(now - s->slot_start, 1UL);
+		if (s->slot_bytes) {
+			bytes = (u64)s->slot_bytes * 1000;
+			s->rate[s->rate_count++ % NET_STATS_RATE_SLOTS] =
+				div_u64(bytes, left * 1024);
+		}
+		memcpy(t->rate, s->rate, sizeof(t->rate));
+		t->rate_count = s->rate_count;
+
+		bootstage_accum(net_stats_ids[i]);
+	}
+	if (active)
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_NET);
+	memset(net_stats_cur, '\0', sizeof(net_stats_cur));
+}
+
+void net_stats_rx(enum net_stats_proto proto, uint bytes)
+{
+	struct net_proto_stats *s = &net_stats_cur[proto];
+
+	s->rx_packets++;
+	s->rx_bytes += bytes;
+	if (s->active) {
+		net_stats_rate(s, get_timer(0));
+		s->slot_bytes += bytes;
+	}
+}
+
+void net_stats_retransmit(enum net_stats_proto proto)
+{
+	net_stats_cur[proto].retransmits++;
+	net_stats_cur[proto].rtt_start = 0;
+}
+
+void net_stats_dup(enum net_stats_proto proto)
+{
+	net_stats_cur[proto].dups++;
+}
+
+void net_stats_ooo(enum net_stats_proto proto)
+{
+	net_stats_cur[proto].ooo++;
+}
+
+void net_stats_rtt(enum net_stats_proto proto, ulong us)
+{
+	struct net_proto_stats *s = &net_stats_cur[proto];
+
+	if (!s->rtt_count || us < s->rtt_min)
+		s->rtt_min = us;
+	s->rtt_max = max(s->rtt_max, us);
+	s->rtt_count++;
+	s->rtt_sum += us;
+}
+
+void net_stats_rtt_start(enum net_stats_proto proto)
+{
+	struct net_proto_stats *s = &net_stats_cur[proto];
+
+	if (!s->rtt_start)
+		s->rtt_start = timer_get_us() ?: 1;
+}
+
+void net_stats_rtt_end(enum net_stats_proto proto)
+{
+	struct net_proto_stats *s = &net_stats_cur[proto];
+
+	if (!s->rtt_start)
+		return;
+	net_stats_rtt(proto, timer_get_us() - s->rtt_start);
+	s->rtt_start = 0;
+}
+
+void net_stats_rx_drop(uint count)
+{
+	net_stats.rx_drops += count;
+}
@@ -22,6 +22,8 @@
 #include <env_internal.h>
 #include <errno.h>
 #include <net.h>
+#include <time.h>
+#include <net/stats.h>
 #include <net/tcp.h>
 
 /*
@@ -36,16 +38,13 @@
 #define TCP_SEND_RETRY		3
 #define TCP_SEND_TIMEOUT	2000UL
 #define TCP_RX_INACTIVE_TIMEOUT	30000UL
-#if PKTBUFSRX != 0
-  #define TCP_RCV_WND_SIZE	(PKTBUFSRX * TCP_MSS)
-#else
-  #define TCP_RCV_WND_SIZE	(4 * TCP_MSS)
-#endif
+#define TCP_DELACK_TIMEOUT	20UL
+#define TCP_RCV_WND_SIZE	(CONFIG_PROT_TCP_RCV_WND * TCP_MSS)
 
 #define TCP_PACKET_OK		0
 #define TCP_PACKET_DROP		1
 
-static struct tcp_stream tcp_stream;
+static struct tcp_stream tcp_streams[CONFIG_PROT_TCP_STREAMS];
 
 static int (*tcp_stream_on_create)(struct tcp_stream *tcp);
 
@@ -146,6 +145,36 @@ void tcp_stream_restart_rx_timer(struct tcp_stream *tcp)
 	tcp->time_last_rx = get_timer(0);
 }
 
+/**
+ * tcp_rcv_wnd_scale() - get the shift needed to advertise a receive window
+ * @wnd: receive window in bytes
+ *
+ * Return: smallest shift which makes @wnd fit in the 16-bit window field
+ */
+static u8 tcp_rcv_wnd_scale(u32 wnd)
+{
+	u8 scale = 0;
+
+	while ((wnd >> scale) > 0xffff && scale < TCP_MAX_SCALE)
+		scale++;
+
+	return scale;
+}
+
+/**
+ * tcp_stream_no_wnd_scale() - stop scaling windows on a stream
+ * @tcp: tcp stream
+ *
+ * RFC 7323 only allows windows to be scaled if both sides sent the window
+ * scale option in their SYN, so fall back to a window of at most 64KiB.
+ */
+static void tcp_stream_no_wnd_scale(struct tcp_stream *tcp)
+{
+	tcp->rmt_win_scale = 0;
+	tcp->rcv_wnd_scale = 0;
+	tcp->rcv_wnd = min_t(u32, tcp->rcv_wnd, 0xffff);
+}
+
 static void tcp_stream_init(struct tcp_stream *tcp,
 			    struct in_addr rhost, u16 rport, u16 lport)
 {
@@ -156,33 +185,43 @@ static void tcp_stream_init(struct tcp_stream *tcp,
 	tcp->state = TCP_CLOSED;
 	tcp->lost.len = TCP_OPT_LEN_2;
 	tcp->rcv_wnd = TCP_RCV_WND_SIZE;
+	tcp->rcv_wnd_scale = tcp_rcv_wnd_scale(tcp->rcv_wnd);
 	tcp->max_retry_count = TCP_SEND_RETRY;
 	tcp->initial_timeout = TCP_SEND_TIMEOUT;
 	tcp->rx_inactiv_timeout = TCP_RX_INACTIVE_TIMEOUT;
 	tcp_stream_restart_rx_timer(tcp);
 }
 
+/*
+ * The slot is freed before the user is told, so that the on_closed()
+ * callback may open another stream in it
+ */
 static void tcp_stream_destroy(struct tcp_stream *tcp)
 {
-	if (tcp->on_closed)
-		tcp->on_closed(tcp);
+	struct tcp_stream old = *tcp;
+
 	memset(tcp, 0, sizeof(struct tcp_stream));
+	if (old.on_closed)
+		old.on_closed(&old);
 }
 
 void tcp_init(void)
 {
 	static int initialized;
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
 	tcp_stream_on_create = NULL;
 	if (!initialized) {
 		initialized = 1;
-		memset(tcp, 0, sizeof(struct tcp_stream));
+		memset(tcp_streams, 0, sizeof(tcp_streams));
 	}
 
-	tcp_stream_set_state(tcp, TCP_CLOSED);
-	tcp_stream_set_status(tcp, TCP_ERR_RST);
-	tcp_stream_destroy(tcp);
+	for (tcp = tcp_streams; tcp < tcp_streams + CONFIG_PROT_TCP_STREAMS;
+	     tcp++) {
+		tcp_stream_set_state(tcp, TCP_CLOSED);
+		tcp_stream_set_status(tcp, TCP_ERR_RST);
+		tcp_stream_destroy(tcp);
+	}
 }
 
 void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
@@ -190,13 +229,36 @@ void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
 	tcp_stream_on_create = on_create;
 }
 
+static struct tcp_stream *tcp_stream_find(struct in_addr rhost,
+					  u16 rport, u16 lport)
+{
+	struct tcp_stream *tcp;
+
+	for (tcp = tcp_streams; tcp < tcp_streams + CONFIG_PROT_TCP_STREAMS;
+	     tcp++) {
+		if (tcp->rhost.s_addr == rhost.s_addr &&
+		    tcp->rport == rport &&
+		    tcp->lport == lport)
+			return tcp;
+	}
+
+	return NULL;
+}
+
 static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 					 u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
+
+	if (!tcp_stream_on_create)
+		return NULL;
 
-	if (!tcp_stream_on_create ||
-	    tcp->state != TCP_CLOSED)
+	for (tcp = tcp_streams; tcp < tcp_streams + CONFIG_PROT_TCP_STREAMS;
+	     tcp++) {
+		if (tcp->state == TCP_CLOSED)
+			break;
+	}
+	if (tcp == tcp_streams + CONFIG_PROT_TCP_STREAMS)
 		return NULL;
 
 	tcp_stream_init(tcp, rhost, rport, lport);
@@ -209,11 +271,10 @@ static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 struct tcp_stream *tcp_stream_get(int is_new, struct in_addr rhost,
 				  u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
-	if (tcp->rhost.s_addr == rhost.s_addr &&
-	    tcp->rport == rport &&
-	    tcp->lport == lport)
+	tcp = tcp_stream_find(rhost, rport, lport);
+	if (tcp)
 		return tcp;
 
 	return is_new ? tcp_stream_add(rhost, rport, lport) : NULL;
@@ -282,6 +343,7 @@ static void tcp_send_packet(struct tcp_stream *tcp, u8 action,
 			    u32 tcp_seq_num, u32 tcp_ack_num, u32 tx_len)
 {
 	tcp->tx_packets++;
+	tcp->ack_pending = 0;
 	net_send_tcp_packet(tx_len, tcp->rhost, tcp->rport,
 			    tcp->lport, action, tcp_seq_num,
 			    tcp_ack_num);
@@ -304,6 +366,8 @@ static void tcp_send_repeat(struct tcp_stream *tcp)
 	}
 	tcp->retry_cnt--;
 	tcp->retry_timeout += tcp->initial_timeout;
+	tcp->retry_sent = 0;
+	net_stats_retransmit(NET_STATS_TCP);
 
 	if (tcp->retry_tx_len > 0) {
 		tcp_opts_size = ROUND_TCPHDR_BYTES(TCP_TSOPT_SIZE +
@@ -341,16 +405,33 @@ static void tcp_send_packet_with_retry(struct tcp_stream *tcp, u8 action,
 	tcp->retry_seq_num = tcp_seq_num;
 	tcp->retry_tx_len = tx_len;
 	tcp->retry_tx_offs = tx_offs;
+	tcp->retry_sent = timer_get_us() ?: 1;
 
 	tcp_send_packet(tcp, action, tcp_seq_num, tcp->rcv_nxt, tx_len);
 	tcp_stream_set_time_handler(tcp, tcp->retry_timeout, tcp_send_repeat);
 }
 
+/* The segment being sent has been acknowledged, so time the round trip */
+static void tcp_stream_rtt(struct tcp_stream *tcp)
+{
+	if (tcp->retry_sent)
+		net_stats_rtt(NET_STATS_TCP, timer_get_us() - tcp->retry_sent);
+	tcp->retry_sent = 0;
+}
+
 static inline u8 tcp_stream_fin_needed(struct tcp_stream *tcp, u32 tcp_seq_num)
 {
 	return (tcp->fin_tx && (tcp_seq_num == tcp->fin_tx_seq)) ? TCP_FIN : 0;
 }
 
+static void tcp_send_ack(struct tcp_stream *tcp)
+{
+	u8 action = tcp_stream_fin_needed(tcp, tcp->snd_una) | TCP_ACK;
+
+	tcp->tx_acks++;
+	tcp_send_packet(tcp, action, tcp->snd_una, tcp->rcv_nxt, 0);
+}
+
 static void tcp_steam_tx_try(struct tcp_stream *tcp)
 {
 	uchar *ptr;
@@ -425,6 +506,11 @@ static void tcp_stream_poll(struct tcp_stream *tcp, ulong time)
 		handler(tcp);
 	}
 
+	/* send an ACK held back in the hope of more data */
+	if (tcp->ack_pending &&
+	    time - tcp->ack_time >= msec_to_ticks(TCP_DELACK_TIMEOUT))
+		tcp_send_ack(tcp);
+
 	tcp_steam_tx_try(tcp);
 }
 
@@ -434,8 +520,9 @@ void tcp_streams_poll(void)
 	struct tcp_stream	*tcp;
 
 	time = get_timer(0);
-	tcp = &tcp_stream;
-	tcp_stream_poll(tcp, time);
+	for (tcp = tcp_streams; tcp < tcp_streams + CONFIG_PROT_TCP_STREAMS;
+	     tcp++)
+		tcp_stream_poll(tcp, time);
 }
 
 /**
@@ -549,7 +636,7 @@ void net_set_syn_options(struct tcp_stream *tcp, union tcp_build_pkt *b)
 	b->ip.mss.len = TCP_OPT_LEN_4;
 	b->ip.mss.mss = htons(TCP_MSS);
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	b->ip.scale.scale = tcp->rcv_wnd_scale;
 	b->ip.scale.len = TCP_OPT_LEN_3;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
@@ -597,6 +684,7 @@ int tcp_set_tcp_header(struct tcp_stream *tcp, uchar *pkt, int payload_len,
 	int pkt_hdr_len;
 	int pkt_len;
 	int tcp_len;
+	u32 win;
 
 	/*
 	 * Header: 5 32 bit words. 4 bits TCP header Length,
@@ -655,14 +743,23 @@ int tcp_set_tcp_header(struct tcp_stream *tcp, uchar *pkt, int payload_len,
 	 * SOCs is may not be considered a constraint to buffer space, if
 	 * it is, then the u-boot tftp or nfs kernel netboot should be
 	 * considered.
+	 *
+	 * The window in a SYN segment is never scaled.
 	 */
-	b->ip.hdr.tcp_win = htons(tcp->rcv_wnd >> TCP_SCALE);
+	if (action & TCP_SYN)
+		win = tcp->rcv_wnd;
+	else
+		win = tcp->rcv_wnd >> tcp->rcv_wnd_scale;
+	b->ip.hdr.tcp_win = htons(min_t(u32, win, 0xffff));
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
 
-	b->ip.hdr.tcp_xsum = tcp_set_pseudo_header(pkt, net_ip, tcp->rhost,
-						   tcp_len, pkt_len);
+	/* Otherwise net_send_ip_packet() leaves the checksum to the device */
+	if (!(eth_get_offload(eth_get_dev()) & ETH_OFFLOAD_TX_CSUM))
+		b->ip.hdr.tcp_xsum = tcp_set_pseudo_header(pkt, net_ip,
+							   tcp->rhost, tcp_len,
+							   pkt_len);
 
 	net_set_ip_header((uchar *)&b->ip, tcp->rhost, net_ip,
 			  pkt_len, IPPROTO_TCP);
@@ -670,17 +767,34 @@ int tcp_set_tcp_header(struct tcp_stream *tcp, uchar *pkt, int payload_len,
 	return pkt_hdr_len;
 }
 
-static void tcp_update_rcv_nxt(struct tcp_stream *tcp)
+/**
+ * tcp_sack_update() - pick the hills to report in the SACK option
+ * @tcp: tcp stream
+ * @tcp_seq_num: TCP sequence number of the last segment received
+ *
+ * The hill holding the last segment comes first, as RFC 2018 asks, followed
+ * by the others in sequence order, as many as fit.
+ */
+static void tcp_sack_update(struct tcp_stream *tcp, u32 tcp_seq_num)
 {
-	if (tcp_seq_cmp(tcp->rcv_nxt, tcp->lost.hill[0].l) >= 0) {
-		tcp->rcv_nxt = tcp->lost.hill[0].r;
+	int i, first, cnt = 0;
 
-		memmove(&tcp->lost.hill[0], &tcp->lost.hill[1],
-			(TCP_SACK_HILLS - 1) * sizeof(struct sack_edges));
+	for (first = 0; first < tcp->rx_hills; first++) {
+		if (tcp_seq_cmp(tcp->rx_hill[first].l, tcp_seq_num) <= 0 &&
+		    tcp_seq_cmp(tcp->rx_hill[first].r, tcp_seq_num) > 0) {
+			tcp->lost.hill[cnt++] = tcp->rx_hill[first];
+			break;
+		}
+	}
+	for (i = 0; i < tcp->rx_hills && cnt < TCP_SACK_REPORT; i++) {
+		if (i != first)
+			tcp->lost.hill[cnt++] = tcp->rx_hill[i];
+	}
 
-		tcp->lost.len -= TCP_OPT_LEN_8;
-		tcp->lost.hill[TCP_SACK_HILLS - 1].l = TCP_O_NOP;
-		tcp->lost.hill[TCP_SACK_HILLS - 1].r = TCP_O_NOP;
+	tcp->lost.len = TCP_OPT_LEN_2 + cnt * TCP_OPT_LEN_8;
+	for (i = cnt; i < TCP_SACK_HILLS; i++) {
+		tcp->lost.hill[i].l = TCP_O_NOP;
+		tcp->lost.hill[i].r = TCP_O_NOP;
 	}
 }
 
@@ -689,82 +803,81 @@ static void tcp_update_rcv_nxt(struct tcp_stream *tcp)
  * @tcp: tcp stream
  * @tcp_seq_num: TCP sequence start number
  * @len: the length of sequence numbers
+ *
+ * Record the data as received, merging it with the hills around it, and
+ * move rcv_nxt on if the hole in front of the first hill is now filled.
+ * If there are too many hills, the last one is forgotten and its data will
+ * be sent again.
+ *
+ * Return: number of bytes which were not already recorded
  */
-void tcp_hole(struct tcp_stream *tcp, u32 tcp_seq_num, u32 len)
+u32 tcp_hole(struct tcp_stream *tcp, u32 tcp_seq_num, u32 len)
 {
-	int i, j, cnt, cnt_move;
+	struct sack_edges *hill = tcp->rx_hill;
+	u32 l = tcp_seq_num, r = tcp_seq_num + len;
+	u32 new_l, new_r, added;
+	int i, j;
 
-	cnt = (tcp->lost.len - TCP_OPT_LEN_2) / TCP_OPT_LEN_8;
-	for (i = 0; i < cnt; i++) {
-		if (tcp_seq_cmp(tcp->lost.hill[i].r, tcp_seq_num) < 0)
-			continue;
-		if (tcp_seq_cmp(tcp->lost.hill[i].l, tcp_seq_num + len) > 0)
+	if (tcp_seq_cmp(r, tcp->rcv_nxt) <= 0)
+		return 0;
+	if (tcp_seq_cmp(l, tcp->rcv_nxt) < 0)
+		l = tcp->rcv_nxt;
+	new_l = l;
+	new_r = r;
+	added = r - l;
+
+	/* find the hills which touch the new data */
+	for (i = 0; i < tcp->rx_hills; i++) {
+		if (tcp_seq_cmp(hill[i].r, l) >= 0)
 			break;
+	}
+	for (j = i; j < tcp->rx_hills; j++) {
+		if (tcp_seq_cmp(hill[j].l, r) > 0)
+			break;
+		/* take off the part which this hill already holds */
+		if (tcp_seq_cmp(hill[j].r, new_l) > 0 &&
+		    tcp_seq_cmp(hill[j].l, new_r) < 0)
+			added -= (tcp_seq_cmp(hill[j].r, new_r) < 0 ?
+				  hill[j].r : new_r) -
+				 (tcp_seq_cmp(hill[j].l, new_l) > 0 ?
+				  hill[j].l : new_l);
+		if (tcp_seq_cmp(hill[j].l, l) < 0)
+			l = hill[j].l;
+		if (tcp_seq_cmp(hill[j].r, r) > 0)
+			r = hill[j].r;
+	}
 
-		if (tcp_seq_cmp(tcp->lost.hill[i].l, tcp_seq_num) > 0)
-			tcp->lost.hill[i].l = tcp_seq_num;
-		if (tcp_seq_cmp(tcp->lost.hill[i].l, tcp_seq_num) < 0) {
-			len += tcp_seq_num - tcp->lost.hill[i].l;
-			tcp_seq_num = tcp->lost.hill[i].l;
-		}
-		if (tcp_seq_cmp(tcp->lost.hill[i].r, tcp_seq_num + len) >= 0) {
-			tcp_update_rcv_nxt(tcp);
-			return;
-		}
-
-		/* check overlapping with next hills */
-		cnt_move = 0;
-		tcp->lost.hill[i].r = tcp_seq_num + len;
-		for (j = i + 1; j < cnt; j++) {
-			if (tcp_seq_cmp(tcp->lost.hill[j].l, tcp->lost.hill[i].r) > 0)
-				break;
-
-			tcp->lost.hill[i].r = tcp->lost.hill[j].r;
-			cnt_move++;
-		}
-
-		if (cnt_move > 0) {
-			if (cnt > i + cnt_move + 1)
-				memmove(&tcp->lost.hill[i + 1],
-					&tcp->lost.hill[i + cnt_move + 1],
-					cnt_move * sizeof(struct sack_edges));
-
-			cnt -= cnt_move;
-			tcp->lost.len = TCP_OPT_LEN_2 + cnt * TCP_OPT_LEN_8;
-			for (j = cnt; j < TCP_SACK_HILLS; j++) {
-				tcp->lost.hill[j].l = TCP_O_NOP;
-				tcp->lost.hill[j].r = TCP_O_NOP;
+	if (j == i) {
+		/* a new hill, make room for it */
+		if (tcp->rx_hills == TCP_RX_HILLS) {
+			if (i == TCP_RX_HILLS) {
+				added = 0;
+				goto update;
 			}
+			tcp->rx_hills--;
 		}
-
-		tcp_update_rcv_nxt(tcp);
-		return;
-	}
-
-	if (i == TCP_SACK_HILLS) {
-		tcp_update_rcv_nxt(tcp);
-		return;
+		memmove(&hill[i + 1], &hill[i],
+			(tcp->rx_hills - i) * sizeof(*hill));
+		tcp->rx_hills++;
+	} else if (j > i + 1) {
+		memmove(&hill[i + 1], &hill[j],
+			(tcp->rx_hills - j) * sizeof(*hill));
+		tcp->rx_hills -= j - i - 1;
 	}
-
-	if (cnt < TCP_SACK_HILLS) {
-		cnt_move = cnt - i;
-		cnt++;
-	} else {
-		cnt = TCP_SACK_HILLS;
-		cnt_move = TCP_SACK_HILLS - i;
+	hill[i].l = l;
+	hill[i].r = r;
+
+update:
+	if (tcp->rx_hills && tcp_seq_cmp(hill[0].l, tcp->rcv_nxt) <= 0) {
+		tcp->rcv_nxt = hill[0].r;
+		tcp->rx_hills--;
+		memmove(&hill[0], &hill[1], tcp->rx_hills * sizeof(*hill));
 	}
 
-	if (cnt_move > 0)
-		memmove(&tcp->lost.hill[i + 1],
-			&tcp->lost.hill[i],
-			cnt_move * sizeof(struct sack_edges));
+	tcp_sack_update(tcp, tcp_seq_num);
 
-	tcp->lost.hill[i].l = tcp_seq_num;
-	tcp->lost.hill[i].r = tcp_seq_num + len;
-	tcp->lost.len = TCP_OPT_LEN_2 + cnt * TCP_OPT_LEN_8;
-
-	tcp_update_rcv_nxt(tcp);
-};
+	return added;
+}
 
 /**
  * tcp_parse_options() - parsing TCP options
@@ -795,7 +908,9 @@ void tcp_parse_options(struct tcp_stream *tcp, uchar *o, int o_len)
 			break;
 		case TCP_O_SCL:
 			wsopt = (struct tcp_scale *)p;
-			tcp->rmt_win_scale = wsopt->scale;
+			tcp->rmt_win_scale = min_t(u8, wsopt->scale,
+						   TCP_MAX_SCALE);
+			tcp->rmt_win_scale_ok = 1;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
@@ -879,6 +994,7 @@ static int tcp_rx_check_ack_num(struct tcp_stream *tcp, u32 tcp_seq_num,
 			new_offs = tcp_stream_tx_offs(tcp);
 			if (tcp->time_handler &&
 			    tcp_seq_cmp(tcp->snd_una, tcp->retry_seq_num) > 0) {
+				tcp_stream_rtt(tcp);
 				tcp_stream_set_time_handler(tcp, 0, NULL);
 			}
 			if (tcp->on_snd_una_update &&
@@ -922,7 +1038,7 @@ static int tcp_rx_user_data(struct tcp_stream *tcp, u32 tcp_seq_num,
 {
 	int tmp_len;
 	u32 buf_offs, old_offs, new_offs;
-	u8 action;
+	bool ack_now;
 
 	if (!len)
 		return TCP_PACKET_OK;
@@ -936,6 +1052,16 @@ static int tcp_rx_user_data(struct tcp_stream *tcp, u32 tcp_seq_num,
 		return TCP_PACKET_DROP;
 	}
 
+	/*
+	 * Data out of order, or filling a hole, is acknowledged at once so
+	 * that the sender learns about the loss quickly (RFC 5681)
+	 */
+	ack_now = tcp_seq_num != tcp->rcv_nxt || tcp->rx_hills;
+	if (tcp_seq_cmp(tcp_seq_num, tcp->rcv_nxt) > 0) {
+		tcp->rx_ooo++;
+		net_stats_ooo(NET_STATS_TCP);
+	}
+
 	tmp_len = len;
 	old_offs = tcp_stream_rx_offs(tcp);
 	buf_offs = tcp_seq_num - tcp->irs - 1;
@@ -951,15 +1077,27 @@ static int tcp_rx_user_data(struct tcp_stream *tcp, u32 tcp_seq_num,
 			return TCP_PACKET_DROP;
 		}
 	}
-	if (tmp_len)
-		tcp_hole(tcp, tcp_seq_num, tmp_len);
+	/* only count what was kept, not data held already or refused */
+	if (tmp_len) {
+		tmp_len = tcp_hole(tcp, tcp_seq_num, tmp_len);
+		if (tmp_len)
+			net_stats_rx(NET_STATS_TCP, tmp_len);
+	}
 
 	new_offs = tcp_stream_rx_offs(tcp);
 	if (tcp->on_rcv_nxt_update && old_offs != new_offs)
 		tcp->on_rcv_nxt_update(tcp, new_offs);
 
-	action = tcp_stream_fin_needed(tcp, tcp->snd_una) | TCP_ACK;
-	tcp_send_packet(tcp, action, tcp->snd_una, tcp->rcv_nxt, 0);
+	/* the callback may have closed the stream */
+	if (tcp->state == TCP_CLOSED)
+		return TCP_PACKET_OK;
+
+	if (!ack_now && ++tcp->ack_pending < CONFIG_PROT_TCP_ACK_SEGS) {
+		if (tcp->ack_pending == 1)
+			tcp->ack_time = get_timer(0);
+		return TCP_PACKET_OK;
+	}
+	tcp_send_ack(tcp);
 
 	return TCP_PACKET_OK;
 }
@@ -984,7 +1122,9 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 	 */
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
-	tcp_win_size = ntohs(b->ip.hdr.tcp_win) << tcp->rmt_win_scale;
+	tcp_win_size = ntohs(b->ip.hdr.tcp_win);
+	if (!(b->ip.hdr.tcp_flags & TCP_SYN))
+		tcp_win_size <<= tcp->rmt_win_scale;
 
 	tcp_flags = b->ip.hdr.tcp_flags;
 
@@ -1014,6 +1154,9 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 		tcp->snd_nxt = tcp->iss + 1;
 		tcp->snd_wnd = tcp_win_size;
 
+		/* our SYN ACK does not offer window scaling */
+		tcp_stream_no_wnd_scale(tcp);
+
 		tcp_stream_restart_rx_timer(tcp);
 
 		tcp_stream_set_state(tcp, TCP_SYN_RECEIVED);
@@ -1042,11 +1185,14 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 			return;
 
 		/* stop retransmit of SYN */
+		tcp_stream_rtt(tcp);
 		tcp_stream_set_time_handler(tcp, 0, NULL);
 
 		tcp->irs = tcp_seq_num;
 		tcp->rcv_nxt = tcp->irs + 1;
 		tcp->snd_una = tcp_ack_num;
+		if (!tcp->rmt_win_scale_ok)
+			tcp_stream_no_wnd_scale(tcp);
 
 		tcp_stream_restart_rx_timer(tcp);
 
@@ -1073,6 +1219,10 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 		if (!tcp_seg_in_wnd(tcp, tcp_seq_num, payload_len)) {
 			if (tcp_flags & TCP_RST)
 				return;
+			if (payload_len > 0 &&
+			    tcp_seq_cmp(tcp_seq_num + payload_len,
+					tcp->rcv_nxt) <= 0)
+				net_stats_dup(NET_STATS_TCP);
 			action = tcp_stream_fin_needed(tcp, tcp->snd_una) | TCP_ACK;
 			tcp_send_packet(tcp, action, tcp->snd_una, tcp->rcv_nxt, 0);
 			return;
@@ -1184,10 +1334,11 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 		return;
 	}
 
-	/* Build pseudo header and verify TCP header */
+	/* Build pseudo header and verify TCP header, unless the device did */
 	tcp_rx_xsum = b->ip.hdr.tcp_xsum;
 	b->ip.hdr.tcp_xsum = 0;
-	if (tcp_rx_xsum != tcp_set_pseudo_header((uchar *)b, b->ip.hdr.ip_src,
+	if (!net_rx_csum_valid &&
+	    tcp_rx_xsum != tcp_set_pseudo_header((uchar *)b, b->ip.hdr.ip_src,
 						 b->ip.hdr.ip_dst, tcp_len,
 						 pkt_len)) {
 		debug_cond(DEBUG_DEV_PKT,
@@ -1211,8 +1362,15 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 struct tcp_stream *tcp_stream_connect(struct in_addr rhost, u16 rport)
 {
 	struct tcp_stream *tcp;
+	uint lport;
+
+	/* streams opened within the same tick need different ports */
+	lport = random_port();
+	while (tcp_stream_find(rhost, rport, lport))
+		lport = RANDOM_PORT_START +
+			(lport + 1 - RANDOM_PORT_START) % RANDOM_PORT_RANGE;
 
-	tcp = tcp_stream_add(rhost, rport, random_port());
+	tcp = tcp_stream_add(rhost, rport, lport);
 	if (!tcp)
 		return NULL;
 
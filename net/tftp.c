@@ -5,6 +5,7 @@
  * Copyright 2011 Comelit Group SpA,
  *                Luca Ceresoli <luca.ceresoli@comelit.it>
  */
+#include <blk_stream.h>
 #include <command.h>
 #include <display_options.h>
 #include <efi_loader.h>
@@ -17,6 +18,7 @@
 #include <net.h>
 #include <net6.h>
 #include <asm/global_data.h>
+#include <net/stats.h>
 #include <net/tftp.h>
 #include "bootp.h"
 
@@ -95,6 +97,18 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Blocks received early, bit n is block tftp_cur_block + 1 + n */
+static u64	tftp_early_map;
+/* Number of the last block of the file, if received early, else -1 */
+static int	tftp_final_block;
+/* Number of times we asked the server to send blocks again */
+static ulong	tftp_retransmits;
+/* Number of blocks received ahead of a missing one */
+static ulong	tftp_reordered;
+/* Window size to request in the next transfer, 0 if not known yet */
+static ushort	tftp_window_adapt;
+/* Number of bytes of the file copied out of receive buffers */
+static ulong	tftp_copied;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -118,6 +132,10 @@ static int	tftp_put_final_block_sent;
 #define TFTP_MTU_BLOCKSIZE6 (CONFIG_TFTP_BLOCKSIZE - 20)
 /* sequence number is 16 bit */
 #define TFTP_SEQUENCE_SIZE	((ulong)(1<<16))
+/* How far ahead of the next expected block we keep blocks */
+#define TFTP_REORDER_BLOCKS	64
+/* Number of early blocks after which a missing block is taken as lost */
+#define TFTP_REORDER_THRESHOLD	3
 
 #define DEFAULT_NAME_LEN	(8 + 4 + 1)
 static char default_filename[DEFAULT_NAME_LEN];
@@ -157,6 +175,17 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	ulong newsize = offset + len;
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
+	int ret;
+
+	if (net_blk_stream) {
+		ret = blk_stream_write(net_blk_stream, offset, src, len);
+		if (ret) {
+			printf("\nTFTP error: cannot write to device (err=%d)\n",
+			       ret);
+			return -1;
+		}
+		goto done;
+	}
 
 	if (CONFIG_IS_ENABLED(LMB)) {
 		if (store_addr < tftp_load_addr ||
@@ -167,22 +196,98 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 		}
 	}
 
+	/* The block may have been placed there already by the driver */
 	ptr = map_sysmem(store_addr, len);
-	memcpy(ptr, src, len);
+	if (ptr != src) {
+		memcpy(ptr, src, len);
+		tftp_copied += len;
+	}
 	unmap_sysmem(ptr);
 
+done:
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
 
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(TFTP_ZEROCOPY)
+/* Where the next block of the file goes, as posted to the Ethernet driver */
+static struct eth_rx_dest tftp_rx_dest;
+/* Number of the block which tftp_rx_dest is for, -1 if none is posted */
+static int tftp_rx_block = -1;
+
+/* Check that a frame is the block which tftp_rx_dest was posted for */
+static bool tftp_rx_claim(const uchar *pkt, int len)
+{
+	const struct ethernet_hdr *et = (void *)pkt;
+	struct ip_udp_hdr *ip = (void *)pkt + ETHER_HDR_SIZE;
+	const __be16 *data = (void *)ip + IP_UDP_HDR_SIZE;
+	uint size = tftp_rx_dest.sg[0].len;
+
+	return et->et_protlen == htons(PROT_IP) && ip->ip_hl_v == 0x45 &&
+	       !(ntohs(ip->ip_off) & (IP_OFFS | IP_FLAGS_MFRAG)) &&
+	       ip->ip_p == IPPROTO_UDP &&
+	       net_read_ip(&ip->ip_src).s_addr == tftp_remote_ip.s_addr &&
+	       ntohs(ip->udp_src) == tftp_remote_port &&
+	       ntohs(ip->udp_dst) == tftp_our_port &&
+	       ntohs(ip->udp_len) == UDP_HDR_SIZE + 4 + size &&
+	       len >= tftp_rx_dest.hdr_len + size &&
+	       ntohs(data[0]) == TFTP_DATA && ntohs(data[1]) == tftp_rx_block;
+}
+
+/*
+ * Post where the next block goes, so that the driver can put it straight
+ * there. The file size must be known, since nothing after the file may be
+ * written.
+ */
+static void tftp_post_rx(void)
+{
+	ushort block = tftp_cur_block + 1;
+	ulong offset = tftp_cur_block * tftp_block_size +
+		       tftp_block_wrap_offset;
+	ulong addr = tftp_load_addr + offset;
+	uint len;
+
+	if (tftp_state != STATE_DATA || tftp_put_active || !block ||
+	    net_blk_stream || net_state != NETLOOP_CONTINUE ||
+	    offset >= tftp_tsize ||
+	    net_eth_hdr_size() != ETHER_HDR_SIZE ||
+	    (IS_ENABLED(CONFIG_IPV6) && use_ip6))
+		goto withdraw;
+
+	len = min_t(ulong, tftp_block_size, tftp_tsize - offset);
+	if (CONFIG_IS_ENABLED(LMB) && lmb_read_check(addr, len))
+		goto withdraw;
+
+	tftp_rx_dest.hdr_len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + 4;
+	tftp_rx_dest.sg[0].addr = map_sysmem(addr, len);
+	tftp_rx_dest.sg[0].len = len;
+	tftp_rx_dest.count = 1;
+	tftp_rx_dest.claim = tftp_rx_claim;
+	tftp_rx_block = block;
+	if (!eth_rx_post(&tftp_rx_dest))
+		return;
+
+withdraw:
+	if (tftp_rx_block >= 0)
+		eth_rx_post(NULL);
+	tftp_rx_block = -1;
+}
+#else
+static inline void tftp_post_rx(void)
+{
+}
+#endif
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_early_map = 0;
+	tftp_final_block = -1;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -277,6 +382,39 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Pick the window size for the next transfer: grow it while there is no
+ * loss, shrink it when more than 1% of the blocks had to be sent again.
+ * The window is only negotiated when the transfer starts, so it cannot be
+ * changed in the middle of one.
+ */
+static void tftp_adapt_window(void)
+{
+	ulong blocks = net_boot_file_size / tftp_block_size + 1;
+	uint window = tftp_window_size_option;
+
+	if (!IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE))
+		return;
+	if (!tftp_retransmits)
+		window = min(window * 2, (uint)TFTP_REORDER_BLOCKS);
+	else if (tftp_retransmits * 100 > blocks)
+		window = max(window / 2, 1U);
+	debug("TFTP window size %d -> %d (%lu of %lu blocks resent)\n",
+	      tftp_window_size_option, window, tftp_retransmits, blocks);
+	tftp_window_adapt = window;
+}
+
+/* Record how the transfer went, taking @msecs */
+static void tftp_export_stats(ulong msecs)
+{
+	msecs = max(msecs, 1UL);
+	env_set_ulong("tftpwindow", tftp_windowsize);
+	env_set_ulong("tftpretransmits", tftp_retransmits);
+	env_set_ulong("tftpreordered", tftp_reordered);
+	env_set_ulong("tftprate", net_boot_file_size / msecs * 1000 / 1024);
+	env_set_ulong("tftpcopied", tftp_copied);
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -297,9 +435,15 @@ static void tftp_complete(void)
 	}
 	puts("\ndone\n");
 
+	if (!tftp_put_active) {
+		tftp_adapt_window();
+		if (IS_ENABLED(CONFIG_TFTP_STATS))
+			tftp_export_stats(time_start);
+	}
+
 	led_activity_off();
 
-	if (!tftp_put_active)
+	if (!tftp_put_active && !net_blk_stream)
 		efi_set_bootdev("Net", "", tftp_filename,
 				map_sysmem(tftp_load_addr, 0),
 				net_boot_file_size);
@@ -449,11 +593,36 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/**
+ * tftp_take_early_blocks() - Move past blocks which were received early
+ *
+ * Return: true if this completed the transfer, else false
+ */
+static bool tftp_take_early_blocks(void)
+{
+	while (tftp_early_map & 1) {
+		tftp_early_map >>= 1;
+		tftp_cur_block++;
+		tftp_cur_block %= TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+
+		if ((int)tftp_cur_block == tftp_final_block) {
+			tftp_send();
+			tftp_complete();
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
 	__be16 proto;
 	__be16 *s;
+	ushort block;
 	int i;
 	u16 timeout_val_rcvd;
 
@@ -500,7 +669,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 						tftp_remote_port = src;
 					}
 					timeout_count = 0;
+					net_stats_rtt_end(NET_STATS_TFTP);
 					tftp_send(); /* Send next data block */
+					net_stats_rtt_start(NET_STATS_TFTP);
 				}
 			}
 		}
@@ -585,25 +756,64 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			tftp_cur_block++;
 		}
 #endif
+		net_stats_rtt_end(NET_STATS_TFTP);
 		tftp_send(); /* Send ACK or first data block */
+		net_stats_rtt_start(NET_STATS_TFTP);
 		break;
 	case TFTP_DATA:
 		if (len < 2)
 			return;
 		len -= 2;
 
-		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+		block = ntohs(*(__be16 *)pkt);
+		if (block != (ushort)(tftp_cur_block + 1)) {
+			ushort ahead = block - (ushort)(tftp_cur_block + 1);
+
 			debug("Received unexpected block: %d, expected: %d\n",
-			      ntohs(*(__be16 *)pkt),
-			      (ushort)(tftp_cur_block + 1));
+			      block, (ushort)(tftp_cur_block + 1));
 			/*
 			 * Only ACK if the block count received is greater than
 			 * the expected block count, otherwise skip ACK.
 			 * (required to properly handle the server retransmitting
 			 *  the window)
 			 */
-			if ((ushort)(tftp_cur_block + 1) - (short)(ntohs(*(__be16 *)pkt)) > 0)
+			if (ahead >= TFTP_SEQUENCE_SIZE / 2) {
+				net_stats_dup(NET_STATS_TFTP);
 				break;
+			}
+			/* A block device is written in order */
+			if (tftp_state == STATE_DATA && !net_blk_stream &&
+			    ahead < TFTP_REORDER_BLOCKS) {
+				/* Keep the block, so it need not be sent again */
+				if (tftp_early_map & BIT_ULL(ahead)) {
+					net_stats_dup(NET_STATS_TFTP);
+					break;
+				}
+				if (store_block(tftp_cur_block + 1 + ahead,
+						pkt + 2, len)) {
+					eth_halt_state_only();
+					net_set_state(NETLOOP_FAIL);
+					break;
+				}
+				tftp_early_map |= BIT_ULL(ahead);
+				tftp_reordered++;
+				net_stats_rx(NET_STATS_TFTP, len);
+				net_stats_ooo(NET_STATS_TFTP);
+				if (len < tftp_block_size)
+					tftp_final_block = block;
+
+				/*
+				 * The missing block may just be late, so only
+				 * ask for it when the server is about to wait
+				 * for an ACK, or several blocks have overtaken
+				 * it
+				 */
+				if (block != tftp_next_ack &&
+				    len == tftp_block_size &&
+				    generic_hweight64(tftp_early_map) <
+				    TFTP_REORDER_THRESHOLD)
+					break;
+			}
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
@@ -612,6 +822,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 */
 			if (tftp_last_nack != tftp_cur_block) {
 				tftp_send();
+				tftp_retransmits++;
+				net_stats_retransmit(NET_STATS_TFTP);
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
@@ -646,6 +858,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		if (tftp_cur_block == tftp_prev_block) {
 			/* Same block again; ignore it. */
+			net_stats_dup(NET_STATS_TFTP);
 			break;
 		}
 
@@ -654,12 +867,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-		if (store_block(tftp_cur_block, pkt + 2, len)) {
+		/* Only a block claimed by tftp_rx_claim() can be placed */
+		if (store_block(tftp_cur_block, net_rx_placed ?
+				net_rx_placed->sg[0].addr : pkt + 2, len)) {
 			eth_halt_state_only();
 			net_set_state(NETLOOP_FAIL);
 			break;
 		}
 		timeout_count = 0;
+		tftp_early_map >>= 1;
+		net_stats_rx(NET_STATS_TFTP, len);
+		net_stats_rtt_end(NET_STATS_TFTP);
 
 		if (len < tftp_block_size) {
 			tftp_send();
@@ -667,13 +885,20 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		/* Take in any blocks which arrived before this one */
+		if ((tftp_early_map & 1) && tftp_take_early_blocks())
+			break;
+
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Early blocks may have taken
+		 *	us past the end of the window.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)(tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			net_stats_rtt_start(NET_STATS_TFTP);
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
 		}
 		break;
 
@@ -700,6 +925,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		}
 		break;
 	}
+
+	tftp_post_rx();
 }
 
 static void tftp_timeout_handler(void)
@@ -709,8 +936,12 @@ static void tftp_timeout_handler(void)
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-		if (tftp_state != STATE_RECV_WRQ)
+		if (tftp_state == STATE_DATA)
+			tftp_retransmits++;
+		if (tftp_state != STATE_RECV_WRQ) {
+			net_stats_retransmit(NET_STATS_TFTP);
 			tftp_send();
+		}
 	}
 }
 
@@ -782,6 +1013,9 @@ void tftp_start(enum proto_t protocol)
 		ep = env_get("tftpwindowsize");
 		if (ep != NULL)
 			tftp_window_size_option = simple_strtol(ep, NULL, 10);
+		else if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE) &&
+			 tftp_window_adapt)
+			tftp_window_size_option = tftp_window_adapt;
 
 		ep = env_get("tftptimeout");
 		if (ep != NULL)
@@ -937,6 +1171,9 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	tftp_retransmits = 0;
+	tftp_reordered = 0;
+	tftp_copied = 0;
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -947,6 +1184,7 @@ void tftp_start(enum proto_t protocol)
 #endif
 
 	tftp_send();
+	net_stats_rtt_start(NET_STATS_TFTP);
 }
 
 #ifdef CONFIG_CMD_TFTPSRV
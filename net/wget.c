@@ -5,6 +5,7 @@
  */
 
 #include <asm/global_data.h>
+#include <blk_stream.h>
 #include <command.h>
 #include <display_options.h>
 #include <env.h>
@@ -13,9 +14,11 @@
 #include <lmb.h>
 #include <mapmem.h>
 #include <net.h>
+#include <net/stats.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <stdlib.h>
+#include <time.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -28,34 +31,76 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define HTTP_STATUS_BAD		0
 #define HTTP_STATUS_OK		200
+#define HTTP_STATUS_PARTIAL	206
 
 static const char http_proto[] = "HTTP/1.0";
 static const char http_eom[] = "\r\n\r\n";
 static const char content_len[] = "Content-Length:";
+static const char content_range[] = "Content-Range: bytes";
 static const char linefeed[] = "\r\n";
 static struct in_addr web_server_ip;
 static unsigned int server_port;
 static unsigned long content_length;
-static u32 http_hdr_size, max_rx_pos;
 static int wget_tsize_num_hash;
+static ulong wget_time_start;
+
+/**
+ * struct wget_conn - a connection fetching the file, or a range of it
+ *
+ * @tcp: TCP stream of the connection, NULL if the slot is free
+ * @offset: Offset of the range in the file
+ * @len: Length of the range, 0 to fetch the whole file
+ * @size: Number of bytes of the file received in order
+ * @hdr_size: Size of the HTTP response header, 0 until it is received
+ * @max_rx_pos: Highest position received in the response, -1 if none
+ * @sent: Time the request was first sent in microseconds, to time the wait
+ * for the response header, 0 if not sent yet
+ * @hdr: Start of the response, kept until the end of the header is found
+ */
+struct wget_conn {
+	struct tcp_stream *tcp;
+	ulong offset;
+	ulong len;
+	ulong size;
+	u32 hdr_size;
+	u32 max_rx_pos;
+	ulong sent;
+	char hdr[HTTP_MAX_HDR_LEN + 1];
+};
+
+static struct wget_conn wget_conns[CONFIG_PROT_TCP_STREAMS];
+static int wget_max_conns;
+static ulong wget_range_size;
+static ulong wget_next_offset;
+static u32 wget_rx_packets, wget_tx_acks, wget_rx_ooo;
 
 static char *image_url;
 static enum net_loop_state wget_loop_state;
 
 /**
- * store_block() - store block in memory
+ * store_block() - store block in memory, or write it to net_blk_stream
  * @src: source of data
  * @offset: offset
  * @len: length
+ * Return: 0 if OK, -ESPIPE if the block device needs earlier data first,
+ * other -ve on error
  */
 static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 {
 	ulong store_addr = image_load_addr + offset;
 	uchar *ptr;
+	int ret;
 
 	// Avoid overflow
 	if (wget_info->buffer_size && wget_info->buffer_size < offset + len)
 		return -1;
+	if (net_blk_stream) {
+		ret = blk_stream_write(net_blk_stream, offset, src, len);
+		if (ret && ret != -ESPIPE && !wget_info->silent)
+			printf("\nwget error: cannot write to device (err=%d)\n",
+			       ret);
+		return ret;
+	}
 	if (CONFIG_IS_ENABLED(LMB) && wget_info->set_bootdev) {
 		if (store_addr < image_load_addr ||
 		    lmb_read_check(store_addr, len)) {
@@ -98,25 +143,133 @@ static void show_block_marker(u32 packets)
 	}
 }
 
+/* Record how the transfer went */
+static void wget_export_stats(void)
+{
+	ulong msecs = max(get_timer(wget_time_start), 1UL);
+
+	env_set_ulong("wgetrate", net_boot_file_size / msecs * 1000 / 1024);
+	env_set_ulong("wgetacks", wget_tx_acks);
+	env_set_ulong("wgetreordered", wget_rx_ooo);
+}
+
+static int tcp_stream_on_create(struct tcp_stream *tcp);
+
+/**
+ * wget_connect() - open a connection to fetch part of the file
+ * @offset: offset of the range in the file
+ * @len: length of the range, 0 for the whole file
+ *
+ * Return: 0 if OK, -EBUSY if no connection is free
+ */
+static int wget_connect(ulong offset, ulong len)
+{
+	struct wget_conn *conn;
+	struct tcp_stream *tcp;
+
+	for (conn = wget_conns; conn < wget_conns + wget_max_conns; conn++) {
+		if (!conn->tcp)
+			break;
+	}
+	if (conn == wget_conns + wget_max_conns)
+		return -EBUSY;
+
+	tcp_stream_set_on_create_handler(tcp_stream_on_create);
+	tcp = tcp_stream_connect(web_server_ip, server_port);
+	if (!tcp)
+		return -EBUSY;
+
+	conn->tcp = tcp;
+	conn->offset = offset;
+	conn->len = len;
+	conn->size = 0;
+	conn->hdr_size = 0;
+	conn->max_rx_pos = (u32)(-1);
+	conn->sent = 0;
+	tcp->priv = conn;
+	tcp_stream_put(tcp);
+
+	return 0;
+}
+
+/* Ask for the next ranges of the file, as connections become free */
+static void wget_request_ranges(void)
+{
+	ulong len;
+
+	while (wget_next_offset < content_length) {
+		len = min(wget_range_size, content_length - wget_next_offset);
+		if (wget_connect(wget_next_offset, len))
+			break;
+		wget_next_offset += len;
+	}
+}
+
+/* Give up on the transfer, dropping all connections */
+static void wget_fail(void)
+{
+	struct wget_conn *conn;
+
+	wget_loop_state = NETLOOP_FAIL;
+	for (conn = wget_conns; conn < wget_conns + wget_max_conns; conn++) {
+		if (conn->tcp) {
+			tcp_stream_reset(conn->tcp);
+			conn->tcp = NULL;
+		}
+	}
+	net_set_state(NETLOOP_FAIL);
+}
+
 static void tcp_stream_on_closed(struct tcp_stream *tcp)
 {
-	if (tcp->status != TCP_ERR_OK)
-		wget_loop_state = NETLOOP_FAIL;
+	struct wget_conn *conn = tcp->priv;
+	int i;
 
-	net_set_state(wget_loop_state);
-	if (wget_loop_state != NETLOOP_SUCCESS) {
+	if (!conn || wget_loop_state == NETLOOP_FAIL)
+		return;
+	conn->tcp = NULL;
+	wget_rx_packets += tcp->rx_packets;
+	wget_tx_acks += tcp->tx_acks;
+	wget_rx_ooo += tcp->rx_ooo;
+
+	if (tcp->status != TCP_ERR_OK || !conn->hdr_size ||
+	    (conn->len && conn->size != conn->len)) {
 		net_boot_file_size = 0;
 		if (!wget_info->silent)
 			printf("\nwget: Transfer Fail, TCP status - %d\n",
 			       tcp->status);
+		wget_fail();
+		return;
+	}
+
+	if (wget_info->range_done &&
+	    wget_info->range_done(wget_info, image_load_addr + conn->offset,
+				  conn->offset, conn->size)) {
+		net_boot_file_size = 0;
+		if (!wget_info->silent)
+			printf("\nwget: Range at %lx failed to verify\n",
+			       conn->offset);
+		wget_fail();
 		return;
 	}
 
+	/* carry on until every range has been received */
+	wget_request_ranges();
+	for (i = 0; i < wget_max_conns; i++) {
+		if (wget_conns[i].tcp)
+			return;
+	}
+
+	wget_loop_state = NETLOOP_SUCCESS;
+	net_set_state(wget_loop_state);
 	if (!wget_info->silent)
 		printf("\nPackets received %d, Transfer Successful\n",
-		       tcp->rx_packets);
+		       wget_rx_packets);
 	wget_info->file_size = net_boot_file_size;
-	if (wget_info->method == WGET_HTTP_METHOD_GET && wget_info->set_bootdev) {
+	if (IS_ENABLED(CONFIG_WGET_STATS))
+		wget_export_stats();
+	if (wget_info->method == WGET_HTTP_METHOD_GET &&
+	    wget_info->set_bootdev && !net_blk_stream) {
 		efi_set_bootdev("Http", NULL, image_url,
 				map_sysmem(image_load_addr, 0),
 				net_boot_file_size);
@@ -124,123 +277,226 @@ static void tcp_stream_on_closed(struct tcp_stream *tcp)
 	}
 }
 
+/**
+ * wget_check_range() - check the range sent by the server
+ * @conn: connection which received the response
+ * @status: HTTP status code of the response
+ * @hdr: response header
+ *
+ * The first range also tells how large the file is. A server which does not
+ * support ranges sends the whole file in reply to the first request instead.
+ *
+ * Return: 0 if OK, -EINVAL if the response does not hold the range asked for
+ */
+static int wget_check_range(struct wget_conn *conn, u32 status, char *hdr)
+{
+	ulong first, last, total;
+	char *pos;
+
+	if (!conn->len)
+		return status == HTTP_STATUS_OK ? 0 : -EINVAL;
+
+	if (status == HTTP_STATUS_OK && !conn->offset) {
+		conn->len = 0;
+		wget_next_offset = -1;
+		return 0;
+	}
+
+	pos = strstr(hdr, content_range);
+	if (status != HTTP_STATUS_PARTIAL || !pos)
+		return -EINVAL;
+
+	pos += strlen(content_range);
+	while (*pos == ' ')
+		pos++;
+	first = simple_strtoul(pos, &pos, 10);
+	if (*pos++ != '-')
+		return -EINVAL;
+	last = simple_strtoul(pos, &pos, 10);
+	if (*pos++ != '/')
+		return -EINVAL;
+	total = simple_strtoul(pos, NULL, 10);
+	if (first != conn->offset || last < first || last >= total ||
+	    last - first + 1 > conn->len ||
+	    (conn->offset && total != content_length))
+		return -EINVAL;
+
+	conn->len = last - first + 1;
+	if (!conn->offset) {
+		content_length = total;
+		wget_info->hdr_cont_len = total;
+	}
+
+	return 0;
+}
+
 static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
 {
+	struct wget_conn *conn = tcp->priv;
 	char	*pos, *tail;
-	uchar	saved, *ptr;
+	char	*ptr = conn->hdr;
+	u32	status;
+	u32	held;
 	int	reply_len;
 
-	if (http_hdr_size) {
-		net_boot_file_size = rx_bytes - http_hdr_size;
+	if (conn->hdr_size) {
+		net_stats_rx(NET_STATS_WGET,
+			     rx_bytes - conn->hdr_size - conn->size);
+		net_boot_file_size += rx_bytes - conn->hdr_size - conn->size;
+		conn->size = rx_bytes - conn->hdr_size;
 		show_block_marker(tcp->rx_packets);
 		return;
 	}
 
-	ptr = map_sysmem(image_load_addr, rx_bytes + 1);
-
-	saved = ptr[rx_bytes];
 	ptr[rx_bytes] = '\0';
-	pos = strstr((char *)ptr, http_eom);
-	ptr[rx_bytes] = saved;
+	pos = strstr(ptr, http_eom);
 
 	if (!pos) {
 		if (rx_bytes < HTTP_MAX_HDR_LEN &&
 		    tcp->state == TCP_ESTABLISHED)
-			goto end;
+			return;
 
 		if (!wget_info->silent)
 			printf("ERROR: misssed HTTP header\n");
 		tcp_stream_close(tcp);
-		goto end;
+		return;
 	}
 
-	http_hdr_size = pos - (char *)ptr + strlen(http_eom);
+	conn->hdr_size = pos - ptr + strlen(http_eom);
 	*pos = '\0';
+	if (conn->sent)
+		net_stats_rtt(NET_STATS_WGET, timer_get_us() - conn->sent);
 
-	if (wget_info->headers && http_hdr_size < MAX_HTTP_HEADERS_SIZE)
+	if (wget_info->headers && !conn->offset &&
+	    conn->hdr_size < MAX_HTTP_HEADERS_SIZE)
 		strcpy(wget_info->headers, ptr);
 
 	/* check for HTTP proto */
-	if (strncasecmp((char *)ptr, "HTTP/", 5)) {
+	if (strncasecmp(ptr, "HTTP/", 5)) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(no HTTP Status Line found)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		goto bad;
 	}
 
 	/* get HTTP reply len */
-	pos = strstr((char *)ptr, linefeed);
+	pos = strstr(ptr, linefeed);
 	if (pos)
-		reply_len = pos - (char *)ptr;
+		reply_len = pos - ptr;
 	else
-		reply_len = http_hdr_size - strlen(http_eom);
+		reply_len = conn->hdr_size - strlen(http_eom);
 
-	pos = strchr((char *)ptr, ' ');
-	if (!pos || pos - (char *)ptr > reply_len) {
+	pos = strchr(ptr, ' ');
+	if (!pos || pos - ptr > reply_len) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(no HTTP Status Code found)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		goto bad;
 	}
 
-	wget_info->status_code = (u32)simple_strtoul(pos + 1, &tail, 10);
+	status = (u32)simple_strtoul(pos + 1, &tail, 10);
 	if (tail == pos + 1 || *tail != ' ') {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(bad HTTP Status Code)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		goto bad;
 	}
 
-	debug_cond(DEBUG_WGET,
-		   "wget: HTTP Status Code %d\n", wget_info->status_code);
+	debug_cond(DEBUG_WGET, "wget: HTTP Status Code %d\n", status);
 
-	if (wget_info->status_code != HTTP_STATUS_OK) {
+	if (!conn->offset)
+		wget_info->status_code = status;
+	if (wget_check_range(conn, status, ptr)) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer\n");
-		tcp_stream_close(tcp);
-		goto end;
+		goto bad;
 	}
 
 	debug_cond(DEBUG_WGET, "wget: Connctd pkt %p  hlen %x\n",
-		   ptr, http_hdr_size);
-
-	content_length = -1;
-	pos = strstr((char *)ptr, content_len);
-	if (pos) {
-		pos += strlen(content_len) + 1;
-		while (*pos == ' ')
-			pos++;
-		content_length = simple_strtoul(pos, &tail, 10);
-		if (*tail != '\r' && *tail != '\n' && *tail != '\0')
-			content_length = -1;
+		   ptr, conn->hdr_size);
+
+	if (!conn->len) {
+		content_length = -1;
+		pos = strstr(ptr, content_len);
+		if (pos) {
+			pos += strlen(content_len) + 1;
+			while (*pos == ' ')
+				pos++;
+			content_length = simple_strtoul(pos, &tail, 10);
+			if (*tail != '\r' && *tail != '\n' && *tail != '\0')
+				content_length = -1;
+		}
+		if (content_length != -1) {
+			debug_cond(DEBUG_WGET,
+				   "wget: Connected Len %lu\n",
+				   content_length);
+			wget_info->hdr_cont_len = content_length;
+		}
 	}
 
-	if (content_length != -1) {
-		debug_cond(DEBUG_WGET,
-			   "wget: Connected Len %lu\n",
-			   content_length);
-		wget_info->hdr_cont_len = content_length;
-		if (wget_info->buffer_size && wget_info->buffer_size < wget_info->hdr_cont_len){
-			tcp_stream_reset(tcp);
-			goto end;
-		}
+	if (!conn->offset && wget_info->buffer_size &&
+	    wget_info->buffer_size < wget_info->hdr_cont_len) {
+		tcp_stream_reset(tcp);
+		return;
+	}
 
+	/*
+	 * Move the data which came with the header into place. Segments after
+	 * a hole are kept too, and memory is filled in when the hole is, but
+	 * a block device is written in order, so it only gets what is in
+	 */
+	held = net_blk_stream ? rx_bytes : conn->max_rx_pos + 1;
+	if (held > conn->hdr_size &&
+	    store_block((uchar *)ptr + conn->hdr_size, conn->offset,
+			held - conn->hdr_size) < 0) {
+		tcp_stream_reset(tcp);
+		return;
 	}
+	conn->size = rx_bytes - conn->hdr_size;
+	net_stats_rx(NET_STATS_WGET, conn->size);
+	net_boot_file_size += conn->size;
 
-	net_boot_file_size = rx_bytes - http_hdr_size;
-	memmove(ptr, ptr + http_hdr_size, max_rx_pos + 1 - http_hdr_size);
-	wget_loop_state = NETLOOP_SUCCESS;
+	if (!conn->offset)
+		wget_request_ranges();
+	return;
 
-end:
-	unmap_sysmem(ptr);
+bad:
+	conn->hdr_size = 0;
+	tcp_stream_close(tcp);
 }
 
 static int tcp_stream_rx(struct tcp_stream *tcp, u32 rx_offs, void *buf, int len)
 {
-	if ((max_rx_pos == (u32)(-1)) || (max_rx_pos < rx_offs + len - 1))
-		max_rx_pos = rx_offs + len - 1;
+	struct wget_conn *conn = tcp->priv;
+	u32 skip;
+	int ret;
+
+	/* keep the start of the response until the header has been parsed */
+	if (!conn->hdr_size) {
+		if (rx_offs >= HTTP_MAX_HDR_LEN)
+			return 0;
+		/* a block device cannot take data after a hole, so refuse it */
+		if (net_blk_stream && rx_offs > tcp_stream_rx_offs(tcp))
+			return 0;
+		len = min_t(u32, len, HTTP_MAX_HDR_LEN - rx_offs);
+		memcpy(conn->hdr + rx_offs, buf, len);
+		if (conn->max_rx_pos == (u32)(-1) ||
+		    conn->max_rx_pos < rx_offs + len - 1)
+			conn->max_rx_pos = rx_offs + len - 1;
+		return len;
+	}
+
+	/* a resent segment may still hold part of the header */
+	skip = rx_offs < conn->hdr_size ? conn->hdr_size - rx_offs : 0;
+	if (skip >= len)
+		return len;
+
+	rx_offs += skip - conn->hdr_size;
+	if (conn->len && rx_offs + len - skip > conn->len)
+		return -1;
 
 	// Avoid overflow
-	if (store_block(buf, rx_offs - http_hdr_size, len) < 0)
+	ret = store_block(buf + skip, conn->offset + rx_offs, len - skip);
+	/* leave it to be sent again once the missing data is in */
+	if (ret == -ESPIPE)
+		return 0;
+	if (ret < 0)
 		return -1;
 
 	return len;
@@ -248,11 +504,14 @@ static int tcp_stream_rx(struct tcp_stream *tcp, u32 rx_offs, void *buf, int len
 
 static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int maxlen)
 {
+	struct wget_conn *conn = tcp->priv;
 	int ret;
 	const char *method;
 
 	if (tx_offs)
 		return 0;
+	if (!conn->sent)
+		conn->sent = timer_get_us() ?: 1;
 
 	switch (wget_info->method) {
 	case WGET_HTTP_METHOD_HEAD:
@@ -264,8 +523,14 @@ static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int max
 		break;
 	}
 
-	ret = snprintf(buf, maxlen, "%s %s %s\r\n\r\n",
-		       method, image_url, http_proto);
+	if (conn->len)
+		ret = snprintf(buf, maxlen,
+			       "%s %s %s\r\nRange: bytes=%lu-%lu\r\n\r\n",
+			       method, image_url, http_proto, conn->offset,
+			       conn->offset + conn->len - 1);
+	else
+		ret = snprintf(buf, maxlen, "%s %s %s\r\n\r\n",
+			       method, image_url, http_proto);
 
 	return ret;
 }
@@ -290,8 +555,6 @@ static int tcp_stream_on_create(struct tcp_stream *tcp)
 
 void wget_start(void)
 {
-	struct tcp_stream *tcp;
-
 	if (!wget_info)
 		wget_info = &default_wget_info;
 
@@ -340,11 +603,14 @@ void wget_start(void)
 
 	memset(net_server_ethaddr, 0, 6);
 
-	max_rx_pos = (u32)(-1);
 	net_boot_file_size = 0;
-	http_hdr_size = 0;
+	content_length = -1;
 	wget_tsize_num_hash = 0;
-	wget_loop_state = NETLOOP_FAIL;
+	wget_loop_state = NETLOOP_CONTINUE;
+	wget_time_start = get_timer(0);
+	wget_rx_packets = 0;
+	wget_tx_acks = 0;
+	wget_rx_ooo = 0;
 
 	wget_info->status_code = HTTP_STATUS_BAD;
 	wget_info->file_size = 0;
@@ -352,16 +618,37 @@ void wget_start(void)
 	if (wget_info->headers)
 		wget_info->headers[0] = 0;
 
+	/*
+	 * With more than one connection, the file is fetched in ranges. The
+	 * first one also tells how large the file is, then the others are
+	 * asked for as connections become free. A block device is written in
+	 * order, so takes the file in one piece.
+	 */
+	wget_max_conns = 1;
+	wget_range_size = 0;
+	wget_next_offset = -1;
+	if (IS_ENABLED(CONFIG_WGET_RANGES) && !net_blk_stream &&
+	    wget_info->method == WGET_HTTP_METHOD_GET) {
+		wget_max_conns = env_get_ulong("wgetconnections", 10, 1);
+		wget_max_conns = clamp(wget_max_conns, 1,
+				       CONFIG_PROT_TCP_STREAMS);
+		wget_range_size = env_get_hex("wgetrangesize",
+				CONFIG_IF_ENABLED_INT(WGET_RANGES,
+						      WGET_RANGE_SIZE));
+		if (wget_max_conns == 1 || !wget_range_size)
+			wget_range_size = 0;
+		else
+			wget_next_offset = wget_range_size;
+	}
+	memset(wget_conns, '\0', sizeof(wget_conns));
+
 	server_port = env_get_ulong("httpdstp", 10, SERVER_PORT) & 0xffff;
-	tcp_stream_set_on_create_handler(tcp_stream_on_create);
-	tcp = tcp_stream_connect(web_server_ip, server_port);
-	if (!tcp) {
+	if (wget_connect(0, wget_range_size)) {
 		if (!wget_info->silent)
 			printf("No free tcp streams\n");
 		net_set_state(NETLOOP_FAIL);
 		return;
 	}
-	tcp_stream_put(tcp);
 }
 
 int wget_do_request(ulong dst_addr, char *uri)
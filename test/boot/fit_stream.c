@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for streaming FIT images with external data
+ */
+
+#include <image.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <test/ut.h>
+#include "bootstd_common.h"
+
+#define FIT_ADDR	0x1000000
+#define KERNEL_LOAD	0x2000000
+#define KERNEL_SIZE	0x280000
+#define STRUCT_SIZE	0x1000
+#define FDT_SIZE	0x100
+#define FW_SIZE		0x345
+
+/**
+ * struct stream_src - a FIT file held in memory
+ *
+ * @buf: File contents
+ * @size: Size of the file
+ * @reads: Number of reads made from it
+ */
+struct stream_src {
+	u8 *buf;
+	ulong size;
+	int reads;
+};
+
+static int stream_read(void *priv, ulong offset, ulong size, void *buf)
+{
+	struct stream_src *src = priv;
+
+	if (offset + size > src->size)
+		return -EIO;
+	memcpy(buf, src->buf + offset, size);
+	src->reads++;
+
+	return 0;
+}
+
+static int add_hash(struct unit_test_state *uts, void *fit, const char *name,
+		    const char *algo, const void *data, int size)
+{
+	u8 value[FIT_MAX_HASH_LEN];
+	int len = sizeof(value);
+
+	ut_assertok(hash_block(algo, data, size, value, &len));
+	ut_assertok(fdt_begin_node(fit, name));
+	ut_assertok(fdt_property_string(fit, FIT_ALGO_PROP, algo));
+	ut_assertok(fdt_property(fit, FIT_VALUE_PROP, value, len));
+	ut_assertok(fdt_end_node(fit));
+
+	return 0;
+}
+
+static int add_image(struct unit_test_state *uts, void *fit, const char *name,
+		     const char *type, ulong load, int offset, const void *data,
+		     int size)
+{
+	ut_assertok(fdt_begin_node(fit, name));
+	ut_assertok(fdt_property_string(fit, FIT_TYPE_PROP, type));
+	ut_assertok(fdt_property_string(fit, FIT_ARCH_PROP, "sandbox"));
+	ut_assertok(fdt_property_string(fit, FIT_OS_PROP, "linux"));
+	ut_assertok(fdt_property_string(fit, FIT_COMP_PROP, "none"));
+	if (load) {
+		ut_assertok(fdt_property_u32(fit, FIT_LOAD_PROP, load));
+		ut_assertok(fdt_property_u32(fit, FIT_ENTRY_PROP, load));
+	}
+	ut_assertok(fdt_property_u32(fit, FIT_DATA_OFFSET_PROP, offset));
+	ut_assertok(fdt_property_u32(fit, FIT_DATA_SIZE_PROP, size));
+	ut_assertok(add_hash(uts, fit, "hash-1", "sha256", data, size));
+	if (!strcmp(type, "kernel"))
+		ut_assertok(add_hash(uts, fit, "hash-2", "crc32", data, size));
+	ut_assertok(fdt_end_node(fit));
+
+	return 0;
+}
+
+/*
+ * Create a FIT file with a kernel and devicetree in conf-1, plus a firmware
+ * image which is not used by any configuration
+ */
+static int make_fit(struct unit_test_state *uts, struct stream_src *src,
+		    ulong load)
+{
+	int fdt_off, fw_off;
+	u8 *kernel, *fdt, *fw;
+	void *fit;
+	int i;
+
+	src->size = STRUCT_SIZE + KERNEL_SIZE + FDT_SIZE + FW_SIZE;
+	src->buf = calloc(1, src->size);
+	ut_assertnonnull(src->buf);
+	src->reads = 0;
+
+	kernel = src->buf + STRUCT_SIZE;
+	for (i = 0; i < KERNEL_SIZE; i++)
+		kernel[i] = i * 7 + (i >> 12);
+	fdt_off = KERNEL_SIZE;
+	fdt = kernel + fdt_off;
+	ut_assertok(fdt_create_empty_tree(fdt, FDT_SIZE));
+	fw_off = fdt_off + FDT_SIZE;
+	fw = kernel + fw_off;
+	memset(fw, 0xa5, FW_SIZE);
+
+	fit = src->buf;
+	ut_assertok(fdt_create(fit, STRUCT_SIZE));
+	ut_assertok(fdt_finish_reservemap(fit));
+	ut_assertok(fdt_begin_node(fit, ""));
+	ut_assertok(fdt_property_string(fit, FIT_DESC_PROP, "stream test"));
+	ut_assertok(fdt_property_u32(fit, FIT_TIMESTAMP_PROP, 0));
+
+	ut_assertok(fdt_begin_node(fit, "images"));
+	ut_assertok(add_image(uts, fit, "kernel", "kernel", load, 0, kernel,
+			      KERNEL_SIZE));
+	ut_assertok(add_image(uts, fit, "fdt-1", "flat_dt", 0, fdt_off, fdt,
+			      FDT_SIZE));
+	ut_assertok(add_image(uts, fit, "firmware", "firmware", 0x4000000,
+			      fw_off, fw, FW_SIZE));
+	ut_assertok(fdt_end_node(fit));
+
+	ut_assertok(fdt_begin_node(fit, "configurations"));
+	ut_assertok(fdt_property_string(fit, FIT_DEFAULT_PROP, "conf-1"));
+	ut_assertok(fdt_begin_node(fit, "conf-1"));
+	ut_assertok(fdt_property_string(fit, FIT_KERNEL_PROP, "kernel"));
+	ut_assertok(fdt_property_string(fit, FIT_FDT_PROP, "fdt-1"));
+	ut_assertok(fdt_end_node(fit));
+	ut_assertok(fdt_end_node(fit));
+
+	ut_assertok(fdt_end_node(fit));
+	ut_assertok(fdt_finish(fit));
+
+	/* the external data starts right after the structure */
+	fdt_set_totalsize(fit, STRUCT_SIZE);
+
+	return 0;
+}
+
+/* Test streaming a FIT, then loading its images as bootm does */
+static int fit_stream_test_load(struct unit_test_state *uts)
+{
+	struct stream_src src;
+	const void *data;
+	int noffset;
+	size_t size;
+	void *fit;
+	ulong end;
+	u8 *load;
+
+	ut_assertok(make_fit(uts, &src, KERNEL_LOAD));
+	fit = map_sysmem(FIT_ADDR, STRUCT_SIZE);
+	load = map_sysmem(KERNEL_LOAD, KERNEL_SIZE);
+	memset(load, '\0', KERNEL_SIZE);
+
+	ut_assertok(fit_stream_load(FIT_ADDR, NULL, stream_read, &src, &end));
+	ut_asserteq(src.size, end);
+
+	/* header, structure, three kernel chunks, devicetree and firmware */
+	ut_asserteq(2 + 3 + 1 + 1, src.reads);
+
+	/* the kernel is at its load address, the rest in the FIT layout */
+	ut_asserteq_mem(src.buf + STRUCT_SIZE, load, KERNEL_SIZE);
+	noffset = fit_image_get_node(fit, "kernel");
+	ut_assert(noffset >= 0);
+	ut_assertok(fit_image_get_data(fit, noffset, &data, &size));
+	ut_asserteq_ptr(load, data);
+	ut_asserteq(KERNEL_SIZE, size);
+
+	noffset = fit_image_get_node(fit, "fdt-1");
+	ut_assertok(fit_image_get_data(fit, noffset, &data, &size));
+	ut_asserteq(FIT_ADDR + STRUCT_SIZE + KERNEL_SIZE, map_to_sysmem(data));
+	ut_assertok(fdt_check_header(data));
+	ut_asserteq(-ENOENT, fit_stream_get_data(fit, noffset, &data, &size));
+
+	/* bootm hashes the placed data again, so changes to it are caught */
+	noffset = fit_image_get_node(fit, "kernel");
+	ut_asserteq(1, fit_image_verify(fit, noffset));
+	load[0x1234] ^= 1;
+	ut_asserteq(0, fit_image_verify(fit, noffset));
+	load[0x1234] ^= 1;
+
+	noffset = fit_image_get_node(fit, "firmware");
+	ut_asserteq(1, fit_image_verify(fit, noffset));
+
+	/* a different FIT at the same address must not use the results */
+	fdt_setprop_string(fit, 0, FIT_DESC_PROP, "other");
+	noffset = fit_image_get_node(fit, "kernel");
+	ut_assertok(fit_image_get_data(fit, noffset, &data, &size));
+	ut_asserteq(FIT_ADDR + STRUCT_SIZE, map_to_sysmem(data));
+
+	fit_stream_reset();
+	unmap_sysmem(load);
+	unmap_sysmem(fit);
+	free(src.buf);
+
+	return 0;
+}
+BOOTSTD_TEST(fit_stream_test_load, 0);
+
+/* Test that bad data or a bad layout stops the stream */
+static int fit_stream_test_bad(struct unit_test_state *uts)
+{
+	struct stream_src src;
+	const void *data;
+	size_t size;
+	void *fit;
+
+	/* bad image data is left for bootm to find */
+	ut_assertok(make_fit(uts, &src, KERNEL_LOAD));
+	fit = map_sysmem(FIT_ADDR, STRUCT_SIZE);
+	src.buf[STRUCT_SIZE + 0x123456] ^= 1;
+	ut_assertok(fit_stream_load(FIT_ADDR, NULL, stream_read, &src, NULL));
+	ut_asserteq(0, fit_image_verify(fit, fit_image_get_node(fit, "kernel")));
+	fit_stream_reset();
+	ut_asserteq(-ENOENT, fit_stream_get_data(fit,
+						 fit_image_get_node(fit, "kernel"),
+						 &data, &size));
+	free(src.buf);
+
+	/* kernel load address on top of the FIT structure */
+	ut_assertok(make_fit(uts, &src, FIT_ADDR + 0x800));
+	ut_asserteq(-EXDEV, fit_stream_load(FIT_ADDR, NULL, stream_read, &src,
+					    NULL));
+	free(src.buf);
+
+	ut_assertok(make_fit(uts, &src, KERNEL_LOAD));
+	ut_asserteq(-ENOENT, fit_stream_load(FIT_ADDR, "conf-2", stream_read,
+					     &src, NULL));
+	src.buf[0] = 0;
+	ut_asserteq(-ENOEXEC, fit_stream_load(FIT_ADDR, NULL, stream_read,
+					      &src, NULL));
+	unmap_sysmem(fit);
+	free(src.buf);
+
+	return 0;
+}
+BOOTSTD_TEST(fit_stream_test_bad, 0);
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Common code for tests of network commands
+ */
+
+#include <command.h>
+#include <env.h>
+#include <mapmem.h>
+#include <test/ut.h>
+#include "net_common.h"
+
+int net_test_load(struct unit_test_state *uts, const char *cmd, ulong addr,
+		  int size, u8 (*byte)(uint offset))
+{
+	u8 *buf;
+	int i;
+
+	env_set("filesize", NULL);
+	ut_assertok(run_command(cmd, 0));
+	ut_asserteq(size, env_get_hex("filesize", 0));
+
+	buf = map_sysmem(addr, size);
+	for (i = 0; i < size; i++) {
+		if (buf[i] != byte(i))
+			break;
+	}
+	unmap_sysmem(buf);
+	ut_asserteq(size, i);
+
+	return 0;
+}
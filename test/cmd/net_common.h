@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Common header file for tests of network commands
+ */
+
+#ifndef __net_common_h
+#define __net_common_h
+
+#include <linux/types.h>
+
+struct unit_test_state;
+
+/**
+ * net_test_load() - Download a file and check what arrived
+ *
+ * The file is served by a tx handler on the sandbox Ethernet device, which
+ * fills it in with the bytes given by @byte.
+ *
+ * @uts: Unit test state to use for ut_assert...() functions
+ * @cmd: Command which downloads the file to @addr
+ * @addr: Address the file is downloaded to
+ * @size: Size of the file
+ * @byte: Returns the value of the file's byte at @offset
+ * Return: 0 if OK, -ve on error
+ */
+int net_test_load(struct unit_test_state *uts, const char *cmd, ulong addr,
+		  int size, u8 (*byte)(uint offset));
+
+#endif
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the nfs command, using a minimal NFSv3 server on the sandbox
+ * Ethernet device
+ */
+
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/cmd.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "net_common.h"
+
+#define SB_NFS_SIZE		(64 * 1024 + 100)
+#define SB_NFS_PORT		2049
+#define SB_MOUNT_PORT		635
+
+#define PROG_PORTMAP		100000
+#define PROG_MOUNT		100005
+#define MSG_REPLY		1
+#define NFS_READ		6
+#define RPC_CRED_WORDS		9	/* AUTH_UNIX credential + verifier */
+
+/**
+ * struct sb_nfs_server - state of the fake NFS server
+ *
+ * @reads: Number of READ requests received
+ * @max_in_flight: Largest number of READ replies waiting to be received, i.e.
+ *	of READ requests the client had in flight at once
+ * @drop_offset: Drop the first reply for a READ at this offset, -1 for none
+ */
+struct sb_nfs_server {
+	int reads;
+	int max_in_flight;
+	int drop_offset;
+};
+
+static struct sb_nfs_server sb_nfs;
+
+static u8 sb_nfs_byte(uint offset)
+{
+	return offset * 7 + (offset >> 10);
+}
+
+/* Fill in the reply to an RPC call, returning the number of data words */
+static int sb_nfs_rpc_reply(u32 *call, u32 *data)
+{
+	u32 prog = ntohl(call[3]);
+	u32 proc = ntohl(call[5]);
+	u32 *args = &call[6];
+	uint offset, count;
+
+	/* portmap GETPORT: args are the auth words, then prog, vers */
+	if (prog == PROG_PORTMAP) {
+		data[0] = htonl(ntohl(args[4]) == PROG_MOUNT ? SB_MOUNT_PORT :
+				SB_NFS_PORT);
+		return 1;
+	}
+
+	/* MNT and LOOKUP return a file handle, UMNTALL returns nothing */
+	if (prog == PROG_MOUNT || proc != NFS_READ) {
+		data[0] = 0;
+		data[1] = htonl(8);
+		data[2] = htonl(prog);
+		data[3] = htonl(proc);
+		return 4;
+	}
+
+	/* READ: handle length, handle, 64-bit offset, count */
+	args += RPC_CRED_WORDS;
+	args += 1 + ntohl(args[0]) / 4;
+	offset = ntohl(args[1]);
+	count = ntohl(args[2]);
+	sb_nfs.reads++;
+	if (offset == sb_nfs.drop_offset) {
+		sb_nfs.drop_offset = -1;
+		sandbox_eth_skip_timeout();
+		return -EAGAIN;
+	}
+	if (offset >= SB_NFS_SIZE)
+		count = 0;
+	else
+		count = min(count, SB_NFS_SIZE - offset);
+
+	data[0] = 0;			/* status */
+	data[1] = 0;			/* no attributes */
+	data[2] = htonl(count);
+	data[3] = htonl(offset + count >= SB_NFS_SIZE);
+	data[4] = htonl(count);
+	for (int i = 0; i < count; i++)
+		((u8 *)&data[5])[i] = sb_nfs_byte(offset + i);
+
+	return 5 + DIV_ROUND_UP(count, 4);
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *udp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_udp_hdr *udp_send;
+	u32 *call, *reply;
+	int words, pkt_len;
+	int reads = sb_nfs.reads;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || udp->ip_p != IPPROTO_UDP)
+		return -EPROTONOSUPPORT;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	udp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	call = (void *)udp + IP_UDP_HDR_SIZE;
+	reply = (void *)udp_send + IP_UDP_HDR_SIZE;
+
+	words = sb_nfs_rpc_reply(call, &reply[6]);
+	if (words < 0)
+		return 0;
+	reply[0] = call[0];
+	reply[1] = htonl(MSG_REPLY);
+	reply[2] = 0;
+	reply[3] = 0;
+	reply[4] = 0;
+	reply[5] = 0;
+
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+
+	pkt_len = (6 + words) * sizeof(u32);
+	net_set_ip_header((uchar *)udp_send, udp->ip_src, udp->ip_dst,
+			  IP_UDP_HDR_SIZE + pkt_len, IPPROTO_UDP);
+	udp_send->udp_src = udp->udp_dst;
+	udp_send->udp_dst = udp->udp_src;
+	udp_send->udp_len = htons(UDP_HDR_SIZE + pkt_len);
+	udp_send->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+	/* the replies waiting, less any which the client is handling now */
+	if (sb_nfs.reads != reads)
+		sb_nfs.max_in_flight = max(sb_nfs.max_in_flight,
+					   priv->recv_packets - priv->rx_calls +
+					   priv->free_calls);
+
+	return 0;
+}
+
+/* Load the file with the given window size and check what arrived */
+static int sb_nfs_load(struct unit_test_state *uts, int window)
+{
+	sb_nfs.reads = 0;
+	sb_nfs.max_in_flight = 0;
+	env_set_ulong("nfswindowsize", window);
+	ut_assertok(net_test_load(uts, "nfs 0x20000 1.1.2.2:/export/image",
+				  0x20000, SB_NFS_SIZE, sb_nfs_byte));
+
+	return 0;
+}
+
+static int net_test_nfs(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	int window;
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	sb_nfs.drop_offset = -1;
+
+	/*
+	 * The client keeps up to a window of READ requests in flight, each
+	 * reading the next block, so every block is read once, along with a
+	 * block past the end for each further slot. The sandbox driver only
+	 * holds PKTBUFSRX packets, so stay below that.
+	 */
+	for (window = 1; window < min(PKTBUFSRX, 4); window++) {
+		ut_assertok(sb_nfs_load(uts, window));
+		ut_asserteq(window, sb_nfs.max_in_flight);
+		ut_asserteq(DIV_ROUND_UP(SB_NFS_SIZE, 1024) + window - 1,
+			    sb_nfs.reads);
+	}
+
+	/* A lost reply is resent on its own, without stopping the others */
+	sb_nfs.drop_offset = 8 * 1024;
+	ut_assertok(sb_nfs_load(uts, 2));
+	ut_asserteq(-1, sb_nfs.drop_offset);
+	ut_asserteq(2, sb_nfs.max_in_flight);
+	/* the block past the end and the one which was sent again */
+	ut_asserteq(DIV_ROUND_UP(SB_NFS_SIZE, 1024) + 2, sb_nfs.reads);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("nfswindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_nfs, 0);
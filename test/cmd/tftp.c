@@ -0,0 +1,481 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for TFTP windows, using a minimal TFTP server on the sandbox Ethernet
+ * device which can reorder and drop blocks
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <net/stats.h>
+#include <test/cmd.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "net_common.h"
+
+#define SB_TFTP_BLKSIZE		512
+#define SB_TFTP_SIZE		(40 * SB_TFTP_BLKSIZE + 100)
+#define SB_TFTP_BLOCKS		(SB_TFTP_SIZE / SB_TFTP_BLKSIZE + 1)
+#define SB_TFTP_TID		5000
+
+/*
+ * The sandbox driver holds PKTBUFSRX packets and one of them is in use while
+ * an ACK is sent, so a larger window would overflow it
+ */
+#define SB_TFTP_MAX_WINDOW	(PKTBUFSRX - 1)
+
+#define TFTP_PORT		69
+#define TFTP_RRQ		1
+#define TFTP_DATA		3
+#define TFTP_ACK		4
+#define TFTP_OACK		6
+
+/**
+ * struct sb_tftp_server - state of the fake TFTP server
+ *
+ * @requested: Window size asked for by the client
+ * @window: Window size in use
+ * @sent: Number of DATA packets sent
+ * @swap_block: Send this block after the one following it, 0 for none
+ * @drop_block: Drop this block, 0 for none
+ */
+struct sb_tftp_server {
+	int requested;
+	int window;
+	int sent;
+	int swap_block;
+	int drop_block;
+};
+
+static struct sb_tftp_server sb_tftp;
+
+static u8 sb_tftp_byte(uint offset)
+{
+	return offset * 13 + (offset >> 9);
+}
+
+/* Queue a UDP reply to @packet, from our TID, returning its payload */
+static void *sb_tftp_reply(struct udevice *dev, void *packet, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *udp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_udp_hdr *udp_send;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return NULL;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+
+	udp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)udp_send, udp->ip_src, udp->ip_dst,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	udp_send->udp_src = htons(SB_TFTP_TID);
+	udp_send->udp_dst = udp->udp_src;
+	udp_send->udp_len = htons(UDP_HDR_SIZE + len);
+	udp_send->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return (void *)udp_send + IP_UDP_HDR_SIZE;
+}
+
+/* Fill in the UDP checksum, so that it is checked on the way in */
+static void sb_tftp_checksum(struct ip_udp_hdr *udp)
+{
+	uint len = ntohs(udp->udp_len);
+	u8 *ptr = (u8 *)&udp->udp_src;
+	ulong sum;
+	uint i;
+
+	sum = IPPROTO_UDP + len;
+	for (i = 0; i < 2; i++) {
+		u32 addr = ntohl(net_read_ip(i ? &udp->ip_dst :
+					     &udp->ip_src).s_addr);
+
+		sum += (addr >> 16) + (addr & 0xffff);
+	}
+	for (i = 0; i < len; i += 2)
+		sum += (ptr[i] << 8) + (i + 1 < len ? ptr[i + 1] : 0);
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	udp->udp_xsum = htons(~sum & 0xffff ?: 0xffff);
+}
+
+static void sb_tftp_send_block(struct udevice *dev, void *packet, int block)
+{
+	uint offset = (block - 1) * SB_TFTP_BLKSIZE;
+	uint size = min_t(uint, SB_TFTP_SIZE - offset, SB_TFTP_BLKSIZE);
+	__be16 *data;
+	int i;
+
+	data = sb_tftp_reply(dev, packet, 4 + size);
+	if (!data)
+		return;
+	data[0] = htons(TFTP_DATA);
+	data[1] = htons(block);
+	for (i = 0; i < size; i++)
+		((u8 *)&data[2])[i] = sb_tftp_byte(offset + i);
+	sb_tftp_checksum((void *)data - IP_UDP_HDR_SIZE);
+	sb_tftp.sent++;
+}
+
+/* Send the window following block @acked, as RFC 7440 asks */
+static void sb_tftp_send_window(struct udevice *dev, void *packet, int acked)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int blocks[SB_TFTP_MAX_WINDOW];
+	int count = 0;
+	int block, i;
+
+	/* Anything still queued is stale; the client only has the ACK'd one */
+	priv->recv_packets = min(priv->recv_packets, 1);
+
+	for (block = acked + 1; block <= SB_TFTP_BLOCKS &&
+	     count < sb_tftp.window; block++) {
+		if (block == sb_tftp.drop_block) {
+			sb_tftp.drop_block = 0;
+			continue;
+		}
+		blocks[count++] = block;
+	}
+	for (i = 0; i + 1 < count; i++) {
+		if (blocks[i] == sb_tftp.swap_block) {
+			blocks[i] = blocks[i + 1];
+			blocks[i + 1] = sb_tftp.swap_block;
+			sb_tftp.swap_block = 0;
+			break;
+		}
+	}
+	for (i = 0; i < count; i++)
+		sb_tftp_send_block(dev, packet, blocks[i]);
+}
+
+static void sb_tftp_rrq(struct udevice *dev, void *packet, char *opts,
+			char *end)
+{
+	bool tsize = false;
+	char oack[64];
+	char *data;
+	int len;
+
+	sb_tftp.requested = 1;
+	for (; opts < end; opts += strlen(opts) + 1) {
+		if (!strcmp(opts, "windowsize"))
+			sb_tftp.requested = dectoul(opts + 11, NULL);
+		else if (!strcmp(opts, "tsize"))
+			tsize = true;
+	}
+	sb_tftp.window = min(sb_tftp.requested, SB_TFTP_MAX_WINDOW);
+
+	len = sprintf(oack, "blksize%c%d", 0, SB_TFTP_BLKSIZE) + 1;
+	if (sb_tftp.requested > 1)
+		len += sprintf(oack + len, "windowsize%c%d", 0,
+			       sb_tftp.window) + 1;
+	if (tsize)
+		len += sprintf(oack + len, "tsize%c%d", 0, SB_TFTP_SIZE) + 1;
+	data = sb_tftp_reply(dev, packet, 2 + len);
+	if (!data)
+		return;
+	*(__be16 *)data = htons(TFTP_OACK);
+	memcpy(data + 2, oack, len);
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *udp = packet + ETHER_HDR_SIZE;
+	__be16 *tftp = (void *)udp + IP_UDP_HDR_SIZE;
+	char *end = packet + len;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || udp->ip_p != IPPROTO_UDP)
+		return -EPROTONOSUPPORT;
+
+	if (ntohs(udp->udp_dst) == TFTP_PORT && ntohs(tftp[0]) == TFTP_RRQ) {
+		char *name = (char *)&tftp[1];
+		char *mode = name + strlen(name) + 1;
+
+		sb_tftp_rrq(dev, packet, mode + strlen(mode) + 1, end);
+	} else if (ntohs(udp->udp_dst) == SB_TFTP_TID &&
+		   ntohs(tftp[0]) == TFTP_ACK) {
+		sb_tftp_send_window(dev, packet, ntohs(tftp[1]));
+	}
+
+	return 0;
+}
+
+/* Load the file, checking that it arrived intact */
+static int sb_tftp_load(struct unit_test_state *uts)
+{
+	sb_tftp.sent = 0;
+	ut_assertok(net_test_load(uts, "tftpboot 0x20000 1.1.2.2:image",
+				  0x20000, SB_TFTP_SIZE, sb_tftp_byte));
+
+	return 0;
+}
+
+static int net_test_tftp_window(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	int window;
+
+	if (SB_TFTP_MAX_WINDOW < 3)
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set_ulong("tftpwindowsize", 3);
+	sb_tftp.swap_block = 0;
+	sb_tftp.drop_block = 0;
+
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(SB_TFTP_BLOCKS, sb_tftp.sent);
+	if (IS_ENABLED(CONFIG_TFTP_STATS)) {
+		ut_asserteq(3, env_get_ulong("tftpwindow", 10, 0));
+		ut_asserteq(0, env_get_ulong("tftpretransmits", 10, -1));
+		ut_asserteq(0, env_get_ulong("tftpreordered", 10, -1));
+		ut_assert(env_get_ulong("tftprate", 10, 0) > 0);
+	}
+
+	/* A block overtaken by the next one is kept, with nothing resent */
+	sb_tftp.swap_block = 7;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(0, sb_tftp.swap_block);
+	ut_asserteq(SB_TFTP_BLOCKS, sb_tftp.sent);
+	if (IS_ENABLED(CONFIG_TFTP_STATS)) {
+		ut_asserteq(0, env_get_ulong("tftpretransmits", 10, -1));
+		ut_asserteq(1, env_get_ulong("tftpreordered", 10, -1));
+	}
+
+	/*
+	 * When a block is lost, the blocks after it are kept; the window is
+	 * sent again once, then the transfer carries on after it
+	 */
+	sb_tftp.drop_block = 10;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(0, sb_tftp.drop_block);
+	ut_asserteq(SB_TFTP_BLOCKS + 3, sb_tftp.sent);
+	if (IS_ENABLED(CONFIG_TFTP_STATS)) {
+		ut_asserteq(1, env_get_ulong("tftpretransmits", 10, -1));
+		ut_asserteq(2, env_get_ulong("tftpreordered", 10, -1));
+	}
+
+	/* The window grows while there is no loss and shrinks after it */
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE)) {
+		env_set("tftpwindowsize", NULL);
+		ut_assertok(sb_tftp_load(uts));
+		window = sb_tftp.requested;
+		ut_assertok(sb_tftp_load(uts));
+		ut_asserteq(min(window * 2, 64), sb_tftp.requested);
+		window = sb_tftp.requested;
+
+		sb_tftp.drop_block = 20;
+		ut_assertok(sb_tftp_load(uts));
+		ut_asserteq(min(window * 2, 64), sb_tftp.requested);
+		window = sb_tftp.requested;
+		ut_assertok(sb_tftp_load(uts));
+		ut_asserteq(window / 2, sb_tftp.requested);
+	}
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_tftp_window, 0);
+
+/* Load the file and return how many KiB were copied for each MiB loaded */
+static int sb_tftp_copies(struct unit_test_state *uts, ulong *kbp)
+{
+	ut_assertok(sb_tftp_load(uts));
+	*kbp = env_get_ulong("tftpcopied", 10, 0) / (SB_TFTP_SIZE / 1024);
+
+	return 0;
+}
+
+static int net_test_tftp_zerocopy(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	ulong before, after;
+
+	if (!IS_ENABLED(CONFIG_TFTP_ZEROCOPY) || !IS_ENABLED(CONFIG_TFTP_STATS))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set_ulong("tftpwindowsize", 3);
+	sb_tftp.swap_block = 0;
+	sb_tftp.drop_block = 0;
+
+	/* Without help from the driver, every byte is copied */
+	sandbox_eth_disable_rx_dest(0, true);
+	ut_assertok(sb_tftp_copies(uts, &before));
+	ut_asserteq(SB_TFTP_SIZE, env_get_ulong("tftpcopied", 10, 0));
+	sandbox_eth_disable_rx_dest(0, false);
+
+	/* With it, only the first block is, since the size isn't known yet */
+	ut_assertok(sb_tftp_copies(uts, &after));
+	ut_asserteq(SB_TFTP_BLKSIZE, env_get_ulong("tftpcopied", 10, 0));
+	ut_assert(after < before / 10);
+
+	/* A block arriving early is copied back out of the wrong place */
+	sb_tftp.swap_block = 7;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(0, sb_tftp.swap_block);
+	ut_asserteq(2 * SB_TFTP_BLKSIZE, env_get_ulong("tftpcopied", 10, 0));
+
+	/* The blocks after a lost one are copied, then placed again */
+	sb_tftp.drop_block = 10;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(0, sb_tftp.drop_block);
+	ut_assert(env_get_ulong("tftpcopied", 10, 0) < SB_TFTP_SIZE / 4);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_tftp_zerocopy, 0);
+
+static int net_test_netwrite(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	struct blk_desc *desc;
+	u8 *buf;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_CMD_NETWRITE))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set_ulong("tftpwindowsize", 3);
+	sb_tftp.drop_block = 0;
+
+	/* A block arriving early is dropped, since the device is in order */
+	sb_tftp.swap_block = 7;
+	ut_assertok(run_command("netwrite tftp mmc 0 10 1.1.2.2:image", 0));
+	ut_asserteq(0, sb_tftp.swap_block);
+	ut_asserteq(SB_TFTP_SIZE, env_get_hex("filesize", 0));
+
+	desc = blk_get_devnum_by_uclass_id(UCLASS_MMC, 0);
+	ut_assertnonnull(desc);
+	buf = malloc(SB_TFTP_BLOCKS * SB_TFTP_BLKSIZE);
+	ut_assertnonnull(buf);
+	ut_asserteq(SB_TFTP_BLOCKS, blk_dread(desc, 0x10, SB_TFTP_BLOCKS,
+					      buf));
+	for (i = 0; i < SB_TFTP_SIZE; i++) {
+		if (buf[i] != sb_tftp_byte(i))
+			break;
+	}
+	ut_asserteq(SB_TFTP_SIZE, i);
+	for (; i < SB_TFTP_BLOCKS * SB_TFTP_BLKSIZE; i++)
+		ut_asserteq(0, buf[i]);
+	free(buf);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_netwrite, 0);
+
+static int net_test_net_stats(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	const struct net_proto_stats *s;
+	struct udevice *dev;
+
+	if (!IS_ENABLED(CONFIG_NET_STATS))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set_ulong("tftpwindowsize", 3);
+	sb_tftp.drop_block = 0;
+	ut_assertok(run_command("net stats reset", 0));
+	s = &net_stats_get()->proto[NET_STATS_TFTP];
+
+	/* A block overtaken by the next one is counted, with nothing resent */
+	sb_tftp.swap_block = 7;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(1, s->transfers);
+	ut_asserteq(SB_TFTP_BLOCKS, s->rx_packets);
+	ut_asserteq(SB_TFTP_SIZE, s->rx_bytes);
+	ut_asserteq(1, s->ooo);
+	ut_asserteq(0, s->retransmits);
+	ut_assert(s->rtt_count > 0);
+	ut_assert(s->rtt_min <= s->rtt_max);
+	ut_assert(s->rate_count > 0);
+
+	/* A lost block is asked for again, and resent blocks are duplicates */
+	sb_tftp.drop_block = 10;
+	ut_assertok(sb_tftp_load(uts));
+	ut_asserteq(2, s->transfers);
+	ut_asserteq(2 * SB_TFTP_BLOCKS, s->rx_packets);
+	ut_asserteq(2 * SB_TFTP_SIZE, s->rx_bytes);
+	ut_asserteq(1, s->retransmits);
+	ut_asserteq(0, net_stats_get()->proto[NET_STATS_NFS].transfers);
+
+	console_record_reset_enable();
+	ut_assertok(run_command("net stats", 0));
+	ut_assert_nextlinen("Proto");
+	ut_assert_nextlinen("tftp       2 %8d", 2 * SB_TFTP_BLOCKS);
+	ut_assert_nextlinen("nfs        0        0");
+	ut_assert_skipline();
+	ut_assert_skipline();
+	ut_assert_nextline("Driver RX drops: 0");
+	ut_assert_nextline("KiB/s over the last transfer:");
+	ut_assert_nextlinen("tftp ");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("net stats reset", 0));
+	ut_asserteq(0, s->transfers);
+
+	/* drops are not known for a driver which does not count them */
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000", &dev));
+	eth_set_offload(dev, 0);
+	ut_assertok(sb_tftp_load(uts));
+	eth_set_offload(dev, ETH_OFFLOAD_RX_DROPS);
+	console_record_reset_enable();
+	ut_assertok(run_command("net stats", 0));
+	ut_assert_skip_to_line("Driver RX drops: n/a");
+	ut_assertok(run_command("net stats reset", 0));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_net_stats, 0);
@@ -6,13 +6,16 @@
  * Ying-Chun Liu (PaulLiu) <paul.liu@linaro.org>
  */
 
+#include <blk.h>
 #include <command.h>
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <net/stats.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <asm/eth.h>
@@ -22,31 +25,12 @@
 #include <test/cmd.h>
 #include <test/test.h>
 #include <test/ut.h>
+#include "net_common.h"
 
 #define SHIFT_TO_TCPHDRLEN_FIELD(x) ((x) << 4)
 #define LEN_B_TO_DW(x) ((x) >> 2)
 #define GET_TCP_HDR_LEN_IN_BYTES(x) ((x) >> 2)
 
-static int sb_arp_handler(struct udevice *dev, void *packet,
-			  unsigned int len)
-{
-	struct eth_sandbox_priv *priv = dev_get_priv(dev);
-	struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
-	int ret = 0;
-
-	if (ntohs(arp->ar_op) == ARPOP_REQUEST) {
-		priv->fake_host_ipaddr = net_read_ip(&arp->ar_spa);
-
-		ret = sandbox_eth_recv_arp_req(dev);
-		if (ret)
-			return ret;
-		ret = sandbox_eth_arp_req_to_reply(dev, packet, len);
-		return ret;
-	}
-
-	return -EPROTONOSUPPORT;
-}
-
 static int sb_syn_handler(struct udevice *dev, void *packet,
 			  unsigned int len)
 {
@@ -196,7 +180,7 @@ static int sb_http_handler(struct udevice *dev, void *packet,
 	struct ip_tcp_hdr *tcp;
 
 	if (ntohs(eth->et_protlen) == PROT_ARP) {
-		return sb_arp_handler(dev, packet, len);
+		return sandbox_eth_arp_handler(dev, packet, len);
 	} else if (ntohs(eth->et_protlen) == PROT_IP) {
 		ip = packet + ETHER_HDR_SIZE;
 		if (ip->ip_p == IPPROTO_TCP) {
@@ -242,6 +226,801 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 CMD_TEST(net_test_wget, UTF_CONSOLE);
 
+#define SB_WGET_SIZE		(256 * 1024 + 100)
+#define SB_WGET_SEG		TCP_MSS
+
+/**
+ * struct sb_wget_server - state of the HTTP server sending a large file
+ *
+ * Offsets are into the response, which is the HTTP header then the file.
+ *
+ * @irs: Initial sequence number of the client
+ * @iss: Initial sequence number of the server
+ * @rcv_nxt: Next sequence number expected from the client
+ * @hdr: HTTP response header
+ * @len: Length of the response
+ * @wnd_scale: Window scale sent by the client, -1 if none
+ * @max_wnd: Largest window advertised by the client, in bytes
+ * @snd_nxt: Offset of the next new data to send
+ * @acked: Offset acknowledged by the client
+ * @dup_acks: Number of duplicate ACKs received in a row
+ * @segments: Number of data segments sent, including resends
+ * @resent: Number of data segments sent again
+ * @fin_sent: True if the FIN has been sent
+ * @swap_offset: Send the segment at this offset after the one following it,
+ *	-1 for none
+ * @drop_offset: Drop the first copy of the segment at this offset, -1 for
+ *	none
+ * @rewind: On a fast retransmit, send everything from the missing segment
+ *	on again, as a sender does when the segments after it are not taken
+ */
+struct sb_wget_server {
+	u32 irs;
+	u32 iss;
+	u32 rcv_nxt;
+	char hdr[128];
+	uint len;
+	int wnd_scale;
+	uint max_wnd;
+	uint snd_nxt;
+	uint acked;
+	int dup_acks;
+	int segments;
+	int resent;
+	bool fin_sent;
+	int swap_offset;
+	int drop_offset;
+	bool rewind;
+};
+
+static struct sb_wget_server sb_wget;
+
+static u8 sb_wget_byte(uint offset)
+{
+	return offset * 13 + (offset >> 12);
+}
+
+/* Queue a segment of the response, with @len bytes at @offset */
+static int sb_wget_send(struct udevice *dev, struct ip_tcp_hdr *tcp,
+			u8 flags, uint offset, int len, const u8 *opt,
+			int opt_len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	u8 *data;
+	int pkt_len, i;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(sb_wget.iss + 1 + offset);
+	tcp_send->tcp_ack = htonl(sb_wget.rcv_nxt);
+	tcp_send->tcp_hlen =
+		SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE + opt_len));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS);
+	tcp_send->tcp_ugr = 0;
+
+	data = (void *)tcp_send + IP_TCP_HDR_SIZE;
+	memcpy(data, opt, opt_len);
+	data += opt_len;
+	for (i = 0; i < len; i++, offset++) {
+		if (offset < strlen(sb_wget.hdr))
+			data[i] = sb_wget.hdr[offset];
+		else
+			data[i] = sb_wget_byte(offset - strlen(sb_wget.hdr));
+	}
+	if (len)
+		sb_wget.segments++;
+
+	pkt_len = IP_TCP_HDR_SIZE + opt_len + len;
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src, tcp->ip_dst,
+						   pkt_len - IP_HDR_SIZE,
+						   pkt_len);
+	net_set_ip_header((uchar *)tcp_send, tcp->ip_src, tcp->ip_dst,
+			  pkt_len, IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int sb_wget_send_data(struct udevice *dev, struct ip_tcp_hdr *tcp,
+			     uint offset)
+{
+	return sb_wget_send(dev, tcp, TCP_ACK, offset,
+			    min_t(uint, SB_WGET_SEG, sb_wget.len - offset), NULL,
+			    0);
+}
+
+static void sb_wget_syn(struct udevice *dev, struct ip_tcp_hdr *tcp,
+			int hdr_len)
+{
+	static const u8 opt[] = { TCP_1_NOP, TCP_O_SCL, TCP_OPT_LEN_3, 0 };
+	u8 *o = (void *)tcp + IP_TCP_HDR_SIZE;
+	int i;
+
+	sb_wget.irs = ntohl(tcp->tcp_seq);
+	sb_wget.iss = ~sb_wget.irs;
+	sb_wget.rcv_nxt = sb_wget.irs + 1;
+	sb_wget.wnd_scale = -1;
+	for (i = 0; i < hdr_len - TCP_HDR_SIZE && o[i] != TCP_O_END;) {
+		if (o[i] == TCP_1_NOP) {
+			i++;
+			continue;
+		}
+		if (o[i] == TCP_O_SCL)
+			sb_wget.wnd_scale = o[i + 2];
+		i += o[i + 1];
+	}
+
+	/* the SYN takes the sequence number just before the response */
+	sb_wget_send(dev, tcp, TCP_SYN | TCP_ACK, -1, 0, opt, sizeof(opt));
+}
+
+/* Send what the client's window and the receive queue allow */
+static void sb_wget_push(struct udevice *dev, struct ip_tcp_hdr *tcp,
+			 uint wnd)
+{
+	uint offset;
+
+	while (sb_wget.snd_nxt < sb_wget.len &&
+	       sb_wget.snd_nxt + SB_WGET_SEG <= sb_wget.acked + wnd) {
+		offset = sb_wget.snd_nxt;
+		if (offset == sb_wget.drop_offset) {
+			sb_wget.drop_offset = -1;
+			sb_wget.segments++;
+		} else if (offset == sb_wget.swap_offset &&
+			   offset + SB_WGET_SEG < sb_wget.len) {
+			struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+			if (priv->recv_packets + 2 > PKTBUFSRX)
+				return;
+			sb_wget.swap_offset = -1;
+			sb_wget_send_data(dev, tcp, offset + SB_WGET_SEG);
+			sb_wget_send_data(dev, tcp, offset);
+			sb_wget.snd_nxt += SB_WGET_SEG;
+		} else if (sb_wget_send_data(dev, tcp, offset)) {
+			return;
+		}
+		sb_wget.snd_nxt += SB_WGET_SEG;
+	}
+	sb_wget.snd_nxt = min(sb_wget.snd_nxt, sb_wget.len);
+
+	if (sb_wget.acked == sb_wget.len && !sb_wget.fin_sent &&
+	    !sb_wget_send(dev, tcp, TCP_ACK | TCP_FIN, sb_wget.len, 0, NULL,
+			  0))
+		sb_wget.fin_sent = true;
+}
+
+static int sb_wget_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int hdr_len, data_len;
+	uint acked, wnd;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	hdr_len = GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+	if (tcp->tcp_flags == TCP_SYN) {
+		sb_wget_syn(dev, tcp, hdr_len);
+		return 0;
+	}
+	if (!(tcp->tcp_flags & TCP_ACK))
+		return 0;
+
+	/* the GET request, or the client's FIN */
+	data_len = ntohs(tcp->ip_len) - IP_HDR_SIZE - hdr_len;
+	if (tcp->tcp_flags & TCP_FIN)
+		data_len++;
+	if (data_len) {
+		sb_wget.rcv_nxt = ntohl(tcp->tcp_seq) + data_len;
+		if (tcp->tcp_flags & TCP_FIN) {
+			sb_wget_send(dev, tcp, TCP_ACK, sb_wget.len + 1, 0,
+				     NULL, 0);
+			return 0;
+		}
+	}
+
+	wnd = ntohs(tcp->tcp_win);
+	if (sb_wget.wnd_scale > 0)
+		wnd <<= sb_wget.wnd_scale;
+	sb_wget.max_wnd = max(sb_wget.max_wnd, wnd);
+
+	acked = min(ntohl(tcp->tcp_ack) - sb_wget.iss - 1, sb_wget.len);
+	if (acked > sb_wget.acked) {
+		sb_wget.acked = acked;
+		sb_wget.dup_acks = 0;
+	} else if (!data_len && acked < sb_wget.snd_nxt &&
+		   ++sb_wget.dup_acks == 2) {
+		/* fast retransmit of the first missing segment */
+		sb_wget.resent++;
+		if (sb_wget.rewind)
+			sb_wget.snd_nxt = acked;
+		else
+			sb_wget_send_data(dev, tcp, acked);
+	}
+
+	sb_wget_push(dev, tcp, wnd);
+
+	return 0;
+}
+
+/* Download the file and check what arrived */
+static int sb_wget_load(struct unit_test_state *uts, int swap_offset,
+			int drop_offset)
+{
+	memset(&sb_wget, '\0', sizeof(sb_wget));
+	sb_wget.swap_offset = swap_offset;
+	sb_wget.drop_offset = drop_offset;
+	snprintf(sb_wget.hdr, sizeof(sb_wget.hdr),
+		 "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+		 SB_WGET_SIZE);
+	sb_wget.len = strlen(sb_wget.hdr) + SB_WGET_SIZE;
+
+	ut_assertok(net_test_load(uts, "wget 0x20000 1.1.2.2:/image", 0x20000,
+				  SB_WGET_SIZE, sb_wget_byte));
+	ut_assert(sb_wget.fin_sent);
+
+	return 0;
+}
+
+static int net_test_wget_window(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	uint wnd = CONFIG_PROT_TCP_RCV_WND * TCP_MSS;
+	ulong acks;
+	int segs, scale;
+
+	sandbox_eth_set_tx_handler(0, sb_wget_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	ut_assertok(sb_wget_load(uts, -1, -1));
+	segs = DIV_ROUND_UP(sb_wget.len, SB_WGET_SEG);
+	ut_asserteq(segs, sb_wget.segments);
+	acks = env_get_ulong("wgetacks", 10, 0);
+
+	/* the window is scaled if it does not fit in 16 bits */
+	scale = sb_wget.wnd_scale;
+	ut_assert(scale >= 0);
+	ut_asserteq(wnd > 0xffff, scale > 0);
+	ut_asserteq(wnd >> scale << scale, sb_wget.max_wnd);
+
+	/* one ACK for every CONFIG_PROT_TCP_ACK_SEGS segments */
+	ut_asserteq(0, sb_wget.resent);
+	ut_assert(acks >= segs / CONFIG_PROT_TCP_ACK_SEGS);
+	ut_assert(acks <= segs / CONFIG_PROT_TCP_ACK_SEGS + 8);
+
+	/* a segment received ahead of its turn is kept */
+	ut_assertok(sb_wget_load(uts, 64 * SB_WGET_SEG, -1));
+	ut_asserteq(-1, sb_wget.swap_offset);
+	ut_asserteq(0, sb_wget.resent);
+	ut_asserteq(1, env_get_ulong("wgetreordered", 10, 0));
+
+	/* after a loss, only the missing segment is sent again */
+	if (IS_ENABLED(CONFIG_NET_STATS))
+		net_stats_reset();
+	ut_assertok(sb_wget_load(uts, -1, 100 * SB_WGET_SEG));
+	ut_asserteq(-1, sb_wget.drop_offset);
+	ut_asserteq(1, sb_wget.resent);
+	ut_asserteq(segs + 1, sb_wget.segments);
+	ut_assert(env_get_ulong("wgetreordered", 10, 0) >= 1);
+
+	/* TCP counts each byte of the response once, as it is kept */
+	if (IS_ENABLED(CONFIG_NET_STATS)) {
+		const struct net_proto_stats *s;
+
+		s = &net_stats_get()->proto[NET_STATS_TCP];
+		ut_asserteq(segs, s->rx_packets);
+		ut_asserteq(sb_wget.len, s->rx_bytes);
+		net_stats_reset();
+	}
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_window, 0);
+
+static int net_test_wget_netwrite(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	int blks = DIV_ROUND_UP(SB_WGET_SIZE, 512);
+	struct blk_desc *desc;
+	u8 *buf;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_CMD_NETWRITE))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_wget_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/*
+	 * The segment holding the header is lost, so the ones after it arrive
+	 * first. They must not reach the device ahead of the data before them,
+	 * so they are refused and sent again.
+	 */
+	memset(&sb_wget, '\0', sizeof(sb_wget));
+	sb_wget.swap_offset = -1;
+	sb_wget.drop_offset = 0;
+	sb_wget.rewind = true;
+	snprintf(sb_wget.hdr, sizeof(sb_wget.hdr),
+		 "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+		 SB_WGET_SIZE);
+	sb_wget.len = strlen(sb_wget.hdr) + SB_WGET_SIZE;
+	ut_assertok(run_command("netwrite wget mmc 0 10 1.1.2.2:/image", 0));
+	ut_asserteq(-1, sb_wget.drop_offset);
+	ut_asserteq(SB_WGET_SIZE, env_get_hex("filesize", 0));
+
+	desc = blk_get_devnum_by_uclass_id(UCLASS_MMC, 0);
+	ut_assertnonnull(desc);
+	buf = malloc(blks * 512);
+	ut_assertnonnull(buf);
+	ut_asserteq(blks, blk_dread(desc, 0x10, blks, buf));
+	for (i = 0; i < SB_WGET_SIZE; i++) {
+		if (buf[i] != sb_wget_byte(i))
+			break;
+	}
+	ut_asserteq(SB_WGET_SIZE, i);
+	free(buf);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_netwrite, 0);
+
+#define SB_RANGE_CONNS		8
+#define SB_RANGE_PORT		80
+/* Leave room in the receive queue to answer a SYN or FIN promptly */
+#define SB_RANGE_QUEUE		(PKTBUFSRX - 1)
+
+/**
+ * struct sb_range_conn - a connection to the server sending ranges
+ *
+ * Offsets are into the response, which is the HTTP header then the data.
+ *
+ * @port: Port of the client, 0 if the slot is free
+ * @iss: Initial sequence number of the server
+ * @rcv_nxt: Next sequence number expected from the client
+ * @hdr: HTTP response header, empty until the request is received
+ * @start: Offset in the file of the first byte sent
+ * @len: Length of the response
+ * @snd_nxt: Offset of the next new data to send
+ * @acked: Offset acknowledged by the client
+ * @syn_sent: True if the SYN has been answered, false if the reply is waiting
+ *	for room in the receive queue
+ * @fin_sent: True if the FIN has been sent
+ * @fin_rcvd: True if the client has sent its FIN
+ * @closed: True once the client has closed the connection
+ */
+struct sb_range_conn {
+	u16 port;
+	u32 iss;
+	u32 rcv_nxt;
+	char hdr[160];
+	uint start;
+	uint len;
+	uint snd_nxt;
+	uint acked;
+	bool syn_sent;
+	bool fin_sent;
+	bool fin_rcvd;
+	bool closed;
+};
+
+/**
+ * struct sb_range_server - state of the HTTP server supporting ranges
+ *
+ * @conns: Connections from the client
+ * @size: Size of the file
+ * @ranges: True to honour the Range header, false to always send the file
+ * @cwnd: Number of segments to send on a connection before an ACK arrives
+ * @turn: Connection to send first when pushing data
+ * @requests: Number of requests received
+ * @open: Number of connections open at present
+ * @max_open: Largest number of connections open at once
+ * @max_in_flight: Largest number of data segments sent and not acknowledged
+ *	yet, over all the connections
+ * @done_calls: Number of calls to the range_done() hook
+ * @done_bytes: Number of bytes reported to the range_done() hook
+ * @fail_offset: Fail the range_done() hook for this offset, -1 for none
+ */
+struct sb_range_server {
+	struct sb_range_conn conns[SB_RANGE_CONNS];
+	int size;
+	bool ranges;
+	uint cwnd;
+	uint turn;
+	int requests;
+	int open;
+	int max_open;
+	int max_in_flight;
+	int done_calls;
+	ulong done_bytes;
+	long fail_offset;
+};
+
+static struct sb_range_server sb_range;
+
+/* Queue a segment on @conn, with @len bytes at @offset */
+static int sb_range_send(struct udevice *dev, struct sb_range_conn *conn,
+			 u8 flags, uint offset, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct in_addr server_ip = string_to_ip("1.1.2.2");
+	uint hdr_len = strlen(conn->hdr);
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	u8 *data;
+	int pkt_len, i;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = htons(SB_RANGE_PORT);
+	tcp_send->tcp_dst = htons(conn->port);
+	tcp_send->tcp_seq = htonl(conn->iss + 1 + offset);
+	tcp_send->tcp_ack = htonl(conn->rcv_nxt);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS);
+	tcp_send->tcp_ugr = 0;
+
+	data = (void *)tcp_send + IP_TCP_HDR_SIZE;
+	for (i = 0; i < len; i++, offset++) {
+		if (offset < hdr_len)
+			data[i] = conn->hdr[offset];
+		else
+			data[i] = sb_wget_byte(conn->start + offset - hdr_len);
+	}
+
+	pkt_len = IP_TCP_HDR_SIZE + len;
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   server_ip, net_ip,
+						   pkt_len - IP_HDR_SIZE,
+						   pkt_len);
+	net_set_ip_header((uchar *)tcp_send, net_ip, server_ip, pkt_len,
+			  IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Build the response to a GET, sending a range if one is asked for */
+static void sb_range_request(struct sb_range_conn *conn, const char *req,
+			     int len)
+{
+	char buf[256];
+	ulong first = 0, last = sb_range.size - 1;
+	char *pos;
+
+	len = min_t(int, len, sizeof(buf) - 1);
+	memcpy(buf, req, len);
+	buf[len] = '\0';
+	pos = strstr(buf, "Range: bytes=");
+	sb_range.requests++;
+	if (pos && sb_range.ranges) {
+		first = simple_strtoul(pos + 13, &pos, 10);
+		last = min_t(ulong, simple_strtoul(pos + 1, NULL, 10),
+			     sb_range.size - 1);
+		snprintf(conn->hdr, sizeof(conn->hdr),
+			 "HTTP/1.1 206 Partial Content\r\n"
+			 "Content-Range: bytes %lu-%lu/%d\r\n"
+			 "Content-Length: %lu\r\n\r\n", first, last,
+			 sb_range.size, last - first + 1);
+	} else {
+		snprintf(conn->hdr, sizeof(conn->hdr),
+			 "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+			 sb_range.size);
+	}
+	conn->start = first;
+	conn->len = strlen(conn->hdr) + last - first + 1;
+}
+
+/* Check if the client still has data to acknowledge on any connection */
+static bool sb_range_in_flight(void)
+{
+	struct sb_range_conn *conn;
+
+	for (conn = sb_range.conns; conn < sb_range.conns + SB_RANGE_CONNS;
+	     conn++) {
+		if (conn->port && !conn->closed && conn->snd_nxt > conn->acked)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Send what each connection's window allows, taking turns between them. While
+ * an ACK is still to come, a small window is held back until it all fits in
+ * the receive queue, so that the client does not wait to acknowledge a lone
+ * segment.
+ */
+static void sb_range_push(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_range_conn *conn;
+	uint end, seg;
+	int segs, i;
+
+	for (i = 0; i < SB_RANGE_CONNS; i++) {
+		conn = &sb_range.conns[(sb_range.turn + i) % SB_RANGE_CONNS];
+		if (!conn->port || conn->closed)
+			continue;
+
+		/* the SYN takes the sequence number just before the response */
+		if (!conn->syn_sent) {
+			conn->syn_sent = !sb_range_send(dev, conn,
+							TCP_SYN | TCP_ACK, -1,
+							0);
+			continue;
+		}
+		if (conn->fin_rcvd) {
+			if (!sb_range_send(dev, conn, TCP_ACK, conn->len + 1,
+					   0)) {
+				conn->closed = true;
+				sb_range.open--;
+			}
+			continue;
+		}
+		if (!conn->len)
+			continue;
+		end = min(conn->len, conn->acked + sb_range.cwnd * SB_WGET_SEG);
+		segs = DIV_ROUND_UP(end - min(conn->snd_nxt, end), SB_WGET_SEG);
+		if (segs <= SB_RANGE_QUEUE &&
+		    priv->recv_packets + segs > SB_RANGE_QUEUE &&
+		    sb_range_in_flight())
+			continue;
+		while (conn->snd_nxt < end &&
+		       priv->recv_packets < SB_RANGE_QUEUE) {
+			seg = min_t(uint, SB_WGET_SEG, end - conn->snd_nxt);
+			sb_range_send(dev, conn, TCP_ACK, conn->snd_nxt, seg);
+			conn->snd_nxt += seg;
+		}
+		if (conn->acked == conn->len && !conn->fin_sent &&
+		    !sb_range_send(dev, conn, TCP_ACK | TCP_FIN, conn->len, 0))
+			conn->fin_sent = true;
+	}
+	sb_range.turn++;
+
+	for (segs = 0, i = 0; i < SB_RANGE_CONNS; i++) {
+		conn = &sb_range.conns[i];
+		if (conn->port && !conn->closed && conn->snd_nxt > conn->acked)
+			segs += DIV_ROUND_UP(conn->snd_nxt - conn->acked,
+					     SB_WGET_SEG);
+	}
+	sb_range.max_in_flight = max(sb_range.max_in_flight, segs);
+}
+
+static void sb_range_syn(struct udevice *dev, struct ip_tcp_hdr *tcp)
+{
+	struct sb_range_conn *conn;
+
+	/* the client sends the SYN again if no reply comes in time */
+	for (conn = sb_range.conns; conn < sb_range.conns + SB_RANGE_CONNS;
+	     conn++) {
+		if (conn->port == ntohs(tcp->tcp_src) && !conn->closed)
+			goto reply;
+	}
+	for (conn = sb_range.conns; conn < sb_range.conns + SB_RANGE_CONNS;
+	     conn++) {
+		if (!conn->port || conn->closed)
+			break;
+	}
+	if (conn == sb_range.conns + SB_RANGE_CONNS)
+		return;
+
+	memset(conn, '\0', sizeof(*conn));
+	conn->port = ntohs(tcp->tcp_src);
+	conn->iss = ~ntohl(tcp->tcp_seq);
+	conn->rcv_nxt = ntohl(tcp->tcp_seq) + 1;
+	sb_range.open++;
+	sb_range.max_open = max(sb_range.max_open, sb_range.open);
+
+reply:
+	conn->syn_sent = false;
+	sb_range_push(dev);
+}
+
+static int sb_range_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct sb_range_conn *conn;
+	int hdr_len, data_len;
+	uint acked;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	if (tcp->tcp_flags == TCP_SYN) {
+		sb_range_syn(dev, tcp);
+		return 0;
+	}
+
+	for (conn = sb_range.conns; conn < sb_range.conns + SB_RANGE_CONNS;
+	     conn++) {
+		if (conn->port == ntohs(tcp->tcp_src) && !conn->closed)
+			break;
+	}
+	if (conn == sb_range.conns + SB_RANGE_CONNS)
+		return 0;
+	if ((tcp->tcp_flags & TCP_RST) || !(tcp->tcp_flags & TCP_ACK)) {
+		conn->closed = true;
+		sb_range.open--;
+		return 0;
+	}
+
+	/* the GET request, or the client's FIN */
+	hdr_len = GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+	data_len = ntohs(tcp->ip_len) - IP_HDR_SIZE - hdr_len;
+	if (data_len && !conn->len)
+		sb_range_request(conn, (void *)tcp + IP_HDR_SIZE + hdr_len,
+				 data_len);
+	if (tcp->tcp_flags & TCP_FIN) {
+		conn->fin_rcvd = true;
+		data_len++;
+	}
+	if (data_len)
+		conn->rcv_nxt = ntohl(tcp->tcp_seq) + data_len;
+
+	acked = min(ntohl(tcp->tcp_ack) - conn->iss - 1, conn->len);
+	conn->acked = max(conn->acked, acked);
+	sb_range_push(dev);
+
+	return 0;
+}
+
+static int sb_range_done(struct wget_http_info *info, ulong addr,
+			 ulong offset, ulong len)
+{
+	u8 *buf = map_sysmem(addr, len);
+	ulong i;
+
+	for (i = 0; i < len && buf[i] == sb_wget_byte(offset + i); i++)
+		;
+	unmap_sysmem(buf);
+	if (i != len)
+		return -EINVAL;
+
+	sb_range.done_calls++;
+	sb_range.done_bytes += len;
+
+	return offset == sb_range.fail_offset ? -EIO : 0;
+}
+
+/* Download the file over @conns connections and check what arrived */
+static int sb_range_load(struct unit_test_state *uts, int conns)
+{
+	sb_range.requests = 0;
+	sb_range.open = 0;
+	sb_range.max_open = 0;
+	sb_range.max_in_flight = 0;
+	sb_range.done_calls = 0;
+	sb_range.done_bytes = 0;
+	memset(sb_range.conns, '\0', sizeof(sb_range.conns));
+	env_set_ulong("wgetconnections", conns);
+	ut_assertok(net_test_load(uts, "wget 0x20000 1.1.2.2:/image", 0x20000,
+				  sb_range.size, sb_wget_byte));
+
+	return 0;
+}
+
+/* Check the range_done() hook, which the caller must remove afterwards */
+static int sb_range_check_done(struct unit_test_state *uts, ulong range)
+{
+	/* each range is fetched on its own connection, several at once */
+	default_wget_info.range_done = sb_range_done;
+	ut_assertok(sb_range_load(uts, 4));
+	ut_asserteq(DIV_ROUND_UP(SB_WGET_SIZE, range), sb_range.requests);
+	ut_asserteq(sb_range.requests, sb_range.done_calls);
+	ut_asserteq(SB_WGET_SIZE, sb_range.done_bytes);
+	ut_assert(sb_range.max_open > 1);
+
+	/* a range which does not verify stops the transfer */
+	sb_range.fail_offset = 3 * range;
+	ut_asserteq(1, run_command("wget 0x20000 1.1.2.2:/image", 0));
+
+	return 0;
+}
+
+static int net_test_wget_ranges(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	ulong range = 0x8000;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_WGET_RANGES) || CONFIG_PROT_TCP_STREAMS < 4)
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, sb_range_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set_hex("wgetrangesize", range);
+	sb_range.size = SB_WGET_SIZE;
+	sb_range.ranges = true;
+	sb_range.cwnd = 64;
+	sb_range.fail_offset = -1;
+
+	/* the hook is global, so remove it even if the check fails */
+	ret = sb_range_check_done(uts, range);
+	default_wget_info.range_done = NULL;
+	sb_range.fail_offset = -1;
+	ut_assertok(ret);
+
+	/* a server which ignores the Range header sends the whole file */
+	sb_range.ranges = false;
+	ut_assertok(sb_range_load(uts, 4));
+	ut_asserteq(1, sb_range.requests);
+	ut_asserteq(1, sb_range.max_open);
+	sb_range.ranges = true;
+
+	/*
+	 * With a window of one segment on each connection, a single
+	 * connection waits for every segment to be acknowledged, while
+	 * several keep a segment each in flight
+	 */
+	sb_range.size = 64 * 1024;
+	sb_range.cwnd = 1;
+	env_set_hex("wgetrangesize", sb_range.size / 4);
+	ut_assertok(sb_range_load(uts, 1));
+	ut_asserteq(1, sb_range.requests);
+	ut_asserteq(1, sb_range.max_in_flight);
+	ut_assertok(sb_range_load(uts, 4));
+	ut_asserteq(4, sb_range.requests);
+	ut_asserteq(4, sb_range.max_in_flight);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("wgetconnections", NULL);
+	env_set("wgetrangesize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_ranges, 0);
+
 static int net_test_wget_uri_validate(struct unit_test_state *uts)
 {
 	ut_asserteq(true, wget_validate_uri("http://foo.com/bar.html"));
@@ -4,13 +4,21 @@
  */
 
 #include <blk.h>
+#include <blk_stream.h>
 #include <dm.h>
+#include <gzip.h>
+#include <malloc.h>
+#include <os.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
+#include <uthread.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
+#include <asm/unaligned.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
+#include <linux/sizes.h>
 #include <test/test.h>
 #include <test/ut.h>
 
@@ -294,3 +302,590 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Test the hashed block cache, including partial hits and eviction */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats devs[3];
+	struct block_cache_stats stats;
+	char data[16 * 512], buf[16 * 512];
+	int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7 + i / 512;
+
+	/* 8 entries of up to 8 blocks, at most 16 blocks of data */
+	blkcache_configure(8, 8, 16 * 512);
+
+	/* full hit inside an entry */
+	blkcache_fill(UCLASS_HOST, 0, 100, 8, 512, data);
+	ut_asserteq(2, blkcache_read(UCLASS_HOST, 0, 102, 2, 512, buf));
+	ut_assertok(memcmp(data + 2 * 512, buf, 2 * 512));
+
+	/* partial hit: only the first three blocks are cached */
+	ut_asserteq(3, blkcache_read(UCLASS_HOST, 0, 105, 6, 512, buf));
+	ut_assertok(memcmp(data + 5 * 512, buf, 3 * 512));
+
+	/* same blocks on another device are a miss */
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 1, 102, 2, 512, buf));
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 2, 102, 2, 512, buf));
+
+	/* an entry crossing into the next hash chunk is still found */
+	blkcache_fill(UCLASS_HOST, 1, 6, 4, 512, data);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 1, 9, 1, 512, buf));
+	ut_assertok(memcmp(data + 3 * 512, buf, 512));
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(1, stats.partials);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(2, stats.entries);
+	ut_asserteq(12 * 512, stats.bytes);
+
+	/* misses on a device with nothing cached only count in the totals */
+	ut_asserteq(2, blkcache_dev_stats(devs, ARRAY_SIZE(devs)));
+	ut_asserteq(0, devs[0].devnum);
+	ut_asserteq(1, devs[0].hits);
+	ut_asserteq(1, devs[0].partials);
+	ut_asserteq(0, devs[0].misses);
+	ut_asserteq(8 * 512, devs[0].bytes);
+	ut_asserteq(1, devs[1].devnum);
+	ut_asserteq(1, devs[1].hits);
+	ut_asserteq(0, devs[1].misses);
+
+	/* the byte budget evicts from the device holding the most data */
+	blkcache_fill(UCLASS_HOST, 1, 200, 8, 512, data);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 0, 100, 1, 512, buf));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 1, 9, 1, 512, buf));
+	ut_asserteq(8, blkcache_read(UCLASS_HOST, 1, 200, 8, 512, buf));
+	ut_assertok(memcmp(data, buf, 8 * 512));
+
+	/* invalidation only affects the given device */
+	blkcache_fill(UCLASS_HOST, 0, 300, 2, 512, data);
+	blkcache_invalidate(UCLASS_HOST, 1);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 1, 200, 1, 512, buf));
+	ut_asserteq(2, blkcache_read(UCLASS_HOST, 0, 300, 2, 512, buf));
+
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.entries);
+	ut_asserteq(2 * 512, stats.bytes);
+
+	/* restore the defaults */
+	blkcache_configure(32, 128, SZ_2M);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
+#endif
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/* Test read-ahead on a host device */
+static int dm_test_blk_readahead(struct unit_test_state *uts)
+{
+	const int size = 1024 * DEFAULT_BLKSZ;
+	struct blk_readahead_stats stats;
+	struct udevice *dev, *blk;
+	char buf[8 * DEFAULT_BLKSZ];
+	struct blk_desc *desc;
+	lbaint_t start;
+	char *data;
+	int i;
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 13 + i / DEFAULT_BLKSZ;
+	ut_assertok(os_write_file("blk_ra.img", data, size));
+
+	ut_assertok(host_create_device("ra", true, DEFAULT_BLKSZ, &dev));
+	ut_assertok(host_attach_file(dev, "blk_ra.img"));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+	ut_assertok(blk_readahead_configure(blk, 64));
+
+	/* drop anything cached while probing for partitions */
+	blkcache_invalidate(desc->uclass_id, desc->devnum);
+
+	/*
+	 * Read sequentially in small chunks, yielding after each one as a
+	 * caller does while it processes the data
+	 */
+	for (start = 0; start < 512; start += 8) {
+		ut_asserteq(8, blk_dread(desc, start, 8, buf));
+		ut_assertok(memcmp(data + start * DEFAULT_BLKSZ, buf,
+				   sizeof(buf)));
+		uthread_schedule();
+	}
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(8, stats.prefetches);
+	ut_asserteq(512, stats.blocks);
+	ut_asserteq(512 - 16, stats.used);
+	ut_asserteq(16, stats.misses);
+	ut_asserteq(0, stats.waits);
+
+	/* without yielding, the caller waits for the read-ahead */
+	for (; start < 544; start += 8) {
+		ut_asserteq(8, blk_dread(desc, start, 8, buf));
+		ut_assertok(memcmp(data + start * DEFAULT_BLKSZ, buf,
+				   sizeof(buf)));
+	}
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(1, stats.waits);
+	ut_asserteq(512 + 16, stats.used);
+	ut_asserteq(16, stats.misses);
+
+	/* a write discards the read-ahead data */
+	ut_asserteq(1, blk_dwrite(desc, 1000, 1, buf));
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(1, stats.discarded);
+	ut_asserteq(8, blk_dread(desc, start, 8, buf));
+	ut_assertok(memcmp(data + start * DEFAULT_BLKSZ, buf, sizeof(buf)));
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(512 + 16, stats.used);
+	ut_asserteq(16 + 8, stats.misses);
+
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+	ut_assertok(os_unlink("blk_ra.img"));
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead, UTF_SCAN_FDT);
+
+/* Read @count blocks at @start and check them against @data */
+static int ra_check_read(struct unit_test_state *uts, struct blk_desc *desc,
+			 lbaint_t start, lbaint_t count, const char *data)
+{
+	char buf[8 * DEFAULT_BLKSZ];
+
+	ut_asserteq(count, blk_dread(desc, start, count, buf));
+	ut_assertok(memcmp(data + start * DEFAULT_BLKSZ, buf,
+			   count * DEFAULT_BLKSZ));
+
+	return 0;
+}
+
+/* Test that devices on the same host do not read ahead at the same time */
+static int dm_test_blk_readahead_host(struct unit_test_state *uts)
+{
+	const int size = 256 * DEFAULT_BLKSZ;
+	struct blk_readahead_stats stats;
+	struct blk_desc *desc, *lun_desc;
+	struct udevice *dev, *blk, *lun;
+	lbaint_t start;
+	char *data;
+	int i;
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + i / DEFAULT_BLKSZ;
+	ut_assertok(os_write_file("blk_ra.img", data, size));
+
+	ut_assertok(host_create_device("ra", true, DEFAULT_BLKSZ, &dev));
+	ut_assertok(host_attach_file(dev, "blk_ra.img"));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+
+	/* a second device using the same host, like another LUN */
+	ut_assertok(blk_create_devicef(dev, "sandbox_host_blk", "lun1",
+				       UCLASS_HOST, -1, DEFAULT_BLKSZ,
+				       desc->lba, &lun));
+	lun_desc = dev_get_uclass_plat(lun);
+	lun_desc->readahead = 1;
+	ut_assertok(device_probe(lun));
+
+	ut_assertok(blk_readahead_configure(blk, 32));
+	ut_assertok(blk_readahead_configure(lun, 32));
+	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blkcache_invalidate(lun_desc->uclass_id, lun_desc->devnum);
+
+	/* the LUN reads ahead blocks 116 to 147 */
+	ut_assertok(ra_check_read(uts, lun_desc, 100, 8, data));
+	ut_assertok(ra_check_read(uts, lun_desc, 108, 8, data));
+	uthread_schedule();
+	ut_assertok(blk_readahead_get_stats(lun, &stats));
+	ut_asserteq(1, stats.prefetches);
+	ut_asserteq(32, stats.blocks);
+
+	/* the other device starts reading ahead, but does not get to run */
+	ut_assertok(ra_check_read(uts, desc, 0, 8, data));
+	ut_assertok(ra_check_read(uts, desc, 8, 8, data));
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(1, stats.prefetches);
+	ut_asserteq(0, stats.blocks);
+
+	/* the LUN uses up its read-ahead, but may not start another one */
+	for (start = 116; start < 148; start += 8)
+		ut_assertok(ra_check_read(uts, lun_desc, start, 8, data));
+	ut_assertok(blk_readahead_get_stats(lun, &stats));
+	ut_asserteq(1, stats.prefetches);
+	ut_asserteq(32, stats.used);
+
+	/* nor read from the host until the other read-ahead is done */
+	ut_assertok(ra_check_read(uts, lun_desc, 148, 8, data));
+	ut_assertok(blk_readahead_get_stats(blk, &stats));
+	ut_asserteq(32, stats.blocks);
+	ut_assertok(blk_readahead_get_stats(lun, &stats));
+	ut_asserteq(2, stats.prefetches);
+
+	blk_readahead_wait(lun);
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+	ut_assertok(os_unlink("blk_ra.img"));
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead_host, UTF_SCAN_FDT);
+#endif
+
+#if CONFIG_IS_ENABLED(BLK_STREAM)
+#define STREAM_BLKS	512
+#define STREAM_START	10
+#define STREAM_SIZE	65636
+
+/* Image made by 'zstd' from STREAM_SIZE bytes of stream_byte() */
+static const char stream_zstd[] =
+	"\x28\xb5\x2f\xfd\x64\x64\xff\xbd\x08\x00\x24\x08\x01\x08\x0f\x16"
+	"\x1d\x24\x2b\x32\x39\x40\x47\x4e\x55\x5c\x63\x6a\x71\x78\x7f\x86"
+	"\x8d\x94\x9b\xa2\xa9\xb0\xb7\xbe\xc5\xcc\xd3\xda\xe1\xe8\xef\xf6"
+	"\xfd\x04\x0b\x12\x19\x20\x27\x2e\x35\x3c\x43\x4a\x51\x58\x5f\x66"
+	"\x6d\x74\x7b\x82\x89\x90\x97\x9e\xa5\xac\xb3\xba\xc1\xc8\xcf\xd6"
+	"\xdd\xe4\xeb\xf2\xf9\x00\x07\x0e\x15\x1c\x23\x2a\x31\x38\x3f\x46"
+	"\x4d\x54\x5b\x62\x69\x70\x77\x7e\x85\x8c\x93\x9a\xa1\xa8\xaf\xb6"
+	"\xbd\xc4\xcb\xd2\xd9\xe0\xe7\xee\xf5\xfc\x03\x0a\x11\x18\x1f\x26"
+	"\x2d\x34\x3b\x42\x49\x50\x57\x5e\x65\x6c\x73\x7a\x81\x81\x80\x81"
+	"\x98\x10\xf0\x07\x00\x12\xf8\xff\xff\x3f\x41\xa0\x7f\xcf\xcf\xcf"
+	"\xcf\xcf\xcf\xcf\xcf\xcf\xcf\xcf\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f"
+	"\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x9f\x1f\x3f\x3f\x3f"
+	"\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f\x3f"
+	"\x3f\x7e\x7e\x7e\x7e\x7e\x7e\x7e\x7e\x7e\x7e\x7e\x7e\xfc\xfc\xfc"
+	"\xfc\xfc\xfc\xfc\xfc\xf8\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf9"
+	"\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf9\xf1\xf3\xf3\xf3\xf3\xf3\xf3"
+	"\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xf3\xe3\xe7\xe7"
+	"\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xe7\xcf\x1f\xc0"
+	"\x01\x90\xf4\xf5\xe0";
+
+/* A skippable frame, then a frame holding one empty raw block */
+static const char stream_zstd_lead[] =
+	"\x50\x2a\x4d\x18\x04\x00\x00\x00\x01\x02\x03\x04"
+	"\x28\xb5\x2f\xfd\x20\x00\x01\x00\x00";
+
+static u8 stream_byte(int i)
+{
+	return (i / 512) * 7 + 1;
+}
+
+/* Set up a host device filled with 0xaa, returning its descriptor */
+static int stream_setup(struct unit_test_state *uts, struct udevice **devp,
+			struct blk_desc **descp)
+{
+	struct udevice *blk;
+	char *data;
+
+	data = malloc(STREAM_BLKS * DEFAULT_BLKSZ);
+	ut_assertnonnull(data);
+	memset(data, 0xaa, STREAM_BLKS * DEFAULT_BLKSZ);
+	ut_assertok(os_write_file("blk_stream.img", data,
+				  STREAM_BLKS * DEFAULT_BLKSZ));
+	free(data);
+
+	ut_assertok(host_create_device("stream", true, DEFAULT_BLKSZ, devp));
+	ut_assertok(host_attach_file(*devp, "blk_stream.img"));
+	ut_assertok(blk_get_from_parent(*devp, &blk));
+	ut_assertok(device_probe(blk));
+	*descp = dev_get_uclass_plat(blk);
+
+	return 0;
+}
+
+static int stream_teardown(struct unit_test_state *uts, struct udevice *dev)
+{
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+	ut_assertok(os_unlink("blk_stream.img"));
+
+	return 0;
+}
+
+/* Pass @len bytes of @data to @bs in pieces of varying size */
+static int stream_feed(struct blk_stream *bs, const void *data, int len)
+{
+	static const int sizes[] = { 1, 3, 1000, 4093, 512, 20000 };
+	int i, n, pos, ret;
+
+	for (pos = 0, i = 0; pos < len; pos += n, i++) {
+		n = min(len - pos, sizes[i % ARRAY_SIZE(sizes)]);
+		ret = blk_stream_write(bs, pos, data + pos, n);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Check that the stream_byte() pattern was written from STREAM_START */
+static int stream_check(struct unit_test_state *uts, struct blk_desc *desc)
+{
+	int blks = DIV_ROUND_UP(STREAM_SIZE, DEFAULT_BLKSZ);
+	u8 *buf;
+	int i;
+
+	buf = malloc((blks + 2) * DEFAULT_BLKSZ);
+	ut_assertnonnull(buf);
+	ut_asserteq(blks + 2, blk_dread(desc, STREAM_START - 1, blks + 2,
+					buf));
+	for (i = 0; i < DEFAULT_BLKSZ; i++)
+		ut_asserteq(0xaa, buf[i]);
+	for (i = 0; i < STREAM_SIZE; i++)
+		ut_asserteq(stream_byte(i), buf[DEFAULT_BLKSZ + i]);
+	/* the last block is padded with zeroes */
+	for (i += DEFAULT_BLKSZ; i < (blks + 1) * DEFAULT_BLKSZ; i++)
+		ut_asserteq(0, buf[i]);
+	for (; i < (blks + 2) * DEFAULT_BLKSZ; i++)
+		ut_asserteq(0xaa, buf[i]);
+	free(buf);
+
+	return 0;
+}
+
+/* Test writing raw and compressed images to a block device in pieces */
+static int dm_test_blk_stream(struct unit_test_state *uts)
+{
+	struct blk_stream bs;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	ulong len;
+	u8 *data, *gz;
+	int i;
+
+	ut_assertok(stream_setup(uts, &dev, &desc));
+	data = malloc(STREAM_SIZE);
+	ut_assertnonnull(data);
+	for (i = 0; i < STREAM_SIZE; i++)
+		data[i] = stream_byte(i);
+
+	/* raw, with data repeated and missing on the way */
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+				     STREAM_BLKS - STREAM_START));
+	ut_assertok(blk_stream_write(&bs, 0, data, 1000));
+	ut_asserteq(-ESPIPE, blk_stream_write(&bs, 1001, data + 1001, 10));
+	ut_assertok(blk_stream_write(&bs, 0, data, 500));
+	ut_assertok(blk_stream_write(&bs, 500, data + 500, 1000));
+	ut_assertok(blk_stream_write(&bs, 1500, data + 1500,
+				     STREAM_SIZE - 1500));
+	ut_asserteq(STREAM_SIZE, bs.in_pos);
+	ut_assertok(blk_stream_finish(&bs));
+	ut_asserteq(DIV_ROUND_UP(STREAM_SIZE, DEFAULT_BLKSZ), bs.written);
+	ut_assertok(stream_check(uts, desc));
+
+	/* zstd */
+	ut_assertok(stream_teardown(uts, dev));
+	ut_assertok(stream_setup(uts, &dev, &desc));
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+				     STREAM_BLKS - STREAM_START));
+	ut_assertok(stream_feed(&bs, stream_zstd, sizeof(stream_zstd) - 1));
+	ut_asserteq(BLK_STREAM_ZSTD, bs.comp);
+	ut_assertok(blk_stream_finish(&bs));
+	ut_assertok(stream_check(uts, desc));
+
+	/*
+	 * a skippable frame and an empty frame with a 1K window first, so the
+	 * window must grow for the image itself
+	 */
+	ut_assertok(stream_teardown(uts, dev));
+	ut_assertok(stream_setup(uts, &dev, &desc));
+	len = sizeof(stream_zstd_lead) - 1 + sizeof(stream_zstd) - 1;
+	gz = malloc(len);
+	ut_assertnonnull(gz);
+	memcpy(gz, stream_zstd_lead, sizeof(stream_zstd_lead) - 1);
+	memcpy(gz + sizeof(stream_zstd_lead) - 1, stream_zstd,
+	       sizeof(stream_zstd) - 1);
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+				     STREAM_BLKS - STREAM_START));
+	ut_assertok(stream_feed(&bs, gz, len));
+	ut_asserteq(BLK_STREAM_ZSTD, bs.comp);
+	ut_assertok(blk_stream_finish(&bs));
+	ut_assertok(stream_check(uts, desc));
+	free(gz);
+
+	/* a compressed image which is cut short */
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+				     STREAM_BLKS - STREAM_START));
+	ut_assertok(stream_feed(&bs, stream_zstd, 100));
+	ut_asserteq(-EINVAL, blk_stream_finish(&bs));
+
+	/* gzip */
+	if (IS_ENABLED(CONFIG_GZIP_COMPRESSED)) {
+		ut_assertok(stream_teardown(uts, dev));
+		ut_assertok(stream_setup(uts, &dev, &desc));
+		len = STREAM_SIZE;
+		gz = malloc(len);
+		ut_assertnonnull(gz);
+		ut_assertok(gzip(gz, &len, data, STREAM_SIZE));
+		ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+					     STREAM_BLKS - STREAM_START));
+		ut_assertok(stream_feed(&bs, gz, len));
+		ut_asserteq(BLK_STREAM_GZIP, bs.comp);
+		ut_assertok(blk_stream_finish(&bs));
+		ut_assertok(stream_check(uts, desc));
+		free(gz);
+	}
+
+	/* an image which does not fit, which stops everything after it */
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_BLKS - 100, 100));
+	ut_asserteq(-ENOSPC, stream_feed(&bs, data, STREAM_SIZE));
+	ut_asserteq(-ENOSPC, blk_stream_write(&bs, bs.in_pos, data, 1));
+	ut_asserteq(-ENOSPC, blk_stream_finish(&bs));
+
+	free(data);
+	ut_assertok(stream_teardown(uts, dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_stream, UTF_SCAN_FDT);
+
+/* Add a chunk header to a sparse image, returning the space after it */
+static void *stream_chunk(void *ptr, uint type, uint blks, uint data_sz)
+{
+	chunk_header_t *chunk = ptr;
+
+	chunk->chunk_type = cpu_to_le16(type);
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = cpu_to_le32(blks);
+	chunk->total_sz = cpu_to_le32(sizeof(*chunk) + data_sz);
+
+	return chunk + 1;
+}
+
+/* Check what the sparse image of dm_test_blk_stream_sparse() wrote */
+static int stream_check_sparse(struct unit_test_state *uts,
+			       struct blk_desc *desc, u8 *buf, int blk_sz)
+{
+	int i;
+
+	ut_asserteq(10 * blk_sz / DEFAULT_BLKSZ,
+		    blk_dread(desc, STREAM_START, 10 * blk_sz / DEFAULT_BLKSZ,
+			      buf));
+	for (i = 0; i < 3 * blk_sz; i++)
+		ut_asserteq(stream_byte(i), buf[i]);
+	for (; i < 5 * blk_sz; i++)
+		ut_asserteq(0xaa, buf[i]);
+	for (; i < 9 * blk_sz; i += sizeof(u32))
+		ut_asserteq(0x12345678, get_unaligned_le32(buf + i));
+	for (; i < 10 * blk_sz; i++)
+		ut_asserteq(0xaa, buf[i]);
+
+	return 0;
+}
+
+static lbaint_t stream_sparse_write(struct sparse_storage *info, lbaint_t blk,
+				    lbaint_t blkcnt, const void *buffer)
+{
+	return blk_dwrite(info->priv, blk, blkcnt, buffer);
+}
+
+static lbaint_t stream_sparse_reserve(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+/* Test writing a sparse image to a block device in pieces */
+static int dm_test_blk_stream_sparse(struct unit_test_state *uts)
+{
+	const int blk_sz = 2 * DEFAULT_BLKSZ;
+	struct sparse_storage info;
+	sparse_header_t *hdr;
+	struct blk_stream bs;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *img, *ptr, *buf;
+	ulong len;
+	int i;
+
+	ut_assertok(stream_setup(uts, &dev, &desc));
+	img = calloc(1, 16 * blk_sz);
+	buf = malloc(16 * blk_sz);
+	ut_assertnonnull(img);
+	ut_assertnonnull(buf);
+
+	/* 3 blocks of data, 2 not cared about, 4 filled, and a CRC32 */
+	hdr = (sparse_header_t *)img;
+	hdr->magic = cpu_to_le32(SPARSE_HEADER_MAGIC);
+	hdr->major_version = cpu_to_le16(1);
+	hdr->file_hdr_sz = cpu_to_le16(sizeof(*hdr));
+	hdr->chunk_hdr_sz = cpu_to_le16(sizeof(chunk_header_t));
+	hdr->blk_sz = cpu_to_le32(blk_sz);
+	hdr->total_blks = cpu_to_le32(9);
+	hdr->total_chunks = cpu_to_le32(4);
+	ptr = stream_chunk(hdr + 1, CHUNK_TYPE_RAW, 3, 3 * blk_sz);
+	for (i = 0; i < 3 * blk_sz; i++)
+		*ptr++ = stream_byte(i);
+	ptr = stream_chunk(ptr, CHUNK_TYPE_DONT_CARE, 2, 0);
+	ptr = stream_chunk(ptr, CHUNK_TYPE_FILL, 4, sizeof(u32));
+	put_unaligned_le32(0x12345678, ptr);
+	ptr = stream_chunk(ptr + sizeof(u32), CHUNK_TYPE_CRC32, 0,
+			   sizeof(u32));
+	ptr += sizeof(u32);
+	len = ptr - img;
+
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+				     STREAM_BLKS - STREAM_START));
+	ut_assertok(stream_feed(&bs, img, len));
+	ut_asserteq(BLK_STREAM_SPARSE, bs.sparse);
+	ut_assertok(blk_stream_finish(&bs));
+	ut_asserteq(7 * blk_sz / DEFAULT_BLKSZ, bs.written);
+	ut_assertok(stream_check_sparse(uts, desc, buf, blk_sz));
+
+	/* the same image in memory, as fastboot and 'mmc swrite' write it */
+	memset(buf, 0xaa, 10 * blk_sz);
+	ut_asserteq(10 * blk_sz / DEFAULT_BLKSZ,
+		    blk_dwrite(desc, STREAM_START, 10 * blk_sz / DEFAULT_BLKSZ,
+			       buf));
+	info.blksz = desc->blksz;
+	info.start = STREAM_START;
+	info.size = STREAM_BLKS - STREAM_START;
+	info.priv = desc;
+	info.write = stream_sparse_write;
+	info.reserve = stream_sparse_reserve;
+	info.mssg = NULL;
+	ut_assertok(write_sparse_image(&info, "stream", img, NULL));
+	ut_assertok(stream_check_sparse(uts, desc, buf, blk_sz));
+
+	/* the same, compressed, and cut short */
+	if (IS_ENABLED(CONFIG_GZIP_COMPRESSED)) {
+		ulong gz_len = 16 * blk_sz;
+
+		memset(buf, '\0', gz_len);
+		ut_assertok(gzip(buf, &gz_len, img, len));
+		ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+					     STREAM_BLKS - STREAM_START));
+		ut_assertok(stream_feed(&bs, buf, gz_len));
+		ut_asserteq(BLK_STREAM_SPARSE, bs.sparse);
+		ut_assertok(blk_stream_finish(&bs));
+
+		ut_assertok(blk_stream_start(&bs, desc, STREAM_START,
+					     STREAM_BLKS - STREAM_START));
+		ut_assertok(stream_feed(&bs, img, len - 100));
+		ut_asserteq(-EINVAL, blk_stream_finish(&bs));
+	}
+
+	/* a sparse image which does not fit */
+	ut_assertok(blk_stream_start(&bs, desc, STREAM_BLKS - 8, 8));
+	ut_asserteq(-ENOSPC, stream_feed(&bs, img, len));
+	ut_asserteq(-ENOSPC, blk_stream_finish(&bs));
+
+	free(buf);
+	free(img);
+	ut_assertok(stream_teardown(uts, dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_stream_sparse, UTF_SCAN_FDT);
+#endif
@@ -6,6 +6,8 @@
  * Joe Hershberger <joe.hershberger@ni.com>
  */
 
+#include <command.h>
+#include <console.h>
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
@@ -13,10 +15,12 @@
 #include <malloc.h>
 #include <net.h>
 #include <net6.h>
+#include <time.h>
 #include <asm/eth.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
+#include <net/neigh.h>
 #include <test/test.h>
 #include <test/ut.h>
 #include <ndisc.h>
@@ -623,6 +627,322 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 DM_TEST(dm_test_eth_async_ping_reply, UTF_SCAN_FDT);
 #endif
 
+#if CONFIG_IS_ENABLED(NET)
+#define SB_BATCH_PORT		4321
+
+/* Sequence number of the next packet expected by sb_batch_udp() */
+static int sb_batch_next;
+
+static void sb_batch_udp(uchar *pkt, unsigned int dport, struct in_addr sip,
+			 unsigned int sport, unsigned int len)
+{
+	/* only count packets which arrive in the order they were queued */
+	if (dport == SB_BATCH_PORT && len == 1 && *pkt == sb_batch_next)
+		sb_batch_next++;
+}
+
+/* Queue a UDP packet carrying @seq, as if it had come from the network */
+static void sb_batch_queue(struct udevice *dev, u8 seq, ulong time)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i = priv->recv_packets++;
+	struct ethernet_hdr *eth = (void *)priv->recv_packet_buffer[i];
+	struct ip_udp_hdr *ip = (void *)eth + ETHER_HDR_SIZE;
+
+	memcpy(eth->et_dest, eth_get_ethaddr(), ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+	net_set_ip_header((uchar *)ip, net_ip, string_to_ip("1.1.2.2"),
+			  IP_UDP_HDR_SIZE + 1, IPPROTO_UDP);
+	ip->udp_src = htons(SB_BATCH_PORT);
+	ip->udp_dst = htons(SB_BATCH_PORT);
+	ip->udp_len = htons(UDP_HDR_SIZE + 1);
+	ip->udp_xsum = 0;
+	*((u8 *)ip + IP_UDP_HDR_SIZE) = seq;
+
+	priv->recv_packet_length[i] = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + 1;
+	priv->recv_packet_time[i] = time;
+}
+
+/* Queue a burst of packets, then receive them with a single eth_rx() */
+static int sb_batch_burst(struct unit_test_state *uts, struct udevice *dev,
+			  int count)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i;
+
+	sb_batch_next = 0;
+	priv->rx_calls = 0;
+	priv->free_calls = 0;
+	for (i = 0; i < count; i++)
+		sb_batch_queue(dev, i, 0);
+	ut_assert(eth_rx() >= 0);
+	ut_asserteq(count, sb_batch_next);
+	ut_asserteq(0, priv->recv_packets);
+
+	return 0;
+}
+
+static int dm_test_eth_rx_batch(struct unit_test_state *uts)
+{
+	struct in_addr prev_ip = net_ip;
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+
+	net_init();
+	net_ip = string_to_ip("1.1.2.1");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	ut_asserteq_str("eth@10002000", dev->name);
+	priv = dev_get_priv(dev);
+	net_set_udp_handler(sb_batch_udp);
+
+	/* without batching, the driver is called for each packet */
+	ut_assertok(sb_batch_burst(uts, dev, PKTBUFSRX));
+	ut_asserteq(PKTBUFSRX, priv->rx_calls);
+	ut_asserteq(PKTBUFSRX, priv->free_calls);
+
+	/* with it, the whole burst is taken and handed back at once */
+	sandbox_eth_set_rx_batch(0, true);
+	ut_assertok(sb_batch_burst(uts, dev, PKTBUFSRX));
+	ut_asserteq(1, priv->rx_calls);
+	ut_asserteq(1, priv->free_calls);
+
+	/* packets which have not arrived yet are left for the next batch */
+	sandbox_eth_set_recv_delay(0, 1000);
+	sb_batch_next = 0;
+	sb_batch_queue(dev, 0, 0);
+	sb_batch_queue(dev, 1, 0);
+	sb_batch_queue(dev, 2, get_timer(0));
+	ut_assert(eth_rx() >= 0);
+	ut_asserteq(2, sb_batch_next);
+	ut_asserteq(1, priv->recv_packets);
+	sandbox_eth_set_recv_delay(0, 0);
+	ut_assert(eth_rx() >= 0);
+	ut_asserteq(3, sb_batch_next);
+	ut_asserteq(0, priv->recv_packets);
+
+	sandbox_eth_set_rx_batch(0, false);
+	net_set_udp_handler(NULL);
+	eth_halt();
+	net_ip = prev_ip;
+
+	return 0;
+}
+DM_TEST(dm_test_eth_rx_batch, UTF_SCAN_FDT);
+
+/* Number of UDP packets seen by sb_offload_tx() and their last checksum */
+static int sb_offload_sent;
+static u16 sb_offload_xsum;
+static bool sb_offload_csum_ok;
+
+static int sb_offload_tx(struct udevice *dev, void *packet, unsigned int len)
+{
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __packed ph;
+	uint sum;
+
+	if (ip->ip_p != IPPROTO_UDP || ntohs(ip->udp_dst) != SB_BATCH_PORT)
+		return 0;
+
+	net_copy_ip(&ph.src, &ip->ip_src);
+	net_copy_ip(&ph.dst, &ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = IPPROTO_UDP;
+	ph.len = ip->udp_len;
+	sum = add_ip_checksums(0, compute_ip_checksum(&ph, sizeof(ph)),
+			       compute_ip_checksum(&ip->udp_src,
+						   ntohs(ip->udp_len)));
+	sb_offload_csum_ok = !(sum & 0xfffe);
+	sb_offload_xsum = ip->udp_xsum;
+	sb_offload_sent++;
+
+	return 0;
+}
+
+/* Send a UDP packet with an odd number of bytes to the fake host */
+static void sb_offload_send(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+
+	memcpy(pkt, "abc", 3);
+	net_send_udp_packet(priv->fake_host_hwaddr, string_to_ip("1.1.2.2"),
+			    SB_BATCH_PORT, SB_BATCH_PORT, 3);
+}
+
+/* Queue a packet with a bad UDP checksum and check whether it gets through */
+static int sb_offload_bad_rx(struct unit_test_state *uts, struct udevice *dev,
+			     int expect)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip;
+
+	sb_batch_next = 0;
+	sb_batch_queue(dev, 0, 0);
+	ip = (void *)priv->recv_packet_buffer[0] + ETHER_HDR_SIZE;
+	ip->udp_xsum = htons(0x1234);
+	ut_assert(eth_rx() >= 0);
+	ut_asserteq(expect, sb_batch_next);
+	ut_asserteq(0, priv->recv_packets);
+
+	return 0;
+}
+
+static int dm_test_eth_offload(struct unit_test_state *uts)
+{
+	struct in_addr prev_ip = net_ip;
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+
+	net_init();
+	net_ip = string_to_ip("1.1.2.1");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	ut_asserteq_str("eth@10002000", dev->name);
+	priv = dev_get_priv(dev);
+	sandbox_eth_set_tx_handler(0, sb_offload_tx);
+	net_set_udp_handler(sb_batch_udp);
+
+	/* without offload, UDP packets are sent with no checksum */
+	sb_offload_sent = 0;
+	priv->tx_calls = 0;
+	sb_offload_send(dev);
+	ut_asserteq(1, sb_offload_sent);
+	ut_asserteq(0, sb_offload_xsum);
+	ut_assert(!sb_offload_csum_ok);
+	ut_asserteq(1, priv->tx_calls);
+
+	/* with it, the device fills one in */
+	sandbox_eth_set_offload(0, ETH_OFFLOAD_TX_CSUM | ETH_OFFLOAD_RX_CSUM);
+	ut_asserteq(ETH_OFFLOAD_TX_CSUM | ETH_OFFLOAD_RX_CSUM |
+		    ETH_OFFLOAD_RX_DROPS, eth_get_offload(dev));
+	sb_offload_send(dev);
+	ut_asserteq(2, sb_offload_sent);
+	ut_assert(sb_offload_xsum);
+	ut_assert(sb_offload_csum_ok);
+	ut_asserteq(2, priv->tx_calls);
+
+	/* frames held back go to the driver in a single call */
+	eth_send_hold();
+	sb_offload_send(dev);
+	sb_offload_send(dev);
+	sb_offload_send(dev);
+	ut_asserteq(2, sb_offload_sent);
+	ut_assertok(eth_send_flush());
+	ut_asserteq(5, sb_offload_sent);
+	ut_assert(sb_offload_csum_ok);
+	ut_asserteq(3, priv->tx_calls);
+	ut_assertok(eth_send_flush());
+	ut_asserteq(3, priv->tx_calls);
+
+	/* the stack leaves the received checksums to the device */
+	ut_assertok(sb_offload_bad_rx(uts, dev, 1));
+	sandbox_eth_set_rx_batch(0, true);
+	ut_assertok(sb_offload_bad_rx(uts, dev, 1));
+	sandbox_eth_set_rx_batch(0, false);
+
+	/* and checks them itself otherwise */
+	sandbox_eth_set_offload(0, 0);
+	ut_assertok(sb_offload_bad_rx(uts, dev, 0));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	net_set_udp_handler(NULL);
+	eth_halt();
+	net_ip = prev_ip;
+
+	return 0;
+}
+DM_TEST(dm_test_eth_offload, UTF_SCAN_FDT);
+#endif
+
+#if IS_ENABLED(CONFIG_NET_NEIGH)
+/* Number of ARP requests seen by sb_neigh_handler() */
+static int sb_neigh_arps;
+
+static int sb_neigh_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		sb_neigh_arps++;
+	sandbox_eth_ping_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+static int dm_test_eth_neigh(struct unit_test_state *uts)
+{
+	const struct neigh_stats *stats = neigh_get_stats();
+	struct eth_sandbox_priv *priv;
+
+	neigh_flush(NULL);
+	sb_neigh_arps = 0;
+	net_ping_ip = string_to_ip("1.1.2.2");
+	sandbox_eth_set_tx_handler(0, sb_neigh_handler);
+	env_set("ethact", "eth@10002000");
+
+	/* the first ping resolves the address, the second does not need to */
+	ut_assertok(net_loop(PING));
+	ut_asserteq(1, sb_neigh_arps);
+	ut_asserteq(0, stats->hits);
+	ut_asserteq(1, stats->misses);
+	ut_assertok(net_loop(PING));
+	ut_asserteq(1, sb_neigh_arps);
+	ut_asserteq(1, stats->hits);
+
+	priv = dev_get_priv(eth_get_dev());
+	console_record_reset_enable();
+	ut_assertok(run_command("neigh", 0));
+	ut_assert_nextline("%-39s %-17s %5s  %s", "Address", "Ethernet address",
+			   "Age", "Device");
+	ut_assert_nextline("%-39s %pM %5u  %s", "1.1.2.2",
+			   priv->fake_host_hwaddr, 0, "eth@10002000");
+	ut_assert_nextline("1 hits, 1 misses, 0 probes, 0 expired, 0 evicted");
+	ut_assert_console_end();
+
+	/* an entry in use is probed before it expires */
+	timer_test_add_offset(CONFIG_NET_NEIGH_TTL * 1000 * 7 / 8);
+	ut_assertok(net_loop(PING));
+	ut_asserteq(2, sb_neigh_arps);
+	ut_asserteq(2, stats->hits);
+	ut_asserteq(1, stats->probes);
+	console_record_reset_enable();
+	ut_assertok(run_command("neigh", 0));
+	ut_assert_skipline();
+	ut_assert_nextline("%-39s %pM %5u  %s", "1.1.2.2",
+			   priv->fake_host_hwaddr, 0, "eth@10002000");
+	ut_assert_nextline("2 hits, 1 misses, 1 probes, 0 expired, 0 evicted");
+	ut_assert_console_end();
+
+	/* one which is not used is left to expire */
+	timer_test_add_offset(CONFIG_NET_NEIGH_TTL * 1000);
+	ut_assertok(net_loop(PING));
+	ut_asserteq(3, sb_neigh_arps);
+	ut_asserteq(1, stats->expired);
+	ut_asserteq(2, stats->misses);
+
+	console_record_reset_enable();
+	ut_assertok(run_command("neigh flush", 0));
+	ut_assertok(run_command("neigh", 0));
+	ut_assert_skipline();
+	ut_assert_nextline("0 hits, 0 misses, 0 probes, 0 expired, 0 evicted");
+	ut_assert_console_end();
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_neigh, UTF_SCAN_FDT | UTF_CONSOLE);
+#endif
+
 #if IS_ENABLED(CONFIG_IPV6_ROUTER_DISCOVERY)
 
 static u8 ip6_ra_buf[] = {0x60, 0xf, 0xc5, 0x4a, 0x0, 0x38, 0x3a, 0xff, 0xfe,
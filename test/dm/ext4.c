@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the ext4 block mapping
+ */
+
+#include <blk.h>
+#include <dm.h>
+#include <ext4fs.h>
+#include <fs.h>
+#include <os.h>
+#include <sandbox_host.h>
+#include <dm/device-internal.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../fs/ext4/ext4_common.h"
+
+static void set_extent(struct ext4_extent *ext, u32 lblk, u16 len, u64 pblk)
+{
+	ext->ee_block = cpu_to_le32(lblk);
+	ext->ee_len = cpu_to_le16(len);
+	ext->ee_start_hi = cpu_to_le16(pblk >> 32);
+	ext->ee_start_lo = cpu_to_le32(pblk);
+}
+
+static int check_run(struct unit_test_state *uts, struct ext2fs_node *node,
+		     u32 fileblock, u32 maxblocks, u32 len, u64 pblk)
+{
+	struct ext4_extent_run run;
+
+	ut_assertok(ext4fs_map_run(node, fileblock, maxblocks, &run, NULL));
+	ut_asserteq(fileblock, run.lblk);
+	ut_asserteq(len, run.len);
+	ut_asserteq_64(pblk, run.pblk);
+
+	return 0;
+}
+
+/* Test mapping file blocks of extent and indirect-block inodes to runs */
+static int dm_test_ext4_map_run(struct unit_test_state *uts)
+{
+	struct ext4_extent_header *hdr;
+	struct ext4_extent_run run;
+	struct ext4_extent *ext;
+	struct ext2fs_node node;
+	struct blk_desc *desc;
+	struct udevice *dev, *blk;
+	char fname[256];
+
+	/* Mount the image created in test_ut_dm_init */
+	ut_assertok(os_persistent_file(fname, sizeof(fname), "2MB.ext4.img"));
+	ut_assertok(host_create_attach_file("test", fname, false, DEFAULT_BLKSZ,
+					    &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+
+	/*
+	 * Blocks 0-7 are two extents which are adjacent on disk too, blocks 8-9
+	 * are elsewhere and blocks 10-15 are a hole
+	 */
+	memset(&node, '\0', sizeof(node));
+	node.data = ext4fs_root;
+	node.ino = 1000;
+	node.inode.flags = cpu_to_le32(EXT4_EXTENTS_FL);
+	node.inode.size = cpu_to_le32(20 << LOG2_BLOCK_SIZE(ext4fs_root));
+	node.inode.blockcnt = cpu_to_le32(14);
+	hdr = (struct ext4_extent_header *)node.inode.b.blocks.dir_blocks;
+	hdr->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+	hdr->eh_entries = cpu_to_le16(4);
+	hdr->eh_max = cpu_to_le16(4);
+	ext = (struct ext4_extent *)(hdr + 1);
+	set_extent(&ext[0], 0, 4, 100);
+	set_extent(&ext[1], 4, 4, 104);
+	set_extent(&ext[2], 8, 2, 300);
+	set_extent(&ext[3], 16, 4, 400);
+
+	ut_assertok(check_run(uts, &node, 0, 100, 8, 100));
+	ut_assertok(check_run(uts, &node, 2, 100, 6, 102));
+	ut_assertok(check_run(uts, &node, 5, 2, 2, 105));
+	ut_assertok(check_run(uts, &node, 8, 100, 2, 300));
+	ut_assertok(check_run(uts, &node, 10, 100, 6, 0));
+	ut_assertok(check_run(uts, &node, 12, 3, 3, 0));
+	ut_assertok(check_run(uts, &node, 17, 100, 3, 401));
+	ut_assertok(check_run(uts, &node, 20, 5, 5, 0));
+	ut_asserteq(-EINVAL, ext4fs_map_run(&node, 0, 0, &run, NULL));
+
+	/* Moving the fragment is seen once the inode has changed */
+	set_extent(&ext[2], 8, 2, 108);
+	ut_assertok(check_run(uts, &node, 8, 100, 2, 300));
+	node.inode.blockcnt = cpu_to_le32(16);
+	ut_assertok(check_run(uts, &node, 0, 100, 10, 100));
+	ut_assertok(check_run(uts, &node, 8, 100, 2, 108));
+
+	/* Consecutive block pointers and holes are coalesced */
+	memset(&node, '\0', sizeof(node));
+	node.data = ext4fs_root;
+	node.ino = 1001;
+	node.inode.size = cpu_to_le32(6 << LOG2_BLOCK_SIZE(ext4fs_root));
+	node.inode.b.blocks.dir_blocks[0] = cpu_to_le32(50);
+	node.inode.b.blocks.dir_blocks[1] = cpu_to_le32(51);
+	node.inode.b.blocks.dir_blocks[2] = cpu_to_le32(52);
+	node.inode.b.blocks.dir_blocks[5] = cpu_to_le32(70);
+
+	ut_assertok(check_run(uts, &node, 0, 6, 3, 50));
+	ut_assertok(check_run(uts, &node, 3, 6, 2, 0));
+	ut_assertok(check_run(uts, &node, 5, 1, 1, 70));
+
+	fs_close();
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_ext4_map_run, UTF_SCAN_FDT);
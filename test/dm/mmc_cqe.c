@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for eMMC command queueing, using the sandbox eMMC emulator
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <malloc.h>
+#include <mmc.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define EMMC_TEST_DEPTH		16
+#define EMMC_TEST_BLOCK_LEN	512
+/* The emulated device is 1MiB */
+#define EMMC_TEST_BLOCKS	2048
+/* Largest transfer of the emulated host, in blocks */
+#define EMMC_TEST_TASK		64
+
+/* Bind the emulated eMMC, which is disabled in the device tree */
+static int emmc_test_probe(struct unit_test_state *uts, struct udevice **devp,
+			   struct blk_desc **descp)
+{
+	struct udevice *dev, *blk;
+
+	ut_assertok(lists_bind_fdt(dm_root(), ofnode_path("/emmc"), &dev, NULL,
+				   false));
+	ut_assertok(device_probe(dev));
+	ut_assertok(device_find_first_child_by_uclass(dev, UCLASS_BLK, &blk));
+	ut_assertok(device_probe(blk));
+	*devp = dev;
+	*descp = dev_get_uclass_plat(blk);
+
+	return 0;
+}
+
+/* Test that large transfers are queued as tasks which fill the queue */
+static int dm_test_mmc_cqe(struct unit_test_state *uts)
+{
+	const lbaint_t count = EMMC_TEST_BLOCKS;
+	const ulong len = count * EMMC_TEST_BLOCK_LEN;
+	uint doorbells, tasks, max_depth, doorbells_now, tasks_now;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(emmc_test_probe(uts, &dev, &desc));
+	ut_asserteq(EMMC_TEST_DEPTH, mmc_get_mmc_dev(dev)->cqe_depth);
+	ut_asserteq(EMMC_TEST_BLOCK_LEN, desc->blksz);
+	ut_asserteq(EMMC_TEST_BLOCKS, desc->lba);
+
+	wbuf = malloc(len);
+	rbuf = malloc(len);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < len; i++)
+		wbuf[i] = i ^ i >> 10;
+
+	/* 32 tasks, queued 16 at a time */
+	sandbox_mmc_get_cqe_stats(dev, &doorbells, &tasks, &max_depth);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, wbuf));
+	sandbox_mmc_get_cqe_stats(dev, &doorbells_now, &tasks_now, &max_depth);
+	ut_asserteq(count / EMMC_TEST_TASK, tasks_now - tasks);
+	ut_asserteq(2, doorbells_now - doorbells);
+	ut_asserteq(EMMC_TEST_DEPTH, max_depth);
+
+	ut_asserteq(count, blk_dread(desc, 0, count, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, len);
+
+	/* fifteen full tasks and a shorter one go with one doorbell write */
+	sandbox_mmc_get_cqe_stats(dev, &doorbells, &tasks, &max_depth);
+	ut_asserteq(1000, blk_dread(desc, 24, 1000, rbuf));
+	ut_asserteq_mem(wbuf + 24 * EMMC_TEST_BLOCK_LEN, rbuf,
+			1000 * EMMC_TEST_BLOCK_LEN);
+	sandbox_mmc_get_cqe_stats(dev, &doorbells_now, &tasks_now, &max_depth);
+	ut_asserteq(EMMC_TEST_DEPTH, tasks_now - tasks);
+	ut_asserteq(1, doorbells_now - doorbells);
+
+	/* erasing leaves queueing mode, which the next read enters again */
+	ut_asserteq(EMMC_TEST_TASK, blk_derase(desc, EMMC_TEST_TASK,
+					       EMMC_TEST_TASK));
+	ut_assert(!mmc_get_mmc_dev(dev)->cqe_on);
+	memset(wbuf + EMMC_TEST_TASK * EMMC_TEST_BLOCK_LEN, '\0',
+	       EMMC_TEST_TASK * EMMC_TEST_BLOCK_LEN);
+	ut_asserteq(count, blk_dread(desc, 0, count, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, len);
+	ut_assert(mmc_get_mmc_dev(dev)->cqe_on);
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cqe, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test that a failed task fails the transfer and leaves queueing mode */
+static int dm_test_mmc_cqe_error(struct unit_test_state *uts)
+{
+	const lbaint_t count = EMMC_TEST_TASK * 4;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *buf;
+
+	ut_assertok(emmc_test_probe(uts, &dev, &desc));
+	buf = calloc(count, EMMC_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+
+	/* the last two of the four tasks are beyond the end of the device */
+	ut_asserteq(0, blk_write(desc->bdev, EMMC_TEST_BLOCKS - count / 2,
+				 count, buf));
+	ut_assert_nextline("MMC: queued write of 64 blocks at 0x800 failed");
+	ut_assert_nextline("MMC: queued write of 64 blocks at 0x840 failed");
+	ut_assert_console_end();
+	ut_assert(!mmc_get_mmc_dev(dev)->cqe_on);
+
+	/* the queue is still usable afterwards */
+	ut_asserteq(count, blk_write(desc->bdev, 0, count, buf));
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cqe_error, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
+/* Test the statistics shown by 'mmc info' */
+static int dm_test_mmc_cqe_info(struct unit_test_state *uts)
+{
+	const lbaint_t count = EMMC_TEST_BLOCKS / 2;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *buf;
+
+	ut_assertok(emmc_test_probe(uts, &dev, &desc));
+	buf = calloc(count, EMMC_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	ut_asserteq(count, blk_dread(desc, 0, count, buf));
+	ut_asserteq(count, blk_dread(desc, count, count, buf));
+
+	ut_assertok(run_commandf("mmc dev %d", desc->devnum));
+	ut_assert_skip_to_line("mmc%d is current device", desc->devnum);
+	ut_assertok(run_command("mmc info", 0));
+	ut_assert_skip_to_line("Command Queue: 16 tasks");
+	/* the reads include the partition table, read when probing */
+	ut_assert_nextlinen("Queued Reads: 34 tasks, 1051136 bytes, ");
+	ut_assert_nextlinen("Queued Writes: 16 tasks, 524288 bytes, ");
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cqe_info, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the NVMe driver, using the sandbox emulator
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <malloc.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* Usable entries in the emulated I/O queue, which has one spare */
+#define NVME_TEST_SLOTS		15
+#define NVME_TEST_BLOCK_LEN	512
+#define NVME_TEST_BLOCKS	8192
+/* Largest command the emulated controller accepts, in blocks */
+#define NVME_TEST_MAX_CMD	((128 << 10) / NVME_TEST_BLOCK_LEN)
+
+/* Bind the emulated controller, which is disabled in the device tree */
+static int nvme_test_probe(struct unit_test_state *uts, struct udevice **nvmep,
+			   struct blk_desc **descp)
+{
+	struct udevice *nvme, *blk;
+
+	/* the driver reads the registers and queues with readl() */
+	sandbox_set_enable_memio(true);
+	ut_assertok(lists_bind_fdt(dm_root(), ofnode_path("/nvme"), &nvme,
+				   NULL, false));
+	ut_assertok(device_probe(nvme));
+	ut_assertok(device_find_first_child_by_uclass(nvme, UCLASS_BLK, &blk));
+	*nvmep = nvme;
+	*descp = dev_get_uclass_plat(blk);
+
+	return 0;
+}
+
+/* Test that large transfers are queued in batches which fill the queue */
+static int dm_test_nvme_queue(struct unit_test_state *uts)
+{
+	const lbaint_t count = NVME_TEST_BLOCKS;
+	const ulong len = count * NVME_TEST_BLOCK_LEN;
+	uint sq_doorbells, cq_doorbells, cmds, max_batch;
+	uint sq_now, cq_now, cmds_now;
+	struct udevice *nvme;
+	struct blk_desc *desc;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(nvme_test_probe(uts, &nvme, &desc));
+	ut_asserteq(NVME_TEST_BLOCK_LEN, desc->blksz);
+	ut_asserteq(NVME_TEST_BLOCKS, desc->lba);
+
+	wbuf = malloc(len);
+	rbuf = malloc(len + NVME_TEST_BLOCK_LEN);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < len; i++)
+		wbuf[i] = i ^ i >> 12;
+
+	/* 32 commands of 128KiB, passed in batches of 15, 15 and 2 */
+	sandbox_nvme_get_queue_stats(nvme, &sq_doorbells, &cq_doorbells, &cmds,
+				     &max_batch);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, wbuf));
+	sandbox_nvme_get_queue_stats(nvme, &sq_now, &cq_now, &cmds_now,
+				     &max_batch);
+	ut_asserteq(count / NVME_TEST_MAX_CMD, cmds_now - cmds);
+	ut_asserteq(3, sq_now - sq_doorbells);
+	ut_asserteq(3, cq_now - cq_doorbells);
+	ut_asserteq(NVME_TEST_SLOTS, max_batch);
+
+	/* read into a buffer which does not start on a page */
+	ut_asserteq(count, blk_dread(desc, 0, count,
+				     rbuf + NVME_TEST_BLOCK_LEN));
+	ut_asserteq_mem(wbuf, rbuf + NVME_TEST_BLOCK_LEN, len);
+
+	/* a 1MiB read is spread over eight commands sent together */
+	sandbox_nvme_get_queue_stats(nvme, &sq_doorbells, &cq_doorbells, &cmds,
+				     &max_batch);
+	ut_asserteq(count / 4, blk_dread(desc, count / 2, count / 4, rbuf));
+	ut_asserteq_mem(wbuf + len / 2, rbuf, len / 4);
+	sandbox_nvme_get_queue_stats(nvme, &sq_now, &cq_now, &cmds_now,
+				     &max_batch);
+	ut_asserteq(8, cmds_now - cmds);
+	ut_asserteq(1, sq_now - sq_doorbells);
+	ut_asserteq(1, cq_now - cq_doorbells);
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_queue, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test that a failed command ends the transfer at the blocks before it */
+static int dm_test_nvme_error(struct unit_test_state *uts)
+{
+	const lbaint_t count = NVME_TEST_BLOCKS / 4;
+	struct udevice *nvme;
+	struct blk_desc *desc;
+	u8 *buf;
+
+	ut_assertok(nvme_test_probe(uts, &nvme, &desc));
+	buf = malloc(count * NVME_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+
+	/* the last four of the eight commands are beyond the namespace */
+	ut_asserteq(count / 2, blk_read(desc->bdev, NVME_TEST_BLOCKS - count / 2,
+					count, buf));
+	ut_assert_nextline("ERROR: status = 80, block 8192");
+	ut_assert_nextline("ERROR: status = 80, block 8448");
+	ut_assert_nextline("ERROR: status = 80, block 8704");
+	ut_assert_nextline("ERROR: status = 80, block 8960");
+	ut_assert_console_end();
+
+	/* the queue is still usable afterwards */
+	ut_asserteq(count, blk_read(desc->bdev, 0, count, buf));
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_error, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
+/* Test that commands left by a timeout do not complete into the next read */
+static int dm_test_nvme_timeout(struct unit_test_state *uts)
+{
+	const lbaint_t count = NVME_TEST_BLOCKS / 4;
+	const ulong len = count * NVME_TEST_BLOCK_LEN;
+	struct udevice *nvme;
+	struct blk_desc *desc;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(nvme_test_probe(uts, &nvme, &desc));
+	wbuf = malloc(2 * len);
+	rbuf = malloc(2 * len);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < 2 * len; i++)
+		wbuf[i] = i ^ i >> 11;
+	ut_asserteq(2 * count, blk_write(desc->bdev, 0, 2 * count, wbuf));
+
+	/* the controller hangs, so none of the read is done */
+	sandbox_nvme_set_hang(nvme, true);
+	ut_asserteq(0, blk_read(desc->bdev, 0, count, rbuf));
+	ut_assert_nextline("Error: %s: I/O timed out", desc->bdev->name);
+	ut_assert_console_end();
+	sandbox_nvme_set_hang(nvme, false);
+
+	/* the next read is only answered with its own data */
+	memset(rbuf, '\0', 2 * len);
+	ut_asserteq(count, blk_read(desc->bdev, count, count, rbuf + len));
+	ut_asserteq_mem(wbuf + len, rbuf + len, len);
+	for (i = 0; i < len; i++)
+		ut_asserteq(0, rbuf[i]);
+	ut_assert_console_end();
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_timeout, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
+/* Test the statistics shown by 'nvme info' */
+static int dm_test_nvme_cmd_info(struct unit_test_state *uts)
+{
+	const lbaint_t count = NVME_TEST_BLOCKS / 2;
+	struct udevice *nvme;
+	struct blk_desc *desc;
+	u8 *buf;
+
+	ut_assertok(nvme_test_probe(uts, &nvme, &desc));
+	buf = calloc(count, NVME_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	ut_asserteq(count, blk_dread(desc, 0, count, buf));
+	ut_asserteq(count, blk_dread(desc, count, count, buf));
+
+	ut_assertok(run_command("nvme info", 0));
+	ut_assert_nextline("Device 0: Vendor: sandbox Rev: 1.0 Prod: SANDBOX0001");
+	ut_assert_nextlinen("            Type: Hard Disk");
+	ut_assert_nextlinen("            Capacity: 4.0 MB");
+	/* the reads include two of the partition table when probing */
+	ut_assert_nextlinen("            Reads: 34 cmds, 4196864 bytes, ");
+	ut_assert_nextlinen("            Writes: 16 cmds, 2097152 bytes, ");
+	ut_assert_console_end();
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_cmd_info, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
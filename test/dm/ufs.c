@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the UFS driver, using the sandbox emulator
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <malloc.h>
+#include <scsi.h>
+#include <ufs.h>
+#include <asm/test.h>
+#include <asm/unaligned.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../drivers/ufs/ufs.h"
+
+/* Transfer request slots in the emulated controller */
+#define UFS_TEST_SLOTS		8
+#define UFS_TEST_BLOCK_LEN	4096
+#define UFS_TEST_MAX_GEAR	4
+
+/* Bind the emulated controller, which is disabled in the device tree */
+static int ufs_test_probe(struct unit_test_state *uts, struct udevice **ufsp,
+			  struct udevice **scsip, struct udevice **blkp)
+{
+	struct udevice *ufs, *scsi;
+
+	ut_assertok(lists_bind_fdt(dm_root(), ofnode_path("/ufs"), &ufs, NULL,
+				   false));
+	ut_assertok(device_probe(ufs));
+	ut_assertok(device_find_first_child_by_uclass(ufs, UCLASS_SCSI, &scsi));
+	ut_assertok(scsi_scan_dev(scsi, false));
+	ut_assertok(device_find_first_child_by_uclass(scsi, UCLASS_BLK, blkp));
+	*ufsp = ufs;
+	*scsip = scsi;
+
+	return 0;
+}
+
+/* Test that a large read is passed to the controller as one batch */
+static int dm_test_ufs_queue(struct unit_test_state *uts)
+{
+	const lbaint_t count = (2 << 20) / UFS_TEST_BLOCK_LEN;
+	uint doorbells, reqs, max_depth, now;
+	struct udevice *ufs, *scsi, *blk;
+	struct blk_desc *desc;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+	ut_asserteq(UFS_TEST_BLOCK_LEN, desc->blksz);
+	ut_asserteq(UFS_TEST_SLOTS,
+		    ((struct scsi_plat *)dev_get_uclass_plat(scsi))->queue_depth);
+
+	wbuf = malloc(count * UFS_TEST_BLOCK_LEN);
+	rbuf = malloc(count * UFS_TEST_BLOCK_LEN);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < count * UFS_TEST_BLOCK_LEN; i++)
+		wbuf[i] = i ^ i >> 12;
+	ut_asserteq(count, blk_dwrite(desc, 16, count, wbuf));
+
+	sandbox_ufs_get_queue_stats(ufs, &doorbells, &reqs, &max_depth);
+	ut_asserteq(count, blk_dread(desc, 16, count, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, count * UFS_TEST_BLOCK_LEN);
+
+	/* eight commands of 256KiB, all passed with one doorbell write */
+	sandbox_ufs_get_queue_stats(ufs, &now, &reqs, &max_depth);
+	ut_asserteq(doorbells + 1, now);
+	ut_asserteq(UFS_TEST_SLOTS, max_depth);
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_queue, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test queueing more commands than there are slots */
+static int dm_test_ufs_exec_queue(struct unit_test_state *uts)
+{
+	const int count = UFS_TEST_SLOTS + 4;
+	uint doorbells, reqs, max_depth, old_reqs, now;
+	struct udevice *ufs, *scsi, *blk;
+	struct scsi_cmd *cmds, *pccb;
+	struct blk_desc *desc;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	wbuf = malloc(count * UFS_TEST_BLOCK_LEN);
+	rbuf = calloc(count, UFS_TEST_BLOCK_LEN);
+	cmds = calloc(count, sizeof(*cmds));
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	ut_assertnonnull(cmds);
+	for (i = 0; i < count * UFS_TEST_BLOCK_LEN; i++)
+		wbuf[i] = i * 7 + (i >> 12);
+	ut_asserteq(count, blk_dwrite(desc, 100, count, wbuf));
+
+	/* read the blocks in reverse order, one command each */
+	for (i = 0; i < count; i++) {
+		pccb = &cmds[i];
+		pccb->cmd[0] = SCSI_READ10;
+		put_unaligned_be32(100 + count - 1 - i, &pccb->cmd[2]);
+		put_unaligned_be16(1, &pccb->cmd[7]);
+		pccb->cmdlen = 10;
+		pccb->pdata = rbuf + (count - 1 - i) * UFS_TEST_BLOCK_LEN;
+		pccb->datalen = UFS_TEST_BLOCK_LEN;
+		pccb->dma_dir = DMA_FROM_DEVICE;
+	}
+
+	sandbox_ufs_get_queue_stats(ufs, &doorbells, &old_reqs, &max_depth);
+	ut_asserteq(count, scsi_exec_queue(scsi, cmds, count));
+	ut_asserteq_mem(wbuf, rbuf, count * UFS_TEST_BLOCK_LEN);
+
+	/* slots are refilled as they complete, several at a time */
+	sandbox_ufs_get_queue_stats(ufs, &now, &reqs, &max_depth);
+	ut_asserteq(count, reqs - old_reqs);
+	ut_assert(now - doorbells < count);
+	ut_asserteq(UFS_TEST_SLOTS, max_depth);
+
+	/* a command which fails stops the ones after it being sent */
+	put_unaligned_be32(100000, &cmds[2].cmd[2]);
+	ut_asserteq(2, scsi_exec_queue(scsi, cmds, count));
+
+	free(cmds);
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_exec_queue, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test that a single command does not use a slot which is still in use */
+static int dm_test_ufs_exec_busy(struct unit_test_state *uts)
+{
+	struct utp_transfer_req_desc utrd;
+	struct udevice *ufs, *scsi, *blk;
+	struct scsi_cmd cmd = {};
+	struct blk_desc *desc;
+	struct ufs_hba *hba;
+	u8 *wbuf, *rbuf;
+	int i;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+	hba = dev_get_uclass_priv(ufs);
+
+	wbuf = malloc(UFS_TEST_BLOCK_LEN);
+	rbuf = calloc(1, UFS_TEST_BLOCK_LEN);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < UFS_TEST_BLOCK_LEN; i++)
+		wbuf[i] = i * 3;
+	ut_asserteq(1, blk_dwrite(desc, 200, 1, wbuf));
+
+	/* pretend that another thread is waiting for a request in slot 0 */
+	hba->outstanding_reqs = BIT(0);
+	memcpy(&utrd, &hba->utrdl[0], sizeof(utrd));
+
+	cmd.cmd[0] = SCSI_READ10;
+	put_unaligned_be32(200, &cmd.cmd[2]);
+	put_unaligned_be16(1, &cmd.cmd[7]);
+	cmd.cmdlen = 10;
+	cmd.pdata = rbuf;
+	cmd.datalen = UFS_TEST_BLOCK_LEN;
+	cmd.dma_dir = DMA_FROM_DEVICE;
+	ut_assertok(scsi_exec(scsi, &cmd));
+	ut_asserteq_mem(wbuf, rbuf, UFS_TEST_BLOCK_LEN);
+
+	/* the request in slot 0 was left alone */
+	ut_asserteq(BIT(0), hba->outstanding_reqs);
+	ut_asserteq_mem(&utrd, &hba->utrdl[0], sizeof(utrd));
+	hba->outstanding_reqs = 0;
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_exec_busy, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test that unaligned buffers are passed to the controller in place */
+static int dm_test_ufs_sg(struct unit_test_state *uts)
+{
+	const lbaint_t count = (3 << 20) / UFS_TEST_BLOCK_LEN;
+	const ulong len = count * UFS_TEST_BLOCK_LEN;
+	struct udevice *ufs, *scsi, *blk;
+	struct blk_desc *desc;
+	u8 *wbuf, *rbuf, *ubuf;
+	uint max_prdt;
+	ulong max_xfer;
+	int i;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	wbuf = memalign(ARCH_DMA_MINALIGN, len);
+	rbuf = memalign(ARCH_DMA_MINALIGN, len + 2 * ARCH_DMA_MINALIGN);
+	ut_assertnonnull(wbuf);
+	ut_assertnonnull(rbuf);
+	for (i = 0; i < len; i++)
+		wbuf[i] = i * 3 + (i >> 12);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, wbuf));
+
+	/* eight commands of 384KiB, each with two PRDT entries */
+	ut_asserteq(count, blk_dread(desc, 0, count, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, len);
+	sandbox_ufs_get_sg_stats(ufs, &max_prdt, &max_xfer);
+	ut_asserteq(2, max_prdt);
+	ut_asserteq(len / UFS_TEST_SLOTS, max_xfer);
+
+	/* the start and end of each command are bounced, the rest is not */
+	ubuf = rbuf + 4;
+	memset(rbuf, '\xaa', len + 2 * ARCH_DMA_MINALIGN);
+	ut_asserteq(count, blk_dread(desc, 0, count, ubuf));
+	ut_asserteq_mem(wbuf, ubuf, len);
+	ut_asserteq(0xaa, rbuf[0]);
+	ut_asserteq(0xaa, ubuf[len]);
+	sandbox_ufs_get_sg_stats(ufs, &max_prdt, &max_xfer);
+	ut_asserteq(4, max_prdt);
+	ut_asserteq(len / UFS_TEST_SLOTS, max_xfer);
+
+	/* write from an unaligned buffer and read it back */
+	for (i = 0; i < len; i++)
+		ubuf[i] = i * 5 + (i >> 12);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, ubuf));
+	ut_asserteq(count, blk_dread(desc, 0, count, wbuf));
+	ut_asserteq_mem(ubuf, wbuf, len);
+
+	/* a single block which shares cache lines with its neighbours */
+	ut_asserteq(1, blk_dread(desc, 1, 1, ubuf + 4));
+	ut_asserteq_mem(wbuf + UFS_TEST_BLOCK_LEN, ubuf + 4, UFS_TEST_BLOCK_LEN);
+
+	free(rbuf);
+	free(wbuf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_sg, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test that bulk writes use the highest gear and the WriteBooster buffer */
+static int dm_test_ufs_bulk(struct unit_test_state *uts)
+{
+	const lbaint_t count = (1 << 20) / UFS_TEST_BLOCK_LEN;
+	struct udevice *ufs, *scsi, *blk;
+	struct ufs_bulk_stats stats;
+	struct ufs_status status;
+	struct blk_desc *desc;
+	uint gear;
+	u64 wb_bytes;
+	u8 *buf;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+	ut_asserteq_ptr(ufs, ufs_blk_host(desc));
+	buf = calloc(count, UFS_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+
+	/* outside a bulk transfer the gear is limited */
+	ut_assertok(ufs_get_status(ufs, &status));
+	ut_asserteq(CONFIG_UFS_IDLE_HS_GEAR, status.gear);
+	ut_asserteq(UFS_TEST_MAX_GEAR, status.max_gear);
+	ut_assert(status.hs);
+	ut_assert(status.wb_sup);
+	ut_assert(!status.wb_enabled);
+	ut_asserteq(100, status.wb_avail);
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	sandbox_ufs_get_write_stats(ufs, &gear, &wb_bytes);
+	ut_asserteq(CONFIG_UFS_IDLE_HS_GEAR, gear);
+	ut_asserteq(0, wb_bytes);
+
+	ut_assertok(ufs_bulk_begin(ufs));
+	ut_assertok(ufs_bulk_begin(ufs));
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	sandbox_ufs_get_write_stats(ufs, &gear, &wb_bytes);
+	ut_asserteq(UFS_TEST_MAX_GEAR, gear);
+	ut_asserteq(count * UFS_TEST_BLOCK_LEN, wb_bytes);
+	ut_assertok(ufs_get_status(ufs, &status));
+	ut_assert(status.wb_enabled);
+	ut_asserteq(50, status.wb_avail);
+	ut_assert(status.bulk_active);
+
+	/* reads are not counted */
+	ut_asserteq(count, blk_dread(desc, 0, count, buf));
+	console_record_reset();
+	ut_assertok(ufs_bulk_end(ufs, &stats));
+	ut_asserteq(count * UFS_TEST_BLOCK_LEN, stats.bytes);
+	ut_assert(stats.time_us);
+	ut_assert_nextlinen("UFS: wrote %llu bytes in ", stats.bytes);
+	ut_assert_console_end();
+	ut_asserteq(-EINVAL, ufs_bulk_end(ufs, NULL));
+
+	/* the buffer is flushed once the transfer ends */
+	sandbox_ufs_get_write_stats(ufs, &gear, &wb_bytes);
+	ut_asserteq(CONFIG_UFS_IDLE_HS_GEAR, gear);
+	ut_assertok(ufs_get_status(ufs, &status));
+	ut_assert(!status.wb_enabled);
+	ut_asserteq(100, status.wb_avail);
+	ut_asserteq(stats.bytes, status.bulk_last.bytes);
+
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	sandbox_ufs_get_write_stats(ufs, &gear, &wb_bytes);
+	ut_asserteq(count * UFS_TEST_BLOCK_LEN, wb_bytes);
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_bulk, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
+/* Test the ufs command */
+static int dm_test_ufs_cmd(struct unit_test_state *uts)
+{
+	struct udevice *ufs, *scsi, *blk;
+	const lbaint_t count = 64;
+	struct blk_desc *desc;
+	uint gear;
+	u64 wb_bytes;
+	void *buf;
+
+	ut_assertok(ufs_test_probe(uts, &ufs, &scsi, &blk));
+	desc = dev_get_uclass_plat(blk);
+	buf = calloc(count, UFS_TEST_BLOCK_LEN);
+	ut_assertnonnull(buf);
+	console_record_reset();
+
+	ut_assertok(run_command("ufs info 0", 0));
+	ut_assert_nextline("Device:       ufs");
+	ut_assert_nextline("Link:         HS-G1 (max 4), 2 lanes");
+	ut_assert_nextline("WriteBooster: off, 100%% available");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("ufs wb 0 on", 0));
+	ut_asserteq(count, blk_dwrite(desc, 0, count, buf));
+	ut_assertok(run_command("ufs wb 0 off", 0));
+	ut_asserteq(1, blk_dwrite(desc, 0, 1, buf));
+	sandbox_ufs_get_write_stats(ufs, &gear, &wb_bytes);
+	ut_asserteq(count * UFS_TEST_BLOCK_LEN, wb_bytes);
+
+	ut_assertok(run_command("ufs info 0", 0));
+	ut_assert_skip_to_line("WriteBooster: off, 90%% available");
+	ut_assertok(run_command("ufs wb 0 flush", 0));
+	ut_assertok(run_command("ufs info 0", 0));
+	ut_assert_skip_to_line("WriteBooster: off, 100%% available");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("ufs bulk 0 begin", 0));
+	ut_asserteq(1, blk_dwrite(desc, 0, 1, buf));
+	ut_assertok(run_command("ufs info 0", 0));
+	ut_assert_skip_to_line("Link:         HS-G4 (max 4), 2 lanes");
+	ut_assert_skip_to_line("Bulk write:   in progress");
+	ut_assertok(run_command("ufs bulk 0 end", 0));
+	ut_assert_nextlinen("UFS: wrote 4096 bytes in ");
+	ut_assertok(run_command("ufs info 0", 0));
+	ut_assert_skip_to_line("Link:         HS-G1 (max 4), 2 lanes");
+	ut_assert_nextlinen("WriteBooster: off");
+	ut_assert_nextlinen("Bulk write:   4096 bytes in ");
+	ut_assert_console_end();
+
+	ut_asserteq(1, run_command("ufs bulk 0 end", 0));
+	ut_assert_nextline("Failed (err=-22)");
+	ut_assert_console_end();
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_ufs_cmd, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the virtio-net driver, with the test acting as the device
+ */
+
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <virtio_types.h>
+#include <virtio.h>
+#include <virtio_ring.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../drivers/virtio/virtio_net.h"
+
+/* Number of entries in each ring of the sandbox transport */
+#define VIRTIO_NET_TEST_RING	4
+/* Headers left in the driver's buffer when a destination is posted */
+#define VIRTIO_NET_TEST_HDR	42
+
+/* Get the receive queue, which is set up again if the device is reset */
+static struct virtqueue *virtio_net_test_rx_vq(struct udevice *bus)
+{
+	struct virtio_dev_priv *uc_priv = dev_get_uclass_priv(bus);
+
+	return list_first_entry(&uc_priv->vqs, struct virtqueue, list);
+}
+
+/* Check whether a buffer the device may still write to covers @buf */
+static bool virtio_net_test_in_ring(struct udevice *bus, const void *buf,
+				    uint size)
+{
+	struct virtqueue *vq = virtio_net_test_rx_vq(bus);
+	struct udevice *vdev = vq->vdev;
+	struct vring *vr = &vq->vring;
+	u16 idx = virtio16_to_cpu(vdev, vr->used->idx);
+	u16 avail = virtio16_to_cpu(vdev, vr->avail->idx);
+
+	for (; idx != avail; idx++) {
+		uint i = virtio16_to_cpu(vdev, vr->avail->ring[idx % vr->num]);
+		struct vring_desc *desc;
+		ulong addr;
+		uint len;
+
+		do {
+			desc = &vr->desc[i];
+			addr = virtio64_to_cpu(vdev, desc->addr);
+			len = virtio32_to_cpu(vdev, desc->len);
+			if (addr < (ulong)buf + size && (ulong)buf < addr + len)
+				return true;
+			i = virtio16_to_cpu(vdev, desc->next);
+		} while (virtio16_to_cpu(vdev, desc->flags) & VRING_DESC_F_NEXT);
+	}
+
+	return false;
+}
+
+/* Receive a frame into the next buffer in the ring, as the device would */
+static int virtio_net_test_rx(struct unit_test_state *uts, struct udevice *bus,
+			      const u8 *frame, uint len)
+{
+	struct virtqueue *vq = virtio_net_test_rx_vq(bus);
+	struct udevice *vdev = vq->vdev;
+	struct vring *vr = &vq->vring;
+	u16 idx = virtio16_to_cpu(vdev, vr->used->idx);
+	u8 buf[sizeof(struct virtio_net_hdr_v1) + ETH_FRAME_LEN] = {};
+	uint total = sizeof(struct virtio_net_hdr_v1) + len;
+	uint head, i, part, pos = 0;
+	struct vring_desc *desc;
+
+	ut_assert(idx != virtio16_to_cpu(vdev, vr->avail->idx));
+	memcpy(buf + sizeof(struct virtio_net_hdr_v1), frame, len);
+	head = virtio16_to_cpu(vdev, vr->avail->ring[idx % vr->num]);
+	i = head;
+	do {
+		desc = &vr->desc[i];
+		part = min(virtio32_to_cpu(vdev, desc->len), total - pos);
+		memcpy((void *)(uintptr_t)virtio64_to_cpu(vdev, desc->addr),
+		       buf + pos, part);
+		pos += part;
+		i = virtio16_to_cpu(vdev, desc->next);
+	} while (pos < total &&
+		 (virtio16_to_cpu(vdev, desc->flags) & VRING_DESC_F_NEXT));
+	ut_asserteq(total, pos);
+
+	vr->used->ring[idx % vr->num].id = cpu_to_virtio32(vdev, head);
+	vr->used->ring[idx % vr->num].len = cpu_to_virtio32(vdev, total);
+	vr->used->idx = cpu_to_virtio16(vdev, idx + 1);
+
+	return 0;
+}
+
+/* Receive a frame and check that the driver hands it over whole */
+static int virtio_net_test_recv(struct unit_test_state *uts,
+				struct udevice *bus, struct udevice *dev,
+				const u8 *frame, uint len)
+{
+	struct eth_ops *ops = eth_get_ops(dev);
+	uchar *pkt;
+
+	ut_assertok(virtio_net_test_rx(uts, bus, frame, len));
+	ut_asserteq(len, ops->recv(dev, 0, &pkt));
+	ut_asserteq_mem(frame, pkt, len);
+	ut_assertok(ops->free_pkt(dev, pkt, len));
+
+	return 0;
+}
+
+/* Post a destination and use up buffers until the ring holds it */
+static int virtio_net_test_post(struct unit_test_state *uts,
+				struct udevice *bus, struct udevice *dev,
+				struct eth_rx_dest *dest, const u8 *frame,
+				uint len)
+{
+	struct eth_ops *ops = eth_get_ops(dev);
+	int i;
+
+	ut_assertok(ops->post_rx(dev, dest));
+	for (i = 0; i < VIRTIO_NET_TEST_RING; i++)
+		ut_assertok(virtio_net_test_recv(uts, bus, dev, frame, len));
+	ut_assert(virtio_net_test_in_ring(bus, dest->sg[0].addr,
+					  dest->sg[0].len));
+
+	return 0;
+}
+
+/* Test that a withdrawn destination is never written to */
+static int dm_test_virtio_net_rx_withdraw(struct unit_test_state *uts)
+{
+	u8 frame[VIRTIO_NET_TEST_HDR + 64], dst[256], orig[256];
+	struct eth_rx_dest dest = {
+		.hdr_len = VIRTIO_NET_TEST_HDR,
+		.sg = { { dst, sizeof(dst) } },
+		.count = 1,
+	};
+	struct udevice *bus, *dev;
+	struct eth_ops *ops;
+	char name[16];
+	int i;
+
+	ut_assertok(lists_bind_fdt(dm_root(), ofnode_path("/sandbox-virtio-net"),
+				   &bus, NULL, false));
+	ut_assertok(device_probe(bus));
+	ut_assertok(device_find_first_child_by_uclass(bus, UCLASS_ETH, &dev));
+
+	/* the sandbox transport has no config space to hold a MAC address */
+	snprintf(name, sizeof(name), "eth%daddr", dev_seq(dev));
+	env_set(".flags", name);
+	ut_assertok(env_set(name, "02:00:11:22:33:44"));
+	ut_assertok(device_probe(dev));
+	env_set(".flags", name);
+	ut_assertok(env_set(name, NULL));
+	env_set(".flags", NULL);
+	ops = eth_get_ops(dev);
+
+	for (i = 0; i < sizeof(frame); i++)
+		frame[i] = i;
+	memset(dst, 0xaa, sizeof(dst));
+	memcpy(orig, dst, sizeof(dst));
+	ut_assertok(ops->start(dev));
+
+	/* withdrawing the destination takes its buffer back from the ring */
+	ut_assertok(virtio_net_test_post(uts, bus, dev, &dest, frame,
+					 sizeof(frame)));
+	ut_assertok(ops->post_rx(dev, NULL));
+	ut_assert(!virtio_net_test_in_ring(bus, dst, sizeof(dst)));
+	ut_assertok(virtio_net_test_recv(uts, bus, dev, frame, sizeof(frame)));
+	ut_asserteq_mem(orig, dst, sizeof(dst));
+
+	/* as does stopping the device */
+	ut_assertok(virtio_net_test_post(uts, bus, dev, &dest, frame,
+					 sizeof(frame)));
+	ops->stop(dev);
+	ut_assert(!virtio_net_test_in_ring(bus, dst, sizeof(dst)));
+	ut_assertok(ops->start(dev));
+	ut_assertok(virtio_net_test_recv(uts, bus, dev, frame, sizeof(frame)));
+	ut_asserteq_mem(orig, dst, sizeof(dst));
+	ops->stop(dev);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_net_rx_withdraw, UTF_SCAN_PDATA | UTF_SCAN_FDT);
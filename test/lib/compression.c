@@ -12,6 +12,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
+#include <linux/sizes.h>
 
 #include <u-boot/lz4.h>
 #include <u-boot/zlib.h>
@@ -138,6 +139,46 @@ static const char zstd_compressed[] =
 	"\x01\xe4\xf4\x6e\xfa";
 static const unsigned long zstd_compressed_size = sizeof(zstd_compressed) - 1;
 
+/* zstd -19 -c < /tmp/plain.txt > /tmp/plain-nosize.zst (no content size) */
+static const char zstd_compressed_nosize[] =
+	"\x28\xb5\x2f\xfd\x00\x68\xad\x05\x00\x42\x4e\x26\x17\x90\x3b\x07"
+	"\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8\xba"
+	"\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19\x7c"
+	"\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f\x0a"
+	"\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58\xf8"
+	"\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba\xab"
+	"\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7\xd4"
+	"\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad\xb7"
+	"\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12\x16"
+	"\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29\x65"
+	"\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94\x79"
+	"\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c";
+static const unsigned long zstd_compressed_nosize_size =
+	sizeof(zstd_compressed_nosize) - 1;
+
+/*
+ * /tmp/plain.txt repeated to fill 256KB:
+ * zstd -19 -c /tmp/block.txt > /tmp/block.zst
+ */
+static const char zstd_compressed_block[] =
+	"\x28\xb5\x2f\xfd\xa4\x00\x00\x04\x00\xd4\x05\x00\x52\x4e\x26\x17"
+	"\x80\x6d\x0e\x00\x10\x12\x93\xa0\xe5\x3f\xd1\x9e\x20\xf2\xc4\x30"
+	"\xe6\x6f\x74\x95\x0d\xd7\x03\xc0\xa0\x5f\x50\xf5\x0c\x50\x9c\x8f"
+	"\xa0\xb4\x9e\x73\x8d\xff\xa0\xfa\x61\xb7\xd6\x87\x6f\x1a\xb4\x42"
+	"\x52\x41\x80\x20\x21\x24\xb8\x69\x59\x6d\x42\x5e\xc5\x2f\x2f\xe1"
+	"\xe1\x08\xae\xc6\xab\x2f\x15\x5f\xad\x5b\xfa\xcc\x4b\x4b\xa0\xa5"
+	"\xaf\xed\x6a\x85\x38\xcc\x3f\xbc\x41\x4b\x96\xe3\xa0\xb5\xf0\xbe"
+	"\xcf\x29\xf5\xdf\x21\x17\x56\x0a\x60\x78\x4b\x66\x4d\xbf\x39\x6b"
+	"\xaa\xf5\x3a\x87\x85\x33\x9f\xc9\x65\xa9\x21\xf3\x1f\xfa\xef\xca"
+	"\x00\x86\x8d\xbe\x56\x9c\x37\x0f\x7f\x1d\xa8\xfa\xd7\x30\x87\x58"
+	"\x5a\x6a\x49\x65\x34\x43\x17\x01\x09\x00\x9f\xfe\x61\x9b\x1d\x6c"
+	"\x22\x60\x6c\x94\x45\x51\xaf\x66\x84\xa2\xc0\x08\x23\xe1\x3a\x42"
+	"\x65\x41\xf4\x42\x55\x19\x55\x00\x00\x00\x01\x00\xfd\xff\x57\xff"
+	"\xb9\x06\x02\x45\x42\x13\x8f";
+static const unsigned long zstd_compressed_block_size =
+	sizeof(zstd_compressed_block) - 1;
+#define ZSTD_BLOCK_SIZE		SZ_256K
+
 #define TEST_BUFFER_SIZE	512
 
 typedef int (*mutate_func)(struct unit_test_state *uts, void *, unsigned long,
@@ -505,6 +546,150 @@ static int compression_test_zstd(struct unit_test_state *uts)
 }
 LIB_TEST(compression_test_zstd, 0);
 
+/* Skippable frame holding four bytes of user data */
+static const char zstd_skippable[] = "\x50\x2a\x4d\x18\x04\x00\x00\x00skip";
+
+/* Build Zstandard data from a list of frames, with trailing garbage */
+static ulong zstd_build(char *buf, const char *const frames[],
+			const ulong sizes[], int count)
+{
+	ulong len = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		memcpy(buf + len, frames[i], sizes[i]);
+		len += sizes[i];
+	}
+	memset(buf + len, 'A', 4);
+
+	return len + 4;
+}
+
+/* Test decompressing Zstandard data with several frames */
+static int compression_test_zstd_frames(struct unit_test_state *uts)
+{
+	const char *const frames[] = {
+		zstd_compressed, zstd_skippable, zstd_compressed,
+		zstd_compressed,
+	};
+	const ulong sizes[] = {
+		zstd_compressed_size, sizeof(zstd_skippable) - 1,
+		zstd_compressed_size, zstd_compressed_size,
+	};
+	const char *const nosize_frames[] = {
+		zstd_compressed, zstd_compressed_nosize, zstd_compressed,
+	};
+	const ulong nosize_sizes[] = {
+		zstd_compressed_size, zstd_compressed_nosize_size,
+		zstd_compressed_size,
+	};
+	struct zstd_frame_info info[4];
+	ulong plain_len = strlen(plain);
+	struct abuf in, out;
+	ulong load_end;
+	char *buf, *dst;
+	ulong len;
+
+	buf = malloc(TEST_BUFFER_SIZE * 4);
+	ut_assertnonnull(buf);
+	dst = malloc(TEST_BUFFER_SIZE * 4);
+	ut_assertnonnull(dst);
+
+	len = zstd_build(buf, frames, sizes, ARRAY_SIZE(frames));
+	ut_asserteq(4, zstd_frame_index(buf, len, NULL, 0));
+	ut_asserteq(4, zstd_frame_index(buf, len, info, ARRAY_SIZE(info)));
+	ut_asserteq(0, info[0].in_offset);
+	ut_asserteq(zstd_compressed_size, info[0].in_size);
+	ut_asserteq(plain_len, info[0].out_size);
+	ut_asserteq(zstd_compressed_size, info[1].in_offset);
+	ut_asserteq(0, info[1].out_size);
+	ut_asserteq(plain_len, info[2].out_offset);
+	ut_asserteq(plain_len * 2, info[3].out_offset);
+	ut_asserteq(len - 4, info[3].in_offset + info[3].in_size);
+
+	/* all the frames are decompressed, leaving out the skippable one */
+	memset(dst, '\0', TEST_BUFFER_SIZE * 4);
+	abuf_init_set(&in, buf, len);
+	abuf_init_set(&out, dst, TEST_BUFFER_SIZE * 4);
+	ut_asserteq(plain_len * 3, zstd_decompress(&in, &out));
+	ut_asserteq_mem(plain, dst, plain_len);
+	ut_asserteq_mem(plain, dst + plain_len, plain_len);
+	ut_asserteq_mem(plain, dst + plain_len * 2, plain_len);
+
+	/* the output buffer is too small */
+	abuf_init_set(&out, dst, plain_len * 3 - 1);
+	ut_assert(zstd_decompress(&in, &out) < 0);
+
+	/* bootm uses the same path */
+	memset(dst, '\0', TEST_BUFFER_SIZE * 4);
+	ut_assertok(image_decomp(IH_COMP_ZSTD, map_to_sysmem(dst),
+				 map_to_sysmem(buf), IH_TYPE_KERNEL, dst, buf,
+				 len, TEST_BUFFER_SIZE * 4, &load_end));
+	ut_asserteq(plain_len * 3, load_end - map_to_sysmem(dst));
+	ut_asserteq_mem(plain, dst + plain_len * 2, plain_len);
+
+	/* a bad frame stops the decompression */
+	buf[zstd_compressed_size * 2 + sizeof(zstd_skippable) - 2] ^= 1;
+	abuf_init_set(&out, dst, TEST_BUFFER_SIZE * 4);
+	ut_assert(zstd_decompress(&in, &out) < 0);
+
+	/* a frame without a size means decompressing in one go */
+	len = zstd_build(buf, nosize_frames, nosize_sizes,
+			 ARRAY_SIZE(nosize_frames));
+	ut_asserteq(3, zstd_frame_index(buf, len, info, ARRAY_SIZE(info)));
+	ut_asserteq_64(ZSTD_CONTENTSIZE_UNKNOWN, info[1].out_size);
+	ut_asserteq_64(ZSTD_CONTENTSIZE_UNKNOWN, info[2].out_offset);
+	memset(dst, '\0', TEST_BUFFER_SIZE * 4);
+	abuf_init_set(&in, buf, len);
+	ut_asserteq(plain_len * 3, zstd_decompress(&in, &out));
+	ut_asserteq_mem(plain, dst + plain_len, plain_len);
+	ut_asserteq_mem(plain, dst + plain_len * 2, plain_len);
+
+	/* the data must start with a frame */
+	ut_asserteq(-EINVAL, zstd_frame_index(buf + 1, len - 1, NULL, 0));
+
+	free(dst);
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(compression_test_zstd_frames, 0);
+
+/* Test decompressing many large frames, as written by 'zstd -B' */
+static int compression_test_zstd_blocks(struct unit_test_state *uts)
+{
+	const int count = 32;
+	ulong out_size = ZSTD_BLOCK_SIZE * count;
+	ulong plain_len = strlen(plain);
+	struct abuf in, out;
+	char *buf, *dst;
+	int i;
+
+	buf = malloc(zstd_compressed_block_size * count);
+	ut_assertnonnull(buf);
+	dst = malloc(out_size);
+	ut_assertnonnull(dst);
+	for (i = 0; i < count; i++)
+		memcpy(buf + zstd_compressed_block_size * i,
+		       zstd_compressed_block, zstd_compressed_block_size);
+	abuf_init_set(&in, buf, zstd_compressed_block_size * count);
+	abuf_init_set(&out, dst, out_size);
+
+	memset(dst, '\0', out_size);
+	ut_asserteq(out_size, zstd_decompress(&in, &out));
+
+	/* the last frame ends with part of the text */
+	ut_asserteq_mem(plain, dst, plain_len);
+	ut_asserteq_mem(plain, dst + out_size - ZSTD_BLOCK_SIZE, plain_len);
+	ut_asserteq_mem(dst, dst + out_size - ZSTD_BLOCK_SIZE, ZSTD_BLOCK_SIZE);
+
+	free(dst);
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(compression_test_zstd_blocks, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
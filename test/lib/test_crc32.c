@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for crc32 and crc32c
+ *
+ * Each implementation is checked against the byte-wise table version, over
+ * a range of lengths and alignments
+ */
+
+#include <malloc.h>
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+
+#define CRC32_TEST_SIZE	4096
+
+static const char crc32_check_str[] = "123456789";
+
+static uint8_t *crc32_test_buf(void)
+{
+	uint8_t *buf;
+	uint32_t seed = 0x12345678;
+	int i;
+
+	buf = malloc(CRC32_TEST_SIZE);
+	if (!buf)
+		return NULL;
+	for (i = 0; i < CRC32_TEST_SIZE; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	return buf;
+}
+
+static int lib_crc32(struct unit_test_state *uts)
+{
+	const uint8_t *check = (const uint8_t *)crc32_check_str;
+	uint8_t *buf;
+	int impl, ofs, len;
+
+	/* check value from the CRC catalogue */
+	ut_asserteq(0xcbf43926, crc32(0, check, 9));
+	ut_asserteq(0xcbf43926, crc32(crc32(0, check, 4), check + 4, 5));
+
+	buf = crc32_test_buf();
+	ut_assertnonnull(buf);
+
+	for (impl = 0; impl < CRC32_IMPL_COUNT; impl++) {
+		uint32_t crc = ~0;
+
+		if (crc32_no_comp_impl(impl, &crc, check, 9))
+			continue;
+		ut_asserteq(0xcbf43926, ~crc);
+
+		for (ofs = 0; ofs < 8; ofs++) {
+			for (len = 0; len < 300; len++) {
+				uint32_t expect = 0x5a5a5a5a;
+
+				crc = expect;
+				ut_assertok(crc32_no_comp_impl(CRC32_IMPL_TABLE,
+							       &expect,
+							       buf + ofs, len));
+				ut_assertok(crc32_no_comp_impl(impl, &crc,
+							       buf + ofs, len));
+				ut_asserteq(expect, crc);
+			}
+		}
+
+		crc = 0;
+		ut_assertok(crc32_no_comp_impl(impl, &crc, buf + 3,
+					       CRC32_TEST_SIZE - 3));
+		ut_asserteq(crc32_no_comp(0, buf + 3, CRC32_TEST_SIZE - 3),
+			    crc);
+	}
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_crc32, 0);
+
+static int lib_crc32c(struct unit_test_state *uts)
+{
+	uint32_t table[256];
+	uint8_t *buf;
+	int ofs, len;
+
+	if (!IS_ENABLED(CONFIG_CRC32C))
+		return -EAGAIN;
+
+	crc32c_init(table, 0x82f63b78);
+	ut_asserteq(0xe3069283,
+		    ~crc32c_cal(~0, crc32_check_str, 9, table));
+
+	buf = crc32_test_buf();
+	ut_assertnonnull(buf);
+	for (ofs = 0; ofs < 8; ofs++) {
+		for (len = 0; len < 300; len++) {
+			const char *ptr = (const char *)buf + ofs;
+
+			ut_asserteq(crc32c_table_cal(~0, ptr, len, table),
+				    crc32c_cal(~0, ptr, len, table));
+		}
+	}
+	ut_asserteq(crc32c_table_cal(1, (char *)buf, CRC32_TEST_SIZE, table),
+		    crc32c_cal(1, (char *)buf, CRC32_TEST_SIZE, table));
+	free(buf);
+
+	/* another polynomial must not use the CRC32C instructions */
+	crc32c_init(table, 0xedb88320);
+	ut_asserteq(0xcbf43926, ~crc32c_cal(~0, crc32_check_str, 9, table));
+
+	return 0;
+}
+LIB_TEST(lib_crc32c, 0);
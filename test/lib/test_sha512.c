@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for sha384 and sha512
+ *
+ * The data is fed in pieces which straddle block boundaries, so that both
+ * the partial-block buffering and the multi-block path to sha512_process()
+ * are covered. Vectors are from FIPS 180-2.
+ */
+
+#include <malloc.h>
+#include <hexdump.h>
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/sha512.h>
+
+#define SHA512_TEST_MILLION	1000000
+
+struct sha512_test {
+	const char *input;
+	int repeat;
+	const char *sha384;
+	const char *sha512;
+};
+
+static const struct sha512_test sha512_tests[] = {
+	{
+		"abc", 1,
+		"cb00753f45a35e8bb5a03d699ac65007272c32ab0eded163"
+		"1a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7",
+		"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea2"
+		"0a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd"
+		"454d4423643ce80e2a9ac94fa54ca49f",
+	}, {
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+		"09330c33f71147e83d192fc782cd1b4753111b173b3b05d2"
+		"2fa08086e3b0f712fcc7c71a557e2db966c3e9fa91746039",
+		"8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa1"
+		"7299aeadb6889018501d289e4900f7e4331b99dec4b5433a"
+		"c7d329eeb6dd26545e96e55b874be909",
+	}, {
+		"a", SHA512_TEST_MILLION,
+		"9d0e1809716474cb086e834e310a4a1ced149e9c00f24852"
+		"7972cec5704c2a5b07b8b3dc38ecc4ebae97ddd87f3d8985",
+		"e718483d0ce769644e2e42c7bc15b4638e1f98b13b204428"
+		"5632a803afa973ebde0ff244877ea60a4cb0432ce577c31b"
+		"eb009c5c2c49aa2e4eadb217ad8cc09b",
+	},
+};
+
+/* Hash @buf in pieces of increasing size, to hit every alignment */
+static void sha512_test_update(sha512_context *ctx, const uint8_t *buf,
+			       int len, bool sha384)
+{
+	int piece = 1;
+
+	while (len) {
+		int now = min(piece, len);
+
+		if (sha384)
+			sha384_update(ctx, buf, now);
+		else
+			sha512_update(ctx, buf, now);
+		buf += now;
+		len -= now;
+		piece = piece * 3 + 1;
+	}
+}
+
+static int lib_sha512(struct unit_test_state *uts)
+{
+	uint8_t expect[SHA512_SUM_LEN], digest[SHA512_SUM_LEN];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sha512_tests); i++) {
+		const struct sha512_test *test = &sha512_tests[i];
+		int len = strlen(test->input) * test->repeat;
+		sha512_context ctx;
+		uint8_t *buf;
+
+		buf = malloc(len);
+		ut_assertnonnull(buf);
+		if (test->repeat > 1)
+			memset(buf, *test->input, len);
+		else
+			memcpy(buf, test->input, len);
+
+		if (CONFIG_IS_ENABLED(SHA384)) {
+			sha384_starts(&ctx);
+			sha512_test_update(&ctx, buf, len, true);
+			sha384_finish(&ctx, digest);
+			ut_assertok(hex2bin(expect, test->sha384,
+					    SHA384_SUM_LEN));
+			ut_asserteq_mem(expect, digest, SHA384_SUM_LEN);
+		}
+
+		sha512_starts(&ctx);
+		sha512_test_update(&ctx, buf, len, false);
+		sha512_finish(&ctx, digest);
+		ut_assertok(hex2bin(expect, test->sha512, SHA512_SUM_LEN));
+		ut_asserteq_mem(expect, digest, SHA512_SUM_LEN);
+
+		/* all in one go */
+		sha512_csum_wd(buf, len, digest, CHUNKSZ_SHA512);
+		ut_asserteq_mem(expect, digest, SHA512_SUM_LEN);
+		free(buf);
+	}
+
+	return 0;
+}
+LIB_TEST(lib_sha512, 0);
@@ -382,6 +382,21 @@ def test_fit(ubman):
             check_equal(loadables2, loadables2_out,
                         'Loadables2 (ramdisk) not loaded')
 
+        # A loadable over the kernel is caught before the kernel is loaded
+        with ubman.log.section('Loadable overlapping the kernel'):
+            params['loadables2_load'] = ('load = <%#x>;' %
+                                         (params['kernel_addr'] + 0x100))
+            fit = fit_util.make_fit(ubman, mkimage, base_its, params)
+            ubman.restart_uboot()
+            boot_cmd = cmd.replace('bootm start %x\nbootm loados' %
+                                   params['fit_addr'],
+                                   'bootm %x' % params['fit_addr'])
+            output = ubman.run_command_list(boot_cmd.splitlines())
+            assert 'ERROR: ramdisk-2 overlaps OS image' in ''.join(output)
+            check_not_equal(kernel, kernel_out, 'Kernel loaded but should not be')
+            params['loadables2_load'] = ('load = <%#x>;' %
+                                         params['loadables2_addr'])
+
         # Kernel, FDT and Ramdisk all compressed
         with ubman.log.section('(Kernel + FDT + Ramdisk) compressed'):
             params['compression'] = 'gzip'
@@ -0,0 +1,143 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+"""
+Test streaming a signed FIT with external data
+
+This creates a FIT whose data is held outside the FIT structure and signs its
+configuration with a required key. The FIT is read with 'fitload', which
+checks the configuration signature while placing the images, then booted with
+'bootm', which checks the image hashes. Changing the image data or the signed
+part of the structure must stop the FIT from being booted.
+"""
+
+import os
+import pytest
+import utils
+
+ITS = '''
+/dts-v1/;
+
+/ {
+	description = "Streamed FIT";
+	#address-cells = <1>;
+
+	images {
+		kernel {
+			data = /incbin/("test-kernel.bin");
+			type = "kernel";
+			arch = "sandbox";
+			os = "linux";
+			compression = "none";
+			load = <0x3000000>;
+			entry = <0x3000000>;
+			hash-1 {
+				algo = "sha256";
+			};
+			hash-2 {
+				algo = "crc32";
+			};
+		};
+		fdt-1 {
+			data = /incbin/("sandbox-kernel.dtb");
+			type = "flat_dt";
+			arch = "sandbox";
+			compression = "none";
+			hash-1 {
+				algo = "sha256";
+			};
+		};
+	};
+	configurations {
+		default = "conf-1";
+		conf-1 {
+			kernel = "kernel";
+			fdt = "fdt-1";
+			signature {
+				algo = "sha256,rsa2048";
+				key-name-hint = "dev";
+				sign-images = "fdt", "kernel";
+			};
+		};
+	};
+};
+'''
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fit_signature')
+@pytest.mark.buildconfigspec('cmd_fitload')
+@pytest.mark.requiredtool('dtc')
+@pytest.mark.requiredtool('openssl')
+def test_fit_stream(ubman):
+    """Test streaming a FIT with a signed configuration"""
+
+    def run_fitload(fit, expect, boots):
+        """Stream a FIT and try to boot it
+
+        Args:
+            fit: FIT filename to stream
+            expect: String which is expected in the output
+            boots: True if the FIT is expected to boot
+        """
+        ubman.restart_uboot()
+        output = ''.join(ubman.run_command_list(
+            [f'fitload hostfs - 100 {fit}', 'bootm 100']))
+        assert expect in output
+        assert boots == ('sandbox: continuing, as we cannot run' in output)
+
+    def update_file(src, dst, offset=None, old=None, new=None):
+        """Copy a file, changing a byte or a string on the way"""
+        with open(src, 'rb') as inf:
+            data = bytearray(inf.read())
+        if offset is not None:
+            data[offset] ^= 1
+        else:
+            data = data.replace(old, new)
+        with open(dst, 'wb') as outf:
+            outf.write(data)
+
+    tmpdir = os.path.join(ubman.config.result_dir, 'fit_stream') + '/'
+    os.makedirs(tmpdir, exist_ok=True)
+    datadir = ubman.config.source_dir + '/test/py/tests/vboot/'
+    mkimage = ubman.config.build_dir + '/tools/mkimage'
+    dtc_args = f'-I dts -O dtb -i {tmpdir}'
+    dtb = f'{tmpdir}sandbox-u-boot.dtb'
+    fit = f'{tmpdir}test.fit'
+    its = f'{tmpdir}test.its'
+
+    for dts in ('sandbox-kernel', 'sandbox-u-boot'):
+        utils.run_and_log(ubman, f'dtc {dtc_args} {datadir}{dts}.dts -O dtb '
+                          f'-o {tmpdir}{dts}.dtb')
+    utils.run_and_log(ubman, f'openssl genpkey -algorithm RSA '
+                      f'-out {tmpdir}dev.key -pkeyopt rsa_keygen_bits:2048')
+    utils.run_and_log(ubman, f'openssl req -batch -new -x509 '
+                      f'-key {tmpdir}dev.key -out {tmpdir}dev.crt')
+
+    # Large enough to be read in several chunks
+    kernel_size = 3 << 20
+    with open(f'{tmpdir}test-kernel.bin', 'wb') as outf:
+        outf.write(bytes((i * 7) & 0xff for i in range(kernel_size)))
+    with open(its, 'w', encoding='ascii') as outf:
+        outf.write(ITS)
+
+    utils.run_and_log(ubman, [mkimage, '-D', dtc_args, '-E', '-f', its, fit])
+    utils.run_and_log(ubman, [mkimage, '-F', '-k', tmpdir, '-K', dtb, '-r',
+                             '-E', fit])
+
+    old_dtb = ubman.config.dtb
+    try:
+        ubman.config.dtb = dtb
+        run_fitload(fit, 'dev+', True)
+
+        # Corrupt the last byte of the kernel
+        with open(fit, 'rb') as inf:
+            kernel_end = inf.read().index(b'\xd0\x0d\xfe\xed', 4) - 1
+        bad_fit = f'{tmpdir}test-bad.fit'
+        update_file(fit, bad_fit, offset=kernel_end)
+        run_fitload(bad_fit, "Bad hash value for 'hash-1' hash node", False)
+
+        # Change the description, which is covered by the signature
+        update_file(fit, bad_fit, old=b'Streamed FIT', new=b'Streamed fit')
+        run_fitload(bad_fit, 'Bad Data Hash', False)
+    finally:
+        ubman.config.dtb = old_dtb
+        ubman.restart_uboot()
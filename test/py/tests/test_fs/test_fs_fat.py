@@ -8,6 +8,8 @@
 This test verifies fat specific file system behaviour.
 """
 
+import hashlib
+import os
 import pytest
 import re
 
@@ -23,3 +25,70 @@ class TestFsFat(object):
                 'host bind 0 %s' % fs_img,
                 'fatinfo host 0:0'])
             assert(re.search('Filesystem: %s' % fs_type.upper(), ''.join(output)))
+
+    def test_fs_fat2(self, ubman, fs_obj_fat):
+        """Test reading a fragmented file, also after a raw rewrite."""
+        fs_type,fs_img = fs_obj_fat
+        addr = 0x1000000
+        path = os.path.join(ubman.config.persistent_data_dir, 'frag.bin')
+
+        def put(dev, name, data):
+            with open(path, 'wb') as fd:
+                fd.write(data)
+            output = ubman.run_command_list([
+                'host load hostfs - %x %s' % (addr, path),
+                'fatwrite host %d:0 %x %s %x' % (dev, addr, name, len(data))])
+            os.remove(path)
+            assert('%d bytes written' % len(data) in ''.join(output))
+
+        def check(name, data, offset=0, size=0):
+            size = size or len(data) - offset
+            md5val = hashlib.md5(data[offset:offset + size]).hexdigest()
+            output = ubman.run_command_list([
+                'fatload host 0:0 %x %s %x %x' % (addr, name, size, offset),
+                'md5sum %x %x' % (addr, size)])
+            assert(md5val in ''.join(output))
+
+        with ubman.log.section('Test Case 2a - fragmented file'):
+            ubman.run_command('host bind 0 %s' % fs_img)
+            # Free a hole between two files so that 'frag' is split
+            put(0, 'a', os.urandom(0x10000))
+            put(0, 'b', os.urandom(0x10000))
+            put(0, 'c', os.urandom(0x10000))
+            ubman.run_command('fatrm host 0:0 b')
+            old = os.urandom(0x30000)
+            put(0, 'frag', old)
+
+            # Give 'frag' the same start cluster and size but a different
+            # chain in a copy, to be written raw over the device later
+            new_img = fs_img + '.new'
+            with open(fs_img, 'rb') as fd:
+                image = fd.read()
+            with open(new_img, 'wb') as fd:
+                fd.write(image)
+            ubman.run_command('host bind 1 %s' % new_img)
+            ubman.run_command('fatrm host 1:0 frag')
+            ubman.run_command('fatrm host 1:0 c')
+            new = os.urandom(0x30000)
+            put(1, 'frag', new)
+            ubman.run_command('host unbind 1')
+
+            check('frag', old)
+            check('frag', old, 0x8000, 0x10000)
+            check('frag', old, 0x28000)
+
+        with ubman.log.section('Test Case 2b - raw rewrite'):
+            output = ubman.run_command_list([
+                'host load hostfs - %x %s' % (addr, new_img),
+                'write host 0 %x 0 %x && echo PASS' %
+                (addr, len(image) // 512)])
+            os.remove(new_img)
+            assert('PASS' in ''.join(output))
+            check('frag', new, 0x28000)
+            check('frag', new)
+
+        with ubman.log.section('Test Case 2c - remount'):
+            ubman.run_command('host unbind 0')
+            ubman.run_command('host bind 0 %s' % fs_img)
+            check('frag', new, 0x8000, 0x10000)
+            check('frag', new)
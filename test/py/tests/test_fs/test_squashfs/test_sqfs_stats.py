@@ -0,0 +1,116 @@
+# SPDX-License-Identifier: GPL-2.0
+
+import os
+import re
+import pytest
+
+from sqfs_common import SQFS_SRC_DIR
+from sqfs_common import generate_sqfs_src_dir, mksquashfs
+from sqfs_common import clean_sqfs_src_dir
+from sqfs_common import check_mksquashfs_version
+
+SQFS_STATS_IMAGE = 'stats_frag'
+
+def sqfs_get_stats(ubman):
+    """ Runs sqfsstats and parses its output.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    Returns:
+        A dictionary with the counters printed by sqfsstats.
+    """
+    out = ubman.run_command('sqfsstats')
+    match = re.search(r'metadata: (\d+) hits, (\d+) misses, (\d+) blocks '
+                      r'decompressed\s+fragments: (\d+) hits, (\d+) misses\s+'
+                      r'cached: (\d+) bytes', out)
+    assert match
+    keys = ['meta_hits', 'meta_misses', 'metablks', 'frag_hits',
+            'frag_misses', 'cached_bytes']
+
+    return dict(zip(keys, [int(val) for val in match.groups()]))
+
+def sqfs_load(ubman, file, size):
+    """ Loads a file and checks the amount of bytes read.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+        file: file to be loaded.
+        size: the size of the file.
+    """
+    out = ubman.run_command('sqfsload host 0 $kernel_addr_r {}'.format(file))
+    assert '{} bytes read'.format(size) in out
+
+def sqfs_run_all_stats_tests(ubman):
+    """ Checks the cache counters across loads from the same image.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    # the first load after a flush reads and decompresses the metadata
+    ubman.run_command('sqfsstats flush')
+    start = sqfs_get_stats(ubman)
+    assert start['cached_bytes'] == 0
+    sqfs_load(ubman, 'f1000', 1000)
+    miss = sqfs_get_stats(ubman)
+    assert miss['meta_misses'] > start['meta_misses']
+    assert miss['metablks'] > start['metablks']
+    assert miss['frag_misses'] == start['frag_misses'] + 1
+    assert miss['cached_bytes'] > 0
+
+    # loading it again is served from the cache
+    sqfs_load(ubman, 'f1000', 1000)
+    hit = sqfs_get_stats(ubman)
+    assert hit['meta_hits'] > miss['meta_hits']
+    assert hit['meta_misses'] == miss['meta_misses']
+    assert hit['metablks'] == miss['metablks']
+    assert hit['frag_hits'] == miss['frag_hits'] + 1
+    assert hit['frag_misses'] == miss['frag_misses']
+
+    # f5096's tail lives in the same fragment block
+    sqfs_load(ubman, 'f5096', 5096)
+    frag = sqfs_get_stats(ubman)
+    assert frag['meta_misses'] == hit['meta_misses']
+    assert frag['frag_hits'] == hit['frag_hits'] + 1
+    assert frag['frag_misses'] == hit['frag_misses']
+
+    # flushing drops the cached data but keeps the counters
+    ubman.run_command('sqfsstats flush')
+    flush = sqfs_get_stats(ubman)
+    assert flush['cached_bytes'] == 0
+    assert flush['meta_hits'] == frag['meta_hits']
+    sqfs_load(ubman, 'f1000', 1000)
+    again = sqfs_get_stats(ubman)
+    assert again['meta_misses'] > flush['meta_misses']
+    assert again['frag_misses'] == flush['frag_misses'] + 1
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('fs_squashfs')
+@pytest.mark.requiredtool('mksquashfs')
+def test_sqfs_stats(ubman):
+    """ Executes the sqfsstats test suite.
+
+    First, it generates a SquashFS image with fragments, then it runs the test
+    cases and finally cleans the workspace. If an exception is raised, the
+    workspace is cleaned before exiting.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    build_dir = ubman.config.build_dir
+    image_path = os.path.join(build_dir, SQFS_STATS_IMAGE)
+
+    # setup test environment
+    check_mksquashfs_version()
+    generate_sqfs_src_dir(build_dir)
+    mksquashfs(' '.join([os.path.join(build_dir, SQFS_SRC_DIR), image_path,
+                         '-comp gzip -always-use-fragments']))
+
+    try:
+        ubman.run_command('host bind 0 {}'.format(image_path))
+        sqfs_run_all_stats_tests(ubman)
+    finally:
+        # clean test environment
+        os.remove(image_path)
+        clean_sqfs_src_dir(build_dir)
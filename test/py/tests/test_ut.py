@@ -513,6 +513,7 @@ def test_ut_dm_init(ubman):
             ubman, f'sfdisk {fn}', stdin=b'type=83')
 
     fs_helper.mk_fs(ubman.config, 'ext2', 0x200000, '2MB', None)
+    fs_helper.mk_fs(ubman.config, 'ext4', 0x200000, '2MB', None)
     fs_helper.mk_fs(ubman.config, 'fat32', 0x100000, '1MB', None)
 
     mmc_dev = 6